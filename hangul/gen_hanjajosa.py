@@ -0,0 +1,71 @@
+#!/usr/bin/env python
+# coding=utf-8
+
+# 조사 목록 파일로 hanjajosa.h의 trie를 만든다.
+# 사용법: gen_hanjajosa.py hanjajosa.txt > hanjajosa.h
+
+import io
+import sys
+
+def load_words(filename):
+	words = []
+	src = io.open(filename, 'r', encoding='utf-8')
+	for line in src:
+		line = line.strip()
+		if len(line) == 0 or line[0] == '#':
+			continue
+		words.append(line)
+	src.close()
+	return words
+
+# 조사는 키의 끝에서부터 찾으므로 뒤집어서 trie에 넣는다.
+def build_trie(words):
+	root = {}
+	for word in words:
+		node = root
+		for c in reversed(word):
+			node = node.setdefault(c, {})
+		node[''] = word
+	return root
+
+def main():
+	trie = build_trie(load_words(sys.argv[1]))
+
+	# 자식 노드들이 연속해서 있도록 너비 우선으로 번호를 붙인다.
+	nodes = [(u'\0', trie)]
+	i = 0
+	while i < len(nodes):
+		children = nodes[i][1]
+		for c in sorted(k for k in children if k != ''):
+			nodes.append((c, children[c]))
+		i += 1
+
+	out = []
+	out.append(u'/* 조사와 어미를 뒤에서부터 찾기 위한 trie')
+	out.append(u' * 이 파일은 gen_hanjajosa.py로 hanjajosa.txt에서 만든다.')
+	out.append(u' * 각 노드의 자식 노드들은 글자 순서로 연속해서 있다.')
+	out.append(u' * { 글자, 첫번째 자식 노드, 자식 노드 갯수, 조사나 어미의 끝인지 여부 } */')
+	out.append(u'static const HanjaJosaNode hanja_josa_trie[] = {')
+
+	next_child = 1
+	for i, (c, children) in enumerate(nodes):
+		nchild = len([k for k in children if k != ''])
+		child = next_child if nchild > 0 else 0
+		next_child += nchild
+		final = 1 if '' in children else 0
+		if final:
+			comment = u'%d: %s' % (i, children[''])
+		else:
+			comment = u'%d' % i
+		out.append(u'    { 0x%04X, %3d, %2d, %d },  /* %s */' %
+			   (ord(c), child, nchild, final, comment))
+
+	out.append(u'};')
+
+	text = u'\n'.join(out) + u'\n'
+	if sys.version_info[0] >= 3:
+		sys.stdout.buffer.write(text.encode('utf-8'))
+	else:
+		sys.stdout.write(text.encode('utf-8'))
+
+main()
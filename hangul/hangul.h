@@ -19,6 +19,7 @@
 #ifndef libhangul_hangul_h
 #define libhangul_hangul_h
 
+#include <stddef.h>
 #include <stdbool.h>
 #include <inttypes.h>
 
@@ -75,6 +76,7 @@ typedef struct _HangulKeyboard        HangulKeyboard;
 typedef struct _HangulCombination     HangulCombination;
 typedef struct _HangulBuffer          HangulBuffer;
 typedef struct _HangulInputContext    HangulInputContext;
+typedef struct _HangulInputContextPool HangulInputContextPool;
 
 enum {
     HANGUL_OUTPUT_SYLLABLE,
@@ -93,6 +95,7 @@ enum {
     HANGUL_IC_OPTION_AUTO_REORDER,
     HANGUL_IC_OPTION_COMBI_ON_DOUBLE_STROKE,
     HANGUL_IC_OPTION_NON_CHOSEONG_COMBI,
+    HANGUL_IC_OPTION_AUTOMATON,
 };
 
 /* library */
@@ -124,6 +127,9 @@ bool hangul_combination_set_data(HangulCombination* combination,
 HangulInputContext* hangul_ic_new(const char* keyboard);
 void hangul_ic_delete(HangulInputContext *hic);
 bool hangul_ic_process(HangulInputContext *hic, int ascii);
+size_t hangul_ic_process_string(HangulInputContext *hic,
+				const char* keys, size_t nkeys,
+				ucschar* out, size_t outcap, size_t* consumed);
 void hangul_ic_reset(HangulInputContext *hic);
 bool hangul_ic_backspace(HangulInputContext *hic);
 
@@ -144,6 +150,11 @@ void hangul_ic_select_keyboard(HangulInputContext *hic,
 void hangul_ic_connect_callback(HangulInputContext* hic, const char* event,
 				void* callback, void* user_data);
 
+HangulInputContextPool* hangul_ic_pool_new(unsigned int slab_size);
+void hangul_ic_pool_delete(HangulInputContextPool* pool);
+HangulInputContext* hangul_ic_pool_new_ic(HangulInputContextPool* pool,
+					  const char* keyboard);
+
 const ucschar* hangul_ic_get_preedit_string(HangulInputContext *hic);
 const ucschar* hangul_ic_get_commit_string(HangulInputContext *hic);
 const ucschar* hangul_ic_flush(HangulInputContext *hic);
@@ -152,24 +163,103 @@ const ucschar* hangul_ic_flush(HangulInputContext *hic);
 typedef struct _Hanja Hanja;
 typedef struct _HanjaList HanjaList;
 typedef struct _HanjaTable HanjaTable;
+typedef struct _HanjaModel HanjaModel;
+
+enum {
+    HANJA_TABLE_STAT_KEYS,
+    HANJA_TABLE_STAT_ENTRIES,
+    HANJA_TABLE_STAT_INDEX_BYTES,
+    HANJA_TABLE_STAT_DATA_BYTES,
+    HANJA_TABLE_STAT_HEAP_BYTES,
+    HANJA_TABLE_STAT_MAPPED_BYTES,
+    HANJA_TABLE_STAT_LOAD_TIME_NS,
+    HANJA_TABLE_STAT_LOOKUPS,
+    HANJA_TABLE_STAT_MISSES,
+    HANJA_TABLE_STAT_BYTES_READ,
+    HANJA_TABLE_STAT_PREFETCH_HITS,
+    HANJA_TABLE_STAT_MODE,
+    HANJA_TABLE_STAT_PAGE_SIZE
+};
+
+enum {
+    HANJA_TABLE_MODE_FULL,
+    HANJA_TABLE_MODE_PAGED
+};
+
+enum {
+    HANJA_MATCH_EXACT,
+    HANJA_MATCH_PREFIX,
+    HANJA_MATCH_SUFFIX
+};
 
 HanjaTable*  hanja_table_load(const char *filename);
+HanjaTable*  hanja_table_load_with_budget(const char *filename, size_t budget);
+bool         hanja_table_sort_file(const char* input, const char* output,
+				   size_t memory_limit);
 HanjaList*   hanja_table_match_exact(const HanjaTable* table, const char *key);
 HanjaList*   hanja_table_match_prefix(const HanjaTable* table, const char *key);
 HanjaList*   hanja_table_match_suffix(const HanjaTable* table, const char *key);
+HanjaList*   hanja_table_match_exact_ucs4(const HanjaTable* table,
+					  const ucschar* key);
+HanjaList*   hanja_table_match_prefix_ucs4(const HanjaTable* table,
+					   const ucschar* key);
+HanjaList*   hanja_table_match_suffix_ucs4(const HanjaTable* table,
+					   const ucschar* key);
+HanjaList*   hanja_table_match_syllable(const HanjaTable* table,
+					ucschar syllable);
+HanjaList*   hanja_table_match_josa(const HanjaTable* table, const char *key);
+HanjaList*   hanja_table_match_fuzzy(const HanjaTable* table, const char *key,
+				     int distance);
+HanjaList*   hanja_table_search_comment(const HanjaTable* table,
+					const char *query);
+HanjaList*   hanja_table_search_value(const HanjaTable* table,
+				      const char *hanja);
+HanjaList*   hanja_table_match_josa_ucs4(const HanjaTable* table,
+					 const ucschar* key);
+bool         hanja_table_apply_patch(HanjaTable* table, const char* filename);
+bool         hanja_table_compact(HanjaTable* table);
+uint64_t     hanja_table_get_stat(const HanjaTable* table, int stat);
+bool         hanja_table_start_prefetch(HanjaTable* table);
+void         hanja_table_stop_prefetch(HanjaTable* table);
+void         hanja_table_prefetch_hint(HanjaTable* table, const char* key,
+				       int match);
 void         hanja_table_delete(HanjaTable *table);
 
 int          hanja_list_get_size(const HanjaList *list);
 const char*  hanja_list_get_key(const HanjaList *list);
+const char*  hanja_list_get_josa(const HanjaList *list);
 const Hanja* hanja_list_get_nth(const HanjaList *list, unsigned int n);
+unsigned int hanja_list_get_page(const HanjaList *list, unsigned int offset,
+				 const Hanja** items, unsigned int n);
 const char*  hanja_list_get_nth_key(const HanjaList *list, unsigned int n);
 const char*  hanja_list_get_nth_value(const HanjaList *list, unsigned int n);
 const char*  hanja_list_get_nth_comment(const HanjaList *list, unsigned int n);
+const ucschar* hanja_list_get_nth_key_ucs4(const HanjaList *list,
+					   unsigned int n);
+const ucschar* hanja_list_get_nth_value_ucs4(const HanjaList *list,
+					     unsigned int n);
+const ucschar* hanja_list_get_nth_comment_ucs4(const HanjaList *list,
+					       unsigned int n);
+bool         hanja_list_rerank(HanjaList* list, const HanjaModel* model,
+			       const char* previous);
 void         hanja_list_delete(HanjaList *list);
 
+bool         hanja_model_compile(const char* input, const char* output);
+HanjaModel*  hanja_model_load(const char* filename);
+int          hanja_model_get_score(const HanjaModel* model,
+				   const char* previous, const char* value);
+void         hanja_model_delete(HanjaModel* model);
+
 const char*  hanja_get_key(const Hanja* hanja);
 const char*  hanja_get_value(const Hanja* hanja);
 const char*  hanja_get_comment(const Hanja* hanja);
+const ucschar* hanja_get_key_ucs4(const Hanja* hanja);
+const ucschar* hanja_get_value_ucs4(const Hanja* hanja);
+const ucschar* hanja_get_comment_ucs4(const Hanja* hanja);
+
+size_t       hanja_compatibility_form(ucschar* hanja, const ucschar* hangul,
+				      size_t n);
+size_t       hanja_unified_form(ucschar* str, size_t n);
 
 #ifdef __cplusplus
 }
@@ -187,6 +187,10 @@ typedef bool   (*HangulOnTransition) (HangulInputContext*,
 				      ucschar,
 				      const ucschar*,
 				      void*);
+typedef void   (*HangulOnCommit)     (HangulInputContext*,
+				      const ucschar*,
+				      size_t,
+				      void*);
 
 struct _HangulBuffer {
     ucschar choseong;
@@ -197,6 +201,18 @@ struct _HangulBuffer {
     int     index;
 };
 
+/* 길이를 같이 관리하는 스트링 버퍼.
+ * 짧은 스트링은 inline_buf를 쓰고 넘치면 heap으로 옮겨서 늘린다.
+ * str은 항상 0으로 끝난다. */
+typedef struct _HangulString HangulString;
+typedef struct _HangulAutomaton HangulAutomaton;
+struct _HangulString {
+    ucschar* str;
+    size_t   len;
+    size_t   alloc;
+    ucschar  inline_buf[16];
+};
+
 struct _HangulInputContext {
     int type;
 
@@ -206,9 +222,9 @@ struct _HangulInputContext {
     HangulBuffer buffer;
     int output_mode;
 
-    ucschar preedit_string[64];
-    ucschar commit_string[64];
-    ucschar flushed_string[64];
+    HangulString preedit_string;
+    HangulString commit_string;
+    HangulString flushed_string;
 
     HangulOnTranslate   on_translate;
     void*               on_translate_data;
@@ -216,10 +232,46 @@ struct _HangulInputContext {
     HangulOnTransition  on_transition;
     void*               on_transition_data;
 
+    HangulOnCommit      on_commit;
+    void*               on_commit_data;
+
+    HangulAutomaton*    automaton;
+
     unsigned int use_jamo_mode_only : 1;
     unsigned int option_auto_reorder : 1;
     unsigned int option_combi_on_double_stroke : 1;
     unsigned int option_non_choseong_combi : 1;
+
+    /* hangul_ic_pool_new_ic()로 만든 것이면 그 pool, 아니면 NULL */
+    HangulInputContextPool* pool;
+    HangulInputContext*     next_free;
+};
+
+/* pool의 자판 캐시 크기, 이보다 긴 id는 캐시하지 않는다. */
+#define HANGUL_IC_POOL_NKEYBOARDS   4
+#define HANGUL_IC_POOL_ID_LEN	    32
+#define HANGUL_IC_POOL_SLAB_SIZE    64
+
+typedef struct _HangulInputContextSlab HangulInputContextSlab;
+
+struct _HangulInputContextSlab {
+    HangulInputContextSlab* next;
+    unsigned int n;
+    HangulInputContext contexts[];
+};
+
+struct _HangulInputContextPool {
+    unsigned int slab_size;
+    HangulInputContextSlab* slabs;
+    HangulInputContext*     free_list;
+
+    /* 자판 id로 찾은 자판, 자판 목록이 바뀌면 비운다. */
+    unsigned int keyboards_serial;
+    unsigned int next_keyboard;
+    struct {
+	char id[HANGUL_IC_POOL_ID_LEN];
+	const HangulKeyboard* keyboard;
+    } keyboards[HANGUL_IC_POOL_NKEYBOARDS];
 };
 
 static void    hangul_buffer_push(HangulBuffer *buffer, ucschar ch);
@@ -233,6 +285,73 @@ static int     hangul_buffer_get_jamo_string(HangulBuffer *buffer, ucschar *buf,
 static void    hangul_ic_flush_internal(HangulInputContext *hic);
 
 
+static void
+hangul_string_init(HangulString *string)
+{
+    string->str = string->inline_buf;
+    string->len = 0;
+    string->alloc = N_ELEMENTS(string->inline_buf);
+    string->str[0] = 0;
+}
+
+static void
+hangul_string_free(HangulString *string)
+{
+    if (string->str != string->inline_buf)
+	free(string->str);
+}
+
+static inline void
+hangul_string_clear(HangulString *string)
+{
+    string->len = 0;
+    string->str[0] = 0;
+}
+
+/* 0으로 끝나는 것까지 포함해서 n 글자를 더 넣을 공간을 확보한다.
+ * 메모리가 모자라면 false를 리턴한다. */
+static bool
+hangul_string_reserve(HangulString *string, size_t n)
+{
+    size_t alloc;
+    ucschar* str;
+
+    if (string->len + n + 1 <= string->alloc)
+	return true;
+
+    alloc = string->alloc * 2;
+    while (alloc < string->len + n + 1)
+	alloc *= 2;
+
+    if (string->str == string->inline_buf) {
+	str = malloc(alloc * sizeof(ucschar));
+	if (str == NULL)
+	    return false;
+	memcpy(str, string->str, (string->len + 1) * sizeof(ucschar));
+    } else {
+	str = realloc(string->str, alloc * sizeof(ucschar));
+	if (str == NULL)
+	    return false;
+    }
+
+    string->str = str;
+    string->alloc = alloc;
+    return true;
+}
+
+static inline void
+hangul_string_append(HangulString *string, const ucschar* s, size_t n)
+{
+    if (!hangul_string_reserve(string, n)) {
+	/* 메모리가 모자라면 들어갈 수 있는 만큼만 넣는다. */
+	n = string->alloc - string->len - 1;
+    }
+
+    memcpy(string->str + string->len, s, n * sizeof(ucschar));
+    string->len += n;
+    string->str[string->len] = 0;
+}
+
 static bool
 hangul_buffer_is_empty(HangulBuffer *buffer)
 {
@@ -504,54 +623,59 @@ hangul_ic_peek(HangulInputContext *hic)
     return hangul_buffer_peek(&hic->buffer);
 }
 
+/* 버퍼의 내용을 output mode에 맞는 스트링으로 string에 저장한다.
+ * 조합중인 글자는 많아야 세 글자이므로 inline_buf에 항상 들어간다. */
 static inline void
-hangul_ic_save_preedit_string(HangulInputContext *hic)
+hangul_ic_get_buffer_string(HangulInputContext *hic, HangulString *string)
 {
     if (hic->output_mode == HANGUL_OUTPUT_JAMO) {
-	hangul_buffer_get_jamo_string(&hic->buffer,
-				      hic->preedit_string,
-				      N_ELEMENTS(hic->preedit_string));
+	string->len = hangul_buffer_get_jamo_string(&hic->buffer,
+						    string->str, string->alloc);
     } else {
-	hangul_buffer_get_string(&hic->buffer,
-				 hic->preedit_string,
-				 N_ELEMENTS(hic->preedit_string));
+	string->len = hangul_buffer_get_string(&hic->buffer,
+					       string->str, string->alloc);
     }
 }
 
 static inline void
-hangul_ic_append_commit_string(HangulInputContext *hic, ucschar ch)
+hangul_ic_save_preedit_string(HangulInputContext *hic)
 {
-    int i;
+    hangul_ic_get_buffer_string(hic, &hic->preedit_string);
+}
 
-    for (i = 0; i < N_ELEMENTS(hic->commit_string); i++) {
-	if (hic->commit_string[i] == 0)
-	    break;
-    }
+/* 완성된 글자를 내보낸다. commit 콜백이 연결되어 있으면 그쪽으로 바로
+ * 보내고, 아니면 commit string 뒤에 붙인다. */
+static inline void
+hangul_ic_commit(HangulInputContext *hic, const ucschar* str, size_t len)
+{
+    if (len == 0)
+	return;
 
-    if (i + 1 < N_ELEMENTS(hic->commit_string)) {
-	hic->commit_string[i++] = ch;
-	hic->commit_string[i] = 0;
+    if (hic->on_commit != NULL) {
+	hic->on_commit(hic, str, len, hic->on_commit_data);
+    } else {
+	hangul_string_append(&hic->commit_string, str, len);
     }
 }
 
 static inline void
-hangul_ic_save_commit_string(HangulInputContext *hic)
+hangul_ic_append_commit_string(HangulInputContext *hic, ucschar ch)
 {
-    ucschar *string = hic->commit_string;
-    int len = N_ELEMENTS(hic->commit_string);
+    hangul_ic_commit(hic, &ch, 1);
+}
 
-    while (len > 0) {
-	if (*string == 0)
-	    break;
-	len--;
-	string++;
-    }
+static inline void
+hangul_ic_save_commit_string(HangulInputContext *hic)
+{
+    ucschar buf[8];
+    int len;
 
     if (hic->output_mode == HANGUL_OUTPUT_JAMO) {
-	hangul_buffer_get_jamo_string(&hic->buffer, string, len);
+	len = hangul_buffer_get_jamo_string(&hic->buffer, buf, N_ELEMENTS(buf));
     } else {
-	hangul_buffer_get_string(&hic->buffer, string, len);
+	len = hangul_buffer_get_string(&hic->buffer, buf, N_ELEMENTS(buf));
     }
+    hangul_ic_commit(hic, buf, len);
 
     hangul_buffer_clear(&hic->buffer);
 }
@@ -1047,6 +1171,733 @@ flush:
     return false;
 }
 
+static bool
+hangul_ic_process_internal(HangulInputContext *hic, int ascii)
+{
+    ucschar c;
+
+    c = hangul_keyboard_map_to_char(hic->keyboard, hic->tableid, ascii);
+    if (hic->on_translate != NULL)
+	hic->on_translate(hic, ascii, &c, hic->on_translate_data);
+
+    if (ascii == '\b') {
+	return hangul_ic_backspace(hic);
+    }
+
+    int type = hangul_keyboard_get_type(hic->keyboard);
+    switch (type) {
+    case HANGUL_KEYBOARD_TYPE_JASO:
+    case HANGUL_KEYBOARD_TYPE_JASO_YET:
+	return hangul_ic_process_jaso(hic, c);
+    case HANGUL_KEYBOARD_TYPE_ROMAJA:
+	return hangul_ic_process_romaja(hic, ascii, c);
+    default:
+	return hangul_ic_process_jamo(hic, c);
+    }
+}
+
+/* 상태 전이 테이블
+ *
+ * HANGUL_IC_OPTION_AUTOMATON 옵션을 켜면 위의 조합 루틴이 어떤 조합 상태에서
+ * 어떤 키를 받았을때 어떻게 동작하는지를 테이블로 기록해 두고, 다음부터는
+ * 같은 상태에서 같은 키가 오면 테이블만 보고 처리한다.
+ *
+ * 상태는 backspace 처리까지 똑같이 하기 위해서 스택을 포함한 HangulBuffer
+ * 전체로 한다. 이렇게 하면 자판에 따라 가능한 상태가 수십만개가 넘을 수
+ * 있으므로 모든 상태를 미리 만들지 않고, 자판이나 옵션을 바꿀 때에는 빈
+ * 상태에서의 전이만 만들어 두고 나머지는 처음 만날 때 하나씩 만든다.
+ * 상태가 HANGUL_AUTOMATON_MAX_STATES개를 넘으면 테이블을 비우고 다시
+ * 시작한다.
+ *
+ * 키는 자판에서 같은 글자로 변환되는 것끼리 묶어서 class로 나눈다.
+ * 자모가 아닌 글자로 변환되는 키는 어느 상태에서나 조합중인 글자를
+ * commit하고 그 글자를 commit하므로 테이블에 넣지 않고 따로 처리한다.
+ *
+ * 전이는 조합 루틴을 HangulInputContext의 사본에서 실행해서 만든다. 따라서
+ * 결과는 항상 조합 루틴과 같다. 조합 결과는 자판, 옵션, output mode에
+ * 따라서 달라지므로 이 값들이 바뀌면 테이블을 다시 만든다. translate,
+ * transition 콜백은 임의의 동작을 할 수 있으므로 콜백이 연결되어 있으면
+ * 테이블을 쓰지 않는다. */
+
+#define HANGUL_AUTOMATON_NKEYS      0x80
+#define HANGUL_AUTOMATON_MAX_STATES 16384
+#define HANGUL_AUTOMATON_UNKNOWN    (-1)
+#define HANGUL_AUTOMATON_LITERAL    0xff
+
+/* 음절 단위 처리에서 키의 종류 */
+#define HANGUL_AUTOMATON_KEY_NONE      0
+#define HANGUL_AUTOMATON_KEY_CONSONANT 1
+#define HANGUL_AUTOMATON_KEY_VOWEL     2
+#define HANGUL_AUTOMATON_KEY_LITERAL   3
+
+/* 현대 한글 종성의 수, 0은 종성이 없는 경우 */
+#define HANGUL_AUTOMATON_NFINALS       28
+
+typedef struct _HangulAutomatonState HangulAutomatonState;
+typedef struct _HangulAutomatonTransition HangulAutomatonTransition;
+
+struct _HangulAutomatonState {
+    HangulBuffer buffer;
+    ucschar      preedit[4];
+    uint32_t     npreedit;
+};
+
+/* next는 (다음 상태 번호 + 1) << 1 | 키를 사용했는지 여부, 0이면 아직 모름.
+ * commit은 pool에서 commit string의 위치 << 6 | 길이 */
+struct _HangulAutomatonTransition {
+    uint32_t next;
+    uint32_t commit;
+};
+
+struct _HangulAutomaton {
+    HangulAutomatonState* states;
+    size_t nstates;
+    size_t states_alloced;
+
+    /* 상태마다 nclasses개의 전이 */
+    HangulAutomatonTransition* rows;
+
+    uint8_t classes[HANGUL_AUTOMATON_NKEYS];
+    ucschar chars[HANGUL_AUTOMATON_NKEYS];
+    int nclasses;
+
+    /* 음절 단위 처리에 쓰는 키의 종류, 키가 받침이 될 때의 종성,
+     * 받침 뒤에 모음 앞의 자음으로 올 수 있는 키의 bitmap,
+     * 현대 한글 종성 두개가 조합되는 겹받침 */
+    uint8_t kinds[0x100];
+    ucschar finals[HANGUL_AUTOMATON_NKEYS];
+    uint64_t final_pairs[HANGUL_AUTOMATON_NKEYS][2];
+    ucschar final_combinations[HANGUL_AUTOMATON_NFINALS][HANGUL_AUTOMATON_NFINALS];
+
+    ucschar* pool;
+    size_t npool;
+    size_t pool_alloced;
+
+    int32_t* hash;
+    size_t hash_mask;
+
+    /* 빈 상태와 hic->buffer에 해당하는 상태 */
+    int empty;
+    int current;
+};
+
+static void
+hangul_buffer_normalize(HangulBuffer *buffer)
+{
+    int i;
+
+    for (i = buffer->index + 1; i < N_ELEMENTS(buffer->stack); i++)
+	buffer->stack[i] = 0;
+}
+
+static uint32_t
+hangul_automaton_hash_buffer(const HangulBuffer *buffer)
+{
+    uint32_t h = 2166136261u;
+    int i;
+
+    h = (h ^ buffer->choseong) * 16777619u;
+    h = (h ^ buffer->jungseong) * 16777619u;
+    h = (h ^ buffer->jongseong) * 16777619u;
+    for (i = 0; i <= buffer->index; i++)
+	h = (h ^ buffer->stack[i]) * 16777619u;
+
+    return h ^ (h >> 15);
+}
+
+static HangulAutomaton*
+hangul_automaton_new()
+{
+    HangulAutomaton* automaton;
+
+    automaton = calloc(1, sizeof(HangulAutomaton));
+    if (automaton == NULL)
+	return NULL;
+
+    automaton->empty = HANGUL_AUTOMATON_UNKNOWN;
+    automaton->current = HANGUL_AUTOMATON_UNKNOWN;
+    return automaton;
+}
+
+static void
+hangul_automaton_delete(HangulAutomaton *automaton)
+{
+    if (automaton == NULL)
+	return;
+
+    free(automaton->states);
+    free(automaton->rows);
+    free(automaton->pool);
+    free(automaton->hash);
+    free(automaton);
+}
+
+static bool
+hangul_automaton_grow_states(HangulAutomaton *automaton)
+{
+    size_t alloced;
+    size_t i;
+    size_t mask;
+    HangulAutomatonState* states;
+    HangulAutomatonTransition* rows;
+    int32_t* hash;
+
+    alloced = automaton->states_alloced == 0 ? 64 : automaton->states_alloced * 2;
+
+    states = realloc(automaton->states, alloced * sizeof(states[0]));
+    if (states == NULL)
+	return false;
+    automaton->states = states;
+
+    rows = realloc(automaton->rows,
+		   alloced * automaton->nclasses * sizeof(rows[0]));
+    if (rows == NULL)
+	return false;
+    automaton->rows = rows;
+
+    mask = alloced * 2 - 1;
+    hash = malloc((mask + 1) * sizeof(hash[0]));
+    if (hash == NULL)
+	return false;
+    memset(hash, 0xff, (mask + 1) * sizeof(hash[0]));
+    for (i = 0; i < automaton->nstates; i++) {
+	uint32_t h = hangul_automaton_hash_buffer(&states[i].buffer);
+	while (hash[h & mask] >= 0)
+	    h++;
+	hash[h & mask] = i;
+    }
+    free(automaton->hash);
+    automaton->hash = hash;
+    automaton->hash_mask = mask;
+
+    automaton->states_alloced = alloced;
+    return true;
+}
+
+/* buffer에 해당하는 상태를 찾고, 없으면 새로 만든다.
+ * 메모리가 모자라면 HANGUL_AUTOMATON_UNKNOWN을 리턴한다. */
+static int
+hangul_automaton_add_state(HangulAutomaton *automaton,
+			   HangulInputContext *hic, const HangulBuffer *buffer)
+{
+    HangulAutomatonState* state;
+    HangulBuffer key = *buffer;
+    uint32_t h;
+    int32_t id;
+
+    hangul_buffer_normalize(&key);
+
+    if (automaton->hash != NULL) {
+	h = hangul_automaton_hash_buffer(&key);
+	while ((id = automaton->hash[h & automaton->hash_mask]) >= 0) {
+	    if (memcmp(&automaton->states[id].buffer, &key, sizeof(key)) == 0)
+		return id;
+	    h++;
+	}
+    }
+
+    if (automaton->nstates >= automaton->states_alloced) {
+	if (!hangul_automaton_grow_states(automaton))
+	    return HANGUL_AUTOMATON_UNKNOWN;
+    }
+
+    id = automaton->nstates++;
+    h = hangul_automaton_hash_buffer(&key);
+    while (automaton->hash[h & automaton->hash_mask] >= 0)
+	h++;
+    automaton->hash[h & automaton->hash_mask] = id;
+
+    state = &automaton->states[id];
+    state->buffer = key;
+    if (hic->output_mode == HANGUL_OUTPUT_JAMO) {
+	state->npreedit = hangul_buffer_get_jamo_string(&key, state->preedit,
+						 N_ELEMENTS(state->preedit));
+    } else {
+	state->npreedit = hangul_buffer_get_string(&key, state->preedit,
+						 N_ELEMENTS(state->preedit));
+    }
+
+    memset(automaton->rows + id * automaton->nclasses, 0,
+	   automaton->nclasses * sizeof(automaton->rows[0]));
+
+    return id;
+}
+
+/* 상태를 모두 지우고 빈 상태만 남긴다. */
+static void
+hangul_automaton_clear(HangulAutomaton *automaton, HangulInputContext *hic)
+{
+    HangulBuffer empty;
+
+    automaton->nstates = 0;
+    automaton->npool = 0;
+    automaton->current = HANGUL_AUTOMATON_UNKNOWN;
+
+    if (automaton->hash != NULL) {
+	memset(automaton->hash, 0xff,
+	       (automaton->hash_mask + 1) * sizeof(automaton->hash[0]));
+    }
+
+    hangul_buffer_clear(&empty);
+    automaton->empty = hangul_automaton_add_state(automaton, hic, &empty);
+}
+
+static bool
+hangul_automaton_add_commit(HangulAutomaton *automaton,
+			    const ucschar* str, size_t len)
+{
+    if (len == 0)
+	return true;
+
+    if (automaton->npool + len > automaton->pool_alloced) {
+	size_t alloced = automaton->pool_alloced == 0 ? 1024
+					: automaton->pool_alloced * 2;
+	ucschar* pool;
+
+	while (alloced < automaton->npool + len)
+	    alloced *= 2;
+
+	pool = realloc(automaton->pool, alloced * sizeof(pool[0]));
+	if (pool == NULL)
+	    return false;
+
+	automaton->pool = pool;
+	automaton->pool_alloced = alloced;
+    }
+
+    memcpy(automaton->pool + automaton->npool, str, len * sizeof(str[0]));
+    automaton->npool += len;
+    return true;
+}
+
+/* from 상태에서 ascii 키를 받았을 때의 전이를 만든다.
+ * 조합 루틴을 hic의 사본에서 실행해서 결과를 기록하고 전이를 리턴한다.
+ * 기록할 수 없으면 NULL을 리턴한다. 테이블을 비우고 다시 시작하는
+ * 경우에는 from 상태의 번호가 바뀌므로 automaton->current에 현재 상태의
+ * 번호를 저장한다. */
+static const HangulAutomatonTransition*
+hangul_automaton_compile(HangulAutomaton *automaton,
+			 HangulInputContext *hic, int from, int ascii)
+{
+    HangulInputContext tmp;
+    HangulAutomatonTransition* transition = NULL;
+    const HangulAutomatonState* state;
+    size_t len;
+    int to;
+    bool res;
+
+    if (automaton->nstates + 1 >= HANGUL_AUTOMATON_MAX_STATES) {
+	HangulBuffer buffer = automaton->states[from].buffer;
+	hangul_automaton_clear(automaton, hic);
+	from = hangul_automaton_add_state(automaton, hic, &buffer);
+	if (from == HANGUL_AUTOMATON_UNKNOWN)
+	    return NULL;
+    }
+    automaton->current = from;
+
+    tmp = *hic;
+    hangul_string_init(&tmp.preedit_string);
+    hangul_string_init(&tmp.commit_string);
+    hangul_string_init(&tmp.flushed_string);
+    tmp.on_translate = NULL;
+    tmp.on_transition = NULL;
+    tmp.on_commit = NULL;
+    tmp.automaton = NULL;
+    tmp.buffer = automaton->states[from].buffer;
+
+    res = hangul_ic_process_internal(&tmp, ascii);
+
+    to = hangul_automaton_add_state(automaton, hic, &tmp.buffer);
+    if (to == HANGUL_AUTOMATON_UNKNOWN)
+	goto out;
+
+    /* preedit string은 상태에 저장해 둔 것을 쓰므로, 조합 루틴이 다른
+     * preedit string을 만든 경우에는 기록하지 않는다. */
+    state = &automaton->states[to];
+    if (tmp.preedit_string.len != state->npreedit ||
+	memcmp(tmp.preedit_string.str, state->preedit,
+	       state->npreedit * sizeof(ucschar)) != 0)
+	goto out;
+
+    len = tmp.commit_string.len;
+    if (len >= 64 || automaton->npool >= (1 << 26) - len)
+	goto out;
+
+    transition = &automaton->rows[from * automaton->nclasses +
+				  automaton->classes[ascii]];
+    transition->commit = automaton->npool << 6 | len;
+    if (!hangul_automaton_add_commit(automaton, tmp.commit_string.str, len)) {
+	transition = NULL;
+	goto out;
+    }
+    transition->next = (to + 1) << 1 | (res ? 1 : 0);
+
+out:
+    hangul_string_free(&tmp.preedit_string);
+    hangul_string_free(&tmp.commit_string);
+    hangul_string_free(&tmp.flushed_string);
+    return transition;
+}
+
+static inline bool
+hangul_automaton_is_final_pair(const HangulAutomaton *automaton,
+			       int key, int next)
+{
+    return (automaton->final_pairs[key][next >> 6] >> (next & 63)) & 1;
+}
+
+/* 받침 first 뒤에 second가 오면 조합되는 겹받침을 리턴하고, 조합되지
+ * 않으면 0을 리턴한다. first는 현대 한글 종성, second는 현대 한글 종성이나
+ * 0이어야 한다. */
+static inline ucschar
+hangul_automaton_combine_finals(const HangulAutomaton *automaton,
+				ucschar first, ucschar second)
+{
+    return automaton->final_combinations[first - 0x11a7]
+					[second == 0 ? 0 : second - 0x11a7];
+}
+
+/* 두벌식처럼 자모를 하나씩 입력하는 자판에서 음절 단위로 처리하기 위한
+ * 테이블을 만든다. 키가 초성, 중성, 자모가 아닌 글자 중 어떤 것으로
+ * 변환되는지와, 받침 뒤에 자음과 모음이 올 때 그 자음이 다음 음절의
+ * 초성으로 넘어가는지를 조합 루틴이 쓰는 함수로 미리 계산해 둔다.
+ * 조합 결과가 이 규칙으로 설명되지 않는 키는 KEY_NONE으로 두어서
+ * 조합 루틴이 처리하게 한다. */
+static void
+hangul_automaton_build_syllables(HangulAutomaton *automaton,
+				 HangulInputContext *hic)
+{
+    int key;
+    int next;
+    int i;
+    int j;
+
+    memset(automaton->kinds, 0, sizeof(automaton->kinds));
+    memset(automaton->finals, 0, sizeof(automaton->finals));
+    memset(automaton->final_pairs, 0, sizeof(automaton->final_pairs));
+    memset(automaton->final_combinations, 0,
+	   sizeof(automaton->final_combinations));
+
+    if (hangul_keyboard_get_type(hic->keyboard) != HANGUL_KEYBOARD_TYPE_JAMO ||
+	hic->output_mode != HANGUL_OUTPUT_SYLLABLE)
+	return;
+
+    for (key = 0; key < HANGUL_AUTOMATON_NKEYS; key++) {
+	ucschar c = automaton->chars[key];
+
+	if (key == '\b')
+	    continue;
+
+	if (automaton->classes[key] == HANGUL_AUTOMATON_LITERAL) {
+	    automaton->kinds[key] = HANGUL_AUTOMATON_KEY_LITERAL;
+	} else if (hangul_is_choseong_conjoinable(c)) {
+	    /* 받침이 된 자음은 다음 모음 앞에서 다시 같은 초성이 되어야
+	     * 한다. */
+	    ucschar jong = hangul_ic_choseong_to_jongseong(hic, c);
+	    if (jong != 0 && hangul_jongseong_to_choseong(jong) != c)
+		continue;
+
+	    automaton->kinds[key] = HANGUL_AUTOMATON_KEY_CONSONANT;
+	    automaton->finals[key] = jong;
+	} else if (hangul_is_jungseong_conjoinable(c)) {
+	    automaton->kinds[key] = HANGUL_AUTOMATON_KEY_VOWEL;
+	}
+    }
+
+    for (i = 1; i < HANGUL_AUTOMATON_NFINALS; i++) {
+	for (j = 1; j < HANGUL_AUTOMATON_NFINALS; j++) {
+	    ucschar combined = hangul_ic_combine(hic, 0x11a7 + i, 0x11a7 + j);
+	    if (hangul_is_jongseong(combined))
+		automaton->final_combinations[i][j] = combined;
+	}
+    }
+
+    /* 받침 뒤에 자음이 오면 두 자음이 겹받침으로 조합될 수 있는데,
+     * 그 다음에 모음이 와서 뒤의 자음이 다시 원래의 초성으로 떨어져
+     * 나가면 겹받침이 되지 않은 것과 결과가 같다. */
+    for (key = 0; key < HANGUL_AUTOMATON_NKEYS; key++) {
+	ucschar jong = automaton->finals[key];
+
+	if (jong == 0)
+	    continue;
+
+	for (next = 0; next < HANGUL_AUTOMATON_NKEYS; next++) {
+	    ucschar combined;
+
+	    if (automaton->kinds[next] != HANGUL_AUTOMATON_KEY_CONSONANT)
+		continue;
+
+	    combined = hangul_ic_combine(hic, jong, automaton->finals[next]);
+	    if (!hangul_is_jongseong(combined) ||
+		hangul_jongseong_get_diff(jong, combined) == automaton->chars[next]) {
+		automaton->final_pairs[key][next >> 6] |= (uint64_t)1 << (next & 63);
+	    }
+	}
+    }
+}
+
+/* 자판이나 옵션이 바뀌었을 때 키를 class로 나누고 테이블을 비운 다음
+ * 빈 상태에서의 전이를 미리 만들어 둔다. */
+static void
+hangul_ic_rebuild_automaton(HangulInputContext *hic)
+{
+    HangulAutomaton* automaton = hic->automaton;
+    int nclasses;
+    int type;
+    int key;
+    int i;
+
+    if (automaton == NULL)
+	return;
+
+    /* 키 값이 필요한 로마자 자판을 빼면 조합 루틴은 키가 변환된 글자만
+     * 보므로 같은 글자로 변환되는 키는 같은 class로 한다. */
+    type = hangul_keyboard_get_type(hic->keyboard);
+    nclasses = automaton->nclasses;
+    automaton->nclasses = 0;
+    for (key = 0; key < HANGUL_AUTOMATON_NKEYS; key++) {
+	ucschar c = hangul_keyboard_map_to_char(hic->keyboard, hic->tableid, key);
+
+	automaton->chars[key] = c;
+	if (c != 0 && !hangul_is_jamo(c) && key != '\b') {
+	    automaton->classes[key] = HANGUL_AUTOMATON_LITERAL;
+	    continue;
+	}
+
+	automaton->classes[key] = automaton->nclasses;
+	if (type != HANGUL_KEYBOARD_TYPE_ROMAJA && key != '\b') {
+	    for (i = 0; i < key; i++) {
+		if (automaton->classes[i] != HANGUL_AUTOMATON_LITERAL &&
+		    automaton->chars[i] == c && i != '\b') {
+		    automaton->classes[key] = automaton->classes[i];
+		    break;
+		}
+	    }
+	}
+	if (automaton->classes[key] == automaton->nclasses)
+	    automaton->nclasses++;
+    }
+
+    /* class 수가 바뀌면 row의 크기가 바뀌므로 메모리를 새로 잡는다. */
+    if (automaton->nclasses != nclasses) {
+	free(automaton->states);
+	free(automaton->rows);
+	free(automaton->hash);
+	automaton->states = NULL;
+	automaton->rows = NULL;
+	automaton->hash = NULL;
+	automaton->nstates = 0;
+	automaton->states_alloced = 0;
+    }
+
+    hangul_automaton_build_syllables(automaton, hic);
+
+    hangul_automaton_clear(automaton, hic);
+    if (automaton->empty == HANGUL_AUTOMATON_UNKNOWN)
+	return;
+
+    for (key = 0; key < HANGUL_AUTOMATON_NKEYS; key++) {
+	if (automaton->classes[key] != HANGUL_AUTOMATON_LITERAL)
+	    hangul_automaton_compile(automaton, hic, automaton->empty, key);
+    }
+
+    automaton->current = HANGUL_AUTOMATON_UNKNOWN;
+}
+
+/* 조합 루틴 밖에서 hic->buffer를 바꾸면 불러야 한다. */
+static inline void
+hangul_ic_invalidate_automaton_state(HangulInputContext *hic)
+{
+    if (hic->automaton != NULL)
+	hic->automaton->current = HANGUL_AUTOMATON_UNKNOWN;
+}
+
+static bool
+hangul_ic_process_automaton(HangulInputContext *hic, int ascii)
+{
+    HangulAutomaton* automaton = hic->automaton;
+    const HangulAutomatonTransition* transition;
+    const HangulAutomatonState* state;
+    int cls;
+
+    if (automaton->current == HANGUL_AUTOMATON_UNKNOWN) {
+	automaton->current = hangul_automaton_add_state(automaton, hic,
+							&hic->buffer);
+	if (automaton->current == HANGUL_AUTOMATON_UNKNOWN)
+	    return hangul_ic_process_internal(hic, ascii);
+    }
+
+    cls = automaton->classes[ascii];
+    if (cls == HANGUL_AUTOMATON_LITERAL) {
+	/* 조합중인 글자를 commit하고 키의 글자를 commit한다. */
+	state = &automaton->states[automaton->current];
+	hangul_ic_commit(hic, state->preedit, state->npreedit);
+	hangul_ic_commit(hic, &automaton->chars[ascii], 1);
+	hangul_buffer_clear(&hic->buffer);
+	automaton->current = automaton->empty;
+	return true;
+    }
+
+    transition = &automaton->rows[automaton->current * automaton->nclasses + cls];
+    if (transition->next == 0) {
+	transition = hangul_automaton_compile(automaton, hic,
+					      automaton->current, ascii);
+	if (transition == NULL) {
+	    automaton->current = HANGUL_AUTOMATON_UNKNOWN;
+	    return hangul_ic_process_internal(hic, ascii);
+	}
+    }
+
+    automaton->current = (transition->next >> 1) - 1;
+    state = &automaton->states[automaton->current];
+
+    hic->buffer = state->buffer;
+    memcpy(hic->preedit_string.str, state->preedit,
+	   (state->npreedit + 1) * sizeof(ucschar));
+    hic->preedit_string.len = state->npreedit;
+    hangul_ic_commit(hic, automaton->pool + (transition->commit >> 6),
+		     transition->commit & 0x3f);
+
+    return transition->next & 1;
+}
+
+/* keys를 앞에서부터 음절 단위로 처리해서 out[*len]부터 저장하고, 처리한
+ * 키의 개수를 리턴한다.
+ *
+ * 초성, 중성 뒤에 받침이 오는 음절은 다음 음절의 초성과 중성이나 자모가
+ * 아닌 글자가 오면 조합 루틴에서도 그대로 commit되므로 키 몇개만 보고
+ * 바로 음절을 만들 수 있다. 모음이 겹치거나 자음이 세개 이상 이어지는
+ * 것처럼 조합 루틴의 규칙을 따라야 하는 곳이나 입력의 마지막 음절을
+ * 만나면 그 음절의 처음에서 멈추고 나머지는 조합 루틴에 맡긴다.
+ * hic->buffer에 조합중인 글자가 있으면 그 글자가 그대로 commit되는
+ * 경우에만 처리한다. 멈춘 곳에서 hic->buffer는 비어 있다. */
+static size_t
+hangul_ic_process_syllables(HangulInputContext *hic,
+			    const unsigned char* keys, size_t nkeys,
+			    ucschar* out, size_t outcap, size_t* len)
+{
+    HangulAutomaton* automaton = hic->automaton;
+    const uint8_t* kinds = automaton->kinds;
+    const ucschar* chars = automaton->chars;
+    const ucschar* finals = automaton->finals;
+    size_t n = *len;
+    size_t i = 0;
+
+    if (!hangul_buffer_is_empty(&hic->buffer)) {
+	HangulBuffer* buffer = &hic->buffer;
+	ucschar str[8];
+	int slen;
+
+	if (kinds[keys[0]] == HANGUL_AUTOMATON_KEY_LITERAL) {
+	    /* 자모가 아닌 글자는 조합중인 글자를 commit한다. */
+	} else if (kinds[keys[0]] == HANGUL_AUTOMATON_KEY_CONSONANT &&
+		   nkeys > 1 && kinds[keys[1]] == HANGUL_AUTOMATON_KEY_VOWEL &&
+		   buffer->choseong != 0 && buffer->jungseong != 0) {
+	    /* 자음이 받침으로 조합되었다가 모음이 오면서 떨어져 나가는
+	     * 경우에 조합중인 글자가 그대로 남는지 확인한다. */
+	    if (buffer->jongseong == 0) {
+		if (hangul_is_jongseong(hangul_buffer_peek(buffer)))
+		    return 0;
+	    } else {
+		if (!hangul_is_jongseong_conjoinable(buffer->jongseong))
+		    return 0;
+		if (hangul_automaton_combine_finals(automaton,
+			    buffer->jongseong, finals[keys[0]]) != 0)
+		    return 0;
+	    }
+	} else {
+	    return 0;
+	}
+
+	slen = hangul_buffer_get_string(buffer, str, N_ELEMENTS(str));
+	if (n + slen > outcap)
+	    return 0;
+
+	memcpy(out + n, str, slen * sizeof(ucschar));
+	n += slen;
+	hangul_buffer_clear(buffer);
+    }
+
+    while (i < nkeys && n + 2 <= outcap) {
+	unsigned char key = keys[i];
+	ucschar jong = 0;
+	ucschar syllable;
+	size_t next;
+	size_t j;
+
+	if (kinds[key] == HANGUL_AUTOMATON_KEY_LITERAL) {
+	    out[n++] = chars[key];
+	    i++;
+	    continue;
+	}
+
+	if (kinds[key] != HANGUL_AUTOMATON_KEY_CONSONANT ||
+	    i + 2 >= nkeys ||
+	    kinds[keys[i + 1]] != HANGUL_AUTOMATON_KEY_VOWEL)
+	    break;
+
+	/* 중성 뒤의 키를 보고 음절이 어디서 끝나는지 정한다. */
+	j = i + 2;
+	if (kinds[keys[j]] == HANGUL_AUTOMATON_KEY_LITERAL) {
+	    next = j;
+	} else if (kinds[keys[j]] != HANGUL_AUTOMATON_KEY_CONSONANT ||
+		   j + 1 >= nkeys) {
+	    break;
+	} else if (kinds[keys[j + 1]] == HANGUL_AUTOMATON_KEY_VOWEL) {
+	    next = j;
+	} else if (finals[keys[j]] == 0) {
+	    break;
+	} else if (kinds[keys[j + 1]] == HANGUL_AUTOMATON_KEY_LITERAL) {
+	    jong = finals[keys[j]];
+	    next = j + 1;
+	} else if (kinds[keys[j + 1]] != HANGUL_AUTOMATON_KEY_CONSONANT ||
+		   j + 2 >= nkeys) {
+	    break;
+	} else if (kinds[keys[j + 2]] == HANGUL_AUTOMATON_KEY_VOWEL) {
+	    if (!hangul_automaton_is_final_pair(automaton, keys[j], keys[j + 1]))
+		break;
+	    jong = finals[keys[j]];
+	    next = j + 1;
+	} else {
+	    /* 받침 뒤에 자음이 두개 이상 오면 앞의 두 자음이 겹받침으로
+	     * 조합되고, 다음 자음과는 더 조합되지 않는 경우만 처리한다. */
+	    jong = hangul_automaton_combine_finals(automaton, finals[keys[j]],
+						   finals[keys[j + 1]]);
+	    if (!hangul_is_jongseong_conjoinable(jong))
+		break;
+
+	    if (kinds[keys[j + 2]] == HANGUL_AUTOMATON_KEY_LITERAL) {
+		next = j + 2;
+	    } else if (kinds[keys[j + 2]] == HANGUL_AUTOMATON_KEY_CONSONANT &&
+		       j + 3 < nkeys &&
+		       kinds[keys[j + 3]] == HANGUL_AUTOMATON_KEY_VOWEL &&
+		       hangul_automaton_combine_finals(automaton, jong,
+						finals[keys[j + 2]]) == 0) {
+		next = j + 2;
+	    } else {
+		break;
+	    }
+	}
+
+	syllable = hangul_jamo_to_syllable(chars[key], chars[keys[i + 1]], jong);
+	if (syllable == 0)
+	    break;
+
+	out[n++] = syllable;
+	i = next;
+    }
+
+    if (n != *len) {
+	hangul_buffer_clear(&hic->buffer);
+	hangul_string_clear(&hic->preedit_string);
+	hangul_string_clear(&hic->commit_string);
+	automaton->current = automaton->empty;
+	*len = n;
+    }
+
+    return i;
+}
+
 /**
  * @ingroup hangulic
  * @brief 키 입력을 처리하여 실제로 한글 조합을 하는 함수
@@ -1076,32 +1927,114 @@ flush:
 bool
 hangul_ic_process(HangulInputContext *hic, int ascii)
 {
-    ucschar c;
-
     if (hic == NULL)
 	return false;
 
-    hic->preedit_string[0] = 0;
-    hic->commit_string[0] = 0;
+    hangul_string_clear(&hic->preedit_string);
+    hangul_string_clear(&hic->commit_string);
 
-    c = hangul_keyboard_map_to_char(hic->keyboard, hic->tableid, ascii);
-    if (hic->on_translate != NULL)
-	hic->on_translate(hic, ascii, &c, hic->on_translate_data);
+    if (hic->automaton != NULL &&
+	ascii >= 0 && ascii < HANGUL_AUTOMATON_NKEYS &&
+	hic->on_translate == NULL && hic->on_transition == NULL) {
+	return hangul_ic_process_automaton(hic, ascii);
+    }
 
-    if (ascii == '\b') {
-	return hangul_ic_backspace(hic);
+    hangul_ic_invalidate_automaton_state(hic);
+    return hangul_ic_process_internal(hic, ascii);
+}
+
+/**
+ * @ingroup hangulic
+ * @brief 키 버퍼 전체를 처리하여 commit 스트링을 주어진 버퍼에 저장하는 함수
+ * @param hic @ref HangulInputContext 오브젝트
+ * @param keys 처리할 키 값의 배열, 각 값은 hangul_ic_process()의 ascii와 같다
+ * @param nkeys @a keys 의 길이
+ * @param out 결과를 저장할 버퍼
+ * @param outcap @a out 에 저장할 수 있는 글자 수
+ * @param consumed 처리한 키의 개수를 저장할 포인터, NULL이어도 된다
+ * @return @a out 에 저장한 글자 수
+ *
+ * @a keys 의 키를 차례로 hangul_ic_process()로 처리하면서 그때마다 생기는
+ * commit 스트링을 @a out 에 이어서 저장한다. @a hic 가 사용하지 않은 키는
+ * 그 키 값을 그대로 한 글자로 저장한다. 즉 hangul_ic_process()를 부르고
+ * commit 스트링과 처리되지 않은 키를 차례로 출력하는 루프와 같은 결과를
+ * 만든다.
+ *
+ * 어떤 키의 출력이 @a out 의 남은 공간에 들어가지 않으면 그 키는 처리하지
+ * 않은 것으로 하고 멈춘다. 이때 @a hic 의 조합 상태는 그 키를 받기 전으로
+ * 돌아가므로 @a consumed 위치부터 다시 부르면 이어서 처리할 수 있다.
+ * 결과는 0으로 끝나지 않으며, 조합중인 글자는 @a out 에 들어가지 않는다.
+ * 입력이 끝나면 hangul_ic_flush()로 남은 글자를 구해야 한다.
+ * "commit" 콜백이 연결되어 있어도 이 함수가 처리하는 동안에는 불리지
+ * 않고 결과는 모두 @a out 에 저장된다.
+ *
+ * @remarks 이 함수는 @ref HangulInputContext 의 상태를 변화 시킨다.
+ */
+size_t
+hangul_ic_process_string(HangulInputContext *hic,
+			 const char* keys, size_t nkeys,
+			 ucschar* out, size_t outcap, size_t* consumed)
+{
+    HangulOnCommit on_commit;
+    const uint8_t* kinds = NULL;
+    size_t i;
+    size_t len = 0;
+
+    if (hic == NULL || keys == NULL || out == NULL) {
+	if (consumed != NULL)
+	    *consumed = 0;
+	return 0;
     }
 
-    int type = hangul_keyboard_get_type(hic->keyboard);
-    switch (type) {
-    case HANGUL_KEYBOARD_TYPE_JASO:
-    case HANGUL_KEYBOARD_TYPE_JASO_YET:
-	return hangul_ic_process_jaso(hic, c);
-    case HANGUL_KEYBOARD_TYPE_ROMAJA:
-	return hangul_ic_process_romaja(hic, ascii, c);
-    default:
-	return hangul_ic_process_jamo(hic, c);
+    /* commit 콜백이 연결되어 있어도 결과는 out에 모은다. */
+    on_commit = hic->on_commit;
+    hic->on_commit = NULL;
+
+    if (hic->automaton != NULL &&
+	hic->on_translate == NULL && hic->on_transition == NULL)
+	kinds = hic->automaton->kinds;
+
+    for (i = 0; i < nkeys; i++) {
+	int ascii = (unsigned char)keys[i];
+	HangulBuffer saved;
+	size_t n;
+	bool res;
+
+	/* 음절 단위로 처리할 수 있는 부분은 한번에 처리하고, 멈춘 곳의
+	 * 키부터 조합 루틴으로 처리한다. */
+	if (kinds != NULL && kinds[ascii] != HANGUL_AUTOMATON_KEY_NONE) {
+	    i += hangul_ic_process_syllables(hic,
+					     (const unsigned char*)keys + i,
+					     nkeys - i, out, outcap, &len);
+	    if (i >= nkeys)
+		break;
+	    ascii = (unsigned char)keys[i];
+	}
+
+	saved = hic->buffer;
+	res = hangul_ic_process(hic, ascii);
+
+	n = hic->commit_string.len;
+	if (len + n + (res ? 0 : 1) > outcap) {
+	    hic->buffer = saved;
+	    hangul_ic_invalidate_automaton_state(hic);
+	    hangul_string_clear(&hic->commit_string);
+	    hangul_ic_save_preedit_string(hic);
+	    break;
+	}
+
+	memcpy(out + len, hic->commit_string.str, n * sizeof(ucschar));
+	len += n;
+	if (!res)
+	    out[len++] = ascii;
     }
+
+    hic->on_commit = on_commit;
+
+    if (consumed != NULL)
+	*consumed = i;
+
+    return len;
 }
 
 /**
@@ -1122,7 +2055,7 @@ hangul_ic_get_preedit_string(HangulInputContext *hic)
     if (hic == NULL)
 	return NULL;
 
-    return hic->preedit_string;
+    return hic->preedit_string.str;
 }
 
 /**
@@ -1134,6 +2067,8 @@ hangul_ic_get_preedit_string(HangulInputContext *hic)
  * 
  * 이 함수는  @a hic 내부의 현재 상태의 commit string을 리턴한다.
  * 따라서 hic가 다른 키 이벤트를 처리하고 나면 그 내용이 바뀔 수 있다.
+ * "commit" 콜백이 연결되어 있으면 완성된 글자는 콜백으로 전달되므로
+ * 이 함수는 빈 스트링을 리턴한다.
  *
  * @remarks 이 함수는 @ref HangulInputContext 의 상태를 변화 시키지 않는다.
  */
@@ -1143,7 +2078,7 @@ hangul_ic_get_commit_string(HangulInputContext *hic)
     if (hic == NULL)
 	return NULL;
 
-    return hic->commit_string;
+    return hic->commit_string.str;
 }
 
 /**
@@ -1166,11 +2101,12 @@ hangul_ic_reset(HangulInputContext *hic)
     if (hic == NULL)
 	return;
 
-    hic->preedit_string[0] = 0;
-    hic->commit_string[0] = 0;
-    hic->flushed_string[0] = 0;
+    hangul_string_clear(&hic->preedit_string);
+    hangul_string_clear(&hic->commit_string);
+    hangul_string_clear(&hic->flushed_string);
 
     hangul_buffer_clear(&hic->buffer);
+    hangul_ic_invalidate_automaton_state(hic);
 }
 
 /* append current preedit to the commit buffer.
@@ -1178,7 +2114,7 @@ hangul_ic_reset(HangulInputContext *hic)
 static void
 hangul_ic_flush_internal(HangulInputContext *hic)
 {
-    hic->preedit_string[0] = 0;
+    hangul_string_clear(&hic->preedit_string);
 
     hangul_ic_save_commit_string(hic);
     hangul_buffer_clear(&hic->buffer);
@@ -1196,6 +2132,8 @@ hangul_ic_flush_internal(HangulInputContext *hic)
  * 되돌아 간다. 조합중이던 글자를 강제로 commit하고 싶을때 사용하는 함수다.
  * 보통의 경우 입력 framework에서 focus가 나갈때 이 함수를 불러서 마지막 
  * 상태를 완료해야 조합중이던 글자를 잃어버리지 않게 된다.
+ * "commit" 콜백이 연결되어 있으면 완성한 스트링은 그 콜백으로 전달하고
+ * 빈 스트링을 리턴한다.
  *
  * 비교: hangul_ic_reset()
  *
@@ -1208,21 +2146,20 @@ hangul_ic_flush(HangulInputContext *hic)
 	return NULL;
 
     // get the remaining string and clear the buffer
-    hic->preedit_string[0] = 0;
-    hic->commit_string[0] = 0;
-    hic->flushed_string[0] = 0;
-
-    if (hic->output_mode == HANGUL_OUTPUT_JAMO) {
-	hangul_buffer_get_jamo_string(&hic->buffer, hic->flushed_string,
-				 N_ELEMENTS(hic->flushed_string));
-    } else {
-	hangul_buffer_get_string(&hic->buffer, hic->flushed_string,
-				 N_ELEMENTS(hic->flushed_string));
-    }
+    hangul_string_clear(&hic->preedit_string);
+    hangul_string_clear(&hic->commit_string);
+    hangul_ic_get_buffer_string(hic, &hic->flushed_string);
 
     hangul_buffer_clear(&hic->buffer);
+    hangul_ic_invalidate_automaton_state(hic);
+
+    /* 조합을 끝낸 글자도 commit과 같은 곳으로 보낸다. */
+    if (hic->on_commit != NULL) {
+	hangul_ic_commit(hic, hic->flushed_string.str, hic->flushed_string.len);
+	hangul_string_clear(&hic->flushed_string);
+    }
 
-    return hic->flushed_string;
+    return hic->flushed_string.str;
 }
 
 /**
@@ -1246,12 +2183,13 @@ hangul_ic_backspace(HangulInputContext *hic)
     if (hic == NULL)
 	return false;
 
-    hic->preedit_string[0] = 0;
-    hic->commit_string[0] = 0;
+    hangul_string_clear(&hic->preedit_string);
+    hangul_string_clear(&hic->commit_string);
 
     ret = hangul_buffer_backspace(&hic->buffer);
     if (ret)
 	hangul_ic_save_preedit_string(hic);
+    hangul_ic_invalidate_automaton_state(hic);
     return ret;
 }
 
@@ -1334,6 +2272,8 @@ hangul_ic_get_option(HangulInputContext* hic, int option)
 	return hic->option_combi_on_double_stroke;
     case HANGUL_IC_OPTION_NON_CHOSEONG_COMBI:
 	return hic->option_non_choseong_combi;
+    case HANGUL_IC_OPTION_AUTOMATON:
+	return hic->automaton != NULL;
     }
 
     return false;
@@ -1359,6 +2299,14 @@ hangul_ic_get_option(HangulInputContext* hic, int option)
  *        두벌식 자판 이외에는 옵션이 동작하지 않는다.
  *        MS IME와 호환을 위해서 사용.
  *        예) true면 ㄱ+ㅅ -> ㄳ 으로 조합시켜 줌.
+ *    - HANGUL_IC_OPTION_AUTOMATON
+ *      - 자판과 옵션에 따른 조합 과정을 상태 전이 테이블로 만들어 두고
+ *        키 입력을 테이블 조회로 처리하는 옵션.
+ *        결과는 같고, 많은 양의 키를 처리할 때 빠르다.
+ *        두벌식처럼 자모를 하나씩 입력하는 자판에서는
+ *        hangul_ic_process_string()이 음절 단위로 처리한다.
+ *        테이블을 위해 메모리를 더 사용하며, translate나 transition
+ *        콜백이 연결되어 있으면 테이블을 쓰지 않는다.
  * @param value 설정하고자 하는 값, true 또는 false
  */
 void
@@ -1374,7 +2322,17 @@ hangul_ic_set_option(HangulInputContext* hic, int option, bool value)
     case HANGUL_IC_OPTION_NON_CHOSEONG_COMBI:
 	hic->option_non_choseong_combi = value;
 	break;
+    case HANGUL_IC_OPTION_AUTOMATON:
+	if (value && hic->automaton == NULL) {
+	    hic->automaton = hangul_automaton_new();
+	} else if (!value && hic->automaton != NULL) {
+	    hangul_automaton_delete(hic->automaton);
+	    hic->automaton = NULL;
+	}
+	break;
     }
+
+    hangul_ic_rebuild_automaton(hic);
 }
 
 void
@@ -1383,8 +2341,10 @@ hangul_ic_set_output_mode(HangulInputContext *hic, int mode)
     if (hic == NULL)
 	return;
 
-    if (!hic->use_jamo_mode_only)
+    if (!hic->use_jamo_mode_only) {
 	hic->output_mode = mode;
+	hangul_ic_rebuild_automaton(hic);
+    }
 }
 
 void
@@ -1409,6 +2369,29 @@ hangul_ic_connect_transition(HangulInputContext* hic,
     }
 }
 
+/**
+ * @ingroup hangulic
+ * @brief @ref HangulInputContext 에 콜백 함수를 연결하는 함수
+ * @param hic @ref HangulInputContext 오브젝트
+ * @param event 콜백을 연결할 이벤트 이름
+ *    - "translate": 키를 자모로 변환한 후에 불린다.
+ *	void (*)(HangulInputContext*, int ascii, ucschar* ch, void* data)
+ *    - "transition": 자모를 조합 버퍼에 넣기 전에 불린다. false를
+ *	리턴하면 그 자모를 넣지 않고 조합을 끝낸다.
+ *	bool (*)(HangulInputContext*, ucschar ch, const ucschar* preedit,
+ *	void* data)
+ *    - "commit": 조합이 완료된 글자가 생길 때마다 불린다. 이 콜백이
+ *	연결되어 있으면 완성된 글자를 commit string에 모으지 않고
+ *	@a str 의 @a len 글자를 바로 전달한다. hangul_ic_flush()로 완성한
+ *	글자도 flush 스트링 대신 이 콜백으로 전달한다. @a str 은 0으로
+ *	끝나지 않을 수 있고 콜백이 리턴하면 사라지므로 필요하면 복사해야
+ *	한다. preedit 스트링은 쌓이는 출력이 아니라 키마다 새로 만드는
+ *	조합 상태이므로 이 콜백으로 전달하지 않는다.
+ *	void (*)(HangulInputContext*, const ucschar* str, size_t len,
+ *	void* data)
+ * @param callback 연결할 콜백 함수, NULL이면 연결을 끊는다
+ * @param user_data 콜백 함수에 전달할 데이터
+ */
 void hangul_ic_connect_callback(HangulInputContext* hic, const char* event,
 				void* callback, void* user_data)
 {
@@ -1421,6 +2404,9 @@ void hangul_ic_connect_callback(HangulInputContext* hic, const char* event,
     } else if (strcasecmp(event, "transition") == 0) {
         *(void**)(&hic->on_transition) = callback;
 	hic->on_transition_data = user_data;
+    } else if (strcasecmp(event, "commit") == 0) {
+        *(void**)(&hic->on_commit) = callback;
+	hic->on_commit_data = user_data;
     }
 }
 
@@ -1432,6 +2418,7 @@ hangul_ic_set_keyboard(HangulInputContext *hic, const HangulKeyboard* keyboard)
 
     hic->keyboard = keyboard;
     hic->tableid = 0;
+    hangul_ic_rebuild_automaton(hic);
 }
 
 void
@@ -1441,6 +2428,7 @@ hangul_ic_switch_keyboard_table(HangulInputContext *hic, int tableid)
         return;
 
     hic->tableid = tableid;
+    hangul_ic_rebuild_automaton(hic);
 }
 
 /**
@@ -1487,6 +2475,39 @@ hangul_ic_set_combination(HangulInputContext *hic,
 {
 }
 
+/* 새로 만들거나 pool에서 다시 꺼낸 hic를 hangul_ic_new() 직후의 상태로
+ * 만든다. 스트링은 이미 초기화되어 있어야 하고 자판은 고르지 않는다. */
+static void
+hangul_ic_init(HangulInputContext *hic)
+{
+    hic->keyboard = NULL;
+    hic->tableid = 0;
+
+    hangul_string_clear(&hic->preedit_string);
+    hangul_string_clear(&hic->commit_string);
+    hangul_string_clear(&hic->flushed_string);
+
+    hic->on_translate      = NULL;
+    hic->on_translate_data = NULL;
+
+    hic->on_transition      = NULL;
+    hic->on_transition_data = NULL;
+
+    hic->on_commit      = NULL;
+    hic->on_commit_data = NULL;
+
+    hic->automaton = NULL;
+
+    hic->use_jamo_mode_only = FALSE;
+
+    hic->option_auto_reorder = false;
+    hic->option_combi_on_double_stroke = false;
+    hic->option_non_choseong_combi = true;
+
+    hangul_ic_set_output_mode(hic, HANGUL_OUTPUT_SYLLABLE);
+    hangul_buffer_clear(&hic->buffer);
+}
+
 /**
  * @ingroup hangulic
  * @brief @ref HangulInputContext 오브젝트를 생성한다.
@@ -1508,30 +2529,16 @@ hangul_ic_new(const char* keyboard)
     if (hic == NULL)
 	return NULL;
 
-    hic->keyboard = NULL;
-    hic->tableid = 0;
-
-    hic->preedit_string[0] = 0;
-    hic->commit_string[0] = 0;
-    hic->flushed_string[0] = 0;
-
-    hic->on_translate      = NULL;
-    hic->on_translate_data = NULL;
-
-    hic->on_transition      = NULL;
-    hic->on_transition_data = NULL;
-
-    hic->use_jamo_mode_only = FALSE;
+    hangul_string_init(&hic->preedit_string);
+    hangul_string_init(&hic->commit_string);
+    hangul_string_init(&hic->flushed_string);
 
-    hic->option_auto_reorder = false;
-    hic->option_combi_on_double_stroke = false;
-    hic->option_non_choseong_combi = true;
+    hic->pool = NULL;
+    hic->next_free = NULL;
 
-    hangul_ic_set_output_mode(hic, HANGUL_OUTPUT_SYLLABLE);
+    hangul_ic_init(hic);
     hangul_ic_select_keyboard(hic, keyboard);
 
-    hangul_buffer_clear(&hic->buffer);
-
     return hic;
 }
 
@@ -1545,6 +2552,9 @@ hangul_ic_new(const char* keyboard)
  * 이 함수로 메모리해제를 해야 한다.
  * 메모리 해제 과정에서 상태 변화는 일어나지 않으므로 마지막 입력된 
  * 조합중이던 내용은 사라지게 된다.
+ *
+ * hangul_ic_pool_new_ic() 함수로 만든 것이면 메모리를 해제하지 않고
+ * 다시 쓸 수 있도록 그 pool에 돌려준다.
  */
 void
 hangul_ic_delete(HangulInputContext *hic)
@@ -1552,9 +2562,195 @@ hangul_ic_delete(HangulInputContext *hic)
     if (hic == NULL)
 	return;
 
+    hangul_automaton_delete(hic->automaton);
+    hic->automaton = NULL;
+
+    if (hic->pool != NULL) {
+	/* 스트링이 늘려 놓은 버퍼는 다음에 다시 쓴다. */
+	hic->next_free = hic->pool->free_list;
+	hic->pool->free_list = hic;
+	return;
+    }
+
+    hangul_string_free(&hic->preedit_string);
+    hangul_string_free(&hic->commit_string);
+    hangul_string_free(&hic->flushed_string);
+
     free(hic);
 }
 
+/**
+ * @ingroup hangulic
+ * @brief @ref HangulInputContext 를 모아서 관리하는 pool을 생성한다.
+ * @param slab_size 한번에 할당할 @ref HangulInputContext 의 개수,
+ *	0이면 기본값(64)을 사용한다.
+ * @return 새로 생성된 pool, 메모리가 모자라면 NULL
+ *
+ * 많은 수의 @ref HangulInputContext 를 만들고 지우는 프로그램을 위한
+ * pool을 생성한다. hangul_ic_pool_new_ic() 함수는 @a slab_size 개씩 한번에
+ * 할당한 메모리에서 @ref HangulInputContext 를 꺼내주고, hangul_ic_delete()
+ * 함수로 지운 것은 메모리를 해제하지 않고 다시 쓴다. 또 최근에 사용한
+ * 자판 id를 기억해서 매번 자판 목록을 찾지 않는다.
+ *
+ * pool은 thread safe하지 않으므로 한 pool과 그 pool에서 만든
+ * @ref HangulInputContext 의 생성과 삭제는 한 thread에서만 해야 한다.
+ * 더이상 사용하지 않을 때에는 hangul_ic_pool_delete() 함수로 삭제해야 한다.
+ */
+HangulInputContextPool*
+hangul_ic_pool_new(unsigned int slab_size)
+{
+    HangulInputContextPool* pool;
+
+    pool = malloc(sizeof(HangulInputContextPool));
+    if (pool == NULL)
+	return NULL;
+
+    if (slab_size == 0)
+	slab_size = HANGUL_IC_POOL_SLAB_SIZE;
+
+    pool->slab_size = slab_size;
+    pool->slabs = NULL;
+    pool->free_list = NULL;
+    pool->keyboards_serial = hangul_keyboard_list_get_serial();
+    pool->next_keyboard = 0;
+    memset(pool->keyboards, 0, sizeof(pool->keyboards));
+
+    return pool;
+}
+
+/**
+ * @ingroup hangulic
+ * @brief pool과 그 pool에서 만든 모든 @ref HangulInputContext 를 삭제한다.
+ * @param pool hangul_ic_pool_new() 함수로 만든 pool
+ *
+ * 아직 hangul_ic_delete() 함수로 지우지 않은 것까지 포함해서 @a pool 에서
+ * 만든 @ref HangulInputContext 의 메모리를 모두 해제한다. 이 함수를 부른
+ * 뒤에는 그 @ref HangulInputContext 들을 사용해서는 안된다.
+ */
+void
+hangul_ic_pool_delete(HangulInputContextPool* pool)
+{
+    HangulInputContextSlab* slab;
+    HangulInputContextSlab* next;
+    unsigned int i;
+
+    if (pool == NULL)
+	return;
+
+    for (slab = pool->slabs; slab != NULL; slab = next) {
+	next = slab->next;
+	for (i = 0; i < slab->n; i++) {
+	    HangulInputContext* hic = &slab->contexts[i];
+	    hangul_string_free(&hic->preedit_string);
+	    hangul_string_free(&hic->commit_string);
+	    hangul_string_free(&hic->flushed_string);
+	    hangul_automaton_delete(hic->automaton);
+	}
+	free(slab);
+    }
+
+    free(pool);
+}
+
+static bool
+hangul_ic_pool_grow(HangulInputContextPool* pool)
+{
+    HangulInputContextSlab* slab;
+    unsigned int i;
+
+    slab = malloc(sizeof(HangulInputContextSlab) +
+		  sizeof(HangulInputContext) * pool->slab_size);
+    if (slab == NULL)
+	return false;
+
+    slab->n = pool->slab_size;
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+
+    /* 앞의 것부터 꺼내도록 뒤에서부터 free list에 넣는다. */
+    for (i = slab->n; i > 0; i--) {
+	HangulInputContext* hic = &slab->contexts[i - 1];
+	hangul_string_init(&hic->preedit_string);
+	hangul_string_init(&hic->commit_string);
+	hangul_string_init(&hic->flushed_string);
+	hic->automaton = NULL;
+	hic->pool = pool;
+	hic->next_free = pool->free_list;
+	pool->free_list = hic;
+    }
+
+    return true;
+}
+
+static const HangulKeyboard*
+hangul_ic_pool_get_keyboard(HangulInputContextPool* pool, const char* id)
+{
+    const HangulKeyboard* keyboard;
+    unsigned int serial;
+    unsigned int i;
+
+    if (id == NULL)
+	id = "2";
+
+    /* 자판이 등록되거나 해제되면 찾아둔 포인터는 쓸 수 없다. */
+    serial = hangul_keyboard_list_get_serial();
+    if (serial != pool->keyboards_serial) {
+	memset(pool->keyboards, 0, sizeof(pool->keyboards));
+	pool->keyboards_serial = serial;
+	pool->next_keyboard = 0;
+    }
+
+    for (i = 0; i < HANGUL_IC_POOL_NKEYBOARDS; i++) {
+	if (pool->keyboards[i].keyboard != NULL &&
+	    strcmp(pool->keyboards[i].id, id) == 0)
+	    return pool->keyboards[i].keyboard;
+    }
+
+    keyboard = hangul_keyboard_list_get_keyboard(id);
+    if (keyboard != NULL && strlen(id) < HANGUL_IC_POOL_ID_LEN) {
+	i = pool->next_keyboard;
+	strcpy(pool->keyboards[i].id, id);
+	pool->keyboards[i].keyboard = keyboard;
+	pool->next_keyboard = (i + 1) % HANGUL_IC_POOL_NKEYBOARDS;
+    }
+
+    return keyboard;
+}
+
+/**
+ * @ingroup hangulic
+ * @brief pool에서 @ref HangulInputContext 오브젝트를 꺼낸다.
+ * @param pool hangul_ic_pool_new() 함수로 만든 pool
+ * @param keyboard 사용하고자 하는 키보드, 사용 가능한 값에 대해서는
+ *	hangul_ic_select_keyboard() 함수 설명을 참조한다.
+ * @return @ref HangulInputContext 에 대한 포인터, 메모리가 모자라면 NULL
+ *
+ * hangul_ic_new() 함수와 같은 상태의 @ref HangulInputContext 를 @a pool 에서
+ * 꺼내준다. 다 쓴 것은 hangul_ic_delete() 함수로 pool에 돌려줄 수 있다.
+ * pool에 남은 것이 없으면 hangul_ic_pool_new()에서 지정한 개수만큼 새로
+ * 할당한다.
+ */
+HangulInputContext*
+hangul_ic_pool_new_ic(HangulInputContextPool* pool, const char* keyboard)
+{
+    HangulInputContext* hic;
+
+    if (pool == NULL)
+	return NULL;
+
+    if (pool->free_list == NULL && !hangul_ic_pool_grow(pool))
+	return NULL;
+
+    hic = pool->free_list;
+    pool->free_list = hic->next_free;
+    hic->next_free = NULL;
+
+    hangul_ic_init(hic);
+    hangul_ic_set_keyboard(hic, hangul_ic_pool_get_keyboard(pool, keyboard));
+
+    return hic;
+}
+
 /** @deprecated 이 함수 대신 @ref hangul_keyboard_list_get_count 를 사용하라 */
 unsigned int
 hangul_ic_get_n_keyboards()
@@ -39,5 +39,6 @@ int hangul_keyboard_list_init(const char* user_defined_keyboard_path);
 int hangul_keyboard_list_fini();
 
 const HangulKeyboard* hangul_keyboard_list_get_keyboard(const char* id);
+unsigned int hangul_keyboard_list_get_serial();
 
 #endif /* libhangul_hangulinternals_h */
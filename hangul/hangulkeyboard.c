@@ -98,6 +98,8 @@ typedef struct _HangulKeyboardList {
     size_t n;
     size_t nalloced;
     HangulKeyboard** keyboards;
+    /* 목록이 바뀔 때마다 증가한다. */
+    unsigned int serial;
 } HangulKeyboardList;
 
 #include "hangulkeyboard.h"
@@ -224,7 +226,7 @@ static const HangulKeyboard* hangul_builtin_keyboards[] = {
 };
 static const unsigned int hangul_builtin_keyboard_count = countof(hangul_builtin_keyboards);
 
-static HangulKeyboardList hangul_keyboards = { 0, 0, NULL };
+static HangulKeyboardList hangul_keyboards = { 0, 0, NULL, 0 };
 
 typedef struct _HangulKeyboardLoadContext {
     const char* path_stack[64];
@@ -895,6 +897,7 @@ hangul_keyboard_list_clear()
     hangul_keyboards.n = 0;
     hangul_keyboards.nalloced = 0;
     hangul_keyboards.keyboards = NULL;
+    hangul_keyboards.serial++;
 }
 
 #if ENABLE_EXTERNAL_KEYBOARDS
@@ -1160,6 +1163,14 @@ hangul_keyboard_list_get_keyboard_name(unsigned index_)
     return keyboard->name;
 }
 
+/* 자판 목록이 바뀌었는지 확인하기 위한 값을 리턴한다. 이 값이 같으면
+ * hangul_keyboard_list_get_keyboard()로 찾은 자판을 계속 쓸 수 있다. */
+unsigned int
+hangul_keyboard_list_get_serial()
+{
+    return hangul_keyboards.serial;
+}
+
 /**
  * @ingroup hangulkeyboards
  * @brief libhangul에서 제공하는 자판의 HangulKeyboard 포인터를 구하는 함수
@@ -1205,6 +1216,7 @@ hangul_keyboard_list_append(HangulKeyboard* keyboard)
     size_t i = hangul_keyboards.n;
     hangul_keyboards.keyboards[i] = keyboard;
     hangul_keyboards.n = i + 1;
+    hangul_keyboards.serial++;
 
     return true;
 }
@@ -1263,6 +1275,7 @@ hangul_keyboard_list_unregister_keyboard(const char* id)
 
     hangul_keyboards.keyboards[i - 1] = NULL;
     hangul_keyboards.n--;
+    hangul_keyboards.serial++;
 
     return keyboard;
 }
@@ -26,17 +26,25 @@
 #include <unistd.h>
 #else
 #include <io.h>
+#include <windows.h>
 #define strtok_r strtok_s
 #endif
 
 #ifdef HAVE_MMAP
+#include <fcntl.h>
 #include <sys/mman.h>
 #endif
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 #include <limits.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "hangul.h"
 #include "hangulinternals.h"
@@ -152,33 +160,200 @@
  */
 
 typedef struct _HanjaIndex     HanjaIndex;
+typedef struct _HanjaData      HanjaData;
+typedef struct _HanjaBuffer    HanjaBuffer;
+typedef struct _HanjaPosting   HanjaPosting;
+typedef struct _HanjaPostingIndex HanjaPostingIndex;
+typedef struct _HanjaBuilder   HanjaBuilder;
+typedef struct _HanjaBuilderValue HanjaBuilderValue;
+typedef struct _HanjaListRun   HanjaListRun;
+typedef struct _HanjaPrefetch  HanjaPrefetch;
+typedef struct _HanjaPageIndex HanjaPageIndex;
 
 typedef struct _HanjaPair      HanjaPair;
 typedef struct _HanjaPairArray HanjaPairArray;
+typedef struct _HanjaJosaNode  HanjaJosaNode;
 
+/* 사전의 엔트리 하나.
+ * 키와 값은 HanjaData의 컬럼에 모아두고, 이 오브젝트의 주소에서의 상대적인
+ * 위치로 참조한다. 설명은 대부분의 검색에서 쓰이지 않으므로 메모리에
+ * 올리지 않고, hanja_get_comment()를 부를때 파일에서 읽는다. */
 struct _Hanja {
     uint32_t key_offset;
     uint32_t value_offset;
-    uint32_t comment_offset;
+    uint32_t ucs4_key_offset;
+    uint32_t ucs4_value_offset;
+    uint32_t line_offset;
+    uint32_t id;
+};
+
+/* 검색 결과 중에서 entries 배열의 연속된 구간 하나.
+ * start는 리스트 전체에서 이 구간의 첫 아이템의 위치다. */
+struct _HanjaListRun {
+    const Hanja* first;
+    size_t       start;
+    size_t       n;
 };
 
+/* 검색 결과는 아이템 하나하나가 아니라 entries 배열의 구간(run)으로
+ * 기억한다. 구간이 하나뿐이면 runs는 따로 할당하지 않고 run을 가리킨다.
+ * 구간이 가리키는 데이터 블럭은 blocks에 두고 reference를 가지고 있다가
+ * 리스트를 free할 때 놓는다. 그래서 사전을 free하거나 패치를 적용한
+ * 뒤에도 리스트의 엔트리는 그대로 쓸 수 있다. */
 struct _HanjaList {
     char*         key;
+    char*         josa;
     size_t        len;
+    size_t        nruns;
     size_t        alloc;
-    const Hanja** items; 
+    HanjaListRun* runs;
+    HanjaListRun  run;
+    HanjaData**   blocks;
+    HanjaData*    block;
+    size_t        nblocks;
 };
 
+/* 사전의 키 하나에 대한 인덱스.
+ * 키는 정규화하여 HanjaTable의 keys 버퍼에 16비트 단위로 인코딩해서
+ * 저장하고(hanja_key_encode() 참조), 그 키에 해당하는
+ * 엔트리들 중 첫번째 엔트리의 번호와 엔트리의 갯수를 기억한다.
+ * 같은 키의 엔트리는 entries 배열에 연속으로 있다. */
 struct _HanjaIndex {
-    unsigned offset;
-    char     key[8];
+    uint32_t key;
+    uint32_t entry;
+    uint32_t n;
+};
+
+/* 엔트리와 컬럼을 한 블럭에 할당한다.
+ * entries 배열 뒤에 UCS-4 키, UCS-4 값, UTF-8 키, UTF-8 값 컬럼이
+ * 차례로 온다. Hanja 오브젝트에서 table을 찾을 수 있도록 맨 앞에
+ * table 포인터를 둔다.
+ * 블럭은 그것을 가진 사전과 블럭의 엔트리를 가리키는 검색 결과가 하나씩
+ * reference를 가지고, 마지막 reference를 놓을 때 free한다. 블럭은 설명을
+ * 읽을 수 있도록 table의 reference를 가지고 있다. */
+struct _HanjaData {
+    HanjaTable* table;
+    unsigned    refcount;
+    Hanja       entries[];
 };
 
 struct _HanjaTable {
     HanjaIndex*    keytable;
     unsigned       nkeys;
-    unsigned       key_size;
+    uint16_t*      keys;
+    uint64_t*      bloom;
+    uint32_t       bloom_mask;
+    uint32_t*      syllables;
+    HanjaData*     data;
+    unsigned       nentries;
+    char**         comments;
+    ucschar**      ucs4_comments;
+    HanjaPostingIndex* comment_index;
+    HanjaPostingIndex* value_index;
+    HanjaTable*    overlay;
+    HanjaPrefetch* prefetch;
+    HanjaPageIndex* pages;
     FILE*          file;
+
+    /* 통계 */
+    size_t         keys_size;
+    size_t         data_size;
+    size_t         comment_bytes;
+    uint64_t       load_time_ns;
+    uint64_t       nlookups;
+    uint64_t       nmisses;
+    uint64_t       bytes_read;
+    uint64_t       nprefetch_hits;
+
+    /* 검색 결과가 이 사전의 엔트리를 가지고 있는 동안에는 free하지 않는다.
+     * overlay처럼 다른 사전의 파일을 같이 쓰면 parent가 그 사전이다.
+     * hanja_table_compact()는 이 앞의 필드만 바꾸므로 맨 뒤에 둔다. */
+    HanjaTable*    parent;
+    unsigned       refcount;
+};
+
+/* inverted index의 항목 하나.
+ * 글자 하나(unigram) 또는 연속된 두 글자(bigram)에 대해서 그것이 나오는
+ * 엔트리 번호의 목록(posting list)을 가진다. posting list는 이전 번호와의
+ * 차이를 varint로 인코딩해서 HanjaPostingIndex의 data에 저장한다. */
+struct _HanjaPosting {
+    uint64_t gram;
+    uint32_t offset;
+    uint32_t n;
+};
+
+struct _HanjaPostingIndex {
+    HanjaPosting*  postings;
+    unsigned       npostings;
+    unsigned char* data;
+    size_t         data_len;
+};
+
+/* 메모리 예산이 작을 때 쓰는 sparse index.
+ * 정렬된 키를 interval개씩 묶어서 페이지로 나누고, 페이지마다 첫 키와
+ * 그 키가 파일에서 시작하는 위치만 기억한다. 엔트리는 검색할 때 그
+ * 페이지의 줄을 파일에서 읽어서 만든다. 키는 정규화한 키를 UTF-8로
+ * 저장한다. UTF-8의 바이트 순서는 코드 순서와 같다. */
+struct _HanjaPageIndex {
+    unsigned  npages;
+    unsigned  interval;
+    unsigned  nkeys;
+    unsigned  nentries;
+    uint32_t* offsets;
+    uint32_t* key_offsets;
+    char*     keys;
+    size_t    keys_size;
+};
+
+struct _HanjaBuffer {
+    char*  data;
+    size_t len;
+    size_t alloc;
+};
+
+/* 값 컬럼에 넣은 값 하나의 위치. offset이 UINT32_MAX면 빈 슬롯이다. */
+struct _HanjaBuilderValue {
+    uint32_t offset;
+    uint32_t ucs4_offset;
+};
+
+/* 엔트리를 하나씩 받아서 HanjaTable의 인덱스와 데이터 블럭을 만든다.
+ * 키와 값을 각각의 컬럼에 모으고, 정규화한 키로 인덱스를 만든다.
+ * 같은 값은 여러 키에 나오므로(樂은 락, 낙, 악, 요) values 해시 테이블로
+ * 한번만 저장하고 엔트리는 그 위치를 공유한다.
+ * 설명은 보통 파일에서 읽으므로 메모리에 있는 설명이 주어질 때만
+ * comments를 채운다. */
+struct _HanjaBuilder {
+    HanjaBuffer index;
+    HanjaBuffer key_pool;
+    HanjaBuffer entries;
+    HanjaBuffer keys_column;
+    HanjaBuffer values_column;
+    HanjaBuffer ucs4_keys_column;
+    HanjaBuffer ucs4_values_column;
+    HanjaBuffer comments;
+    size_t      comment_bytes;
+    Hanja       entry;
+    unsigned    nkeys;
+    unsigned    nentries;
+    bool        unsorted;
+    bool        inline_comments;
+    HanjaBuilderValue* values;
+    size_t      values_mask;
+    size_t      nvalues;
+};
+
+typedef struct _HanjaKeyIter   HanjaKeyIter;
+
+/* 키를 정규화하면서 한 글자씩 읽어가는 iterator.
+ * 원본 스트링은 UTF-8(p)이나 UCS-4(s) 중 하나로 주어진다.
+ * 한 음절을 이루는 자모 클러스터는 buf에 변환해 두고 하나씩 돌려준다. */
+struct _HanjaKeyIter {
+    const char*    p;
+    const ucschar* s;
+    ucschar        buf[16];
+    int            len;
+    int            pos;
 };
 
 struct _HanjaPair {
@@ -191,7 +366,53 @@ struct _HanjaPairArray {
     const HanjaPair* pairs;
 };
 
+struct _HanjaJosaNode {
+    ucschar  c;
+    uint16_t child;
+    uint8_t  nchild;
+    uint8_t  final;
+};
+
 #include "hanjacompatible.h"
+#include "hanjajosa.h"
+
+static const ucschar syllable_base = 0xac00;
+static const unsigned nsyllables   = 11172;
+
+/* 통계 카운터는 검색할 때마다 더한다. prefetch 쓰레드와 검색이 동시에
+ * 더해도 빠지지 않도록 atomic하게 더하고, 다른 메모리와의 순서는 필요
+ * 없으므로 relaxed로 한다. GCC 호환 컴파일러가 아니면 volatile로 더하므로
+ * 동시에 더한 값이 빠질 수 있다. */
+#if defined(__GNUC__)
+#define hanja_counter_add(counter, n) \
+    __atomic_fetch_add((counter), (n), __ATOMIC_RELAXED)
+#define hanja_counter_get(counter) \
+    __atomic_load_n((counter), __ATOMIC_RELAXED)
+#else
+#define hanja_counter_add(counter, n) (*(volatile uint64_t*)(counter) += (n))
+#define hanja_counter_get(counter)    (*(volatile const uint64_t*)(counter))
+#endif
+
+/* 처음 부를 때 채워 넣는 포인터(설명 캐시)는 lock 없이 읽으므로 가리키는
+ * 내용을 다 만든 뒤에 보이도록 release로 쓰고 acquire로 읽는다. */
+#if defined(__GNUC__)
+#define hanja_pointer_get(ptr)      __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define hanja_pointer_set(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#else
+#define hanja_pointer_get(ptr)      (*(ptr))
+#define hanja_pointer_set(ptr, val) (*(ptr) = (val))
+#endif
+
+/* 엔트리 블럭과 사전은 검색 결과가 같이 가지고 있으므로 reference count를
+ * 쓴다. 다른 쓰레드에서 검색 결과를 free할 수 있으므로 atomic하게 세고,
+ * 마지막으로 놓는 쪽이 앞에서 쓴 내용을 볼 수 있도록 acq_rel로 뺀다. */
+#if defined(__GNUC__)
+#define hanja_ref_inc(ref) __atomic_fetch_add((ref), 1, __ATOMIC_RELAXED)
+#define hanja_ref_dec(ref) (__atomic_sub_fetch((ref), 1, __ATOMIC_ACQ_REL) == 0)
+#else
+#define hanja_ref_inc(ref) (++*(ref))
+#define hanja_ref_dec(ref) (--*(ref) == 0)
+#endif
 
 static const char utf8_skip_table[256] = {
     1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
@@ -232,352 +453,4734 @@ static inline char* utf8_prev(const char *str, const char *p)
     return (char*)p;
 }
 
-/* hanja searching functions */
-static Hanja *
-hanja_new(const char *key, const char *value, const char *comment)
+static inline ucschar
+utf8_get_char(const char *p)
 {
-    Hanja* hanja;
-    size_t size;
-    size_t keylen;
-    size_t valuelen;
-    size_t commentlen;
-    char*  p;
-
-    keylen = strlen(key) + 1;
-    valuelen = strlen(value) + 1;
-    if (comment != NULL)
-	commentlen = strlen(comment) + 1;
-    else
-	commentlen = 1;
+    const unsigned char* s = (const unsigned char*)p;
+    int n = utf8_char_len(p);
+    ucschar c;
+    int i;
 
-    size = sizeof(*hanja) + keylen + valuelen + commentlen;
-    hanja = malloc(size);
-    if (hanja == NULL)
-	return NULL;
-
-    p = (char*)hanja + sizeof(*hanja);
-    strcpy(p, key);
-    p += keylen;
-    strcpy(p, value);
-    p += valuelen;
-    if (comment != NULL)
-	strcpy(p, comment);
-    else
-	*p = '\0';
-    p += valuelen;
+    switch (n) {
+    case 1:
+	return s[0];
+    case 2:
+	c = s[0] & 0x1f;
+	break;
+    case 3:
+	c = s[0] & 0x0f;
+	break;
+    default:
+	c = s[0] & 0x07;
+	break;
+    }
 
-    hanja->key_offset     = sizeof(*hanja);
-    hanja->value_offset   = sizeof(*hanja) + keylen;
-    hanja->comment_offset = sizeof(*hanja) + keylen + valuelen;
+    for (i = 1; i < n; i++) {
+	if ((s[i] & 0xc0) != 0x80)
+	    return s[0];
+	c = (c << 6) | (s[i] & 0x3f);
+    }
 
-    return hanja;
+    return c;
 }
 
-static void
-hanja_delete(Hanja* hanja)
+static inline int
+utf8_put_char(char *buf, ucschar c)
 {
-    free(hanja);
+    unsigned char* s = (unsigned char*)buf;
+
+    if (c < 0x80) {
+	s[0] = c;
+	return 1;
+    } else if (c < 0x800) {
+	s[0] = 0xc0 | (c >> 6);
+	s[1] = 0x80 | (c & 0x3f);
+	return 2;
+    } else if (c < 0x10000) {
+	s[0] = 0xe0 | (c >> 12);
+	s[1] = 0x80 | ((c >> 6) & 0x3f);
+	s[2] = 0x80 | (c & 0x3f);
+	return 3;
+    }
+
+    s[0] = 0xf0 | (c >> 18);
+    s[1] = 0x80 | ((c >> 12) & 0x3f);
+    s[2] = 0x80 | ((c >> 6) & 0x3f);
+    s[3] = 0x80 | (c & 0x3f);
+    return 4;
 }
 
-/**
- * @ingroup hanjadictionary
- * @brief @ref Hanja 의 키를 찾아본다.
- * @return @a hanja 오브젝트의 키, UTF-8
+/*
+ * 키 정규화
  *
- * 일반적으로 @ref Hanja 아이템의 키는 한글이다.
- * 리턴되는 스트링은 @a hanja 오브젝트 내부적으로 관리하는 데이터로
- * 수정하거나 free 되어서는 안된다.
+ * preedit 스트링은 HANGUL_OUTPUT_JAMO 모드에서는 첫가끝 자모로, 그렇지
+ * 않으면 음절이나 호환 자모로 전달된다. 같은 키를 어떤 형태로 주더라도
+ * 같은 엔트리를 찾을 수 있도록 사전의 키와 검색어를 다음 규칙으로
+ * 정규화해서 비교한다.
+ *
+ *  - 한 음절을 이루는 자모 클러스터가 현대 한글 음절로 조합되면 음절로
+ *    바꾼다. (hangul_jamos_to_syllables() 참조)
+ *  - 채움 문자를 제외하고 자모 하나로만 된 클러스터는 호환 자모로 바꾼다.
+ *    예) "ᄀᅠ" -> "ㄱ"
+ *  - 그 외의 클러스터(옛한글 등)와 다른 글자는 그대로 둔다.
+ *
+ * 사전의 키는 인덱스를 만들 때 정규화해 두고, 검색어는 검색을 시작할 때
+ * 한번 정규화해서 인덱스의 키와 같은 형태로 인코딩한 다음 비교한다.
+ * (hanja_key_encode_query() 참조)
  */
-const char*
-hanja_get_key(const Hanja* hanja)
+static inline bool
+hanja_key_is_hangul(ucschar c)
 {
-    if (hanja != NULL) {
-	const char* p  = (const char*)hanja;
-	return p + hanja->key_offset;
-    }
-    return NULL;
+    return hangul_is_syllable(c) || hangul_is_jamo(c);
 }
 
-/**
- * @ingroup hanjadictionary
- * @brief @ref Hanja 의 값을 찾아본다.
- * @return @a hanja 오브젝트의 값, UTF-8
- *
- * 일반적으로 @ref Hanja 아이템의 값은 key에 대응되는 한자다.
- * 리턴되는 스트링은 @a hanja 오브젝트 내부적으로 관리하는 데이터로
- * 수정하거나 free되어서는 안된다.
- */
-const char*
-hanja_get_value(const Hanja* hanja)
+static void
+hanja_key_iter_init(HanjaKeyIter* iter, const char* p, const ucschar* s)
 {
-    if (hanja != NULL) {
-	const char* p  = (const char*)hanja;
-	return p + hanja->value_offset;
-    }
-    return NULL;
+    iter->p = p;
+    iter->s = s;
+    iter->len = 0;
+    iter->pos = 0;
 }
 
-/**
- * @ingroup hanjadictionary
- * @brief @ref Hanja 의 설명을 찾아본다.
- * @return @a hanja 오브젝트의 comment 필드, UTF-8
- *
- * 일반적으로 @ref Hanja 아이템의 설명은 한글과 그 한자에 대한 설명이다.
- * 파일에 따라서 내용이 없을 수 있다.
- * 리턴되는 스트링은 @a hanja 오브젝트 내부적으로 관리하는 데이터로
- * 수정하거나 free되어서는 안된다.
- */
-const char*
-hanja_get_comment(const Hanja* hanja)
+static inline ucschar
+hanja_key_iter_peek(const HanjaKeyIter* iter)
 {
-    if (hanja != NULL) {
-	const char* p  = (const char*)hanja;
-	return p + hanja->comment_offset;
-    }
-    return NULL;
+    if (iter->s != NULL)
+	return *iter->s;
+    return utf8_get_char(iter->p);
 }
 
-static HanjaList *
-hanja_list_new(const char *key)
+static inline void
+hanja_key_iter_skip(HanjaKeyIter* iter)
 {
-    HanjaList *list;
+    if (iter->s != NULL)
+	iter->s++;
+    else
+	iter->p = utf8_next(iter->p);
+}
 
-    list = malloc(sizeof(*list));
-    if (list == NULL)
-	return NULL;
+/* 원본 스트링에서 한 글자 또는 한 음절 클러스터를 읽어서 정규화한 결과를
+ * buf에 채운다. 정규화한 결과가 빈 스트링일 수도 있다. */
+static void
+hanja_key_iter_fill(HanjaKeyIter* iter)
+{
+    ucschar cluster[16];
+    const char* next_p[16];
+    const ucschar* next_s[16];
+    ucschar jamos[N_ELEMENTS(cluster) + 2];
+    ucschar c;
+    int n, m, i;
+    int njamos;
+    int nsyllables;
+    ucschar single;
+    int nsingle;
 
-    list->key = strdup(key);
-    if (list->key == NULL) {
-	free(list);
-	return NULL;
-    }
+    iter->len = 0;
+    iter->pos = 0;
 
-    list->len = 0;
-    list->alloc = 1;
-    list->items = malloc(list->alloc * sizeof(list->items[0]));
-    if (list->items == NULL) {
-	free(list->key);
-	free(list);
-	return NULL;
+    c = hanja_key_iter_peek(iter);
+    hanja_key_iter_skip(iter);
+    if (!hanja_key_is_hangul(c)) {
+	iter->buf[iter->len++] = c;
+	return;
     }
 
-    return list;
-}
+    /* 대부분의 키는 음절로만 되어 있으므로 바로 처리한다. */
+    if (hangul_is_syllable(c)) {
+	ucschar d = hanja_key_iter_peek(iter);
+	if (!hangul_is_jungseong(d) && !hangul_is_jongseong(d)) {
+	    iter->buf[iter->len++] = c;
+	    return;
+	}
+    }
 
-static void
-hanja_list_reserve(HanjaList* list, size_t n)
-{
-    size_t size = list->alloc;
+    cluster[0] = c;
+    next_p[0] = iter->p;
+    next_s[0] = iter->s;
+    n = 1;
+    while (n < N_ELEMENTS(cluster)) {
+	c = hanja_key_iter_peek(iter);
+	if (!hanja_key_is_hangul(c))
+	    break;
+	hanja_key_iter_skip(iter);
+	cluster[n] = c;
+	next_p[n] = iter->p;
+	next_s[n] = iter->s;
+	n++;
+    }
 
-    if (n > SIZE_MAX / sizeof(list->items[0]) - list->len)
-	return;
+    m = hangul_syllable_len(cluster, n);
+    iter->p = next_p[m - 1];
+    iter->s = next_s[m - 1];
 
-    while (size < list->len + n)
-	size *= 2;
+    /* 음절 뒤에 자모가 붙어 있는 경우도 조합할 수 있도록 음절은 자모로
+     * 분해한 후에 다시 조합한다. */
+    njamos = 0;
+    nsingle = 0;
+    single = 0;
+    for (i = 0; i < m; i++) {
+	if (hangul_is_syllable(cluster[i])) {
+	    ucschar cho, jung, jong;
+	    hangul_syllable_to_jamo(cluster[i], &cho, &jung, &jong);
+	    jamos[njamos++] = cho;
+	    jamos[njamos++] = jung;
+	    if (jong != 0)
+		jamos[njamos++] = jong;
+	    nsingle += 2;
+	} else {
+	    jamos[njamos++] = cluster[i];
+	    if (cluster[i] != HANGUL_CHOSEONG_FILLER &&
+		cluster[i] != HANGUL_JUNGSEONG_FILLER) {
+		single = cluster[i];
+		nsingle++;
+	    }
+	}
+    }
 
-    if (size > SIZE_MAX / sizeof(list->items[0]))
+    nsyllables = hangul_jamos_to_syllables(iter->buf, N_ELEMENTS(iter->buf),
+					   jamos, njamos);
+    if (nsyllables == 1 && hangul_is_syllable(iter->buf[0])) {
+	iter->len = 1;
 	return;
+    }
 
-    if (list->alloc < list->len + n) {
-	const Hanja** data;
+    if (nsingle == 0)
+	return;
 
-	data = realloc(list->items, size * sizeof(list->items[0]));
-	if (data != NULL) {
-	    list->alloc = size;
-	    list->items = data;
+    if (nsingle == 1) {
+	c = hangul_jamo_to_cjamo(single);
+	if (hangul_is_cjamo(c)) {
+	    iter->buf[iter->len++] = c;
+	    return;
 	}
     }
+
+    for (i = 0; i < m; i++)
+	iter->buf[iter->len++] = cluster[i];
 }
 
-static void
-hanja_list_append_n(HanjaList* list, const Hanja* hanja, int n)
+/* 정규화된 다음 글자를 돌려준다. 스트링의 끝이면 0을 리턴한다. */
+static ucschar
+hanja_key_iter_next(HanjaKeyIter* iter)
 {
-    hanja_list_reserve(list, n);
+    while (iter->pos >= iter->len) {
+	const char* p = iter->p;
+	const ucschar* s = iter->s;
+	ucschar c = hanja_key_iter_peek(iter);
 
-    if (list->alloc >= list->len + n) {
-	unsigned int i;
-	for (i = 0; i < n ; i++)
-	    list->items[list->len + i] = hanja + i;
-	list->len += n;
-    }
-}
+	if (c == 0)
+	    return 0;
 
-static void
-hanja_table_match(const HanjaTable* table,
-		  const char* key, HanjaList** list)
-{
-    int low, high, mid;
-    int res = -1;
+	/* 한글이 아닌 글자와 뒤에 자모가 붙지 않은 음절은 정규화할 필요가
+	 * 없으므로 buf를 거치지 않는다. 대부분의 키가 여기에 해당한다. */
+	if (c < 0x1100) {
+	    hanja_key_iter_skip(iter);
+	    return c;
+	}
 
-    low = 0;
-    high = table->nkeys - 1;
+	if (c >= 0xac00 && c <= 0xd7a3) {
+	    ucschar d;
 
-    while (low < high) {
-	mid = (low + high) / 2;
-	res = strncmp(table->keytable[mid].key, key, table->key_size);
-	if (res < 0) {
-	    low = mid + 1;
-	} else if (res > 0) {
-	    high = mid - 1;
-	} else {
-	    break;
+	    hanja_key_iter_skip(iter);
+	    d = hanja_key_iter_peek(iter);
+	    if (!(d >= 0x1160 && d <= 0x11ff) && !(d >= 0xd7b0 && d <= 0xd7fb))
+		return c;
+
+	    iter->p = p;
+	    iter->s = s;
 	}
-    }
 
-    if (res != 0) {
-	mid = low;
-	res = strncmp(table->keytable[mid].key, key, table->key_size);
+	hanja_key_iter_fill(iter);
     }
 
-    if (res == 0) {
-	unsigned offset;
-	char buf[512];
+    return iter->buf[iter->pos++];
+}
 
-	offset = table->keytable[mid].offset;
-	fseek(table->file, offset, SEEK_SET);
+/* 키의 다음 글자 위치를 구한다. 자모 클러스터는 한 글자로 취급한다. */
+static const ucschar*
+hanja_key_next(const ucschar* key)
+{
+    HanjaKeyIter iter;
 
-	while (fgets(buf, sizeof(buf), table->file) != NULL) {
-	    char* save = NULL;
-	    char* p = strtok_r(buf, ":", &save);
-	    res = strcmp(p, key);
-	    if (res == 0) {
-                if (*list == NULL) {
-                    *list = hanja_list_new(key);
-                }
+    hanja_key_iter_init(&iter, NULL, key);
+    hanja_key_iter_fill(&iter);
+    return iter.s;
+}
 
-                if (*list == NULL) {
-                    break;
-                }
+/* UTF-8 스트링 @a p 나 UCS-4 스트링 @a s 를 정규화하여 buf에 저장한다.
+ * 정규화된 키는 원래 키보다 글자수가 늘지 않으므로 buf는 원래 키의
+ * 글자수 + 1 만큼이면 충분하다. */
+static size_t
+hanja_key_normalize(ucschar* buf, const char* p, const ucschar* s)
+{
+    HanjaKeyIter iter;
+    ucschar c;
+    size_t len = 0;
 
-		char* value   = strtok_r(NULL, ":", &save);
-		char* comment = strtok_r(NULL, "\r\n", &save);
+    hanja_key_iter_init(&iter, p, s);
+    while ((c = hanja_key_iter_next(&iter)) != 0)
+	buf[len++] = c;
+    buf[len] = 0;
 
-		Hanja* hanja = hanja_new(p, value, comment);
+    return len;
+}
 
-		hanja_list_append_n(*list, hanja, 1);
-	    } else if (res > 0) {
-		break;
-	    }
-	}
+/* 정규화된 키 @a key 와 검색어를 비교한다. 검색어는 UTF-8 스트링 @a p 나
+ * UCS-4 스트링 @a s 로 주어지고, 비교하면서 정규화한다. */
+static int
+hanja_key_compare(const ucschar* key, const char* p, const ucschar* s)
+{
+    HanjaKeyIter iter;
+
+    hanja_key_iter_init(&iter, p, s);
+    while (true) {
+	ucschar a = *key;
+	ucschar b = hanja_key_iter_next(&iter);
+	if (a != b)
+	    return a < b ? -1 : 1;
+	if (a == 0)
+	    return 0;
+	key++;
     }
 }
 
-/**
- * @ingroup hanjadictionary
- * @brief 한자 사전 파일을 로딩하는 함수
- * @param filename 로딩할 사전 파일의 위치, 또는 NULL
- * @return 한자 사전 object 또는 NULL
- *
- * 이 함수는 한자 사전 파일을 로딩하는 함수로 @a filename으로 지정된 
- * 파일을 로딩한다. 한자 사전 파일은 libhangul에서 사용하는 포맷이어야 한다.
- * 한자 사전 파일의 포맷에 대한 정보는 HanjaTable을 참조한다.
- * 
- * @a filename은 locale에 따른 인코딩으로 되어 있어야 한다. UTF-8이 아닐 수
- * 있으므로 주의한다.
- * 
- * @a filename 에 NULL을 주면 libhangul에서 디폴트로 배포하는 사전을 로딩한다.
- * 파일이 없거나, 포맷이 맞지 않으면 로딩에 실패하고 NULL을 리턴한다.
- * 한자 사전이 더이상 필요없으면 hanja_table_delete() 함수로 삭제해야 한다.
- */
-HanjaTable*
-hanja_table_load(const char* filename)
+static size_t
+ucs4_strlen(const ucschar* s)
 {
-    unsigned nkeys;
-    char buf[512];
-    int key_size = 5;
-    char last_key[8] = { '\0', };
-    char* save_ptr = NULL;
-    char* key;
-    long offset;
-    unsigned i;
-    FILE* file;
-    HanjaIndex* keytable;
-    HanjaTable* table;
+    size_t len = 0;
+    while (s[len] != 0)
+	len++;
+    return len;
+}
 
-    if (filename == NULL)
-#ifdef LIBHANGUL_DEFAULT_HANJA_DIC
-	filename = LIBHANGUL_DEFAULT_HANJA_DIC;
-#else
-	return NULL;
-#endif /* LIBHANGUL_DEFAULT_HANJA_DIC */
+static int
+ucs4_strcmp(const ucschar* a, const ucschar* b)
+{
+    while (*a != 0 && *a == *b) {
+	a++;
+	b++;
+    }
 
-    file = fopen(filename, "r");
-    if (file == NULL) {
-	return NULL;
+    if (*a == *b)
+	return 0;
+    return *a < *b ? -1 : 1;
+}
+
+/*
+ * 키 인코딩
+ *
+ * 인덱스의 키는 거의 모두 한글 음절이므로 정규화한 키를 UCS-4 대신 16비트
+ * 단위로 저장한다. BMP의 글자는 코드를 그대로 한 단위로 저장하고, 그 밖의
+ * 글자는 HANJA_KEY_ESCAPE 뒤에 0이 아닌 두 단위로 나눠서 저장한다.
+ * U+FFFF는 escape 코드와 겹치므로 escape해서 저장한다. 인코딩한 단위열의
+ * 순서는 원래 코드의 순서와 같으므로 인덱스는 그대로 UCS-4 키의 순서로
+ * 정렬되고, 검색어를 한번만 인코딩하면 단위끼리 바로 비교할 수 있다.
+ */
+#define HANJA_KEY_ESCAPE    0xffff
+#define HANJA_KEY_MAX_UNITS 3
+
+static inline size_t
+hanja_key_put_char(uint16_t* buf, ucschar c)
+{
+    if (c < HANJA_KEY_ESCAPE) {
+	buf[0] = c;
+	return 1;
     }
 
-    nkeys = 0;
-    while (fgets(buf, sizeof(buf), file) != NULL) {
-	/* skip comments and empty lines */
-	if (buf[0] == '#' || buf[0] == '\r' || buf[0] == '\n' || buf[0] == '\0')
-	    continue;
+    buf[0] = HANJA_KEY_ESCAPE;
+    buf[1] = (c >> 15) + 1;
+    buf[2] = (c & 0x7fff) | 0x8000;
+    return 3;
+}
 
-	save_ptr = NULL;
-	key = strtok_r(buf, ":", &save_ptr);
+/* hanja_key_put_char()로 인코딩한 글자 하나를 읽는다. */
+static inline ucschar
+hanja_key_get_char(const uint16_t* p)
+{
+    if (p[0] != HANJA_KEY_ESCAPE)
+	return p[0];
 
-	if (key == NULL || strlen(key) == 0)
-	    continue;
+    return ((ucschar)(p[1] - 1) << 15) | (p[2] & 0x7fff);
+}
 
-	if (strncmp(last_key, key, key_size) != 0) {
-	    nkeys++;
-	    strncpy(last_key, key, key_size);
-	}
-    }
+/* 정규화한 UCS-4 키 @a key 를 인코딩한다. @a buf 는 글자수의
+ * HANJA_KEY_MAX_UNITS 배 + 1 만큼이면 충분하다. 리턴값은 0을 제외한
+ * 단위의 수다. */
+static size_t
+hanja_key_encode(uint16_t* buf, const ucschar* key)
+{
+    size_t len = 0;
 
-    rewind(file);
-    keytable = malloc(nkeys * sizeof(keytable[0]));
-    memset(keytable, 0, nkeys * sizeof(keytable[0]));
+    while (*key != 0)
+	len += hanja_key_put_char(buf + len, *key++);
+    buf[len] = 0;
 
-    i = 0;
-    offset = ftell(file);
-    while (fgets(buf, sizeof(buf), file) != NULL) {
-	/* skip comments and empty lines */
-	if (buf[0] == '#' || buf[0] == '\r' || buf[0] == '\n' || buf[0] == '\0')
-	    continue;
+    return len;
+}
 
-	save_ptr = NULL;
-	key = strtok_r(buf, ":", &save_ptr);
+/* 검색어를 정규화하면서 인코딩한다. 검색어는 UTF-8 스트링 @a p 나 UCS-4
+ * 스트링 @a s 로 주어진다. 결과가 @a n 단위의 @a buf 에 들어가지 않을 수
+ * 있으면 새로 할당하므로, 리턴값이 @a buf 가 아니면 free해야 한다.
+ * UTF-8에서 BMP 글자는 1바이트 이상, 그 밖의 글자는 4바이트이므로
+ * 인코딩한 단위 수는 바이트 수보다 많지 않다. */
+static uint16_t*
+hanja_key_encode_query(uint16_t* buf, size_t n, const char* p, const ucschar* s)
+{
+    HanjaKeyIter iter;
+    size_t size;
+    size_t len = 0;
+    ucschar c;
 
-	if (key == NULL || strlen(key) == 0)
-	    continue;
+    if (p != NULL)
+	size = strlen(p) + 1;
+    else
+	size = ucs4_strlen(s) * HANJA_KEY_MAX_UNITS + 1;
 
-	if (strncmp(last_key, key, key_size) != 0) {
-	    keytable[i].offset = offset;
-	    strncpy(keytable[i].key, key, key_size);
-	    strncpy(last_key, key, key_size);
-	    i++;
-	}
-	offset = ftell(file);
+    if (buf == NULL || size > n) {
+	buf = malloc(size * sizeof(buf[0]));
+	if (buf == NULL)
+	    return NULL;
     }
 
-    table = malloc(sizeof(*table));
-    if (table == NULL) {
-	free(keytable);
-	fclose(file);
-	return NULL;
-    }
+    hanja_key_iter_init(&iter, p, s);
+    while ((c = hanja_key_iter_next(&iter)) != 0)
+	len += hanja_key_put_char(buf + len, c);
+    buf[len] = 0;
 
-    table->keytable = keytable;
-    table->nkeys = nkeys;
-    table->key_size = key_size;
-    table->file = file;
+    return buf;
+}
 
-    return table;
+static int
+hanja_key_strcmp(const uint16_t* a, const uint16_t* b)
+{
+    while (*a != 0 && *a == *b) {
+	a++;
+	b++;
+    }
+
+    if (*a == *b)
+	return 0;
+    return *a < *b ? -1 : 1;
+}
+
+static size_t
+hanja_key_strlen(const uint16_t* key)
+{
+    size_t len = 0;
+    while (key[len] != 0)
+	len++;
+    return len;
+}
+
+/* 인코딩한 키의 해시값을 구한다. */
+static uint64_t
+hanja_key_hash(const uint16_t* key)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    while (*key != 0) {
+	h ^= *key++;
+	h *= 0x100000001b3ULL;
+    }
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+/*
+ * Bloom filter
+ *
+ * prefix, suffix 검색에서 만드는 키는 대부분 사전에 없는 키다. 이런 키를
+ * 인덱스를 검색하기 전에 걸러내기 위해서 모든 키에 대한 bloom filter를
+ * 만든다. 한번의 검색이 한 캐시 라인만 읽도록 64바이트 블럭 하나 안에서
+ * 비트를 확인하는 blocked bloom filter를 쓴다. 키 하나에 16비트를
+ * 쓰고 블럭 안에서 6개의 비트를 확인한다.
+ */
+#define HANJA_BLOOM_BLOCK_WORDS 8
+#define HANJA_BLOOM_BITS_PER_KEY 16
+#define HANJA_BLOOM_NPROBES 6
+
+static inline void
+hanja_bloom_probe(const HanjaTable* table, uint64_t h,
+		  uint64_t** block, unsigned* bits)
+{
+    unsigned i;
+
+    *block = table->bloom + ((h >> 32) & table->bloom_mask) *
+			    HANJA_BLOOM_BLOCK_WORDS;
+    h *= 0x9e3779b97f4a7c15ULL;
+    for (i = 0; i < HANJA_BLOOM_NPROBES; i++) {
+	bits[i] = (h >> (64 - 9 * (i + 1))) & 0x1ff;
+    }
+}
+
+static void
+hanja_bloom_add(HanjaTable* table, uint64_t h)
+{
+    uint64_t* block;
+    unsigned bits[HANJA_BLOOM_NPROBES];
+    unsigned i;
+
+    hanja_bloom_probe(table, h, &block, bits);
+    for (i = 0; i < HANJA_BLOOM_NPROBES; i++)
+	block[bits[i] >> 6] |= (uint64_t)1 << (bits[i] & 0x3f);
+}
+
+static bool
+hanja_bloom_contains(const HanjaTable* table, uint64_t h)
+{
+    uint64_t* block;
+    unsigned bits[HANJA_BLOOM_NPROBES];
+    unsigned i;
+
+    if (table->bloom == NULL)
+	return true;
+
+    hanja_bloom_probe(table, h, &block, bits);
+    for (i = 0; i < HANJA_BLOOM_NPROBES; i++) {
+	if ((block[bits[i] >> 6] & ((uint64_t)1 << (bits[i] & 0x3f))) == 0)
+	    return false;
+    }
+
+    return true;
+}
+
+/* 키 @a nkeys 개에 필요한 bloom filter의 블럭 수를 구한다. */
+static size_t
+hanja_bloom_nblocks(size_t nkeys)
+{
+    size_t nblocks = 1;
+    size_t nbits;
+
+    nbits = nkeys * HANJA_BLOOM_BITS_PER_KEY;
+    while (nblocks * HANJA_BLOOM_BLOCK_WORDS * 64 < nbits)
+	nblocks *= 2;
+
+    return nblocks;
+}
+
+static bool
+hanja_bloom_alloc(HanjaTable* table, size_t nkeys)
+{
+    size_t nblocks = hanja_bloom_nblocks(nkeys);
+
+    table->bloom = calloc(nblocks * HANJA_BLOOM_BLOCK_WORDS,
+			  sizeof(table->bloom[0]));
+    if (table->bloom == NULL)
+	return false;
+
+    table->bloom_mask = nblocks - 1;
+    return true;
+}
+
+static void
+hanja_table_build_bloom(HanjaTable* table)
+{
+    unsigned i;
+
+    if (!hanja_bloom_alloc(table, table->nkeys))
+	return;
+
+    for (i = 0; i < table->nkeys; i++) {
+	uint64_t h = hanja_key_hash(table->keys + table->keytable[i].key);
+	hanja_bloom_add(table, h);
+    }
+}
+
+/* UTF-8 스트링을 UCS-4로 변환한다. @a dest 가 NULL이면 필요한 글자수만
+ * 센다. 리턴값은 0으로 끝나는 것을 제외한 글자수다. */
+static size_t
+utf8_to_ucs4(ucschar* dest, const char* src)
+{
+    size_t len = 0;
+
+    while (*src != '\0') {
+	if (dest != NULL)
+	    dest[len] = utf8_get_char(src);
+	len++;
+	src = utf8_next(src);
+    }
+
+    if (dest != NULL)
+	dest[len] = 0;
+
+    return len;
+}
+
+/* UCS-4 스트링을 UTF-8로 변환한 스트링을 새로 할당한다. */
+static char*
+ucs4_to_utf8_dup(const ucschar* src)
+{
+    size_t i;
+    char* buf;
+    char* p;
+
+    buf = malloc(ucs4_strlen(src) * 4 + 1);
+    if (buf == NULL)
+	return NULL;
+
+    p = buf;
+    for (i = 0; src[i] != 0; i++)
+	p += utf8_put_char(p, src[i]);
+    *p = '\0';
+
+    return buf;
+}
+
+/* @a size 바이트를 더 붙일 수 있도록 버퍼를 늘린다. 내용은 바꾸지 않는다. */
+static bool
+hanja_buffer_reserve(HanjaBuffer* buffer, size_t size)
+{
+    if (buffer->len + size > buffer->alloc) {
+	size_t alloc = buffer->alloc > 0 ? buffer->alloc : 4096;
+	char* p;
+
+	while (alloc < buffer->len + size)
+	    alloc *= 2;
+
+	p = realloc(buffer->data, alloc);
+	if (p == NULL)
+	    return false;
+
+	buffer->data = p;
+	buffer->alloc = alloc;
+    }
+
+    return true;
+}
+
+static bool
+hanja_buffer_append(HanjaBuffer* buffer, const void* data, size_t size)
+{
+    if (!hanja_buffer_reserve(buffer, size))
+	return false;
+
+    memcpy(buffer->data + buffer->len, data, size);
+    buffer->len += size;
+    return true;
+}
+
+/* UTF-8 스트링 @a str 을 UCS-4로 변환해서 0까지 붙인다. */
+static bool
+hanja_buffer_append_ucs4(HanjaBuffer* buffer, const char* str)
+{
+    size_t size = (utf8_to_ucs4(NULL, str) + 1) * sizeof(ucschar);
+    ucschar* dest;
+
+    if (!hanja_buffer_reserve(buffer, size))
+	return false;
+
+    dest = (ucschar*)(buffer->data + buffer->len);
+    utf8_to_ucs4(dest, str);
+    buffer->len += size;
+    return true;
+}
+
+/* hanja searching functions */
+static inline HanjaData*
+hanja_get_data(const Hanja* hanja)
+{
+    return (HanjaData*)((const char*)(hanja - hanja->id) -
+			offsetof(HanjaData, entries));
+}
+
+static inline HanjaTable*
+hanja_get_table(const Hanja* hanja)
+{
+    return hanja_get_data(hanja)->table;
+}
+
+/* 사전 파일은 overlay와 같이 쓰므로 파일을 읽는 동안에는 FILE 자체를
+ * 잠근다. stdio의 lock은 같은 쓰레드에서 다시 잠글 수 있다. */
+static inline void
+hanja_table_lock_file(const HanjaTable* table)
+{
+#ifdef _WIN32
+    _lock_file(table->file);
+#else
+    flockfile(table->file);
+#endif
+}
+
+static inline void
+hanja_table_unlock_file(const HanjaTable* table)
+{
+#ifdef _WIN32
+    _unlock_file(table->file);
+#else
+    funlockfile(table->file);
+#endif
+}
+
+/* 사전 파일에서 엔트리의 설명을 읽는다. 이미 메모리에 있으면 그것을
+ * 복사한다. 파일을 읽지 못하면 NULL을 리턴한다. */
+static char*
+hanja_table_read_comment(const HanjaTable* table, const Hanja* hanja)
+{
+    char buf[512];
+    char* save = NULL;
+    char* comment = NULL;
+    bool res;
+
+    /* 패치로 추가한 엔트리의 설명은 파일에 없다. */
+    if (table->comments != NULL) {
+	const char* cached = hanja_pointer_get(&table->comments[hanja->id]);
+	if (cached != NULL)
+	    return strdup(cached);
+    }
+
+    hanja_table_lock_file(table);
+    res = fseek(table->file, hanja->line_offset, SEEK_SET) == 0 &&
+	  fgets(buf, sizeof(buf), table->file) != NULL;
+    hanja_table_unlock_file(table);
+    if (!res)
+	return NULL;
+
+    hanja_counter_add(&((HanjaTable*)table)->bytes_read, strlen(buf));
+    if (strtok_r(buf, ":", &save) != NULL &&
+	strtok_r(NULL, ":", &save) != NULL)
+	comment = strtok_r(NULL, "\r\n", &save);
+
+    if (comment == NULL)
+	comment = "";
+
+    return strdup(comment);
+}
+
+/* 설명은 처음 찾을 때 읽어서 comments에 보관한다. 여러 쓰레드에서 같이
+ * 부를 수 있도록 채우는 것은 파일 lock 안에서 하고, 다 채운 포인터만
+ * lock 없이 읽는다. 읽지 못했으면 보관하지 않고 NULL을 리턴하므로
+ * 다음에 부를 때 다시 읽는다.
+ * 페이지 모드의 사전에서 읽은 엔트리는 설명을 값 바로 뒤에 가지고 있다. */
+static const char*
+hanja_table_load_comment(HanjaTable* table, const Hanja* hanja)
+{
+    char** comments;
+    char* comment = NULL;
+
+    if (table->pages != NULL) {
+	const char* value = hanja_get_value(hanja);
+	return value + strlen(value) + 1;
+    }
+
+    comments = hanja_pointer_get(&table->comments);
+    if (comments != NULL) {
+	comment = hanja_pointer_get(&comments[hanja->id]);
+	if (comment != NULL)
+	    return comment;
+    }
+
+    hanja_table_lock_file(table);
+
+    comments = table->comments;
+    if (comments == NULL) {
+	comments = calloc(table->nentries, sizeof(comments[0]));
+	if (comments == NULL)
+	    goto done;
+	hanja_pointer_set(&table->comments, comments);
+    }
+
+    comment = comments[hanja->id];
+    if (comment == NULL) {
+	comment = hanja_table_read_comment(table, hanja);
+	if (comment == NULL)
+	    goto done;
+	table->comment_bytes += strlen(comment) + 1;
+	hanja_pointer_set(&comments[hanja->id], comment);
+    }
+
+done:
+    hanja_table_unlock_file(table);
+    return comment;
+}
+
+/* 설명을 읽지 못했을 때에도 NULL 대신 빈 스트링을 리턴한다. */
+static const char*
+hanja_table_get_comment(HanjaTable* table, const Hanja* hanja)
+{
+    const char* comment = hanja_table_load_comment(table, hanja);
+    return comment != NULL ? comment : "";
+}
+
+static const ucschar*
+hanja_table_get_comment_ucs4(HanjaTable* table, const Hanja* hanja)
+{
+    static const ucschar empty[] = { 0 };
+    ucschar** comments;
+    ucschar* buf;
+    const char* comment;
+
+    if (table->pages != NULL) {
+	const ucschar* value = hanja_get_value_ucs4(hanja);
+	return value + ucs4_strlen(value) + 1;
+    }
+
+    comments = hanja_pointer_get(&table->ucs4_comments);
+    if (comments != NULL) {
+	buf = hanja_pointer_get(&comments[hanja->id]);
+	if (buf != NULL)
+	    return buf;
+    }
+
+    /* 파일을 읽지 못한 설명은 UCS-4로도 보관하지 않는다. */
+    comment = hanja_table_load_comment(table, hanja);
+    if (comment == NULL)
+	return empty;
+
+    hanja_table_lock_file(table);
+
+    buf = NULL;
+    comments = table->ucs4_comments;
+    if (comments == NULL) {
+	comments = calloc(table->nentries, sizeof(comments[0]));
+	if (comments == NULL)
+	    goto done;
+	hanja_pointer_set(&table->ucs4_comments, comments);
+    }
+
+    buf = comments[hanja->id];
+    if (buf == NULL) {
+	buf = malloc((utf8_to_ucs4(NULL, comment) + 1) * sizeof(buf[0]));
+	if (buf == NULL)
+	    goto done;
+	table->comment_bytes += (utf8_to_ucs4(buf, comment) + 1) * sizeof(buf[0]);
+	hanja_pointer_set(&comments[hanja->id], buf);
+    }
+
+done:
+    hanja_table_unlock_file(table);
+    return buf != NULL ? buf : empty;
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief @ref Hanja 의 키를 찾아본다.
+ * @return @a hanja 오브젝트의 키, UTF-8
+ *
+ * 일반적으로 @ref Hanja 아이템의 키는 한글이다.
+ * 리턴되는 스트링은 @a hanja 오브젝트 내부적으로 관리하는 데이터로
+ * 수정하거나 free 되어서는 안된다.
+ */
+const char*
+hanja_get_key(const Hanja* hanja)
+{
+    if (hanja != NULL) {
+	const char* p  = (const char*)hanja;
+	return p + hanja->key_offset;
+    }
+    return NULL;
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief @ref Hanja 의 값을 찾아본다.
+ * @return @a hanja 오브젝트의 값, UTF-8
+ *
+ * 일반적으로 @ref Hanja 아이템의 값은 key에 대응되는 한자다.
+ * 리턴되는 스트링은 @a hanja 오브젝트 내부적으로 관리하는 데이터로
+ * 수정하거나 free되어서는 안된다.
+ */
+const char*
+hanja_get_value(const Hanja* hanja)
+{
+    if (hanja != NULL) {
+	const char* p  = (const char*)hanja;
+	return p + hanja->value_offset;
+    }
+    return NULL;
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief @ref Hanja 의 설명을 찾아본다.
+ * @return @a hanja 오브젝트의 comment 필드, UTF-8
+ *
+ * 일반적으로 @ref Hanja 아이템의 설명은 한글과 그 한자에 대한 설명이다.
+ * 파일에 따라서 내용이 없을 수 있다.
+ * 설명은 이 함수를 처음 부를때 사전 파일에서 읽어서 @ref HanjaTable 에
+ * 보관한다. 사전 파일을 읽지 못하면 빈 스트링을 리턴하고, 다음에 부를
+ * 때 다시 읽는다.
+ * 리턴되는 스트링은 @a hanja 오브젝트 내부적으로 관리하는 데이터로
+ * 수정하거나 free되어서는 안된다.
+ *
+ * 같은 @ref HanjaTable 에서 찾은 @ref Hanja 에 대해서 여러 쓰레드가
+ * 동시에 이 함수를 불러도 된다. 파일을 읽는 것은 사전 파일에 lock을 걸고
+ * 하고, 한번 읽은 설명은 lock 없이 리턴한다. 다만 사전을 바꾸는
+ * hanja_table_apply_patch(), hanja_table_compact(), hanja_table_delete()
+ * 와는 동시에 부를 수 없다.
+ */
+const char*
+hanja_get_comment(const Hanja* hanja)
+{
+    if (hanja != NULL) {
+	return hanja_table_get_comment(hanja_get_table(hanja), hanja);
+    }
+    return NULL;
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief @ref Hanja 의 키를 UCS-4로 찾아본다.
+ * @return @a hanja 오브젝트의 키, UCS-4
+ *
+ * hanja_get_key()와 같지만 UCS-4 스트링을 리턴한다.
+ * 리턴되는 스트링은 @a hanja 오브젝트 내부적으로 관리하는 데이터로
+ * 수정하거나 free 되어서는 안된다.
+ */
+const ucschar*
+hanja_get_key_ucs4(const Hanja* hanja)
+{
+    if (hanja != NULL) {
+	const char* p  = (const char*)hanja;
+	return (const ucschar*)(p + hanja->ucs4_key_offset);
+    }
+    return NULL;
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief @ref Hanja 의 값을 UCS-4로 찾아본다.
+ * @return @a hanja 오브젝트의 값, UCS-4
+ *
+ * hanja_get_value()와 같지만 UCS-4 스트링을 리턴한다.
+ * 리턴되는 스트링은 @a hanja 오브젝트 내부적으로 관리하는 데이터로
+ * 수정하거나 free되어서는 안된다.
+ */
+const ucschar*
+hanja_get_value_ucs4(const Hanja* hanja)
+{
+    if (hanja != NULL) {
+	const char* p  = (const char*)hanja;
+	return (const ucschar*)(p + hanja->ucs4_value_offset);
+    }
+    return NULL;
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief @ref Hanja 의 설명을 UCS-4로 찾아본다.
+ * @return @a hanja 오브젝트의 comment 필드, UCS-4
+ *
+ * hanja_get_comment()와 같지만 UCS-4 스트링을 리턴한다. 사전 파일을
+ * 읽지 못했을 때 빈 스트링을 리턴하는 것과 쓰레드에 대한 제약도 같다.
+ * 리턴되는 스트링은 @a hanja 오브젝트 내부적으로 관리하는 데이터로
+ * 수정하거나 free되어서는 안된다.
+ */
+const ucschar*
+hanja_get_comment_ucs4(const Hanja* hanja)
+{
+    if (hanja != NULL) {
+	return hanja_table_get_comment_ucs4(hanja_get_table(hanja), hanja);
+    }
+    return NULL;
+}
+
+static HanjaList *
+hanja_list_new(const char *key, const ucschar* ucs4_key)
+{
+    HanjaList *list;
+
+    list = malloc(sizeof(*list));
+    if (list == NULL)
+	return NULL;
+
+    if (key != NULL)
+	list->key = strdup(key);
+    else
+	list->key = ucs4_to_utf8_dup(ucs4_key);
+    if (list->key == NULL) {
+	free(list);
+	return NULL;
+    }
+
+    list->josa = NULL;
+    list->len = 0;
+    list->nruns = 0;
+    list->alloc = 1;
+    list->runs = &list->run;
+    list->blocks = &list->block;
+    list->nblocks = 0;
+
+    return list;
+}
+
+static bool
+hanja_list_reserve(HanjaList* list, size_t n)
+{
+    size_t size = list->alloc;
+    HanjaListRun* runs;
+
+    if (list->nruns + n <= list->alloc)
+	return true;
+
+    while (size < list->nruns + n)
+	size *= 2;
+
+    if (size > SIZE_MAX / sizeof(list->runs[0]))
+	return false;
+
+    if (list->runs == &list->run) {
+	runs = malloc(size * sizeof(runs[0]));
+	if (runs != NULL)
+	    runs[0] = list->run;
+    } else {
+	runs = realloc(list->runs, size * sizeof(runs[0]));
+    }
+
+    if (runs == NULL)
+	return false;
+
+    list->alloc = size;
+    list->runs = runs;
+    return true;
+}
+
+/* 리스트가 가리키는 엔트리 블럭마다 reference를 하나씩 가진다.
+ * 블럭이 하나뿐이면 blocks는 따로 할당하지 않고 block을 가리킨다. */
+static bool
+hanja_list_ref_block(HanjaList* list, HanjaData* block)
+{
+    HanjaData** blocks;
+    size_t i;
+
+    for (i = list->nblocks; i > 0; i--) {
+	if (list->blocks[i - 1] == block)
+	    return true;
+    }
+
+    if (list->nblocks == 0) {
+	blocks = &list->block;
+    } else if (list->blocks == &list->block) {
+	blocks = malloc(2 * sizeof(blocks[0]));
+	if (blocks != NULL)
+	    blocks[0] = list->block;
+    } else {
+	blocks = realloc(list->blocks, (list->nblocks + 1) * sizeof(blocks[0]));
+    }
+
+    if (blocks == NULL)
+	return false;
+
+    hanja_ref_inc(&block->refcount);
+    blocks[list->nblocks] = block;
+    list->blocks = blocks;
+    list->nblocks++;
+    return true;
+}
+
+/* 아이템을 하나씩 만들지 않고 구간만 추가한다. 앞의 구간에 바로 이어지는
+ * 구간이면 앞의 구간을 늘린다. */
+static void
+hanja_list_append_n(HanjaList* list, const Hanja* hanja, int n)
+{
+    HanjaListRun* last;
+
+    if (n <= 0)
+	return;
+
+    if (!hanja_list_ref_block(list, hanja_get_data(hanja)))
+	return;
+
+    if (list->nruns > 0) {
+	last = &list->runs[list->nruns - 1];
+	if (last->first + last->n == hanja) {
+	    last->n += n;
+	    list->len += n;
+	    return;
+	}
+    }
+
+    if (!hanja_list_reserve(list, 1))
+	return;
+
+    last = &list->runs[list->nruns];
+    last->first = hanja;
+    last->start = list->len;
+    last->n = n;
+    list->nruns++;
+    list->len += n;
+}
+
+static void
+hanja_table_read_entries(const HanjaTable* table, const HanjaIndex* index,
+			 const char* key, const ucschar* ucs4_key,
+			 HanjaList** list)
+{
+    /* 패치로 엔트리를 모두 지운 키는 n이 0이다. */
+    if (index->n == 0)
+	return;
+
+    if (*list == NULL) {
+	*list = hanja_list_new(key, ucs4_key);
+	if (*list == NULL)
+	    return;
+    }
+
+    hanja_list_append_n(*list, &table->data->entries[index->entry], index->n);
+}
+
+/* 음절 하나로 된 키는 인덱스를 검색하지 않고 syllables 테이블에서
+ * 바로 찾는다. syllables에는 (음절 - 0xAC00)을 인덱스로 그 음절을 키로
+ * 가진 첫번째 HanjaIndex의 위치 + 1을 저장해 둔다. 없으면 0이다. */
+static void
+hanja_table_build_syllables(HanjaTable* table)
+{
+    unsigned i;
+
+    table->syllables = calloc(nsyllables,
+			      sizeof(table->syllables[0]));
+    if (table->syllables == NULL)
+	return;
+
+    for (i = 0; i < table->nkeys; i++) {
+	const uint16_t* key = table->keys + table->keytable[i].key;
+	if (hangul_is_syllable(key[0]) && key[1] == 0) {
+	    uint32_t* slot = &table->syllables[key[0] - syllable_base];
+	    if (*slot == 0)
+		*slot = i + 1;
+	}
+    }
+}
+
+static void
+hanja_table_match_syllable_internal(const HanjaTable* table, ucschar c,
+				    const char* key, const ucschar* ucs4_key,
+				    HanjaList** list)
+{
+    unsigned i;
+
+    i = table->syllables[c - syllable_base];
+    if (i == 0)
+	return;
+
+    for (i = i - 1; i < table->nkeys; i++) {
+	const HanjaIndex* index = &table->keytable[i];
+	const uint16_t* k = table->keys + index->key;
+	if (k[0] != c || k[1] != 0)
+	    break;
+	hanja_table_read_entries(table, index, key, ucs4_key, list);
+    }
+}
+
+/* 검색 함수가 결과를 리턴할 때 불러서 검색 횟수를 센다. */
+static HanjaList*
+hanja_table_count_lookup(const HanjaTable* table, HanjaList* list)
+{
+    HanjaTable* t = (HanjaTable*)table;
+
+    hanja_counter_add(&t->nlookups, 1);
+    if (list == NULL)
+	hanja_counter_add(&t->nmisses, 1);
+
+    return list;
+}
+
+/* 인코딩한 키가 @a query 와 같은 첫번째 인덱스의 위치를 찾는다.
+ * 없으면 -1을 리턴한다. */
+static int
+hanja_table_find_index(const HanjaTable* table, const uint16_t* query)
+{
+    int low, high, mid;
+    int res = -1;
+
+    low = 0;
+    high = (int)table->nkeys - 1;
+    mid = 0;
+
+    while (low <= high) {
+	mid = (low + high) / 2;
+	res = hanja_key_strcmp(table->keys + table->keytable[mid].key, query);
+	if (res < 0) {
+	    low = mid + 1;
+	} else if (res > 0) {
+	    high = mid - 1;
+	} else {
+	    break;
+	}
+    }
+
+    if (res != 0)
+	return -1;
+
+    /* 정규화한 키가 같은 인덱스가 여러개 있을 수 있다. */
+    while (mid > 0 &&
+	   hanja_key_strcmp(table->keys + table->keytable[mid - 1].key,
+			    query) == 0)
+	mid--;
+
+    return mid;
+}
+
+static void
+hanja_table_read_index(const HanjaTable* table, int i, const uint16_t* query,
+		       const char* key, const ucschar* ucs4_key,
+		       HanjaList** list)
+{
+    for (; i < (int)table->nkeys; i++) {
+	if (hanja_key_strcmp(table->keys + table->keytable[i].key, query) != 0)
+	    break;
+	hanja_table_read_entries(table, &table->keytable[i],
+				 key, ucs4_key, list);
+    }
+}
+
+static void hanja_table_match_page(const HanjaTable* table,
+				   const char* key, const ucschar* ucs4_key,
+				   HanjaList** list);
+
+/* 검색어는 여기서 한번만 정규화하고 인코딩해서 인덱스와 비교한다. */
+static void
+hanja_table_match(const HanjaTable* table,
+		  const char* key, const ucschar* ucs4_key, HanjaList** list)
+{
+    uint16_t buf[128];
+    uint16_t* query;
+    int i;
+
+    if (table->syllables != NULL && table->overlay == NULL) {
+	ucschar c;
+	bool single;
+
+	if (ucs4_key != NULL) {
+	    c = ucs4_key[0];
+	    single = ucs4_key[1] == 0;
+	} else {
+	    c = utf8_get_char(key);
+	    single = utf8_char_len(key) == 3 && key[1] != '\0' &&
+		     key[2] != '\0' && key[3] == '\0';
+	}
+
+	if (single && hangul_is_syllable(c)) {
+	    hanja_table_match_syllable_internal(table, c, key, ucs4_key, list);
+	    return;
+	}
+    }
+
+    query = hanja_key_encode_query(buf, N_ELEMENTS(buf), key, ucs4_key);
+    if (query == NULL)
+	return;
+
+    /* 패치를 적용한 키는 overlay에 있는 것만 쓴다. */
+    if (table->overlay != NULL) {
+	i = hanja_table_find_index(table->overlay, query);
+	if (i >= 0) {
+	    hanja_table_read_index(table->overlay, i, query,
+				   key, ucs4_key, list);
+	    goto done;
+	}
+    }
+
+    if (table->syllables != NULL && query[0] != 0 && query[1] == 0 &&
+	hangul_is_syllable(query[0])) {
+	hanja_table_match_syllable_internal(table, query[0],
+					    key, ucs4_key, list);
+	goto done;
+    }
+
+    if (!hanja_bloom_contains(table, hanja_key_hash(query)))
+	goto done;
+
+    if (table->pages != NULL) {
+	hanja_table_match_page(table, key, ucs4_key, list);
+	goto done;
+    }
+
+    i = hanja_table_find_index(table, query);
+    if (i >= 0)
+	hanja_table_read_index(table, i, query, key, ucs4_key, list);
+
+done:
+    if (query != buf)
+	free(query);
+}
+
+/* @a hanja 의 키에 패치가 적용되어서 overlay에 있는 엔트리로 대체되었는지
+ * 확인한다. */
+static bool
+hanja_table_is_shadowed(const HanjaTable* table, const Hanja* hanja)
+{
+    uint16_t buf[128];
+    uint16_t* query;
+    bool ret;
+
+    if (table->overlay == NULL)
+	return false;
+
+    query = hanja_key_encode_query(buf, N_ELEMENTS(buf),
+				   hanja_get_key(hanja), NULL);
+    if (query == NULL)
+	return false;
+
+    ret = hanja_table_find_index(table->overlay, query) >= 0;
+    if (query != buf)
+	free(query);
+    return ret;
+}
+
+/* 검색어를 정규화한 UCS-4 스트링을 새로 할당한다. 검색어는 UTF-8
+ * 스트링 @a key 나 UCS-4 스트링 @a ucs4_key 로 주어진다. */
+static ucschar*
+hanja_key_normalize_dup(const char* key, const ucschar* ucs4_key, size_t* len)
+{
+    size_t size;
+    ucschar* buf;
+
+    if (key != NULL)
+	size = strlen(key) + 1;
+    else
+	size = ucs4_strlen(ucs4_key) + 1;
+
+    buf = malloc(size * sizeof(buf[0]));
+    if (buf == NULL)
+	return NULL;
+
+    *len = hanja_key_normalize(buf, key, ucs4_key);
+    return buf;
+}
+
+static HanjaList*
+hanja_table_match_prefix_internal(const HanjaTable* table,
+				  const char* key, const ucschar* ucs4_key)
+{
+    ucschar* newkey;
+    size_t len;
+    HanjaList* ret = NULL;
+
+    /* 정규화한 키에서 한 글자씩 줄여야 자모 클러스터가 중간에 잘리지
+     * 않는다. */
+    newkey = hanja_key_normalize_dup(key, ucs4_key, &len);
+    if (newkey == NULL)
+	return NULL;
+
+    while (len > 0) {
+	hanja_table_match(table, NULL, newkey, &ret);
+	len--;
+	newkey[len] = 0;
+    }
+    free(newkey);
+
+    return ret;
+}
+
+static HanjaList*
+hanja_table_match_suffix_internal(const HanjaTable* table,
+				  const char* key, const ucschar* ucs4_key)
+{
+    ucschar* newkey;
+    const ucschar* p;
+    size_t len;
+    HanjaList* ret = NULL;
+
+    newkey = hanja_key_normalize_dup(key, ucs4_key, &len);
+    if (newkey == NULL)
+	return NULL;
+
+    p = newkey;
+    while (p[0] != 0) {
+	hanja_table_match(table, NULL, p, &ret);
+	p = hanja_key_next(p);
+    }
+    free(newkey);
+
+    return ret;
+}
+
+static int
+compare_josa_node(const void* a, const void* b)
+{
+    const ucschar*       c = a;
+    const HanjaJosaNode* node = b;
+
+    if (*c < node->c)
+	return -1;
+    return *c > node->c;
+}
+
+/* 정규화한 키 @a key 의 끝에 붙은 조사나 어미를 hanja_josa_trie에서 찾아서
+ * 조사를 떼어낸 어간의 길이를 긴 조사부터 순서대로 @a stems 에 저장한다.
+ * 어간이 빈 스트링이 되는 경우는 제외한다. 리턴값은 찾은 갯수다. */
+static int
+hanja_josa_find(const ucschar* key, size_t len, size_t* stems, int max)
+{
+    const HanjaJosaNode* node = &hanja_josa_trie[0];
+    size_t i = len;
+    int n = 0;
+
+    while (i > 1 && node->nchild > 0) {
+	node = bsearch(&key[i - 1],
+		       &hanja_josa_trie[node->child], node->nchild,
+		       sizeof(hanja_josa_trie[0]), compare_josa_node);
+	if (node == NULL)
+	    break;
+
+	i--;
+	if (node->final && n < max) {
+	    memmove(stems + 1, stems, n * sizeof(stems[0]));
+	    stems[0] = i;
+	    n++;
+	}
+    }
+
+    return n;
+}
+
+static HanjaList*
+hanja_table_match_josa_internal(const HanjaTable* table,
+				const char* key, const ucschar* ucs4_key)
+{
+    ucschar* newkey;
+    size_t len;
+    size_t stems[8];
+    int i, n;
+    HanjaList* ret = NULL;
+
+    newkey = hanja_key_normalize_dup(key, ucs4_key, &len);
+    if (newkey == NULL)
+	return NULL;
+
+    /* 키 전체가 사전에 있으면 조사를 떼지 않는다. */
+    hanja_table_match(table, NULL, newkey, &ret);
+    if (ret != NULL) {
+	ret->josa = strdup("");
+	free(newkey);
+	return ret;
+    }
+
+    n = hanja_josa_find(newkey, len, stems, N_ELEMENTS(stems));
+    for (i = 0; i < n; i++) {
+	ucschar c = newkey[stems[i]];
+
+	newkey[stems[i]] = 0;
+	hanja_table_match(table, NULL, newkey, &ret);
+	newkey[stems[i]] = c;
+
+	if (ret != NULL) {
+	    ret->josa = ucs4_to_utf8_dup(newkey + stems[i]);
+	    break;
+	}
+    }
+    free(newkey);
+
+    return ret;
+}
+
+static HanjaList*
+hanja_table_match_internal(const HanjaTable* table, int match,
+			   const char* key, const ucschar* ucs4_key)
+{
+    HanjaList* ret = NULL;
+
+    switch (match) {
+    case HANJA_MATCH_EXACT:
+	hanja_table_match(table, key, ucs4_key, &ret);
+	break;
+    case HANJA_MATCH_PREFIX:
+	ret = hanja_table_match_prefix_internal(table, key, ucs4_key);
+	break;
+    case HANJA_MATCH_SUFFIX:
+	ret = hanja_table_match_suffix_internal(table, key, ucs4_key);
+	break;
+    }
+
+    return ret;
+}
+
+/*
+ * prefetch
+ *
+ * 입력기는 사용자가 한자 키를 누르기 전에 검색할 키를 미리 알 수 있다.
+ * hanja_table_prefetch_hint()로 그 키를 알려주면 별도의 쓰레드에서 미리
+ * 검색해서 작은 캐시에 넣어둔다. 나중에 같은 검색을 하면 캐시에서 결과를
+ * 복사해 준다.
+ *
+ * 입력기 쓰레드는 절대 기다리지 않는다. 힌트를 줄 때나 캐시를 찾을 때
+ * lock을 바로 잡을 수 없으면 힌트를 버리거나 캐시 없이 검색한다.
+ * 쓰레드는 검색하는 동안 busy lock을 잡고 있으므로, 사전을 바꾸는
+ * 함수는 busy lock을 잡아서 검색이 끝나기를 기다린 후 캐시를 비운다.
+ */
+#define HANJA_PREFETCH_CACHE_SIZE 8
+
+#ifdef HAVE_PTHREAD
+/* 검색 결과의 구간을 복사해서 새 리스트를 만든다. 키는 검색어가 아니라
+ * @a list 의 키를 쓴다. prefix, suffix 검색에서는 찾은 키가 검색어와
+ * 다르므로, 캐시에서 가져온 결과도 직접 검색한 결과와 같은 키를 가진다. */
+static HanjaList*
+hanja_list_dup(const HanjaList* list)
+{
+    HanjaList* ret;
+    size_t i;
+
+    ret = hanja_list_new(list->key, NULL);
+    if (ret == NULL)
+	return NULL;
+
+    if (list->josa != NULL) {
+	ret->josa = strdup(list->josa);
+	if (ret->josa == NULL) {
+	    hanja_list_delete(ret);
+	    return NULL;
+	}
+    }
+
+    for (i = 0; i < list->nruns; i++)
+	hanja_list_append_n(ret, list->runs[i].first, list->runs[i].n);
+
+    return ret;
+}
+
+typedef struct _HanjaPrefetchEntry HanjaPrefetchEntry;
+
+struct _HanjaPrefetchEntry {
+    int        match;
+    ucschar*   key;
+    HanjaList* list;
+};
+
+struct _HanjaPrefetch {
+    pthread_t          thread;
+    pthread_mutex_t    lock;
+    pthread_mutex_t    busy;
+    pthread_cond_t     cond;
+    bool               stop;
+    bool               has_hint;
+    int                hint_match;
+    char               hint[256];
+    HanjaPrefetchEntry cache[HANJA_PREFETCH_CACHE_SIZE];
+    unsigned           next;
+};
+
+/* lock을 잡은 상태에서 불러야 한다. */
+static HanjaPrefetchEntry*
+hanja_prefetch_find(HanjaPrefetch* prefetch, int match,
+		    const char* key, const ucschar* ucs4_key)
+{
+    unsigned i;
+
+    for (i = 0; i < HANJA_PREFETCH_CACHE_SIZE; i++) {
+	HanjaPrefetchEntry* entry = &prefetch->cache[i];
+	if (entry->key != NULL && entry->match == match &&
+	    hanja_key_compare(entry->key, key, ucs4_key) == 0)
+	    return entry;
+    }
+
+    return NULL;
+}
+
+/* lock을 잡은 상태에서 불러야 한다. */
+static void
+hanja_prefetch_flush(HanjaPrefetch* prefetch)
+{
+    unsigned i;
+
+    for (i = 0; i < HANJA_PREFETCH_CACHE_SIZE; i++) {
+	HanjaPrefetchEntry* entry = &prefetch->cache[i];
+	free(entry->key);
+	hanja_list_delete(entry->list);
+	entry->key = NULL;
+	entry->list = NULL;
+    }
+    prefetch->has_hint = false;
+}
+
+static void*
+hanja_prefetch_thread(void* data)
+{
+    HanjaTable* table = data;
+    HanjaPrefetch* prefetch = table->prefetch;
+
+    pthread_mutex_lock(&prefetch->lock);
+    while (!prefetch->stop) {
+	HanjaPrefetchEntry* entry;
+	HanjaList* list;
+	ucschar* key;
+	size_t len;
+	int match;
+
+	if (!prefetch->has_hint) {
+	    pthread_cond_wait(&prefetch->cond, &prefetch->lock);
+	    continue;
+	}
+
+	match = prefetch->hint_match;
+	key = hanja_key_normalize_dup(prefetch->hint, NULL, &len);
+	prefetch->has_hint = false;
+	if (key == NULL ||
+	    hanja_prefetch_find(prefetch, match, NULL, key) != NULL) {
+	    free(key);
+	    continue;
+	}
+
+	/* 검색하는 동안에는 입력기 쓰레드가 캐시를 찾을 수 있도록 lock을
+	 * 풀어둔다. lock은 항상 busy 다음에 잡는다. */
+	pthread_mutex_unlock(&prefetch->lock);
+	pthread_mutex_lock(&prefetch->busy);
+	list = hanja_table_match_internal(table, match, NULL, key);
+	pthread_mutex_lock(&prefetch->lock);
+	pthread_mutex_unlock(&prefetch->busy);
+
+	entry = &prefetch->cache[prefetch->next];
+	prefetch->next = (prefetch->next + 1) % HANJA_PREFETCH_CACHE_SIZE;
+	free(entry->key);
+	hanja_list_delete(entry->list);
+	entry->match = match;
+	entry->key = key;
+	entry->list = list;
+    }
+    pthread_mutex_unlock(&prefetch->lock);
+
+    return NULL;
+}
+
+/* 캐시에 결과가 있으면 복사해서 @a list 에 넣고 true를 리턴한다. 결과가
+ * 없었던 검색도 캐시에 있으므로 @a list 가 NULL일 수 있다. */
+static bool
+hanja_prefetch_get(const HanjaTable* table, int match,
+		   const char* key, const ucschar* ucs4_key, HanjaList** list)
+{
+    HanjaPrefetch* prefetch = table->prefetch;
+    HanjaPrefetchEntry* entry;
+    bool found = false;
+
+    if (prefetch == NULL)
+	return false;
+
+    if (pthread_mutex_trylock(&prefetch->lock) != 0)
+	return false;
+
+    entry = hanja_prefetch_find(prefetch, match, key, ucs4_key);
+    if (entry != NULL) {
+	*list = NULL;
+	if (entry->list != NULL)
+	    *list = hanja_list_dup(entry->list);
+	found = entry->list == NULL || *list != NULL;
+    }
+    pthread_mutex_unlock(&prefetch->lock);
+
+    if (found)
+	hanja_counter_add(&((HanjaTable*)table)->nprefetch_hits, 1);
+
+    return found;
+}
+
+/* 사전을 바꾸기 전에 쓰레드의 검색이 끝나기를 기다리고 캐시를 비운다. */
+static void
+hanja_prefetch_pause(HanjaTable* table)
+{
+    HanjaPrefetch* prefetch = table->prefetch;
+
+    if (prefetch != NULL) {
+	pthread_mutex_lock(&prefetch->busy);
+	pthread_mutex_lock(&prefetch->lock);
+	hanja_prefetch_flush(prefetch);
+	pthread_mutex_unlock(&prefetch->lock);
+    }
+}
+
+static void
+hanja_prefetch_resume(HanjaTable* table)
+{
+    if (table->prefetch != NULL)
+	pthread_mutex_unlock(&table->prefetch->busy);
+}
+#else
+static bool
+hanja_prefetch_get(const HanjaTable* table, int match,
+		   const char* key, const ucschar* ucs4_key, HanjaList** list)
+{
+    return false;
+}
+
+static void
+hanja_prefetch_pause(HanjaTable* table)
+{
+}
+
+static void
+hanja_prefetch_resume(HanjaTable* table)
+{
+}
+#endif /* HAVE_PTHREAD */
+
+/**
+ * @ingroup hanjadictionary
+ * @brief 한자 사전의 prefetch 쓰레드를 시작하는 함수
+ * @param table 한자 사전 object
+ * @return 성공하면 true, 쓰레드를 지원하지 않거나 실패하면 false
+ *
+ * hanja_table_prefetch_hint() 로 알려준 키를 미리 검색하는 쓰레드를
+ * 시작한다. 이미 시작했으면 아무 일도 하지 않고 true를 리턴한다.
+ * 쓰레드는 hanja_table_stop_prefetch() 나 hanja_table_delete() 를 부를 때
+ * 끝난다.
+ *
+ * prefetch 쓰레드를 쓰는 동안에도 사전의 다른 함수는 모두 한 쓰레드에서만
+ * 불러야 한다. 페이지 모드의 사전은 검색할 때 사전 파일을 읽으므로
+ * prefetch 쓰레드를 쓸 수 없다.
+ */
+bool
+hanja_table_start_prefetch(HanjaTable* table)
+{
+#ifdef HAVE_PTHREAD
+    HanjaPrefetch* prefetch;
+
+    if (table == NULL || table->pages != NULL)
+	return false;
+
+    if (table->prefetch != NULL)
+	return true;
+
+    prefetch = calloc(1, sizeof(*prefetch));
+    if (prefetch == NULL)
+	return false;
+
+    pthread_mutex_init(&prefetch->lock, NULL);
+    pthread_mutex_init(&prefetch->busy, NULL);
+    pthread_cond_init(&prefetch->cond, NULL);
+
+    table->prefetch = prefetch;
+    if (pthread_create(&prefetch->thread, NULL,
+		       hanja_prefetch_thread, table) != 0) {
+	table->prefetch = NULL;
+	pthread_cond_destroy(&prefetch->cond);
+	pthread_mutex_destroy(&prefetch->busy);
+	pthread_mutex_destroy(&prefetch->lock);
+	free(prefetch);
+	return false;
+    }
+
+    return true;
+#else
+    return false;
+#endif /* HAVE_PTHREAD */
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief 한자 사전의 prefetch 쓰레드를 끝내는 함수
+ * @param table 한자 사전 object
+ *
+ * hanja_table_start_prefetch() 로 시작한 쓰레드를 끝내고 캐시를 비운다.
+ * 쓰레드가 검색하고 있던 것이 끝날 때까지 기다린다.
+ */
+void
+hanja_table_stop_prefetch(HanjaTable* table)
+{
+#ifdef HAVE_PTHREAD
+    HanjaPrefetch* prefetch;
+
+    if (table == NULL || table->prefetch == NULL)
+	return;
+
+    prefetch = table->prefetch;
+    pthread_mutex_lock(&prefetch->lock);
+    prefetch->stop = true;
+    pthread_cond_signal(&prefetch->cond);
+    pthread_mutex_unlock(&prefetch->lock);
+    pthread_join(prefetch->thread, NULL);
+
+    hanja_prefetch_flush(prefetch);
+    pthread_cond_destroy(&prefetch->cond);
+    pthread_mutex_destroy(&prefetch->busy);
+    pthread_mutex_destroy(&prefetch->lock);
+    free(prefetch);
+    table->prefetch = NULL;
+#endif /* HAVE_PTHREAD */
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief 곧 검색할 것 같은 키를 prefetch 쓰레드에 알려주는 함수
+ * @param table 한자 사전 object
+ * @param key 검색할 것 같은 키, UTF-8 인코딩
+ * @param match 검색 방법, HANJA_MATCH_EXACT, HANJA_MATCH_PREFIX,
+ *              HANJA_MATCH_SUFFIX 중 하나
+ *
+ * 입력기는 사용자가 조합하고 있는 글자와 앞에 입력한 글자로 다음에
+ * 검색할 키를 짐작할 수 있다. 이 함수로 그 키를 알려주면 prefetch
+ * 쓰레드가 미리 검색해 둔다. 그 후에 같은 키로
+ * hanja_table_match_exact(), hanja_table_match_prefix(),
+ * hanja_table_match_suffix() 나 그 UCS-4 버전을 부르면 미리 검색한
+ * 결과를 리턴한다.
+ *
+ * 이 함수는 기다리지 않는다. 쓰레드가 바쁘거나 아직 처리하지 않은 힌트가
+ * 있으면 이전 힌트는 버려진다. prefetch 쓰레드를 시작하지 않았으면
+ * 아무 일도 하지 않는다.
+ */
+void
+hanja_table_prefetch_hint(HanjaTable* table, const char* key, int match)
+{
+#ifdef HAVE_PTHREAD
+    HanjaPrefetch* prefetch;
+
+    if (table == NULL || table->prefetch == NULL || key == NULL)
+	return;
+
+    prefetch = table->prefetch;
+    if (key[0] == '\0' || strlen(key) >= sizeof(prefetch->hint))
+	return;
+
+    if (pthread_mutex_trylock(&prefetch->lock) != 0)
+	return;
+
+    strcpy(prefetch->hint, key);
+    prefetch->hint_match = match;
+    prefetch->has_hint = true;
+    pthread_cond_signal(&prefetch->cond);
+    pthread_mutex_unlock(&prefetch->lock);
+#endif /* HAVE_PTHREAD */
+}
+
+/* 검색 함수는 prefetch 캐시를 먼저 찾는다. */
+static HanjaList*
+hanja_table_lookup(const HanjaTable* table, int match,
+		   const char* key, const ucschar* ucs4_key)
+{
+    HanjaList* ret;
+
+    if (!hanja_prefetch_get(table, match, key, ucs4_key, &ret))
+	ret = hanja_table_match_internal(table, match, key, ucs4_key);
+
+    return hanja_table_count_lookup(table, ret);
+}
+
+/*
+ * 오타를 허용하는 검색
+ *
+ * 키를 자모 단위로 풀어서 검색어와의 편집 거리(Levenshtein distance)가
+ * 주어진 값 이하인 키를 찾는다. 정렬된 키 인덱스에서 앞부분이 같은 키는
+ * 연속된 구간에 있으므로 인덱스를 음절 단위의 trie처럼 따라 내려간다.
+ * 음절마다 자모를 하나씩 읽으면서 편집 거리 표의 한 행을 계산하고,
+ * 그 행의 최소값이 허용한 거리보다 크면 그 아래의 키는 보지 않는다.
+ */
+#define HANJA_FUZZY_MAX_JAMO 64
+
+typedef struct _HanjaFuzzy      HanjaFuzzy;
+typedef struct _HanjaFuzzyMatch HanjaFuzzyMatch;
+
+struct _HanjaFuzzy {
+    ucschar      query[HANJA_FUZZY_MAX_JAMO];
+    size_t       m;
+    int          k;
+    HanjaBuffer  matches;
+};
+
+struct _HanjaFuzzyMatch {
+    const HanjaTable* table;
+    const uint16_t*   key;
+    uint32_t          index;
+    int               distance;
+};
+
+/* 음절은 초성, 중성, 종성으로 풀고 그 외의 글자는 그대로 둔다.
+ * "ㄱ" 같은 키와도 비교할 수 있게 자모는 호환 자모로 바꾼다. */
+static int
+hanja_fuzzy_decompose(ucschar c, ucschar* jamo)
+{
+    if (hangul_is_syllable(c)) {
+	hangul_syllable_to_jamo(c, &jamo[0], &jamo[1], &jamo[2]);
+	jamo[0] = hangul_jamo_to_cjamo(jamo[0]);
+	jamo[1] = hangul_jamo_to_cjamo(jamo[1]);
+	if (jamo[2] == 0)
+	    return 2;
+	jamo[2] = hangul_jamo_to_cjamo(jamo[2]);
+	return 3;
+    }
+
+    jamo[0] = c;
+    return 1;
+}
+
+/* 편집 거리 표의 이전 행 @a prev 에 자모 @a c 를 하나 더 읽은 행을
+ * @a row 에 계산한다. 리턴값은 그 행의 최소값이다. */
+static int
+hanja_fuzzy_step(const HanjaFuzzy* fuzzy, const int* prev, int* row, ucschar c)
+{
+    size_t j;
+    int min;
+
+    row[0] = prev[0] + 1;
+    min = row[0];
+    for (j = 1; j <= fuzzy->m; j++) {
+	int d = prev[j - 1] + (fuzzy->query[j - 1] != c);
+	if (prev[j] + 1 < d)
+	    d = prev[j] + 1;
+	if (row[j - 1] + 1 < d)
+	    d = row[j - 1] + 1;
+	row[j] = d;
+	if (d < min)
+	    min = d;
+    }
+
+    return min;
+}
+
+/* keytable의 [i, high) 구간에서 @a depth 번째 글자가 @a limit 보다 작은
+ * 구간의 끝을 찾는다. 구간은 대부분 짧으므로 간격을 두배씩 늘려가며 찾은
+ * 다음 그 안에서 이진 검색한다. */
+static unsigned
+hanja_fuzzy_group_end(const HanjaTable* table, unsigned i, unsigned high,
+		      size_t depth, ucschar limit)
+{
+    unsigned lo = i + 1;
+    unsigned hi = i + 2;
+
+    while (hi < high && table->keys[table->keytable[hi - 1].key + depth] < limit) {
+	lo = hi;
+	hi = i + 2 * (hi - i);
+    }
+    if (hi > high)
+	hi = high;
+
+    while (lo < hi) {
+	unsigned mid = (lo + hi) / 2;
+	if (table->keys[table->keytable[mid].key + depth] < limit)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+
+    return lo;
+}
+
+/* keytable의 [low, high) 구간은 앞의 @a depth 단위가 같은 키들이다.
+ * @a row 는 그 글자들까지 읽은 편집 거리 표의 마지막 행이다.
+ *
+ * BMP 밖의 글자는 escape를 포함한 세 단위로 저장되어 있으므로 풀어서
+ * 한 글자로 비교한다. escape는 가장 큰 단위라서 이런 키는 구간의 끝에
+ * 모여 있다.
+ *
+ * 음절은 코드 순서가 초성, 중성, 종성 순이므로 초성이 같은 음절, 초성과
+ * 중성이 같은 음절이 각각 연속된 구간에 있다. 그래서 자모 단위로 구간을
+ * 나눠 내려가면 초성과 중성의 행은 구간마다 한번만 계산하면 된다. */
+static bool
+hanja_fuzzy_walk(HanjaFuzzy* fuzzy, const HanjaTable* table,
+		 unsigned low, unsigned high, size_t depth, const int* row)
+{
+    int rows[3][HANJA_FUZZY_MAX_JAMO + 1];
+    unsigned i = low;
+
+    /* 여기서 끝나는 키는 더 긴 키보다 앞에 있다. */
+    while (i < high && table->keys[table->keytable[i].key + depth] == 0) {
+	if (row[fuzzy->m] <= fuzzy->k) {
+	    HanjaFuzzyMatch match;
+	    match.table = table;
+	    match.key = table->keys + table->keytable[i].key;
+	    match.index = i;
+	    match.distance = row[fuzzy->m];
+	    if (!hanja_buffer_append(&fuzzy->matches, &match, sizeof(match)))
+		return false;
+	}
+	i++;
+    }
+
+    while (i < high) {
+	ucschar c = table->keys[table->keytable[i].key + depth];
+	ucschar jamo[3];
+	unsigned cho_end, jung_end, end;
+	int n;
+
+	if (c == HANJA_KEY_ESCAPE) {
+	    const uint16_t* p = table->keys + table->keytable[i].key + depth;
+
+	    /* BMP 밖의 글자는 드물므로 같은 글자인 구간을 차례로 찾는다. */
+	    end = i + 1;
+	    while (end < high &&
+		   memcmp(table->keys + table->keytable[end].key + depth, p,
+			  HANJA_KEY_MAX_UNITS * sizeof(p[0])) == 0)
+		end++;
+
+	    c = hanja_key_get_char(p);
+	    if (hanja_fuzzy_step(fuzzy, row, rows[0], c) <= fuzzy->k) {
+		if (!hanja_fuzzy_walk(fuzzy, table, i, end,
+				      depth + HANJA_KEY_MAX_UNITS, rows[0]))
+		    return false;
+	    }
+	    i = end;
+	    continue;
+	}
+
+	n = hanja_fuzzy_decompose(c, jamo);
+	if (n == 1) {
+	    end = hanja_fuzzy_group_end(table, i, high, depth, c + 1);
+	    if (hanja_fuzzy_step(fuzzy, row, rows[0], jamo[0]) <= fuzzy->k) {
+		if (!hanja_fuzzy_walk(fuzzy, table, i, end, depth + 1, rows[0]))
+		    return false;
+	    }
+	    i = end;
+	    continue;
+	}
+
+	/* 초성이 같은 구간 */
+	c -= (c - syllable_base) % 588;
+	cho_end = hanja_fuzzy_group_end(table, i, high, depth, c + 588);
+	if (hanja_fuzzy_step(fuzzy, row, rows[0], jamo[0]) > fuzzy->k) {
+	    i = cho_end;
+	    continue;
+	}
+
+	while (i < cho_end) {
+	    /* 초성과 중성이 같은 구간 */
+	    c = table->keys[table->keytable[i].key + depth];
+	    hanja_fuzzy_decompose(c, jamo);
+	    c -= (c - syllable_base) % 28;
+	    jung_end = hanja_fuzzy_group_end(table, i, cho_end, depth, c + 28);
+	    if (hanja_fuzzy_step(fuzzy, rows[0], rows[1], jamo[1]) > fuzzy->k) {
+		i = jung_end;
+		continue;
+	    }
+
+	    while (i < jung_end) {
+		const int* next = rows[1];
+
+		c = table->keys[table->keytable[i].key + depth];
+		end = hanja_fuzzy_group_end(table, i, jung_end, depth, c + 1);
+		if (hanja_fuzzy_decompose(c, jamo) == 3) {
+		    if (hanja_fuzzy_step(fuzzy, rows[1], rows[2], jamo[2]) >
+			fuzzy->k) {
+			i = end;
+			continue;
+		    }
+		    next = rows[2];
+		}
+
+		if (!hanja_fuzzy_walk(fuzzy, table, i, end, depth + 1, next))
+		    return false;
+		i = end;
+	    }
+	}
+    }
+
+    return true;
+}
+
+static int
+compare_fuzzy_match(const void* a, const void* b)
+{
+    const HanjaFuzzyMatch* x = a;
+    const HanjaFuzzyMatch* y = b;
+    int res;
+
+    if (x->distance != y->distance)
+	return x->distance - y->distance;
+
+    res = hanja_key_strcmp(x->key, y->key);
+    if (res != 0)
+	return res;
+
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief 한자 사전에서 오타를 허용해서 키를 찾는 함수
+ * @param table 한자 사전 object
+ * @param key 찾을 키, UTF-8 인코딩
+ * @param distance 허용할 편집 거리
+ * @return 찾은 결과를 HanjaList object로 리턴한다. 찾은 것이 없거나 에러가 
+ *         있으면 NULL을 리턴한다.
+ *
+ * "삼국사기"를 "삼국사가"로 입력한 것처럼 자모 몇개를 잘못 입력한 키로도
+ * 검색할 수 있게 한다. 키와 @a key 를 자모 단위로 풀어서 자모를 넣거나,
+ * 빼거나, 바꾸는 횟수가 @a distance 이하인 키의 엔트리를 모두 찾는다.
+ * 음절이 아닌 글자는 BMP 밖의 글자를 포함해서 글자 하나를 한 단위로
+ * 비교한다.
+ * 결과는 편집 거리가 작은 것부터, 같은 거리에서는 키의 순서대로 정렬되고
+ * 한 키의 엔트리는 사전 파일의 순서, 즉 많이 쓰는 순서를 따른다.
+ *
+ * 인덱스를 모두 비교하지 않고 거리가 @a distance 를 넘는 구간은 건너뛰므로
+ * @a distance 가 1이나 2 정도면 입력 중에 써도 될만큼 빠르다.
+ * @a key 를 자모로 푼 길이가 64를 넘거나, 키 인덱스가 메모리에 없는
+ * 페이지 모드의 사전이면 NULL을 리턴한다.
+ *
+ * 리턴된 결과는 다 사용하고 나면 반드시 hanja_list_delete() 함수로 free해야
+ * 한다.
+ */
+HanjaList*
+hanja_table_match_fuzzy(const HanjaTable* table, const char *key, int distance)
+{
+    HanjaFuzzy fuzzy;
+    HanjaFuzzyMatch* matches;
+    ucschar* normalized;
+    int row[HANJA_FUZZY_MAX_JAMO + 1];
+    size_t nmatches;
+    size_t len;
+    size_t i;
+    HanjaList* ret = NULL;
+
+    if (key == NULL || key[0] == '\0' || table == NULL || distance < 0 ||
+	table->pages != NULL)
+	return NULL;
+
+    normalized = hanja_key_normalize_dup(key, NULL, &len);
+    if (normalized == NULL)
+	return NULL;
+
+    fuzzy.m = 0;
+    fuzzy.k = distance;
+    for (i = 0; i < len; i++) {
+	ucschar jamo[3];
+	int n = hanja_fuzzy_decompose(normalized[i], jamo);
+	if (fuzzy.m + n > HANJA_FUZZY_MAX_JAMO) {
+	    free(normalized);
+	    return NULL;
+	}
+	memcpy(fuzzy.query + fuzzy.m, jamo, n * sizeof(jamo[0]));
+	fuzzy.m += n;
+    }
+    free(normalized);
+
+    for (i = 0; i <= fuzzy.m; i++)
+	row[i] = i;
+
+    fuzzy.matches.data = NULL;
+    fuzzy.matches.len = 0;
+    fuzzy.matches.alloc = 0;
+    if (!hanja_fuzzy_walk(&fuzzy, table, 0, table->nkeys, 0, row) ||
+	(table->overlay != NULL &&
+	 !hanja_fuzzy_walk(&fuzzy, table->overlay, 0, table->overlay->nkeys,
+			   0, row))) {
+	free(fuzzy.matches.data);
+	return NULL;
+    }
+
+    matches = (HanjaFuzzyMatch*)fuzzy.matches.data;
+    nmatches = fuzzy.matches.len / sizeof(matches[0]);
+    if (nmatches > 0)
+	qsort(matches, nmatches, sizeof(matches[0]), compare_fuzzy_match);
+
+    for (i = 0; i < nmatches; i++) {
+	const HanjaTable* t = matches[i].table;
+
+	/* 패치로 바뀐 키는 overlay의 것만 쓴다. */
+	if (t == table && table->overlay != NULL &&
+	    hanja_table_find_index(table->overlay, matches[i].key) >= 0)
+	    continue;
+
+	hanja_table_read_entries(t, &t->keytable[matches[i].index],
+				 key, NULL, &ret);
+    }
+    free(fuzzy.matches.data);
+
+    return hanja_table_count_lookup(table, ret);
+}
+
+/*
+ * 설명(comment) 검색
+ *
+ * 설명 검색용 인덱스는 hanja_table_search_comment()를 처음 부를 때
+ * 만든다. 설명의 모든 unigram, bigram에 대해서 posting list를 만들고,
+ * 검색어의 n-gram에 해당하는 posting list들의 교집합을 구한 다음
+ * 실제로 설명에 검색어가 있는지 확인한다.
+ */
+typedef struct _HanjaGramEntry HanjaGramEntry;
+
+struct _HanjaGramEntry {
+    uint64_t gram;
+    uint32_t id;
+};
+
+static inline uint64_t
+hanja_gram(ucschar c1, ucschar c2)
+{
+    return ((uint64_t)c1 << 32) | c2;
+}
+
+static int
+compare_gram_entry(const void* a, const void* b)
+{
+    const HanjaGramEntry* x = a;
+    const HanjaGramEntry* y = b;
+
+    if (x->gram != y->gram)
+	return x->gram < y->gram ? -1 : 1;
+    if (x->id != y->id)
+	return x->id < y->id ? -1 : 1;
+    return 0;
+}
+
+static int
+compare_posting(const void* a, const void* b)
+{
+    const uint64_t*     gram = a;
+    const HanjaPosting* posting = b;
+
+    if (*gram != posting->gram)
+	return *gram < posting->gram ? -1 : 1;
+    return 0;
+}
+
+static bool
+hanja_buffer_append_varint(HanjaBuffer* buffer, uint32_t value)
+{
+    unsigned char buf[5];
+    size_t n = 0;
+
+    while (value >= 0x80) {
+	buf[n++] = (value & 0x7f) | 0x80;
+	value >>= 7;
+    }
+    buf[n++] = value;
+
+    return hanja_buffer_append(buffer, buf, n);
+}
+
+static inline uint32_t
+hanja_varint_decode(const unsigned char** p)
+{
+    uint32_t value = 0;
+    int shift = 0;
+
+    while (**p & 0x80) {
+	value |= (uint32_t)(**p & 0x7f) << shift;
+	shift += 7;
+	(*p)++;
+    }
+    value |= (uint32_t)**p << shift;
+    (*p)++;
+
+    return value;
+}
+
+/* (gram, 엔트리 번호) 쌍의 목록 @a grams 로 HanjaPostingIndex를 만든다.
+ * @a grams 는 이 함수에서 free한다. */
+static HanjaPostingIndex*
+hanja_posting_index_new(HanjaBuffer* grams)
+{
+    HanjaBuffer postings = { NULL, 0, 0 };
+    HanjaBuffer data = { NULL, 0, 0 };
+    HanjaPostingIndex* index;
+    HanjaGramEntry* items;
+    size_t nitems;
+    size_t i, j;
+
+    items = (HanjaGramEntry*)grams->data;
+    nitems = grams->len / sizeof(items[0]);
+    if (nitems > 0)
+	qsort(items, nitems, sizeof(items[0]), compare_gram_entry);
+
+    for (i = 0; i < nitems; ) {
+	HanjaPosting posting;
+	uint32_t prev = 0;
+
+	posting.gram = items[i].gram;
+	posting.offset = data.len;
+	posting.n = 0;
+	for (j = i; j < nitems && items[j].gram == posting.gram; j++) {
+	    if (posting.n > 0 && items[j].id == prev)
+		continue;
+	    if (!hanja_buffer_append_varint(&data, items[j].id - prev))
+		goto failed;
+	    prev = items[j].id;
+	    posting.n++;
+	}
+
+	if (!hanja_buffer_append(&postings, &posting, sizeof(posting)))
+	    goto failed;
+	i = j;
+    }
+
+    index = malloc(sizeof(*index));
+    if (index == NULL)
+	goto failed;
+
+    free(grams->data);
+
+    index->postings = (HanjaPosting*)postings.data;
+    index->npostings = postings.len / sizeof(HanjaPosting);
+    index->data = (unsigned char*)data.data;
+    index->data_len = data.len;
+    return index;
+
+failed:
+    free(grams->data);
+    free(postings.data);
+    free(data.data);
+    return NULL;
+}
+
+static void
+hanja_posting_index_delete(HanjaPostingIndex* index)
+{
+    if (index != NULL) {
+	free(index->postings);
+	free(index->data);
+	free(index);
+    }
+}
+
+static const HanjaPosting*
+hanja_posting_index_find(const HanjaPostingIndex* index, uint64_t gram)
+{
+    if (index->npostings == 0)
+	return NULL;
+
+    return bsearch(&gram, index->postings, index->npostings,
+		   sizeof(index->postings[0]), compare_posting);
+}
+
+/* posting list @a posting 을 디코딩하면서 @a ids 와의 교집합만 남긴다.
+ * 리턴값은 남은 갯수다. */
+static size_t
+hanja_posting_intersect(const HanjaPostingIndex* index,
+			const HanjaPosting* posting, uint32_t* ids, size_t n)
+{
+    const unsigned char* p = index->data + posting->offset;
+    uint32_t id = 0;
+    size_t i = 0;
+    size_t m = 0;
+    uint32_t k;
+
+    for (k = 0; k < posting->n && i < n; k++) {
+	id += hanja_varint_decode(&p);
+	while (i < n && ids[i] < id)
+	    i++;
+	if (i < n && ids[i] == id)
+	    ids[m++] = ids[i++];
+    }
+
+    return m;
+}
+
+/* @a grams 의 posting list들의 교집합을 구한다. 결과는 엔트리 번호 순서로
+ * 새로 할당한 배열에 담아 리턴하고, 갯수는 @a n 에 저장한다. */
+static uint32_t*
+hanja_posting_index_query(const HanjaPostingIndex* index,
+			  const uint64_t* grams, size_t ngrams, size_t* n)
+{
+    const HanjaPosting* smallest = NULL;
+    const unsigned char* p;
+    uint32_t* ids;
+    uint32_t id;
+    size_t i;
+
+    *n = 0;
+    for (i = 0; i < ngrams; i++) {
+	const HanjaPosting* posting = hanja_posting_index_find(index, grams[i]);
+	if (posting == NULL)
+	    return NULL;
+	if (smallest == NULL || posting->n < smallest->n)
+	    smallest = posting;
+    }
+
+    if (smallest == NULL)
+	return NULL;
+
+    /* 가장 짧은 posting list에서 시작해서 교집합을 구한다. */
+    ids = malloc(smallest->n * sizeof(ids[0]));
+    if (ids == NULL)
+	return NULL;
+
+    p = index->data + smallest->offset;
+    id = 0;
+    for (*n = 0; *n < smallest->n; (*n)++) {
+	id += hanja_varint_decode(&p);
+	ids[*n] = id;
+    }
+
+    for (i = 0; i < ngrams && *n > 0; i++) {
+	const HanjaPosting* posting = hanja_posting_index_find(index, grams[i]);
+	if (posting != smallest)
+	    *n = hanja_posting_intersect(index, posting, ids, *n);
+    }
+
+    return ids;
+}
+
+static HanjaPostingIndex*
+hanja_table_build_comment_index(HanjaTable* table)
+{
+    HanjaBuffer grams = { NULL, 0, 0 };
+    ucschar buf[512];
+    size_t i, j;
+
+    for (i = 0; i < table->nentries; i++) {
+	const Hanja* hanja = &table->data->entries[i];
+	char* comment;
+	size_t len;
+
+	comment = hanja_table_read_comment(table, hanja);
+	if (comment == NULL)
+	    goto failed;
+
+	len = utf8_to_ucs4(buf, comment);
+	free(comment);
+
+	for (j = 0; j < len; j++) {
+	    HanjaGramEntry item;
+	    item.id = hanja->id;
+	    item.gram = hanja_gram(buf[j], 0);
+	    if (!hanja_buffer_append(&grams, &item, sizeof(item)))
+		goto failed;
+	    if (j + 1 < len) {
+		item.gram = hanja_gram(buf[j], buf[j + 1]);
+		if (!hanja_buffer_append(&grams, &item, sizeof(item)))
+		    goto failed;
+	    }
+	}
+    }
+
+    return hanja_posting_index_new(&grams);
+
+failed:
+    free(grams.data);
+    return NULL;
+}
+
+/* 값에 들어 있는 한자마다 posting list를 만든다. 호환 한자는 통합 한자로
+ * 바꿔서 넣는다. */
+static HanjaPostingIndex*
+hanja_table_build_value_index(HanjaTable* table)
+{
+    HanjaBuffer grams = { NULL, 0, 0 };
+    ucschar buf[512];
+    size_t i, j;
+
+    for (i = 0; i < table->nentries; i++) {
+	const Hanja* hanja = &table->data->entries[i];
+	const ucschar* value = hanja_get_value_ucs4(hanja);
+	size_t len;
+
+	len = ucs4_strlen(value);
+	if (len >= N_ELEMENTS(buf))
+	    len = N_ELEMENTS(buf) - 1;
+	memcpy(buf, value, len * sizeof(buf[0]));
+	buf[len] = 0;
+	hanja_unified_form(buf, len);
+
+	for (j = 0; j < len; j++) {
+	    HanjaGramEntry item;
+	    item.id = hanja->id;
+	    item.gram = hanja_gram(buf[j], 0);
+	    if (!hanja_buffer_append(&grams, &item, sizeof(item))) {
+		free(grams.data);
+		return NULL;
+	    }
+	}
+    }
+
+    return hanja_posting_index_new(&grams);
+}
+
+/* 검색 인덱스는 처음 검색할 때 만든다. 여러 쓰레드에서 같이 검색할 수
+ * 있으므로 설명 캐시와 같이 만드는 것은 파일 lock 안에서 하고, 다 만든
+ * 인덱스만 lock 없이 읽는다. */
+static const HanjaPostingIndex*
+hanja_table_get_comment_index(HanjaTable* table)
+{
+    HanjaPostingIndex* index;
+
+    index = hanja_pointer_get(&table->comment_index);
+    if (index != NULL)
+	return index;
+
+    hanja_table_lock_file(table);
+    index = hanja_pointer_get(&table->comment_index);
+    if (index == NULL) {
+	index = hanja_table_build_comment_index(table);
+	if (index != NULL)
+	    hanja_pointer_set(&table->comment_index, index);
+    }
+    hanja_table_unlock_file(table);
+
+    return index;
+}
+
+static const HanjaPostingIndex*
+hanja_table_get_value_index(HanjaTable* table)
+{
+    HanjaPostingIndex* index;
+
+    index = hanja_pointer_get(&table->value_index);
+    if (index != NULL)
+	return index;
+
+    hanja_table_lock_file(table);
+    index = hanja_pointer_get(&table->value_index);
+    if (index == NULL) {
+	index = hanja_table_build_value_index(table);
+	if (index != NULL)
+	    hanja_pointer_set(&table->value_index, index);
+    }
+    hanja_table_unlock_file(table);
+
+    return index;
+}
+
+static uint64_t
+hanja_get_time_ns()
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (uint64_t)(count.QuadPart / freq.QuadPart) * 1000000000 +
+	   (uint64_t)(count.QuadPart % freq.QuadPart) * 1000000000 /
+	   freq.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static void
+hanja_builder_init(HanjaBuilder* builder)
+{
+    memset(builder, 0, sizeof(*builder));
+}
+
+static void
+hanja_builder_free(HanjaBuilder* builder)
+{
+    char** comments = (char**)builder->comments.data;
+    size_t i;
+
+    for (i = 0; i < builder->comments.len / sizeof(comments[0]); i++)
+	free(comments[i]);
+
+    free(builder->index.data);
+    free(builder->key_pool.data);
+    free(builder->entries.data);
+    free(builder->keys_column.data);
+    free(builder->values_column.data);
+    free(builder->ucs4_keys_column.data);
+    free(builder->ucs4_values_column.data);
+    free(builder->comments.data);
+    free(builder->values);
+}
+
+/* 엔트리가 하나도 없는 키를 인덱스에 넣는다. overlay에서 패치로
+ * 엔트리를 모두 지운 키를 기억하는데 쓴다. */
+static bool
+hanja_builder_add_key(HanjaBuilder* builder, const uint16_t* encoded)
+{
+    HanjaIndex* keytable = (HanjaIndex*)builder->index.data;
+    uint16_t* keys = (uint16_t*)builder->key_pool.data;
+    HanjaIndex item;
+
+    if (builder->nkeys > 0 &&
+	hanja_key_strcmp(keys + keytable[builder->nkeys - 1].key, encoded) == 0)
+	return true;
+
+    item.key = builder->key_pool.len / sizeof(uint16_t);
+    item.entry = builder->nentries;
+    item.n = 0;
+    if (!hanja_buffer_append(&builder->key_pool, encoded,
+			     (hanja_key_strlen(encoded) + 1) * sizeof(uint16_t)) ||
+	!hanja_buffer_append(&builder->index, &item, sizeof(item)))
+	return false;
+
+    builder->nkeys++;
+    return true;
+}
+
+static uint64_t
+hanja_builder_hash_value(const char* value, const char* comment)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    const unsigned char* p;
+
+    for (p = (const unsigned char*)value; *p != '\0'; p++) {
+	h ^= *p;
+	h *= 0x100000001b3ULL;
+    }
+
+    if (comment != NULL) {
+	h ^= 0xff;
+	h *= 0x100000001b3ULL;
+	for (p = (const unsigned char*)comment; *p != '\0'; p++) {
+	    h ^= *p;
+	    h *= 0x100000001b3ULL;
+	}
+    }
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static bool
+hanja_builder_grow_values(HanjaBuilder* builder)
+{
+    HanjaBuilderValue* values;
+    size_t size = builder->values != NULL ? (builder->values_mask + 1) * 2 : 64;
+    size_t i;
+
+    values = malloc(size * sizeof(values[0]));
+    if (values == NULL)
+	return false;
+
+    for (i = 0; i < size; i++)
+	values[i].offset = UINT32_MAX;
+
+    if (builder->values != NULL) {
+	for (i = 0; i <= builder->values_mask; i++) {
+	    const HanjaBuilderValue* v = &builder->values[i];
+	    const char* value;
+	    const char* comment = NULL;
+	    size_t j;
+
+	    if (v->offset == UINT32_MAX)
+		continue;
+
+	    value = builder->values_column.data + v->offset;
+	    if (builder->inline_comments)
+		comment = value + strlen(value) + 1;
+
+	    j = hanja_builder_hash_value(value, comment) & (size - 1);
+	    while (values[j].offset != UINT32_MAX)
+		j = (j + 1) & (size - 1);
+	    values[j] = *v;
+	}
+	free(builder->values);
+    }
+
+    builder->values = values;
+    builder->values_mask = size - 1;
+    return true;
+}
+
+/* 값을 컬럼에 넣고 그 위치를 @a entry 에 기록한다. 같은 값을 이미
+ * 넣었으면 그 위치를 쓴다. inline_comments가 설정되어 있으면 값과 설명을
+ * 한 쌍으로 취급한다. */
+static bool
+hanja_builder_intern_value(HanjaBuilder* builder, Hanja* entry,
+			   const char* value, const char* comment)
+{
+    HanjaBuilderValue* v;
+    ucschar ucs4[512];
+    size_t len;
+    size_t i;
+
+    if (builder->inline_comments && comment == NULL)
+	comment = "";
+
+    if (builder->nvalues * 2 >= builder->values_mask + 1 ||
+	builder->values == NULL) {
+	if (!hanja_builder_grow_values(builder))
+	    return false;
+    }
+
+    i = hanja_builder_hash_value(value, comment) & builder->values_mask;
+    while ((v = &builder->values[i])->offset != UINT32_MAX) {
+	const char* p = builder->values_column.data + v->offset;
+	if (strcmp(p, value) == 0 &&
+	    (comment == NULL || strcmp(p + strlen(p) + 1, comment) == 0)) {
+	    entry->value_offset = v->offset;
+	    entry->ucs4_value_offset = v->ucs4_offset;
+	    return true;
+	}
+	i = (i + 1) & builder->values_mask;
+    }
+
+    if (builder->values_column.len >= UINT32_MAX)
+	return false;
+
+    v->offset = builder->values_column.len;
+    v->ucs4_offset = builder->ucs4_values_column.len;
+    entry->value_offset = v->offset;
+    entry->ucs4_value_offset = v->ucs4_offset;
+
+    len = utf8_to_ucs4(ucs4, value);
+    if (!hanja_buffer_append(&builder->values_column, value, strlen(value) + 1) ||
+	!hanja_buffer_append(&builder->ucs4_values_column, ucs4,
+			     (len + 1) * sizeof(ucs4[0]))) {
+	v->offset = UINT32_MAX;
+	return false;
+    }
+
+    if (comment != NULL) {
+	if (!hanja_buffer_append(&builder->values_column, comment,
+				 strlen(comment) + 1) ||
+	    !hanja_buffer_append_ucs4(&builder->ucs4_values_column, comment)) {
+	    v->offset = UINT32_MAX;
+	    return false;
+	}
+    }
+
+    builder->nvalues++;
+    return true;
+}
+
+/* 엔트리 하나를 추가한다. 같은 키의 엔트리는 연속으로 주어야 하므로
+ * 인덱스에는 첫 엔트리와 갯수만 기억한다. 컬럼에서의 위치는 우선 각
+ * 컬럼의 시작에서의 위치로 기록해 두었다가 블럭을 만든 후에 상대 위치로
+ * 바꾼다. @a comment 가 NULL이면 설명은 나중에 @a line_offset 에서 읽는다.
+ * inline_comments가 설정되어 있으면 설명은 값 컬럼에서 값 바로 뒤에 둔다. */
+static bool
+hanja_builder_add(HanjaBuilder* builder, const char* key, const char* value,
+		  uint32_t line_offset, const char* comment)
+{
+    ucschar normalized[512];
+    uint16_t encoded[512 * HANJA_KEY_MAX_UNITS];
+    ucschar ucs4[512];
+    Hanja* entry = &builder->entry;
+    HanjaIndex* keytable;
+    uint16_t* keys;
+    size_t len;
+
+    if (strlen(key) >= N_ELEMENTS(ucs4) || strlen(value) >= N_ELEMENTS(ucs4))
+	return false;
+
+    if (builder->nentries == 0 ||
+	strcmp(builder->keys_column.data + entry->key_offset, key) != 0) {
+	entry->key_offset = builder->keys_column.len;
+	entry->ucs4_key_offset = builder->ucs4_keys_column.len;
+	len = utf8_to_ucs4(ucs4, key);
+	if (!hanja_buffer_append(&builder->keys_column, key, strlen(key) + 1) ||
+	    !hanja_buffer_append(&builder->ucs4_keys_column, ucs4,
+				 (len + 1) * sizeof(ucs4[0])))
+	    return false;
+
+	hanja_key_normalize(normalized, key, NULL);
+	len = hanja_key_encode(encoded, normalized);
+	keytable = (HanjaIndex*)builder->index.data;
+	keys = (uint16_t*)builder->key_pool.data;
+	if (builder->nkeys > 0 &&
+	    hanja_key_strcmp(keys + keytable[builder->nkeys - 1].key, encoded) == 0) {
+	    keytable[builder->nkeys - 1].n++;
+	} else {
+	    HanjaIndex item;
+	    if (builder->nkeys > 0 &&
+		hanja_key_strcmp(keys + keytable[builder->nkeys - 1].key, encoded) > 0)
+		builder->unsorted = true;
+	    item.key = builder->key_pool.len / sizeof(uint16_t);
+	    item.entry = builder->nentries;
+	    item.n = 1;
+	    if (!hanja_buffer_append(&builder->key_pool, encoded,
+				     (len + 1) * sizeof(encoded[0])) ||
+		!hanja_buffer_append(&builder->index, &item, sizeof(item)))
+		return false;
+	    builder->nkeys++;
+	}
+    } else {
+	keytable = (HanjaIndex*)builder->index.data;
+	keytable[builder->nkeys - 1].n++;
+    }
+
+    if (comment != NULL && !builder->inline_comments) {
+	char* null = NULL;
+	char* dup;
+
+	while (builder->comments.len < builder->nentries * sizeof(char*)) {
+	    if (!hanja_buffer_append(&builder->comments, &null, sizeof(null)))
+		return false;
+	}
+
+	dup = strdup(comment);
+	if (dup == NULL)
+	    return false;
+	if (!hanja_buffer_append(&builder->comments, &dup, sizeof(dup))) {
+	    free(dup);
+	    return false;
+	}
+	builder->comment_bytes += strlen(dup) + 1;
+    }
+
+    entry->line_offset = line_offset;
+    entry->id = builder->nentries;
+    if (!hanja_builder_intern_value(builder, entry, value,
+				    builder->inline_comments ? comment : NULL) ||
+	!hanja_buffer_append(&builder->entries, entry, sizeof(*entry)))
+	return false;
+
+    builder->nentries++;
+    return true;
+}
+
+typedef struct _HanjaBuilderItem HanjaBuilderItem;
+
+struct _HanjaBuilderItem {
+    const uint16_t* key;
+    HanjaIndex     index;
+};
+
+static int
+compare_builder_item(const void* a, const void* b)
+{
+    const HanjaBuilderItem* x = a;
+    const HanjaBuilderItem* y = b;
+    int res;
+
+    res = hanja_key_strcmp(x->key, y->key);
+    if (res != 0)
+	return res;
+
+    return x->index.entry < y->index.entry ? -1 : x->index.entry > y->index.entry;
+}
+
+/* 키 순서대로 들어오지 않은 엔트리를 정렬한다. 같은 키가 여러 곳에
+ * 나뉘어 있으면 파일에 나온 순서대로 모아서 하나의 키로 합친다.
+ * 엔트리의 순서가 바뀌므로 엔트리와 설명도 새 순서로 다시 만든다. */
+static bool
+hanja_builder_sort(HanjaBuilder* builder)
+{
+    HanjaIndex* keytable = (HanjaIndex*)builder->index.data;
+    const uint16_t* keys = (const uint16_t*)builder->key_pool.data;
+    const Hanja* entries = (const Hanja*)builder->entries.data;
+    char** comments = NULL;
+    HanjaBuilderItem* items;
+    Hanja* new_entries;
+    char** new_comments = NULL;
+    unsigned nkeys = 0;
+    unsigned pos = 0;
+    unsigned i, j;
+
+    if (builder->nentries == 0)
+	return true;
+
+    if (builder->comments.len > 0)
+	comments = (char**)builder->comments.data;
+
+    items = malloc(builder->nkeys * sizeof(items[0]));
+    new_entries = malloc(builder->nentries * sizeof(new_entries[0]));
+    if (comments != NULL)
+	new_comments = malloc(builder->nentries * sizeof(new_comments[0]));
+    if (items == NULL || new_entries == NULL ||
+	(comments != NULL && new_comments == NULL)) {
+	free(items);
+	free(new_entries);
+	free(new_comments);
+	return false;
+    }
+
+    for (i = 0; i < builder->nkeys; i++) {
+	items[i].key = keys + keytable[i].key;
+	items[i].index = keytable[i];
+    }
+    qsort(items, builder->nkeys, sizeof(items[0]), compare_builder_item);
+
+    for (i = 0; i < builder->nkeys; i++) {
+	const HanjaIndex* item = &items[i].index;
+
+	if (nkeys > 0 &&
+	    hanja_key_strcmp(keys + keytable[nkeys - 1].key, items[i].key) == 0) {
+	    keytable[nkeys - 1].n += item->n;
+	} else {
+	    keytable[nkeys] = *item;
+	    keytable[nkeys].entry = pos;
+	    nkeys++;
+	}
+
+	for (j = item->entry; j < item->entry + item->n; j++) {
+	    new_entries[pos] = entries[j];
+	    new_entries[pos].id = pos;
+	    if (new_comments != NULL)
+		new_comments[pos] = comments[j];
+	    pos++;
+	}
+    }
+    free(items);
+
+    free(builder->entries.data);
+    builder->entries.data = (char*)new_entries;
+    builder->entries.alloc = builder->entries.len;
+    if (new_comments != NULL) {
+	free(builder->comments.data);
+	builder->comments.data = (char*)new_comments;
+	builder->comments.alloc = builder->comments.len;
+    }
+    builder->index.len = nkeys * sizeof(keytable[0]);
+    builder->nkeys = nkeys;
+    builder->unsorted = false;
+
+    return true;
+}
+
+/* 모은 엔트리로 데이터 블럭을 만들어서 @a table 의 인덱스와 데이터를
+ * 채운다. 성공하면 builder의 버퍼는 table로 넘어가거나 free된다. */
+static bool
+hanja_builder_finish(HanjaBuilder* builder, HanjaTable* table)
+{
+    HanjaIndex* keytable;
+    uint16_t* keys;
+    unsigned nkeys;
+    unsigned nentries = builder->nentries;
+    HanjaData* data;
+    Hanja* hanja;
+    char* p;
+    size_t ucs4_keys_base;
+    size_t ucs4_values_base;
+    size_t keys_base;
+    size_t values_base;
+    size_t size;
+    size_t i;
+
+    if (builder->comments.len > 0) {
+	char* null = NULL;
+	while (builder->comments.len < nentries * sizeof(char*)) {
+	    if (!hanja_buffer_append(&builder->comments, &null, sizeof(null)))
+		return false;
+	}
+    }
+
+    /* 사전 파일이 정렬되어 있지 않거나, 원래의 키로는 정렬되어 있어도
+     * 정규화한 키의 순서와 다를 수 있다. 이진 검색을 하려면 인덱스가
+     * 정규화한 키로 정렬되어 있어야 한다. */
+    if (builder->unsorted && !hanja_builder_sort(builder))
+	return false;
+
+    keytable = (HanjaIndex*)builder->index.data;
+    keys = (uint16_t*)builder->key_pool.data;
+    nkeys = builder->nkeys;
+
+    ucs4_keys_base = offsetof(HanjaData, entries) + builder->entries.len;
+    ucs4_values_base = ucs4_keys_base + builder->ucs4_keys_column.len;
+    keys_base = ucs4_values_base + builder->ucs4_values_column.len;
+    values_base = keys_base + builder->keys_column.len;
+    size = values_base + builder->values_column.len;
+    if (size > UINT32_MAX)
+	return false;
+
+    data = malloc(size);
+    if (data == NULL)
+	return false;
+
+    p = (char*)data;
+    if (nentries > 0)
+	memcpy(data->entries, builder->entries.data, builder->entries.len);
+    if (builder->ucs4_keys_column.len > 0)
+	memcpy(p + ucs4_keys_base, builder->ucs4_keys_column.data,
+	       builder->ucs4_keys_column.len);
+    if (builder->ucs4_values_column.len > 0)
+	memcpy(p + ucs4_values_base, builder->ucs4_values_column.data,
+	       builder->ucs4_values_column.len);
+    if (builder->keys_column.len > 0)
+	memcpy(p + keys_base, builder->keys_column.data,
+	       builder->keys_column.len);
+    if (builder->values_column.len > 0)
+	memcpy(p + values_base, builder->values_column.data,
+	       builder->values_column.len);
+
+    for (i = 0; i < nentries; i++) {
+	size_t base;
+
+	hanja = &data->entries[i];
+	base = (char*)hanja - p;
+	hanja->key_offset += keys_base - base;
+	hanja->value_offset += values_base - base;
+	hanja->ucs4_key_offset += ucs4_keys_base - base;
+	hanja->ucs4_value_offset += ucs4_values_base - base;
+    }
+
+    data->table = table;
+    data->refcount = 1;
+    hanja_ref_inc(&table->refcount);
+
+    table->keytable = keytable;
+    table->nkeys = nkeys;
+    table->keys = keys;
+    table->keys_size = builder->key_pool.len;
+    table->data = data;
+    table->data_size = size;
+    table->nentries = nentries;
+    table->comments = (char**)builder->comments.data;
+    table->ucs4_comments = NULL;
+    table->comment_bytes = builder->comment_bytes;
+
+    free(builder->entries.data);
+    free(builder->keys_column.data);
+    free(builder->values_column.data);
+    free(builder->ucs4_keys_column.data);
+    free(builder->ucs4_values_column.data);
+    free(builder->values);
+    hanja_builder_init(builder);
+
+    return true;
+}
+
+static void
+hanja_page_index_delete(HanjaPageIndex* pages)
+{
+    if (pages != NULL) {
+	free(pages->offsets);
+	free(pages->key_offsets);
+	free(pages->keys);
+	free(pages);
+    }
+}
+
+static void
+hanja_table_init(HanjaTable* table)
+{
+    memset(table, 0, sizeof(*table));
+    table->refcount = 1;
+}
+
+/* 파일과 overlay, 엔트리 블럭을 제외하고 table이 가진 메모리를 모두
+ * free한다. */
+static void
+hanja_table_clear(HanjaTable* table)
+{
+    unsigned i;
+
+    if (table->comments != NULL) {
+	for (i = 0; i < table->nentries; i++)
+	    free(table->comments[i]);
+	free(table->comments);
+    }
+
+    if (table->ucs4_comments != NULL) {
+	for (i = 0; i < table->nentries; i++)
+	    free(table->ucs4_comments[i]);
+	free(table->ucs4_comments);
+    }
+
+    free(table->keytable);
+    free(table->keys);
+    free(table->bloom);
+    free(table->syllables);
+    hanja_posting_index_delete(table->comment_index);
+    hanja_posting_index_delete(table->value_index);
+    hanja_page_index_delete(table->pages);
+}
+
+static void
+hanja_table_unref(HanjaTable* table)
+{
+    if (table != NULL && hanja_ref_dec(&table->refcount)) {
+	hanja_table_clear(table);
+	if (table->parent != NULL)
+	    hanja_table_unref(table->parent);
+	else
+	    fclose(table->file);
+	free(table);
+    }
+}
+
+static void
+hanja_data_unref(HanjaData* data)
+{
+    if (data != NULL && hanja_ref_dec(&data->refcount)) {
+	HanjaTable* table = data->table;
+	free(data);
+	hanja_table_unref(table);
+    }
+}
+
+/* table과 그 엔트리 블럭의 reference를 놓는다. 검색 결과가 아직 블럭을
+ * 가지고 있으면 그 결과를 free할 때까지 table도 남아 있다. */
+static void
+hanja_table_release(HanjaTable* table)
+{
+    if (table != NULL) {
+	hanja_data_unref(table->data);
+	hanja_table_unref(table);
+    }
+}
+
+static void
+hanja_table_delete_overlay(HanjaTable* table)
+{
+    hanja_table_release(table->overlay);
+    table->overlay = NULL;
+}
+
+/* 사전 파일의 줄 하나를 키, 값, 설명으로 나눈다. 엔트리가 아닌 줄이면
+ * false를 리턴한다. @a comment 가 NULL이면 설명은 나누지 않는다. */
+static bool
+hanja_split_line(char* buf, char** key, char** value, char** comment)
+{
+    char* save_ptr = NULL;
+
+    /* skip comments and empty lines */
+    if (buf[0] == '#' || buf[0] == '\r' || buf[0] == '\n' || buf[0] == '\0')
+	return false;
+
+    *key = strtok_r(buf, ":", &save_ptr);
+    *value = strtok_r(NULL, ":\r\n", &save_ptr);
+
+    if (*key == NULL || strlen(*key) == 0 || *value == NULL)
+	return false;
+
+    if (comment != NULL) {
+	*comment = strtok_r(NULL, "\r\n", &save_ptr);
+	if (*comment == NULL)
+	    *comment = "";
+    }
+
+    return true;
+}
+
+/* 사전 파일 전체를 메모리에 올린다. */
+static HanjaTable*
+hanja_table_load_full(FILE* file, uint64_t start, uint64_t bytes_read)
+{
+    char buf[512];
+    char* key;
+    char* value;
+    long offset;
+    HanjaBuilder builder;
+    HanjaTable* table = NULL;
+
+    hanja_builder_init(&builder);
+
+    offset = ftell(file);
+    while (fgets(buf, sizeof(buf), file) != NULL) {
+	long line_offset = offset;
+	offset = ftell(file);
+
+	if (!hanja_split_line(buf, &key, &value, NULL))
+	    continue;
+
+	if (line_offset > UINT32_MAX ||
+	    !hanja_builder_add(&builder, key, value, line_offset, NULL))
+	    goto failed;
+    }
+
+    table = malloc(sizeof(*table));
+    if (table == NULL)
+	goto failed;
+
+    hanja_table_init(table);
+    if (!hanja_builder_finish(&builder, table))
+	goto failed;
+
+    table->file = file;
+    table->bytes_read = bytes_read + offset;
+    hanja_table_build_bloom(table);
+    hanja_table_build_syllables(table);
+    table->load_time_ns = hanja_get_time_ns() - start;
+
+    return table;
+
+failed:
+    hanja_builder_free(&builder);
+    free(table);
+    return NULL;
+}
+
+/*
+ * 메모리 예산
+ *
+ * hanja_table_load_with_budget()은 먼저 사전 파일을 한번 훑어서 모두
+ * 메모리에 올렸을 때의 크기를 계산한다. 예산 안에 들어가지 않으면
+ * HanjaPageIndex만 메모리에 두고 엔트리는 검색할 때 파일에서 읽는
+ * 페이지 모드로 로딩한다. 페이지의 크기는 예산에 들어가는 가장 작은
+ * 2의 거듭제곱 키 갯수로 정한다. 페이지가 작을수록 한번 검색할 때
+ * 파일에서 읽는 양이 줄어든다. 페이지의 크기가 1이면 모든 키를 UTF-8로
+ * 압축해서 가지고 있는 인덱스가 되고, 파일에서는 그 키의 줄만 읽는다.
+ * 예산이 남으면 없는 키를 파일을 읽기 전에 걸러내도록 bloom filter도
+ * 만든다.
+ */
+#define HANJA_PAGE_MAX_SHIFT 16
+
+typedef struct _HanjaTableScan HanjaTableScan;
+
+struct _HanjaTableScan {
+    unsigned nkeys;
+    unsigned nentries;
+    bool     sorted;
+    uint64_t bytes_read;
+    size_t   full_size;
+    size_t   page_keys_size[HANJA_PAGE_MAX_SHIFT + 1];
+};
+
+/* UCS-4 스트링을 UTF-8로 바꿨을 때의 바이트 수를 구한다. */
+static size_t
+ucs4_utf8_len(const ucschar* s)
+{
+    char buf[8];
+    size_t len = 0;
+
+    while (*s != 0)
+	len += utf8_put_char(buf, *s++);
+
+    return len;
+}
+
+/* 사전 파일을 훑어서 키와 엔트리의 갯수, 정렬 여부, 모두 메모리에
+ * 올렸을 때의 크기와 페이지 크기별 인덱스의 키 크기를 구한다.
+ * 크기는 hanja_builder_add()와 hanja_builder_finish()가 할당하는 것과
+ * 같게 계산하되, 같은 값을 한번만 저장하는 것은 고려하지 않으므로 실제보다
+ * 클 수 있다. */
+static void
+hanja_table_scan(FILE* file, HanjaTableScan* scan)
+{
+    char buf[512];
+    char prev_key[512] = "";
+    ucschar normalized[512];
+    uint16_t encoded[512 * HANJA_KEY_MAX_UNITS];
+    ucschar prev[512];
+    char* key;
+    char* value;
+    size_t size;
+    unsigned s;
+
+    memset(scan, 0, sizeof(*scan));
+    scan->sorted = true;
+    prev[0] = 0;
+
+    size = offsetof(HanjaData, entries);
+    while (fgets(buf, sizeof(buf), file) != NULL) {
+	scan->bytes_read += strlen(buf);
+
+	if (!hanja_split_line(buf, &key, &value, NULL))
+	    continue;
+
+	if (scan->nentries == 0 || strcmp(prev_key, key) != 0) {
+	    size_t len = hanja_key_normalize(normalized, key, NULL);
+	    int res = ucs4_strcmp(prev, normalized);
+
+	    size += strlen(key) + 1;
+	    size += (utf8_to_ucs4(NULL, key) + 1) * sizeof(ucschar);
+	    strcpy(prev_key, key);
+
+	    if (scan->nkeys == 0 || res != 0) {
+		size_t utf8_len = ucs4_utf8_len(normalized) + 1;
+
+		if (scan->nkeys > 0 && res > 0)
+		    scan->sorted = false;
+
+		for (s = 0; s <= HANJA_PAGE_MAX_SHIFT; s++) {
+		    if ((scan->nkeys & ((1U << s) - 1)) == 0)
+			scan->page_keys_size[s] += utf8_len;
+		}
+
+		size += sizeof(HanjaIndex) +
+			(hanja_key_encode(encoded, normalized) + 1) * sizeof(uint16_t);
+		memcpy(prev, normalized, (len + 1) * sizeof(ucschar));
+		scan->nkeys++;
+	    }
+	}
+
+	size += sizeof(Hanja);
+	size += strlen(value) + 1;
+	size += (utf8_to_ucs4(NULL, value) + 1) * sizeof(ucschar);
+	scan->nentries++;
+    }
+
+    size += hanja_bloom_nblocks(scan->nkeys) * HANJA_BLOOM_BLOCK_WORDS *
+	    sizeof(uint64_t);
+    size += nsyllables * sizeof(uint32_t);
+    scan->full_size = size;
+}
+
+/* 페이지 크기가 (1 << @a shift) 일때 HanjaPageIndex가 쓰는 메모리 */
+static size_t
+hanja_page_index_size(const HanjaTableScan* scan, unsigned shift)
+{
+    size_t npages = ((size_t)scan->nkeys + (1U << shift) - 1) >> shift;
+
+    return sizeof(HanjaPageIndex) + (npages + 1) * sizeof(uint32_t) +
+	   npages * sizeof(uint32_t) + scan->page_keys_size[shift];
+}
+
+/* 사전 파일을 다시 읽으면서 interval개의 키마다 페이지를 나눠서
+ * sparse index를 만든다. 페이지는 정규화한 키가 바뀌는 곳에서만
+ * 나누므로 정규화한 키가 같은 엔트리는 항상 한 페이지에 있다. */
+static HanjaTable*
+hanja_table_load_paged(FILE* file, unsigned interval, bool bloom,
+		       const HanjaTableScan* scan, uint64_t start)
+{
+    char buf[512];
+    ucschar normalized[512];
+    uint16_t encoded[512 * HANJA_KEY_MAX_UNITS];
+    ucschar prev[512];
+    char* key;
+    char* value;
+    long offset;
+    HanjaBuffer offsets = { NULL, 0, 0 };
+    HanjaBuffer key_offsets = { NULL, 0, 0 };
+    HanjaBuffer keys = { NULL, 0, 0 };
+    HanjaPageIndex* pages = NULL;
+    HanjaTable* table = NULL;
+    uint32_t off;
+
+    table = malloc(sizeof(*table));
+    if (table == NULL)
+	goto failed;
+
+    hanja_table_init(table);
+    pages = calloc(1, sizeof(*pages));
+    if (pages == NULL)
+	goto failed;
+
+    if (bloom && !hanja_bloom_alloc(table, scan->nkeys))
+	goto failed;
+
+    prev[0] = 0;
+    offset = ftell(file);
+    while (fgets(buf, sizeof(buf), file) != NULL) {
+	long line_offset = offset;
+	offset = ftell(file);
+
+	if (!hanja_split_line(buf, &key, &value, NULL))
+	    continue;
+
+	if (line_offset > UINT32_MAX)
+	    goto failed;
+
+	hanja_key_normalize(normalized, key, NULL);
+	if (pages->nkeys == 0 || ucs4_strcmp(prev, normalized) != 0) {
+	    if (pages->nkeys % interval == 0) {
+		char* utf8 = ucs4_to_utf8_dup(normalized);
+		bool ok;
+
+		if (utf8 == NULL)
+		    goto failed;
+
+		off = line_offset;
+		ok = hanja_buffer_append(&offsets, &off, sizeof(off));
+		off = keys.len;
+		ok = ok && hanja_buffer_append(&key_offsets, &off, sizeof(off));
+		ok = ok && hanja_buffer_append(&keys, utf8, strlen(utf8) + 1);
+		free(utf8);
+		if (!ok)
+		    goto failed;
+
+		pages->npages++;
+	    }
+
+	    if (table->bloom != NULL) {
+		hanja_key_encode(encoded, normalized);
+		hanja_bloom_add(table, hanja_key_hash(encoded));
+	    }
+
+	    memcpy(prev, normalized, sizeof(prev));
+	    pages->nkeys++;
+	}
+	pages->nentries++;
+    }
+
+    if (offset > UINT32_MAX)
+	goto failed;
+
+    off = offset;
+    if (!hanja_buffer_append(&offsets, &off, sizeof(off)))
+	goto failed;
+
+    pages->interval = interval;
+    pages->offsets = (uint32_t*)offsets.data;
+    pages->key_offsets = (uint32_t*)key_offsets.data;
+    pages->keys = keys.data;
+    pages->keys_size = keys.len;
+
+    table->pages = pages;
+    table->file = file;
+    table->bytes_read = scan->bytes_read + offset;
+    table->load_time_ns = hanja_get_time_ns() - start;
+
+    return table;
+
+failed:
+    free(offsets.data);
+    free(key_offsets.data);
+    free(keys.data);
+    free(pages);
+    if (table != NULL)
+	free(table->bloom);
+    free(table);
+    return NULL;
+}
+
+/* 페이지 모드의 사전에서 정규화한 키가 @a key 와 같은 엔트리를 찾는다.
+ * 키가 있을 수 있는 페이지를 이진 검색으로 찾고, 파일에서 그 페이지를
+ * 읽으면서 키가 같은 줄로 데이터 블럭을 만든다. 블럭은 결과 리스트가
+ * 가지고 있다가 hanja_list_delete()에서 free한다. */
+static void
+hanja_table_match_page(const HanjaTable* table,
+		       const char* key, const ucschar* ucs4_key,
+		       HanjaList** list)
+{
+    const HanjaPageIndex* pages = table->pages;
+    char buf[512];
+    ucschar normalized[512];
+    ucschar* query;
+    char* utf8;
+    char* k;
+    char* value;
+    char* comment;
+    long offset;
+    long end;
+    size_t len;
+    int low, high, mid;
+    int page = -1;
+    bool failed = false;
+    HanjaBuilder builder;
+    HanjaTable block;
+
+    query = hanja_key_normalize_dup(key, ucs4_key, &len);
+    if (query == NULL)
+	return;
+
+    utf8 = ucs4_to_utf8_dup(query);
+    if (utf8 == NULL) {
+	free(query);
+	return;
+    }
+
+    /* 첫 키가 query보다 크지 않은 마지막 페이지 */
+    low = 0;
+    high = (int)pages->npages - 1;
+    while (low <= high) {
+	mid = (low + high) / 2;
+	if (strcmp(pages->keys + pages->key_offsets[mid], utf8) <= 0) {
+	    page = mid;
+	    low = mid + 1;
+	} else {
+	    high = mid - 1;
+	}
+    }
+    free(utf8);
+
+    if (page < 0) {
+	free(query);
+	return;
+    }
+
+    /* 다른 쓰레드의 검색이나 설명을 읽는 것과 파일 위치를 공유한다. */
+    hanja_table_lock_file(table);
+    if (fseek(table->file, pages->offsets[page], SEEK_SET) != 0) {
+	hanja_table_unlock_file(table);
+	free(query);
+	return;
+    }
+
+    hanja_builder_init(&builder);
+    builder.inline_comments = true;
+
+    offset = pages->offsets[page];
+    end = pages->offsets[page + 1];
+    while (offset < end && fgets(buf, sizeof(buf), table->file) != NULL) {
+	long line_offset = offset;
+	int res;
+
+	offset = ftell(table->file);
+	hanja_counter_add(&((HanjaTable*)table)->bytes_read, strlen(buf));
+
+	if (!hanja_split_line(buf, &k, &value, &comment))
+	    continue;
+
+	hanja_key_normalize(normalized, k, NULL);
+	res = ucs4_strcmp(normalized, query);
+	if (res < 0)
+	    continue;
+	if (res > 0)
+	    break;
+
+	if (!hanja_builder_add(&builder, k, value, line_offset, comment)) {
+	    failed = true;
+	    break;
+	}
+    }
+    hanja_table_unlock_file(table);
+
+    if (failed || builder.nentries == 0)
+	goto done;
+
+    hanja_table_init(&block);
+    if (!hanja_builder_finish(&builder, &block))
+	goto done;
+
+    free(block.keytable);
+    free(block.keys);
+    block.data->table = (HanjaTable*)table;
+    hanja_ref_inc(&((HanjaTable*)table)->refcount);
+
+    if (*list == NULL)
+	*list = hanja_list_new(key, ucs4_key);
+
+    if (*list != NULL)
+	hanja_list_append_n(*list, block.data->entries, block.nentries);
+    hanja_data_unref(block.data);
+
+done:
+    hanja_builder_free(&builder);
+    free(query);
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief 한자 사전 파일을 로딩하는 함수
+ * @param filename 로딩할 사전 파일의 위치, 또는 NULL
+ * @return 한자 사전 object 또는 NULL
+ *
+ * 이 함수는 한자 사전 파일을 로딩하는 함수로 @a filename으로 지정된 
+ * 파일을 로딩한다. 한자 사전 파일은 libhangul에서 사용하는 포맷이어야 한다.
+ * 한자 사전 파일의 포맷에 대한 정보는 HanjaTable을 참조한다.
+ * 
+ * @a filename은 locale에 따른 인코딩으로 되어 있어야 한다. UTF-8이 아닐 수
+ * 있으므로 주의한다.
+ * 
+ * @a filename 에 NULL을 주면 libhangul에서 디폴트로 배포하는 사전을 로딩한다.
+ * 파일이 없거나, 포맷이 맞지 않으면 로딩에 실패하고 NULL을 리턴한다.
+ * 한자 사전이 더이상 필요없으면 hanja_table_delete() 함수로 삭제해야 한다.
+ *
+ * 사전 전체를 메모리에 올린다. 메모리를 제한하려면
+ * hanja_table_load_with_budget() 을 사용한다.
+ */
+HanjaTable*
+hanja_table_load(const char* filename)
+{
+    return hanja_table_load_with_budget(filename, 0);
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief 메모리 예산 안에서 한자 사전 파일을 로딩하는 함수
+ * @param filename 로딩할 사전 파일의 위치, 또는 NULL
+ * @param budget 사전이 쓸 수 있는 메모리, 바이트 단위. 0이면 제한이 없다.
+ * @return 한자 사전 object 또는 NULL
+ *
+ * hanja_table_load() 와 같지만, 사전 전체를 메모리에 올렸을 때의 크기가
+ * @a budget 보다 크면 키의 일부만 가진 sparse index를 메모리에 두고
+ * 엔트리는 검색할 때마다 사전 파일에서 읽는다. 인덱스는 예산 안에서
+ * 가장 촘촘하게 만든다. 사전이 쓰는 메모리가 줄어드는 대신 검색할 때마다
+ * 파일을 읽으므로 검색이 느려진다. 어떤 방식으로 로딩했는지는
+ * hanja_table_get_stat() 의 HANJA_TABLE_STAT_MODE 와
+ * HANJA_TABLE_STAT_PAGE_SIZE 로 확인할 수 있다.
+ *
+ * 예산은 로딩한 직후의 메모리에 대한 것이다. 모두 메모리에 올린 사전은
+ * hanja_get_comment() 로 읽은 설명을 보관하므로 그만큼 메모리가 늘어난다.
+ *
+ * 페이지 모드는 정렬된 사전 파일에서만 쓸 수 있다. 정렬되지 않은 사전은
+ * 예산과 관계 없이 모두 메모리에 올린다. 예산이 너무 작아서 가장 성긴
+ * 인덱스도 들어가지 않으면 가장 성긴 인덱스로 로딩한다.
+ *
+ * 페이지 모드에서는 hanja_table_apply_patch() 와
+ * hanja_table_start_prefetch() 가 실패하고, hanja_table_search_comment(),
+ * hanja_table_search_value(), hanja_table_match_fuzzy() 는 NULL을 리턴한다.
+ * 이 기능들은 모든 키나 엔트리를 메모리에서 훑어야 하기 때문이다.
+ */
+HanjaTable*
+hanja_table_load_with_budget(const char* filename, size_t budget)
+{
+    FILE* file;
+    HanjaTable* table = NULL;
+    HanjaTableScan scan;
+    uint64_t start;
+    size_t bloom_size;
+    unsigned shift = HANJA_PAGE_MAX_SHIFT;
+    bool bloom = false;
+    bool found = false;
+    int pass;
+
+    if (filename == NULL)
+#ifdef LIBHANGUL_DEFAULT_HANJA_DIC
+	filename = LIBHANGUL_DEFAULT_HANJA_DIC;
+#else
+	return NULL;
+#endif /* LIBHANGUL_DEFAULT_HANJA_DIC */
+
+    start = hanja_get_time_ns();
+
+    file = fopen(filename, "r");
+    if (file == NULL) {
+	return NULL;
+    }
+
+    if (budget == 0) {
+	table = hanja_table_load_full(file, start, 0);
+	goto done;
+    }
+
+    hanja_table_scan(file, &scan);
+    if (ferror(file) || fseek(file, 0, SEEK_SET) != 0)
+	goto done;
+
+    if (!scan.sorted || scan.nkeys == 0 || scan.full_size <= budget) {
+	table = hanja_table_load_full(file, start, scan.bytes_read);
+	goto done;
+    }
+
+    /* bloom filter까지 들어가는 가장 작은 페이지를 먼저 찾고, 없으면
+     * bloom filter 없이 찾는다. */
+    bloom_size = hanja_bloom_nblocks(scan.nkeys) * HANJA_BLOOM_BLOCK_WORDS *
+		 sizeof(uint64_t);
+    for (pass = 0; pass < 2 && !found; pass++) {
+	unsigned s;
+
+	for (s = 0; s <= HANJA_PAGE_MAX_SHIFT; s++) {
+	    size_t size = hanja_page_index_size(&scan, s);
+	    if (pass == 0)
+		size += bloom_size;
+	    if (size <= budget) {
+		shift = s;
+		bloom = pass == 0;
+		found = true;
+		break;
+	    }
+	}
+    }
+
+    table = hanja_table_load_paged(file, 1U << shift, bloom, &scan, start);
+
+done:
+    if (table == NULL)
+	fclose(file);
+    return table;
+}
+
+/*
+ * 정렬되지 않은 사전 파일 정렬
+ *
+ * 사용자가 만든 단어 목록은 대부분 정렬되어 있지 않고, 메모리에 한번에
+ * 올리기 어려울 만큼 클 수도 있다. 입력을 정해진 메모리 안에서 읽을 수
+ * 있는 만큼씩 나눠서 정렬한 run을 임시 파일에 쓰고, 그 run들을 k-way
+ * merge해서 정렬된 사전 파일을 만든다.
+ */
+#define HANJA_SORT_DEFAULT_MEMORY (64 * 1024 * 1024)
+#define HANJA_SORT_MAX_RUNS 64
+
+typedef struct _HanjaSortLine   HanjaSortLine;
+typedef struct _HanjaSortRun    HanjaSortRun;
+typedef struct _HanjaSortCursor HanjaSortCursor;
+
+struct _HanjaSortLine {
+    ucschar* key;
+    char*    line;
+    size_t   seq;
+};
+
+/* 정렬된 줄을 쓴 임시 파일. level은 이 run을 만들기 위해 merge를 몇번
+ * 거쳤는지를 나타낸다. */
+struct _HanjaSortRun {
+    FILE*    file;
+    unsigned level;
+};
+
+/* merge할 run 하나에서 현재 읽은 줄 */
+struct _HanjaSortCursor {
+    FILE*       file;
+    HanjaBuffer line;
+    ucschar*    key;
+    size_t      run;
+};
+
+/* @a file 에서 한 줄을 읽어서 줄바꿈 문자를 뺀 스트링으로 @a line 에
+ * 넣는다. 한 줄을 읽었으면 1, 파일의 끝이면 0, 에러가 나면 -1을
+ * 리턴한다. */
+static int
+hanja_read_line(FILE* file, HanjaBuffer* line)
+{
+    char buf[512];
+    char null = '\0';
+
+    line->len = 0;
+    while (fgets(buf, sizeof(buf), file) != NULL) {
+	size_t len = strlen(buf);
+	if (!hanja_buffer_append(line, buf, len))
+	    return -1;
+	if (len > 0 && buf[len - 1] == '\n')
+	    break;
+    }
+
+    if (ferror(file))
+	return -1;
+    if (line->len == 0)
+	return 0;
+
+    while (line->len > 0 &&
+	   (line->data[line->len - 1] == '\n' || line->data[line->len - 1] == '\r'))
+	line->len--;
+
+    if (!hanja_buffer_append(line, &null, 1))
+	return -1;
+    return 1;
+}
+
+/* hanja_table_load()가 엔트리로 읽는 줄인지 확인한다. */
+static bool
+hanja_sort_is_entry(const char* line)
+{
+    const char* value;
+
+    if (line[0] == '#' || line[0] == ':' || line[0] == '\0')
+	return false;
+
+    value = strchr(line, ':');
+    if (value == NULL)
+	return false;
+
+    return value[strspn(value, ":")] != '\0';
+}
+
+/* 줄에서 키 부분을 정규화한 키를 새로 할당한다. */
+static ucschar*
+hanja_sort_line_key(char* line)
+{
+    char* colon = strchr(line, ':');
+    ucschar* key;
+    size_t len;
+
+    *colon = '\0';
+    key = hanja_key_normalize_dup(line, NULL, &len);
+    *colon = ':';
+
+    return key;
+}
+
+static int
+compare_sort_line(const void* a, const void* b)
+{
+    const HanjaSortLine* x = a;
+    const HanjaSortLine* y = b;
+    int res;
+
+    res = ucs4_strcmp(x->key, y->key);
+    if (res != 0)
+	return res;
+
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+/* 메모리에 모은 줄을 정렬해서 @a output 에 쓰고 free한다.
+ * 같은 키의 줄은 입력의 순서를 유지한다. */
+static bool
+hanja_sort_write_run(HanjaSortLine* lines, size_t n, FILE* output)
+{
+    size_t i;
+
+    if (n > 0)
+	qsort(lines, n, sizeof(lines[0]), compare_sort_line);
+
+    for (i = 0; i < n; i++) {
+	if (output != NULL &&
+	    (fputs(lines[i].line, output) == EOF || fputc('\n', output) == EOF))
+	    output = NULL;
+	free(lines[i].key);
+	free(lines[i].line);
+    }
+
+    return output != NULL;
+}
+
+/* 키가 같으면 앞의 run에 있던 줄이 먼저 나온다. 앞의 run이 입력에서도
+ * 앞에 있던 줄이므로 같은 키 안에서 입력의 순서가 유지된다. */
+static int
+compare_sort_cursor(const HanjaSortCursor* a, const HanjaSortCursor* b)
+{
+    int res = ucs4_strcmp(a->key, b->key);
+    if (res != 0)
+	return res;
+
+    return a->run < b->run ? -1 : a->run > b->run;
+}
+
+/* 다음 줄을 읽는다. 1, 0, -1은 hanja_read_line()과 같다. */
+static int
+hanja_sort_cursor_next(HanjaSortCursor* cursor)
+{
+    int res;
+
+    free(cursor->key);
+    cursor->key = NULL;
+
+    res = hanja_read_line(cursor->file, &cursor->line);
+    if (res <= 0)
+	return res;
+
+    cursor->key = hanja_sort_line_key(cursor->line.data);
+    return cursor->key != NULL ? 1 : -1;
+}
+
+static void
+hanja_sort_heap_down(HanjaSortCursor** heap, size_t n, size_t i)
+{
+    for (;;) {
+	size_t min = i;
+	size_t l = 2 * i + 1;
+	size_t r = l + 1;
+	HanjaSortCursor* tmp;
+
+	if (l < n && compare_sort_cursor(heap[l], heap[min]) < 0)
+	    min = l;
+	if (r < n && compare_sort_cursor(heap[r], heap[min]) < 0)
+	    min = r;
+	if (min == i)
+	    break;
+
+	tmp = heap[i];
+	heap[i] = heap[min];
+	heap[min] = tmp;
+	i = min;
+    }
+}
+
+/* 정렬된 run @a runs 를 merge해서 @a output 에 쓴다. run은 모두 닫는다. */
+static bool
+hanja_sort_merge(const HanjaSortRun* runs, size_t nruns, FILE* output)
+{
+    HanjaSortCursor cursors[HANJA_SORT_MAX_RUNS];
+    HanjaSortCursor* heap[HANJA_SORT_MAX_RUNS];
+    size_t n = 0;
+    size_t i;
+    bool ret = true;
+
+    for (i = 0; i < nruns; i++) {
+	HanjaSortCursor* cursor = &cursors[i];
+	int res;
+
+	cursor->file = runs[i].file;
+	cursor->line.data = NULL;
+	cursor->line.len = 0;
+	cursor->line.alloc = 0;
+	cursor->key = NULL;
+	cursor->run = i;
+
+	rewind(cursor->file);
+	res = hanja_sort_cursor_next(cursor);
+	if (res < 0)
+	    ret = false;
+	else if (res > 0)
+	    heap[n++] = cursor;
+    }
+
+    for (i = n / 2; i > 0; i--)
+	hanja_sort_heap_down(heap, n, i - 1);
+
+    while (ret && n > 0) {
+	HanjaSortCursor* cursor = heap[0];
+	int res;
+
+	if (fputs(cursor->line.data, output) == EOF ||
+	    fputc('\n', output) == EOF) {
+	    ret = false;
+	    break;
+	}
+
+	res = hanja_sort_cursor_next(cursor);
+	if (res < 0)
+	    ret = false;
+	else if (res == 0)
+	    heap[0] = heap[--n];
+	hanja_sort_heap_down(heap, n, 0);
+    }
+
+    for (i = 0; i < nruns; i++) {
+	free(cursors[i].key);
+	free(cursors[i].line.data);
+	fclose(cursors[i].file);
+    }
+
+    return ret;
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief 정렬되지 않은 한자 사전 파일을 정렬하는 함수
+ * @param input 정렬할 사전 파일
+ * @param output 정렬한 결과를 쓸 파일
+ * @param memory_limit 정렬에 쓸 메모리의 크기(바이트), 0이면 64MiB
+ * @return 성공하면 true, 실패하면 false
+ *
+ * hanja_table_load()가 읽는 것과 같은 형식의 사전 파일 @a input 을 키의
+ * 순서로 정렬해서 @a output 에 쓴다. 주석과 빈 줄, 엔트리가 아닌 줄은
+ * 빠진다. 같은 키의 엔트리는 @a input 에 나온 순서를 그대로 유지하므로
+ * 많이 쓰는 것을 앞에 적은 목록이면 그 순서가 그대로 남는다.
+ *
+ * hanja_table_load()도 정렬되지 않은 파일을 읽을 수 있지만 사전 전체를
+ * 메모리에서 정렬한다. 이 함수는 @a memory_limit 만큼씩 읽어서 정렬한
+ * 조각을 임시 파일에 쓰고 그 조각들을 merge하므로, 아주 큰 목록도 정해진
+ * 메모리 안에서 정렬할 수 있다. 정렬한 파일은 로딩할 때 다시 정렬할
+ * 필요가 없다.
+ */
+bool
+hanja_table_sort_file(const char* input, const char* output,
+		      size_t memory_limit)
+{
+    HanjaBuffer lines = { NULL, 0, 0 };
+    HanjaBuffer runs = { NULL, 0, 0 };
+    HanjaBuffer line = { NULL, 0, 0 };
+    HanjaSortRun* r;
+    FILE* in;
+    FILE* out = NULL;
+    size_t used = 0;
+    size_t seq = 0;
+    size_t nruns;
+    size_t i;
+    bool ret = false;
+    int res;
+
+    if (input == NULL || output == NULL)
+	return false;
+
+    if (memory_limit == 0)
+	memory_limit = HANJA_SORT_DEFAULT_MEMORY;
+
+    in = fopen(input, "r");
+    if (in == NULL)
+	return false;
+
+    while ((res = hanja_read_line(in, &line)) > 0) {
+	HanjaSortLine item;
+
+	if (!hanja_sort_is_entry(line.data))
+	    continue;
+
+	item.line = strdup(line.data);
+	item.key = item.line != NULL ? hanja_sort_line_key(item.line) : NULL;
+	item.seq = seq++;
+	if (item.key == NULL ||
+	    !hanja_buffer_append(&lines, &item, sizeof(item))) {
+	    free(item.key);
+	    free(item.line);
+	    res = -1;
+	    break;
+	}
+
+	/* 메모리가 차면 모은 줄을 정렬해서 run으로 쓴다. */
+	used += sizeof(item) + line.len + (line.len + 1) * sizeof(ucschar);
+	if (used >= memory_limit) {
+	    HanjaSortRun run;
+	    bool written;
+
+	    run.file = tmpfile();
+	    run.level = 0;
+	    written = hanja_sort_write_run((HanjaSortLine*)lines.data,
+					   lines.len / sizeof(item), run.file);
+	    lines.len = 0;
+	    used = 0;
+	    if (!written || !hanja_buffer_append(&runs, &run, sizeof(run))) {
+		if (run.file != NULL)
+		    fclose(run.file);
+		res = -1;
+		break;
+	    }
+
+	    /* 열린 임시 파일이 너무 많아지지 않도록 같은 level의 run이
+	     * HANJA_SORT_MAX_RUNS 개 모이면 하나로 merge한다. 뒤에 있는
+	     * run은 입력에서도 뒤에 있던 줄이므로 이웃한 run끼리 merge해야
+	     * 같은 키의 순서가 유지된다. */
+	    for (;;) {
+		nruns = runs.len / sizeof(run);
+		r = (HanjaSortRun*)runs.data;
+		if (nruns < HANJA_SORT_MAX_RUNS ||
+		    r[nruns - HANJA_SORT_MAX_RUNS].level != r[nruns - 1].level)
+		    break;
+
+		run.file = tmpfile();
+		run.level = r[nruns - 1].level + 1;
+		if (run.file == NULL) {
+		    res = -1;
+		    break;
+		}
+
+		written = hanja_sort_merge(r + nruns - HANJA_SORT_MAX_RUNS,
+					   HANJA_SORT_MAX_RUNS, run.file);
+		runs.len -= HANJA_SORT_MAX_RUNS * sizeof(run);
+		if (!written) {
+		    fclose(run.file);
+		    res = -1;
+		    break;
+		}
+		hanja_buffer_append(&runs, &run, sizeof(run));
+	    }
+	    if (res < 0)
+		break;
+	}
+    }
+    fclose(in);
+    free(line.data);
+
+    if (res == 0 && lines.len > 0 && runs.len > 0) {
+	HanjaSortRun run;
+
+	run.file = tmpfile();
+	run.level = 0;
+	if (!hanja_sort_write_run((HanjaSortLine*)lines.data,
+				  lines.len / sizeof(HanjaSortLine), run.file) ||
+	    !hanja_buffer_append(&runs, &run, sizeof(run))) {
+	    if (run.file != NULL)
+		fclose(run.file);
+	    res = -1;
+	}
+	lines.len = 0;
+    }
+
+    if (res == 0)
+	out = fopen(output, "w");
+
+    if (out != NULL) {
+	nruns = runs.len / sizeof(HanjaSortRun);
+	if (nruns == 0) {
+	    /* 모두 메모리에 들어가면 임시 파일 없이 바로 쓴다. */
+	    ret = hanja_sort_write_run((HanjaSortLine*)lines.data,
+				       lines.len / sizeof(HanjaSortLine), out);
+	    lines.len = 0;
+	} else if (nruns <= HANJA_SORT_MAX_RUNS) {
+	    ret = hanja_sort_merge((HanjaSortRun*)runs.data, nruns, out);
+	    runs.len = 0;
+	} else {
+	    /* level마다 HANJA_SORT_MAX_RUNS 개 미만의 run이 남아 있다.
+	     * 뒤에서부터 낮은 level의 run을 합쳐서 갯수를 줄인다. */
+	    HanjaSortRun run;
+
+	    while (nruns > HANJA_SORT_MAX_RUNS) {
+		size_t n = nruns - HANJA_SORT_MAX_RUNS + 1;
+
+		if (n > HANJA_SORT_MAX_RUNS)
+		    n = HANJA_SORT_MAX_RUNS;
+
+		run.file = tmpfile();
+		run.level = 0;
+		if (run.file == NULL)
+		    break;
+
+		r = (HanjaSortRun*)runs.data;
+		if (!hanja_sort_merge(r + nruns - n, n, run.file)) {
+		    runs.len -= n * sizeof(run);
+		    fclose(run.file);
+		    break;
+		}
+		runs.len -= n * sizeof(run);
+		hanja_buffer_append(&runs, &run, sizeof(run));
+		nruns = runs.len / sizeof(run);
+	    }
+
+	    if (nruns <= HANJA_SORT_MAX_RUNS) {
+		ret = hanja_sort_merge((HanjaSortRun*)runs.data, nruns, out);
+		runs.len = 0;
+	    }
+	}
+
+	if (fclose(out) != 0)
+	    ret = false;
+    }
+
+    /* 실패한 경우 남은 줄과 run을 정리한다. */
+    hanja_sort_write_run((HanjaSortLine*)lines.data,
+			 lines.len / sizeof(HanjaSortLine), NULL);
+    r = (HanjaSortRun*)runs.data;
+    for (i = 0; i < runs.len / sizeof(HanjaSortRun); i++)
+	fclose(r[i].file);
+    free(runs.data);
+    free(lines.data);
+
+    return ret;
+}
+
+static size_t
+hanja_posting_index_size(const HanjaPostingIndex* index)
+{
+    if (index == NULL)
+	return 0;
+
+    return sizeof(*index) + index->npostings * sizeof(index->postings[0]) +
+	   index->data_len;
+}
+
+static size_t
+hanja_table_index_size(const HanjaTable* table)
+{
+    size_t size;
+
+    size = table->nkeys * sizeof(table->keytable[0]) + table->keys_size;
+    if (table->pages != NULL)
+	size += sizeof(*table->pages) +
+		(table->pages->npages * 2 + 1) * sizeof(uint32_t) +
+		table->pages->keys_size;
+    if (table->bloom != NULL)
+	size += (table->bloom_mask + 1) * HANJA_BLOOM_BLOCK_WORDS *
+		sizeof(table->bloom[0]);
+    if (table->syllables != NULL)
+	size += nsyllables * sizeof(table->syllables[0]);
+    size += hanja_posting_index_size(hanja_pointer_get(&table->comment_index));
+    size += hanja_posting_index_size(hanja_pointer_get(&table->value_index));
+
+    return size;
+}
+
+static size_t
+hanja_table_data_size(const HanjaTable* table)
+{
+    size_t size;
+
+    size = table->data_size + table->comment_bytes;
+    if (table->comments != NULL)
+	size += table->nentries * sizeof(table->comments[0]);
+    if (table->ucs4_comments != NULL)
+	size += table->nentries * sizeof(table->ucs4_comments[0]);
+
+    return size;
+}
+
+/* 검색할 수 있는 키와 엔트리의 갯수를 센다. overlay가 있으면 원래 사전에서
+ * overlay의 키로 가려진 것은 빼고 overlay에 있는 것을 더한다. 패치로
+ * 엔트리를 모두 지운 키는 overlay에 있어도 세지 않는다. */
+static void
+hanja_table_count_visible(const HanjaTable* table,
+			  uint64_t* nkeys, uint64_t* nentries)
+{
+    const HanjaTable* overlay = table->overlay;
+    unsigned i;
+
+    if (table->pages != NULL) {
+	*nkeys = table->pages->nkeys;
+	*nentries = table->pages->nentries;
+    } else {
+	*nkeys = table->nkeys;
+	*nentries = table->nentries;
+    }
+
+    if (overlay == NULL)
+	return;
+
+    for (i = 0; i < overlay->nkeys; i++) {
+	const HanjaIndex* index = &overlay->keytable[i];
+	const uint16_t* key = overlay->keys + index->key;
+	int k;
+
+	k = hanja_table_find_index(table, key);
+	for (; k >= 0 && k < (int)table->nkeys; k++) {
+	    if (hanja_key_strcmp(table->keys + table->keytable[k].key, key) != 0)
+		break;
+	    *nkeys -= 1;
+	    *nentries -= table->keytable[k].n;
+	}
+
+	if (index->n > 0) {
+	    *nkeys += 1;
+	    *nentries += index->n;
+	}
+    }
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief 한자 사전의 통계를 구하는 함수
+ * @param table 한자 사전 object
+ * @param stat 구할 통계의 종류
+ * @return @a stat 의 값
+ *
+ * 로딩한 사전의 크기와 검색 횟수를 확인할 때 사용한다. @a stat 은 다음 중
+ * 하나다.
+ *
+ * - HANJA_TABLE_STAT_KEYS: 키의 갯수
+ * - HANJA_TABLE_STAT_ENTRIES: 엔트리의 갯수
+ * - HANJA_TABLE_STAT_INDEX_BYTES: 키 인덱스나 페이지 인덱스, bloom filter,
+ *   음절 테이블, 설명과 한자 검색용 인덱스가 쓰는 메모리
+ * - HANJA_TABLE_STAT_DATA_BYTES: 키, 값 컬럼과 메모리에 읽어둔 설명이
+ *   쓰는 메모리
+ * - HANJA_TABLE_STAT_HEAP_BYTES: 사전이 할당한 메모리 전체
+ * - HANJA_TABLE_STAT_MAPPED_BYTES: 사전 파일을 메모리에 매핑한 크기
+ * - HANJA_TABLE_STAT_LOAD_TIME_NS: 로딩하는 데 걸린 시간, 나노초 단위
+ * - HANJA_TABLE_STAT_LOOKUPS: 검색 함수를 부른 횟수
+ * - HANJA_TABLE_STAT_MISSES: 그 중에서 결과가 없었던 횟수
+ * - HANJA_TABLE_STAT_BYTES_READ: 사전 파일에서 읽은 바이트 수
+ * - HANJA_TABLE_STAT_PREFETCH_HITS: 검색 결과를 prefetch 캐시에서 찾은 횟수
+ * - HANJA_TABLE_STAT_MODE: 사전을 로딩한 방식. 모두 메모리에 올렸으면
+ *   HANJA_TABLE_MODE_FULL, 검색할 때 파일에서 읽으면 HANJA_TABLE_MODE_PAGED
+ * - HANJA_TABLE_STAT_PAGE_SIZE: 페이지 모드에서 한 페이지의 키 갯수,
+ *   모두 메모리에 올렸으면 0
+ *
+ * hanja_table_apply_patch() 로 적용한 패치가 있으면 키와 엔트리는 패치를
+ * 적용한 뒤에 검색할 수 있는 것의 갯수를 리턴한다. 메모리와 읽은 양에는
+ * 패치가 바꾼 키를 보관하는 테이블의 것도 더한다.
+ * 지금은 사전 파일을 모두 메모리로 읽으므로 매핑한 크기는 0이다.
+ * 페이지 모드에서 검색한 엔트리는 결과 리스트가 가지고 있으므로 데이터의
+ * 메모리에 들어가지 않는다. 대신 한번 검색할 때 파일에서 읽은 양이
+ * HANJA_TABLE_STAT_BYTES_READ 에 더해지므로, 이것을
+ * HANJA_TABLE_STAT_LOOKUPS 로 나누면 검색 한번에 읽는 양을 알 수 있다.
+ * 검색 횟수는 relaxed atomic 카운터로 세므로 항상 켜져 있어도 검색
+ * 속도에 영향이 거의 없다. 모르는 @a stat 에는 0을 리턴한다.
+ */
+uint64_t
+hanja_table_get_stat(const HanjaTable* table, int stat)
+{
+    const HanjaTable* overlay;
+    uint64_t value = 0;
+    uint64_t nkeys, nentries;
+
+    if (table == NULL)
+	return 0;
+
+    overlay = table->overlay;
+    switch (stat) {
+    case HANJA_TABLE_STAT_KEYS:
+	hanja_table_count_visible(table, &nkeys, &nentries);
+	value = nkeys;
+	break;
+    case HANJA_TABLE_STAT_ENTRIES:
+	hanja_table_count_visible(table, &nkeys, &nentries);
+	value = nentries;
+	break;
+    case HANJA_TABLE_STAT_INDEX_BYTES:
+	value = hanja_table_index_size(table);
+	if (overlay != NULL)
+	    value += hanja_table_index_size(overlay);
+	break;
+    case HANJA_TABLE_STAT_DATA_BYTES:
+	value = hanja_table_data_size(table);
+	if (overlay != NULL)
+	    value += hanja_table_data_size(overlay);
+	break;
+    case HANJA_TABLE_STAT_HEAP_BYTES:
+	value = sizeof(*table) + hanja_table_index_size(table) +
+		hanja_table_data_size(table);
+	if (overlay != NULL)
+	    value += sizeof(*overlay) + hanja_table_index_size(overlay) +
+		     hanja_table_data_size(overlay);
+	break;
+    case HANJA_TABLE_STAT_MAPPED_BYTES:
+	value = 0;
+	break;
+    case HANJA_TABLE_STAT_LOAD_TIME_NS:
+	value = table->load_time_ns;
+	break;
+    case HANJA_TABLE_STAT_LOOKUPS:
+	value = hanja_counter_get(&((HanjaTable*)table)->nlookups);
+	break;
+    case HANJA_TABLE_STAT_MISSES:
+	value = hanja_counter_get(&((HanjaTable*)table)->nmisses);
+	break;
+    case HANJA_TABLE_STAT_BYTES_READ:
+	value = hanja_counter_get(&((HanjaTable*)table)->bytes_read);
+	if (overlay != NULL)
+	    value += hanja_counter_get(&((HanjaTable*)overlay)->bytes_read);
+	break;
+    case HANJA_TABLE_STAT_PREFETCH_HITS:
+	value = hanja_counter_get(&((HanjaTable*)table)->nprefetch_hits);
+	break;
+    case HANJA_TABLE_STAT_MODE:
+	value = table->pages != NULL ? HANJA_TABLE_MODE_PAGED
+				     : HANJA_TABLE_MODE_FULL;
+	break;
+    case HANJA_TABLE_STAT_PAGE_SIZE:
+	value = table->pages != NULL ? table->pages->interval : 0;
+	break;
+    }
+
+    return value;
 }
 
 /**
  * @ingroup hanjadictionary
  * @brief 한자 사전 object를 free하는 함수
  * @param table free할 한자 사전 object
+ *
+ * 이 사전에서 검색한 @ref HanjaList 는 이 함수를 부른 뒤에도 쓸 수 있다.
+ * 리스트의 엔트리가 있는 메모리와 설명을 읽을 사전 파일은 그 리스트를
+ * 모두 hanja_list_delete() 함수로 free할 때 놓는다.
  */
 void
 hanja_table_delete(HanjaTable *table)
 {
     if (table != NULL) {
-	free(table->keytable);
-	fclose(table->file);
-	free(table);
+	hanja_table_stop_prefetch(table);
+	hanja_table_delete_overlay(table);
+	hanja_table_release(table);
+    }
+}
+
+/*
+ * 사전 패치
+ *
+ * 로딩한 사전에 엔트리 몇개를 추가하거나 지우기 위해서 사전 파일
+ * 전체를 다시 읽지 않도록, 바뀐 것만 적은 패치 파일을 적용한다.
+ * 패치가 바꾼 키의 엔트리는 모두 overlay라는 작은 HanjaTable로 옮기고,
+ * 검색할 때 overlay에 있는 키는 원래의 사전 대신 overlay에서 찾는다.
+ * overlay는 패치를 적용할 때마다 새로 만들므로 패치의 크기와 overlay의
+ * 크기에 비례하는 시간만 걸린다. hanja_table_compact()는 overlay를
+ * 원래의 사전에 합친다.
+ */
+
+typedef struct _HanjaPatchOp    HanjaPatchOp;
+typedef struct _HanjaPatchEntry HanjaPatchEntry;
+
+/* 패치 파일의 한 줄. key, value, arg는 line 안을 가리킨다. */
+struct _HanjaPatchOp {
+    char*    line;
+    uint16_t* normalized;
+    char*    key;
+    char*    value;
+    char*    arg;
+    char     op;
+    unsigned seq;
+};
+
+/* 패치를 적용하는 동안 한 키의 엔트리를 기억한다. comment가 NULL이면
+ * 설명은 사전 파일의 line_offset에서 읽는다. */
+struct _HanjaPatchEntry {
+    const char* key;
+    const char* value;
+    const char* comment;
+    uint32_t    line_offset;
+};
+
+static int
+compare_patch_op(const void* a, const void* b)
+{
+    const HanjaPatchOp* x = a;
+    const HanjaPatchOp* y = b;
+    int res;
+
+    res = hanja_key_strcmp(x->normalized, y->normalized);
+    if (res != 0)
+	return res;
+
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static void
+hanja_patch_free_ops(HanjaBuffer* ops)
+{
+    HanjaPatchOp* items = (HanjaPatchOp*)ops->data;
+    size_t i;
+
+    for (i = 0; i < ops->len / sizeof(items[0]); i++) {
+	free(items[i].line);
+	free(items[i].normalized);
+    }
+    free(ops->data);
+}
+
+static bool
+hanja_patch_read(const char* filename, HanjaBuffer* ops)
+{
+    char buf[512];
+    FILE* file;
+    unsigned seq = 0;
+
+    file = fopen(filename, "r");
+    if (file == NULL)
+	return false;
+
+    while (fgets(buf, sizeof(buf), file) != NULL) {
+	HanjaPatchOp op;
+	char* save_ptr = NULL;
+
+	/* skip comments and empty lines */
+	if (buf[0] == '#' || buf[0] == '\r' || buf[0] == '\n' || buf[0] == '\0')
+	    continue;
+
+	if (buf[0] != '+' && buf[0] != '-' && buf[0] != '=')
+	    goto failed;
+
+	op.op = buf[0];
+	op.seq = seq++;
+	op.line = strdup(buf + 1);
+	if (op.line == NULL)
+	    goto failed;
+
+	op.key = strtok_r(op.line, ":", &save_ptr);
+	op.value = strtok_r(NULL, ":\r\n", &save_ptr);
+	op.arg = strtok_r(NULL, "\r\n", &save_ptr);
+	if (op.key == NULL || op.value == NULL ||
+	    (op.op == '=' && op.arg == NULL)) {
+	    free(op.line);
+	    goto failed;
+	}
+
+	op.normalized = hanja_key_encode_query(NULL, 0, op.key, NULL);
+	if (op.normalized == NULL) {
+	    free(op.line);
+	    goto failed;
+	}
+
+	if (!hanja_buffer_append(ops, &op, sizeof(op))) {
+	    free(op.line);
+	    free(op.normalized);
+	    goto failed;
+	}
+    }
+
+    fclose(file);
+    return true;
+
+failed:
+    fclose(file);
+    return false;
+}
+
+/* @a index 가 가리키는 엔트리들을 @a entries 에 모은다. */
+static bool
+hanja_patch_collect(const HanjaTable* table, const HanjaIndex* index,
+		    HanjaBuffer* entries)
+{
+    uint32_t i;
+
+    for (i = 0; i < index->n; i++) {
+	const Hanja* hanja = &table->data->entries[index->entry + i];
+	HanjaPatchEntry entry;
+
+	entry.key = hanja_get_key(hanja);
+	entry.value = hanja_get_value(hanja);
+	entry.comment = NULL;
+	if (table->comments != NULL)
+	    entry.comment = table->comments[hanja->id];
+	entry.line_offset = hanja->line_offset;
+	if (!hanja_buffer_append(entries, &entry, sizeof(entry)))
+	    return false;
+    }
+
+    return true;
+}
+
+static bool
+hanja_patch_emit(HanjaBuilder* builder, const uint16_t* normalized,
+		 const HanjaBuffer* entries)
+{
+    const HanjaPatchEntry* items = (const HanjaPatchEntry*)entries->data;
+    size_t n = entries->len / sizeof(items[0]);
+    size_t i;
+
+    if (n == 0)
+	return hanja_builder_add_key(builder, normalized);
+
+    for (i = 0; i < n; i++) {
+	if (!hanja_builder_add(builder, items[i].key, items[i].value,
+			       items[i].line_offset, items[i].comment))
+	    return false;
+    }
+
+    return true;
+}
+
+/* 한 키에 대한 패치 명령을 차례로 적용한다. */
+static bool
+hanja_patch_apply_ops(HanjaBuffer* entries, const HanjaPatchOp* ops, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+	const HanjaPatchOp* op = &ops[i];
+	HanjaPatchEntry* items = (HanjaPatchEntry*)entries->data;
+	size_t nitems = entries->len / sizeof(items[0]);
+	HanjaPatchEntry entry;
+	size_t k;
+	long rank;
+
+	for (k = 0; k < nitems; k++) {
+	    if (strcmp(items[k].value, op->value) == 0)
+		break;
+	}
+
+	switch (op->op) {
+	case '+':
+	    if (k < nitems) {
+		items[k].comment = op->arg != NULL ? op->arg : "";
+	    } else {
+		entry.key = op->key;
+		entry.value = op->value;
+		entry.comment = op->arg != NULL ? op->arg : "";
+		entry.line_offset = 0;
+		if (!hanja_buffer_append(entries, &entry, sizeof(entry)))
+		    return false;
+	    }
+	    break;
+	case '-':
+	    if (k < nitems) {
+		memmove(items + k, items + k + 1,
+			(nitems - k - 1) * sizeof(items[0]));
+		entries->len -= sizeof(items[0]);
+	    }
+	    break;
+	case '=':
+	    if (k < nitems) {
+		rank = strtol(op->arg, NULL, 10);
+		if (rank < 0)
+		    rank = 0;
+		if (rank > (long)nitems - 1)
+		    rank = nitems - 1;
+
+		entry = items[k];
+		memmove(items + k, items + k + 1,
+			(nitems - k - 1) * sizeof(items[0]));
+		memmove(items + rank + 1, items + rank,
+			(nitems - rank - 1) * sizeof(items[0]));
+		items[rank] = entry;
+	    }
+	    break;
+	}
+    }
+
+    return true;
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief 로딩한 한자 사전에 패치 파일을 적용하는 함수
+ * @param table 한자 사전 object
+ * @param filename 패치 파일의 위치
+ * @return 성공하면 true, 파일이 없거나 포맷이 맞지 않으면 false
+ *
+ * 사전 파일 전체를 다시 로딩하지 않고 엔트리를 추가하거나 지우거나
+ * 순서를 바꾼다. 패치 파일은 UTF-8로 된 텍스트 파일로, 각 줄은 명령을
+ * 나타내는 글자 하나와 사전 파일과 같은 형식의 엔트리로 되어 있다.
+ * @code
+ * # 주석
+ * +키:값:설명
+ * -키:값
+ * =키:값:순서
+ * @endcode
+ * '+'는 엔트리를 그 키의 맨 뒤에 추가한다. 같은 값이 이미 있으면 설명만
+ * 바꾼다. '-'는 엔트리를 지운다. '='는 엔트리를 그 키의 엔트리 중에서
+ * 주어진 순서(0부터 시작)로 옮긴다. 패치 파일에 있는 순서대로 적용한다.
+ *
+ * 패치가 바꾼 키의 엔트리는 별도의 작은 테이블(overlay)에 보관하고
+ * 검색할 때 원래의 사전보다 먼저 찾는다. 그러므로 패치를 적용하는 데에는
+ * 사전의 크기가 아니라 패치의 크기에 비례하는 시간이 걸린다. 패치를 여러번
+ * 적용해서 overlay가 커지면 hanja_table_compact() 함수로 원래의 사전에
+ * 합칠 수 있다.
+ *
+ * 이 함수를 부르기 전에 이 사전에서 검색한 @ref HanjaList 는 그 뒤에도
+ * 쓸 수 있고, 이 함수를 부르기 전의 엔트리를 가지고 있다. 실패하면 사전은
+ * 바뀌지 않는다.
+ * hanja_table_load_with_budget() 으로 페이지 모드로 로딩한 사전에는
+ * 패치를 적용할 수 없다.
+ */
+bool
+hanja_table_apply_patch(HanjaTable* table, const char* filename)
+{
+    HanjaBuffer ops = { NULL, 0, 0 };
+    HanjaBuffer entries = { NULL, 0, 0 };
+    HanjaBuilder builder;
+    HanjaTable* old;
+    HanjaTable* overlay = NULL;
+    HanjaPatchOp* items;
+    size_t nops;
+    size_t g, next;
+    unsigned i;
+
+    if (table == NULL || filename == NULL || table->pages != NULL)
+	return false;
+
+    if (!hanja_patch_read(filename, &ops)) {
+	hanja_patch_free_ops(&ops);
+	return false;
+    }
+
+    items = (HanjaPatchOp*)ops.data;
+    nops = ops.len / sizeof(items[0]);
+    if (nops == 0) {
+	hanja_patch_free_ops(&ops);
+	return true;
+    }
+
+    /* 같은 키에 대한 명령을 모으되 파일에 있는 순서는 유지한다. */
+    qsort(items, nops, sizeof(items[0]), compare_patch_op);
+
+    /* 원래 overlay에 있던 키와 패치가 바꾼 키를 정렬된 순서로 합쳐서
+     * 새 overlay를 만든다. */
+    hanja_builder_init(&builder);
+    old = table->overlay;
+    i = 0;
+    g = 0;
+    while (g < nops || (old != NULL && i < old->nkeys)) {
+	const uint16_t* normalized;
+	int res;
+	int k;
+
+	if (g >= nops)
+	    res = -1;
+	else if (old == NULL || i >= old->nkeys)
+	    res = 1;
+	else
+	    res = hanja_key_strcmp(old->keys + old->keytable[i].key,
+				   items[g].normalized);
+
+	entries.len = 0;
+	if (res < 0) {
+	    normalized = old->keys + old->keytable[i].key;
+	    if (!hanja_patch_collect(old, &old->keytable[i], &entries))
+		goto failed;
+	    i++;
+	} else {
+	    normalized = items[g].normalized;
+	    if (res == 0) {
+		if (!hanja_patch_collect(old, &old->keytable[i], &entries))
+		    goto failed;
+		i++;
+	    } else {
+		k = hanja_table_find_index(table, normalized);
+		for (; k >= 0 && k < (int)table->nkeys; k++) {
+		    const HanjaIndex* index = &table->keytable[k];
+		    if (hanja_key_strcmp(table->keys + index->key, normalized) != 0)
+			break;
+		    if (!hanja_patch_collect(table, index, &entries))
+			goto failed;
+		}
+	    }
+
+	    for (next = g; next < nops; next++) {
+		if (hanja_key_strcmp(items[next].normalized, normalized) != 0)
+		    break;
+	    }
+	    if (!hanja_patch_apply_ops(&entries, items + g, next - g))
+		goto failed;
+	    g = next;
+	}
+
+	if (!hanja_patch_emit(&builder, normalized, &entries))
+	    goto failed;
+    }
+
+    overlay = malloc(sizeof(*overlay));
+    if (overlay == NULL)
+	goto failed;
+
+    hanja_table_init(overlay);
+    if (!hanja_builder_finish(&builder, overlay))
+	goto failed;
+
+    /* 원래 사전에서 옮긴 엔트리의 설명은 같은 파일에서 읽는다. */
+    overlay->file = table->file;
+    overlay->parent = table;
+    hanja_ref_inc(&table->refcount);
+
+    hanja_prefetch_pause(table);
+    hanja_table_delete_overlay(table);
+    table->overlay = overlay;
+    hanja_prefetch_resume(table);
+
+    free(entries.data);
+    hanja_patch_free_ops(&ops);
+    return true;
+
+failed:
+    free(overlay);
+    hanja_builder_free(&builder);
+    free(entries.data);
+    hanja_patch_free_ops(&ops);
+    return false;
+}
+
+static bool
+hanja_builder_add_index(HanjaBuilder* builder, const HanjaTable* table,
+			const HanjaIndex* index)
+{
+    uint32_t i;
+
+    for (i = 0; i < index->n; i++) {
+	const Hanja* hanja = &table->data->entries[index->entry + i];
+	const char* comment = NULL;
+
+	if (table->comments != NULL)
+	    comment = table->comments[hanja->id];
+	if (!hanja_builder_add(builder, hanja_get_key(hanja),
+			       hanja_get_value(hanja), hanja->line_offset,
+			       comment))
+	    return false;
+    }
+
+    return true;
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief 패치로 바뀐 내용을 한자 사전에 합치는 함수
+ * @param table 한자 사전 object
+ * @return 성공하면 true, 메모리가 부족하면 false
+ *
+ * hanja_table_apply_patch() 함수로 적용한 패치는 원래의 사전과 따로
+ * 보관된다. 이 함수는 그것을 원래의 사전에 합쳐서 사전 전체의 인덱스를
+ * 다시 만든다. 사전 파일은 다시 읽지 않지만 사전의 크기에 비례하는 시간이
+ * 걸리므로 입력기가 쉬고 있을 때처럼 검색이 없을 때 부르는 것이 좋다.
+ *
+ * 이 함수를 부르기 전에 이 사전에서 검색한 @ref HanjaList 는 그 뒤에도
+ * 쓸 수 있고, 이 함수를 부르기 전의 엔트리를 가지고 있다. 실패하면 사전은
+ * 바뀌지 않는다.
+ */
+bool
+hanja_table_compact(HanjaTable* table)
+{
+    HanjaBuilder builder;
+    HanjaTable merged;
+    HanjaTable* overlay;
+    HanjaTable* old;
+    unsigned i, j;
+
+    if (table == NULL)
+	return false;
+
+    overlay = table->overlay;
+    if (overlay == NULL)
+	return true;
+
+    old = malloc(sizeof(*old));
+    if (old == NULL)
+	return false;
+
+    hanja_builder_init(&builder);
+    i = 0;
+    j = 0;
+    while (i < table->nkeys || j < overlay->nkeys) {
+	const uint16_t* key = NULL;
+	int res;
+
+	if (j >= overlay->nkeys) {
+	    res = -1;
+	} else if (i >= table->nkeys) {
+	    res = 1;
+	} else {
+	    key = overlay->keys + overlay->keytable[j].key;
+	    res = hanja_key_strcmp(table->keys + table->keytable[i].key, key);
+	}
+
+	if (res < 0) {
+	    if (!hanja_builder_add_index(&builder, table, &table->keytable[i]))
+		goto failed;
+	    i++;
+	} else {
+	    /* overlay에 있는 키는 원래 사전의 엔트리를 대신한다. */
+	    while (res == 0 && i < table->nkeys &&
+		   hanja_key_strcmp(table->keys + table->keytable[i].key, key) == 0)
+		i++;
+	    if (!hanja_builder_add_index(&builder, overlay,
+					 &overlay->keytable[j]))
+		goto failed;
+	    j++;
+	}
     }
+
+    hanja_table_init(&merged);
+    if (!hanja_builder_finish(&builder, &merged))
+	goto failed;
+
+    merged.file = table->file;
+    merged.prefetch = table->prefetch;
+    merged.load_time_ns = table->load_time_ns;
+    merged.nlookups = table->nlookups;
+    merged.nmisses = table->nmisses;
+    merged.bytes_read = table->bytes_read + overlay->bytes_read;
+    merged.nprefetch_hits = table->nprefetch_hits;
+    hanja_table_build_bloom(&merged);
+    hanja_table_build_syllables(&merged);
+
+    hanja_prefetch_pause(table);
+    hanja_table_delete_overlay(table);
+
+    /* 원래의 엔트리 블럭을 가진 검색 결과가 있을 수 있으므로 블럭은 그
+     * 설명과 같이 old로 옮기고, 그 결과를 모두 free할 때 놓는다.
+     * 블럭이 가진 table의 reference도 old로 옮겨 간다. */
+    hanja_table_init(old);
+    old->data = table->data;
+    old->nentries = table->nentries;
+    old->comments = table->comments;
+    old->ucs4_comments = table->ucs4_comments;
+    old->file = table->file;
+    old->parent = table;
+    old->data->table = old;
+    hanja_ref_inc(&old->refcount);
+    table->comments = NULL;
+    table->ucs4_comments = NULL;
+    hanja_table_clear(table);
+
+    /* 다른 쓰레드에서 검색 결과를 free하면서 refcount를 바꿀 수 있으므로
+     * parent와 refcount는 그대로 둔다. */
+    memcpy(table, &merged, offsetof(HanjaTable, parent));
+    table->data->table = table;
+    hanja_ref_inc(&table->refcount);
+    hanja_table_release(old);
+    hanja_prefetch_resume(table);
+
+    return true;
+
+failed:
+    hanja_builder_free(&builder);
+    free(old);
+    return false;
 }
 
 /**
@@ -589,20 +5192,19 @@ hanja_table_delete(HanjaTable *table)
  *         있으면 NULL을 리턴한다.
  *
  * @a key 값과 같은 키를 가진 엔트리를 검색한다.
+ * 키는 음절, 첫가끝 자모, 호환 자모 중 어떤 형태로 되어 있어도 같은 키로
+ * 취급한다. 예를 들어 첫가끝 자모로 된 "삼국"은 "삼국"과,
+ * "ᄀᅠ"는 "ㄱ"과 같은 키로 검색된다.
  * 리턴된 결과는 다 사용하고 나면 반드시 hanja_list_delete() 함수로 free해야
  * 한다.
  */
 HanjaList*
 hanja_table_match_exact(const HanjaTable* table, const char *key)
 {
-    HanjaList* ret = NULL;
-
     if (key == NULL || key[0] == '\0' || table == NULL)
 	return NULL;
 
-    hanja_table_match(table, key, &ret);
-
-    return ret;
+    return hanja_table_lookup(table, HANJA_MATCH_EXACT, key, NULL);
 }
 
 /**
@@ -623,26 +5225,10 @@ hanja_table_match_exact(const HanjaTable* table, const char *key)
 HanjaList*
 hanja_table_match_prefix(const HanjaTable* table, const char *key)
 {
-    char* p;
-    char* newkey;
-    HanjaList* ret = NULL;
-
     if (key == NULL || key[0] == '\0' || table == NULL)
 	return NULL;
 
-    newkey = strdup(key);
-    if (newkey == NULL)
-	return NULL;
-
-    p = strchr(newkey, '\0');
-    while (newkey[0] != '\0') {
-	hanja_table_match(table, newkey, &ret);
-	p = utf8_prev(newkey, p);
-	p[0] = '\0';
-    }
-    free(newkey);
-
-    return ret;
+    return hanja_table_lookup(table, HANJA_MATCH_PREFIX, key, NULL);
 }
 
 /**
@@ -663,19 +5249,425 @@ hanja_table_match_prefix(const HanjaTable* table, const char *key)
 HanjaList*
 hanja_table_match_suffix(const HanjaTable* table, const char *key)
 {
-    const char* p;
+    if (key == NULL || key[0] == '\0' || table == NULL)
+	return NULL;
+
+    return hanja_table_lookup(table, HANJA_MATCH_SUFFIX, key, NULL);
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief hanja_table_match_exact()의 UCS-4 버전
+ * @param table 한자 사전 object
+ * @param key 찾을 키, UCS-4
+ * @return 찾은 결과를 HanjaList object로 리턴한다. 찾은 것이 없거나 에러가 
+ *         있으면 NULL을 리턴한다.
+ *
+ * hangul_ic_get_preedit_string() 등으로 얻은 UCS-4 스트링을 UTF-8로 변환하지
+ * 않고 바로 검색할 수 있다. 결과는 hanja_list_get_nth_value_ucs4() 등으로
+ * UCS-4 스트링으로 참조할 수 있다.
+ * 리턴된 결과는 다 사용하고 나면 반드시 hanja_list_delete() 함수로 free해야
+ * 한다.
+ */
+HanjaList*
+hanja_table_match_exact_ucs4(const HanjaTable* table, const ucschar* key)
+{
+    if (key == NULL || key[0] == 0 || table == NULL)
+	return NULL;
+
+    return hanja_table_lookup(table, HANJA_MATCH_EXACT, NULL, key);
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief hanja_table_match_prefix()의 UCS-4 버전
+ * @param table 한자 사전 object
+ * @param key 찾을 키, UCS-4
+ * @return 찾은 결과를 HanjaList object로 리턴한다. 찾은 것이 없거나 에러가 
+ *         있으면 NULL을 리턴한다.
+ *
+ * 리턴된 결과는 다 사용하고 나면 반드시 hanja_list_delete() 함수로 free해야
+ * 한다.
+ */
+HanjaList*
+hanja_table_match_prefix_ucs4(const HanjaTable* table, const ucschar* key)
+{
+    if (key == NULL || key[0] == 0 || table == NULL)
+	return NULL;
+
+    return hanja_table_lookup(table, HANJA_MATCH_PREFIX, NULL, key);
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief hanja_table_match_suffix()의 UCS-4 버전
+ * @param table 한자 사전 object
+ * @param key 찾을 키, UCS-4
+ * @return 찾은 결과를 HanjaList object로 리턴한다. 찾은 것이 없거나 에러가 
+ *         있으면 NULL을 리턴한다.
+ *
+ * 리턴된 결과는 다 사용하고 나면 반드시 hanja_list_delete() 함수로 free해야
+ * 한다.
+ */
+HanjaList*
+hanja_table_match_suffix_ucs4(const HanjaTable* table, const ucschar* key)
+{
+    if (key == NULL || key[0] == 0 || table == NULL)
+	return NULL;
+
+    return hanja_table_lookup(table, HANJA_MATCH_SUFFIX, NULL, key);
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief 한자 사전에서 음절 하나로 된 키를 찾는 함수
+ * @param table 한자 사전 object
+ * @param syllable 찾을 음절, UCS-4
+ * @return 찾은 결과를 HanjaList object로 리턴한다. 찾은 것이 없거나 에러가 
+ *         있으면 NULL을 리턴한다.
+ *
+ * "한"을 "韓", "漢", "寒" 등으로 바꾸는 것처럼 음절 하나를 변환할 때
+ * 사용한다. 음절 하나로 된 키는 로딩할 때 음절별로 테이블을 만들어 두므로
+ * 인덱스를 검색하지 않고 바로 찾는다. 결과는 사전 파일에 있는 순서대로다.
+ * @a syllable 이 한글 음절이 아니면 NULL을 리턴한다.
+ *
+ * 리턴된 결과는 다 사용하고 나면 반드시 hanja_list_delete() 함수로 free해야
+ * 한다.
+ */
+HanjaList*
+hanja_table_match_syllable(const HanjaTable* table, ucschar syllable)
+{
     HanjaList* ret = NULL;
+    ucschar key[2];
+
+    if (table == NULL || !hangul_is_syllable(syllable))
+	return NULL;
+
+    key[0] = syllable;
+    key[1] = 0;
+    if (table->syllables != NULL && table->overlay == NULL)
+	hanja_table_match_syllable_internal(table, syllable, NULL, key, &ret);
+    else
+	hanja_table_match(table, NULL, key, &ret);
+
+    return hanja_table_count_lookup(table, ret);
+}
 
+/**
+ * @ingroup hanjadictionary
+ * @brief 한자 사전에서 조사나 어미를 떼어낸 키를 찾는 함수
+ * @param table 한자 사전 object
+ * @param key 찾을 키, UTF-8 인코딩
+ * @return 찾은 결과를 HanjaList object로 리턴한다. 찾은 것이 없거나 에러가 
+ *         있으면 NULL을 리턴한다.
+ *
+ * 문장을 변환할 때처럼 @a key 의 끝에 조사나 어미가 붙어 있을 수 있는 경우에
+ * 사용한다. 먼저 @a key 전체를 검색하고, 찾지 못하면 libhangul에 내장된
+ * 조사, 어미 목록에서 @a key 의 끝에 붙은 것을 긴 것부터 떼어 가면서
+ * 남은 어간을 검색한다. 예를 들어 "대한민국에서"를 검색하면 "에서"를 떼어낸
+ * "대한민국"의 검색 결과를 리턴한다.
+ *
+ * 떼어낸 조사나 어미는 hanja_list_get_josa() 함수로 확인할 수 있다.
+ * 리턴된 결과는 다 사용하고 나면 반드시 hanja_list_delete() 함수로 free해야
+ * 한다.
+ */
+HanjaList*
+hanja_table_match_josa(const HanjaTable* table, const char *key)
+{
     if (key == NULL || key[0] == '\0' || table == NULL)
 	return NULL;
 
-    p = key;
-    while (p[0] != '\0') {
-	hanja_table_match(table, p, &ret);
-	p = utf8_next(p);
+    return hanja_table_count_lookup(table,
+			hanja_table_match_josa_internal(table, key, NULL));
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief hanja_table_match_josa()의 UCS-4 버전
+ * @param table 한자 사전 object
+ * @param key 찾을 키, UCS-4
+ * @return 찾은 결과를 HanjaList object로 리턴한다. 찾은 것이 없거나 에러가 
+ *         있으면 NULL을 리턴한다.
+ *
+ * 리턴된 결과는 다 사용하고 나면 반드시 hanja_list_delete() 함수로 free해야
+ * 한다.
+ */
+HanjaList*
+hanja_table_match_josa_ucs4(const HanjaTable* table, const ucschar* key)
+{
+    if (key == NULL || key[0] == 0 || table == NULL)
+	return NULL;
+
+    return hanja_table_count_lookup(table,
+			hanja_table_match_josa_internal(table, NULL, key));
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief 한자 사전에서 설명에 검색어가 들어 있는 엔트리를 찾는 함수
+ * @param table 한자 사전 object
+ * @param query 찾을 스트링, UTF-8 인코딩
+ * @return 찾은 결과를 HanjaList object로 리턴한다. 찾은 것이 없거나 에러가 
+ *         있으면 NULL을 리턴한다.
+ *
+ * "물", "나라"와 같이 뜻으로 한자를 찾을 때 사용한다. 설명(comment)에
+ * @a query 가 들어 있는 모든 엔트리를 사전 파일의 순서대로 리턴한다.
+ *
+ * 설명 검색을 위한 인덱스는 이 함수를 처음 부를 때 만든다. 그러므로
+ * 처음 부를 때에는 사전 파일 전체를 읽어야 해서 시간이 걸린다.
+ * 페이지 모드의 사전에서는 NULL을 리턴한다.
+ *
+ * 리턴된 결과는 다 사용하고 나면 반드시 hanja_list_delete() 함수로 free해야
+ * 한다.
+ */
+HanjaList*
+hanja_table_search_comment(const HanjaTable* table, const char *query)
+{
+    HanjaTable* t = (HanjaTable*)table;
+    const HanjaPostingIndex* index;
+    ucschar* q;
+    size_t qlen;
+    uint64_t* grams;
+    size_t ngrams;
+    uint32_t* ids;
+    size_t n;
+    size_t i;
+    HanjaList* ret = NULL;
+
+    if (query == NULL || query[0] == '\0' || table == NULL ||
+	table->pages != NULL)
+	return NULL;
+
+    index = hanja_table_get_comment_index(t);
+    if (index == NULL)
+	return NULL;
+
+    q = malloc((strlen(query) + 1) * sizeof(q[0]));
+    grams = malloc((strlen(query) + 1) * sizeof(grams[0]));
+    if (q == NULL || grams == NULL) {
+	free(q);
+	free(grams);
+	return NULL;
     }
 
-    return ret;
+    /* 검색어가 한 글자면 unigram, 그 외에는 bigram의 posting list를 쓴다. */
+    qlen = utf8_to_ucs4(q, query);
+    if (qlen == 1) {
+	grams[0] = hanja_gram(q[0], 0);
+	ngrams = 1;
+    } else {
+	for (ngrams = 0; ngrams + 1 < qlen; ngrams++)
+	    grams[ngrams] = hanja_gram(q[ngrams], q[ngrams + 1]);
+    }
+
+    ids = hanja_posting_index_query(index, grams, ngrams, &n);
+
+    /* bigram이 모두 들어 있어도 연속해서 나오지 않을 수 있으므로
+     * 설명을 직접 확인한다. */
+    for (i = 0; i < n; i++) {
+	const Hanja* hanja = &table->data->entries[ids[i]];
+
+	if (hanja_table_is_shadowed(table, hanja))
+	    continue;
+
+	if (qlen > 2) {
+	    const char* comment = hanja_table_get_comment(t, hanja);
+	    if (strstr(comment, query) == NULL)
+		continue;
+	}
+
+	if (ret == NULL) {
+	    ret = hanja_list_new(query, NULL);
+	    if (ret == NULL)
+		break;
+	}
+	hanja_list_append_n(ret, hanja, 1);
+    }
+
+    /* overlay는 작으므로 인덱스 없이 찾는다. */
+    if (table->overlay != NULL) {
+	HanjaTable* overlay = table->overlay;
+
+	for (i = 0; i < overlay->nentries; i++) {
+	    const Hanja* hanja = &overlay->data->entries[i];
+	    const char* comment = hanja_table_get_comment(overlay, hanja);
+	    if (strstr(comment, query) == NULL)
+		continue;
+
+	    if (ret == NULL) {
+		ret = hanja_list_new(query, NULL);
+		if (ret == NULL)
+		    break;
+	    }
+	    hanja_list_append_n(ret, hanja, 1);
+	}
+    }
+
+    free(ids);
+    free(grams);
+    free(q);
+
+    return hanja_table_count_lookup(table, ret);
+}
+
+/* 같은 키를 가진 엔트리 중에서 몇번째인지를 구한다. 사전 파일에서 같은
+ * 키의 엔트리는 많이 쓰는 순서로 정렬되어 있다. */
+static unsigned
+hanja_get_rank(const Hanja* hanja)
+{
+    const char* key = hanja_get_key(hanja);
+    unsigned rank = 0;
+
+    while (hanja->id > 0 && hanja_get_key(hanja - 1) == key) {
+	hanja--;
+	rank++;
+    }
+
+    return rank;
+}
+
+/* @a hanja 의 값에 @a chars 의 모든 글자가 들어 있는지 확인한다.
+ * @a chars 는 통합 한자로 바꾼 것이어야 한다. */
+static bool
+hanja_value_contains(const Hanja* hanja, const ucschar* chars, size_t n)
+{
+    const ucschar* value = hanja_get_value_ucs4(hanja);
+    size_t i, j;
+
+    for (i = 0; i < n; i++) {
+	for (j = 0; value[j] != 0; j++) {
+	    ucschar c = value[j];
+	    hanja_unified_form(&c, 1);
+	    if (c == chars[i])
+		break;
+	}
+	if (value[j] == 0)
+	    return false;
+    }
+
+    return true;
+}
+
+typedef struct _HanjaRanked HanjaRanked;
+
+struct _HanjaRanked {
+    unsigned     rank;
+    const Hanja* hanja;
+};
+
+static int
+compare_ranked(const void* a, const void* b)
+{
+    const HanjaRanked* x = a;
+    const HanjaRanked* y = b;
+
+    if (x->rank != y->rank)
+	return x->rank < y->rank ? -1 : 1;
+    if (x->hanja->id != y->hanja->id)
+	return x->hanja->id < y->hanja->id ? -1 : 1;
+    return 0;
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief 한자 사전에서 주어진 한자들이 모두 들어 있는 엔트리를 찾는 함수
+ * @param table 한자 사전 object
+ * @param hanja 찾을 한자들, UTF-8 인코딩
+ * @return 찾은 결과를 HanjaList object로 리턴한다. 찾은 것이 없거나 에러가 
+ *         있으면 NULL을 리턴한다.
+ *
+ * 값(value)에 @a hanja 의 모든 글자가 순서에 상관없이 들어 있는 엔트리를
+ * 찾는다. 예를 들어 "學"을 주면 "學" 자가 들어 있는 모든 단어를,
+ * "學校"를 주면 "學"과 "校"가 모두 들어 있는 단어를 찾는다.
+ * 호환 한자는 hanja_unified_form()으로 통합 한자로 바꿔서 비교한다.
+ *
+ * 결과는 많이 쓰는 것부터 정렬된다. 사전에 빈도가 따로 저장되어 있지
+ * 않으므로, 같은 키를 가진 엔트리 중에서 앞에 있는 것일수록 많이 쓰는
+ * 것으로 본다. 이 순서가 같으면 사전 파일의 순서를 따른다.
+ *
+ * 검색에 필요한 인덱스는 이 함수를 처음 부를 때 만든다.
+ * 페이지 모드의 사전에서는 NULL을 리턴한다.
+ * 리턴된 결과는 다 사용하고 나면 반드시 hanja_list_delete() 함수로 free해야
+ * 한다.
+ */
+HanjaList*
+hanja_table_search_value(const HanjaTable* table, const char *hanja)
+{
+    const HanjaPostingIndex* index;
+    ucschar* q;
+    size_t qlen;
+    uint64_t* grams;
+    uint32_t* ids;
+    HanjaRanked* ranked;
+    size_t noverlay;
+    size_t n, m;
+    size_t i;
+    HanjaList* ret = NULL;
+
+    if (hanja == NULL || hanja[0] == '\0' || table == NULL ||
+	table->pages != NULL)
+	return NULL;
+
+    index = hanja_table_get_value_index((HanjaTable*)table);
+    if (index == NULL)
+	return NULL;
+
+    q = malloc((strlen(hanja) + 1) * sizeof(q[0]));
+    grams = malloc((strlen(hanja) + 1) * sizeof(grams[0]));
+    if (q == NULL || grams == NULL) {
+	free(q);
+	free(grams);
+	return NULL;
+    }
+
+    qlen = utf8_to_ucs4(q, hanja);
+    hanja_unified_form(q, qlen);
+    for (i = 0; i < qlen; i++)
+	grams[i] = hanja_gram(q[i], 0);
+
+    ids = hanja_posting_index_query(index, grams, qlen, &n);
+    noverlay = table->overlay != NULL ? table->overlay->nentries : 0;
+    ranked = NULL;
+    if (n + noverlay > 0)
+	ranked = malloc((n + noverlay) * sizeof(ranked[0]));
+
+    if (ranked != NULL) {
+	m = 0;
+	for (i = 0; i < n; i++) {
+	    const Hanja* entry = &table->data->entries[ids[i]];
+	    if (hanja_table_is_shadowed(table, entry))
+		continue;
+	    ranked[m].hanja = entry;
+	    ranked[m].rank = hanja_get_rank(entry);
+	    m++;
+	}
+
+	/* overlay는 작으므로 인덱스 없이 찾는다. */
+	for (i = 0; i < noverlay; i++) {
+	    const Hanja* entry = &table->overlay->data->entries[i];
+	    if (hanja_value_contains(entry, q, qlen)) {
+		ranked[m].hanja = entry;
+		ranked[m].rank = hanja_get_rank(entry);
+		m++;
+	    }
+	}
+	n = m;
+	qsort(ranked, n, sizeof(ranked[0]), compare_ranked);
+
+	if (n > 0)
+	    ret = hanja_list_new(hanja, NULL);
+	if (ret != NULL) {
+	    for (i = 0; i < n; i++)
+		hanja_list_append_n(ret, ranked[i].hanja, 1);
+	}
+	free(ranked);
+    }
+
+    free(ids);
+    free(grams);
+    free(q);
+
+    return hanja_table_count_lookup(table, ret);
 }
 
 /**
@@ -714,6 +5706,45 @@ hanja_list_get_key(const HanjaList *list)
     return NULL;
 }
 
+/**
+ * @ingroup hanjadictionary
+ * @brief @ref HanjaList 를 검색할 때 키에서 떼어낸 조사나 어미를 구하는 함수
+ * @return 떼어낸 조사나 어미, UTF-8
+ *
+ * hanja_table_match_josa() 함수로 검색한 결과에서 키의 끝에서 떼어낸
+ * 조사나 어미를 리턴한다. 떼어낸 것이 없으면 빈 스트링을 리턴하고,
+ * 다른 검색 함수로 만든 @ref HanjaList 에서는 NULL을 리턴한다.
+ * 이때 hanja_list_get_key()는 조사를 떼어낸 어간을 리턴한다.
+ *
+ * 리턴된 스트링 포인터는 @ref HanjaList 에서 관리하는 스트링으로
+ * 수정하거나 free해서는 안된다.
+ */
+const char*
+hanja_list_get_josa(const HanjaList *list)
+{
+    if (list != NULL)
+	return list->josa;
+    return NULL;
+}
+
+/* @a n 번째 아이템이 들어 있는 구간을 찾는다. */
+static const HanjaListRun*
+hanja_list_find_run(const HanjaList* list, size_t n)
+{
+    size_t low = 0;
+    size_t high = list->nruns;
+
+    while (high - low > 1) {
+	size_t mid = (low + high) / 2;
+	if (list->runs[mid].start <= n)
+	    low = mid;
+	else
+	    high = mid;
+    }
+
+    return &list->runs[low];
+}
+
 /**
  * @ingroup hanjadictionary
  * @brief @ref HanjaList 의 n번째 @ref Hanja 아이템의 포인터를 구하는 함수
@@ -732,25 +5763,71 @@ hanja_list_get_key(const HanjaList *list)
  * 코드다.
  * 
  * @code
- * int i;
- * int n = hanja_list_get_size(list);
- * for (i = 0; i < n; i++) {
- *	Hanja* hanja = hanja_list_get_nth(i);
- *	const char* value = hanja_get_value(hanja);
- *	printf("Hanja: %s\n", value);
- *	// 또는 hanja에서 다른 정보를 참조하거나
- *	// 다른 작업을 할 수도 있다.
- * }
+ * int i;
+ * int n = hanja_list_get_size(list);
+ * for (i = 0; i < n; i++) {
+ *	Hanja* hanja = hanja_list_get_nth(i);
+ *	const char* value = hanja_get_value(hanja);
+ *	printf("Hanja: %s\n", value);
+ *	// 또는 hanja에서 다른 정보를 참조하거나
+ *	// 다른 작업을 할 수도 있다.
+ * }
+ * @endcode
+ */
+const Hanja*
+hanja_list_get_nth(const HanjaList *list, unsigned int n)
+{
+    const HanjaListRun* run;
+
+    if (list == NULL || n >= list->len)
+	return NULL;
+
+    run = hanja_list_find_run(list, n);
+    return run->first + (n - run->start);
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief @ref HanjaList 의 아이템을 여러개 한번에 구하는 함수
+ * @param list @ref HanjaList 를 가리키는 포인터
+ * @param offset 가져올 첫 아이템의 위치, 0부터 시작
+ * @param items 아이템을 저장할 배열
+ * @param n @a items 배열의 크기
+ * @return @a items 에 저장한 아이템의 갯수
+ *
+ * 후보 창에 한 페이지씩 보여줄 때처럼 @a offset 번째 아이템부터
+ * @a n 개를 @a items 에 저장한다. 리스트의 끝을 넘어서는 것은 저장하지
+ * 않는다. 검색 결과는 사전의 구간으로 기억하고 있으므로 이 함수는 리스트
+ * 전체의 크기와 상관없이 @a n 에 비례하는 시간이 걸린다.
+ *
+ * @code
+ * const Hanja* page[9];
+ * unsigned int i, n;
+ * n = hanja_list_get_page(list, 0, page, 9);
+ * for (i = 0; i < n; i++)
+ *	printf("%s\n", hanja_get_value(page[i]));
  * @endcode
  */
-const Hanja*
-hanja_list_get_nth(const HanjaList *list, unsigned int n)
+unsigned int
+hanja_list_get_page(const HanjaList *list, unsigned int offset,
+		    const Hanja** items, unsigned int n)
 {
-    if (list != NULL) {
-	if (n < list->len)
-	    return list->items[n];
+    const HanjaListRun* run;
+    const HanjaListRun* end;
+    unsigned int i;
+
+    if (list == NULL || items == NULL || offset >= list->len)
+	return 0;
+
+    run = hanja_list_find_run(list, offset);
+    end = list->runs + list->nruns;
+    for (i = 0; i < n && run < end; run++) {
+	size_t k = offset + i - run->start;
+	while (k < run->n && i < n)
+	    items[i++] = run->first + k++;
     }
-    return NULL;
+
+    return i;
 }
 
 /**
@@ -795,6 +5872,48 @@ hanja_list_get_nth_comment(const HanjaList *list, unsigned int n)
     return hanja_get_comment(hanja);
 }
 
+/**
+ * @ingroup hanjadictionary
+ * @brief @ref HanjaList 의 n번째 아이템의 키를 UCS-4로 구하는 함수
+ * @return n번째 아이템의 키, UCS-4
+ *
+ * HanjaList_get_nth()의 convenient 함수
+ */
+const ucschar*
+hanja_list_get_nth_key_ucs4(const HanjaList *list, unsigned int n)
+{
+    const Hanja* hanja = hanja_list_get_nth(list, n);
+    return hanja_get_key_ucs4(hanja);
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief @ref HanjaList 의 n번째 아이템의 값을 UCS-4로 구하는 함수
+ * @return n번째 아이템의 값(value), UCS-4
+ *
+ * HanjaList_get_nth()의 convenient 함수
+ */
+const ucschar*
+hanja_list_get_nth_value_ucs4(const HanjaList *list, unsigned int n)
+{
+    const Hanja* hanja = hanja_list_get_nth(list, n);
+    return hanja_get_value_ucs4(hanja);
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief @ref HanjaList 의 n번째 아이템의 설명을 UCS-4로 구하는 함수
+ * @return n번째 아이템의 설명(comment), UCS-4
+ *
+ * HanjaList_get_nth()의 convenient 함수
+ */
+const ucschar*
+hanja_list_get_nth_comment_ucs4(const HanjaList *list, unsigned int n)
+{
+    const Hanja* hanja = hanja_list_get_nth(list, n);
+    return hanja_get_comment_ucs4(hanja);
+}
+
 /**
  * @ingroup hanjadictionary
  * @brief 한자 사전 검색 함수가 리턴한 결과를 free하는 함수
@@ -808,15 +5927,646 @@ hanja_list_delete(HanjaList *list)
 {
     if (list) {
 	size_t i;
-	for (i = 0; i < list->len; i++) {
-	    hanja_delete((Hanja*)list->items[i]);
-	}
-	free(list->items);
+
+	for (i = 0; i < list->nblocks; i++)
+	    hanja_data_unref(list->blocks[i]);
+	if (list->blocks != &list->block)
+	    free(list->blocks);
+	if (list->runs != &list->run)
+	    free(list->runs);
 	free(list->key);
+	free(list->josa);
 	free(list);
     }
 }
 
+/*
+ * bigram 모델
+ *
+ * 같은 음의 한자어 중에서 어느 것을 쓸지는 앞에 입력한 단어에 따라 달라진다.
+ * (앞 단어, 한자어)의 쌍에 점수를 매긴 bigram 모델로 검색 결과의 순서를
+ * 바꿀 수 있게 한다.
+ *
+ * 모델 파일은 minimal perfect hash 테이블로, 그대로 메모리에 매핑해서 쓸 수
+ * 있게 만든다. 쌍마다 16비트 fingerprint와 8비트로 양자화한 점수를 저장하고,
+ * 쌍의 스트링은 저장하지 않는다. hash and displace 방식으로 쌍들을 평균
+ * 4개씩 bucket에 나누고, bucket마다 모든 쌍이 빈 slot에 들어가는
+ * displacement 값을 찾아서 기록한다. 찾을 때는 bucket의 displacement로
+ * slot을 바로 계산하므로 해시 계산 두번과 메모리 접근 세번이면 된다.
+ *
+ * 파일의 구성:
+ *   HanjaModelHeader
+ *   uint32_t displacements[nbuckets]
+ *   uint16_t fingerprints[nslots]
+ *   uint8_t  scores[nslots]
+ */
+#define HANJA_MODEL_MAGIC      "HJBG"
+#define HANJA_MODEL_VERSION    1
+#define HANJA_MODEL_BYTE_ORDER 0x01020304
+#define HANJA_MODEL_BUCKET_SIZE 4
+#define HANJA_MODEL_MAX_DISPLACEMENT (1U << 24)
+
+typedef struct _HanjaModelHeader HanjaModelHeader;
+typedef struct _HanjaModelPair   HanjaModelPair;
+
+struct _HanjaModelHeader {
+    char     magic[4];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t nbuckets;
+    uint32_t nslots;
+    uint32_t reserved;
+};
+
+struct _HanjaModel {
+    void*          data;
+    size_t         size;
+    bool           mapped;
+    uint32_t       nbuckets;
+    uint32_t       nslots;
+    const uint32_t* displacements;
+    const uint16_t* fingerprints;
+    const uint8_t*  scores;
+};
+
+/* 모델을 만들때 쓰는 쌍 하나 */
+struct _HanjaModelPair {
+    uint64_t hash;
+    uint64_t count;
+    uint32_t bucket;
+};
+
+static inline uint64_t
+hanja_model_mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/* (앞 단어, 한자어) 쌍의 해시값. 두 스트링 사이에는 UTF-8에 나오지 않는
+ * 바이트를 넣어서 경계를 구분한다. */
+static uint64_t
+hanja_model_hash(const char* previous, const char* value)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    const unsigned char* p;
+
+    for (p = (const unsigned char*)previous; *p != '\0'; p++) {
+	h ^= *p;
+	h *= 0x100000001b3ULL;
+    }
+    h ^= 0xff;
+    h *= 0x100000001b3ULL;
+    for (p = (const unsigned char*)value; *p != '\0'; p++) {
+	h ^= *p;
+	h *= 0x100000001b3ULL;
+    }
+
+    return hanja_model_mix(h);
+}
+
+static inline uint32_t
+hanja_model_bucket(uint64_t hash, uint32_t nbuckets)
+{
+    return (uint32_t)(hash >> 32) % nbuckets;
+}
+
+static inline uint32_t
+hanja_model_slot(uint64_t hash, uint32_t displacement, uint32_t nslots)
+{
+    return hanja_model_mix(hash + displacement * 0x9e3779b97f4a7c15ULL) % nslots;
+}
+
+static inline uint16_t
+hanja_model_fingerprint(uint64_t hash)
+{
+    return (uint16_t)hash;
+}
+
+/* 빈도를 log 스케일로 바꾼다. 정수 부분은 비트 수, 소수 부분은 그 아래
+ * 4비트로 근사한다. 0은 쓰지 않으므로 1 이상의 값이 나온다. */
+static unsigned
+hanja_model_log_count(uint64_t count)
+{
+    unsigned bits = 0;
+    unsigned frac;
+
+    while (bits < 64 && (count >> bits) > 1)
+	bits++;
+
+    if (bits >= 4)
+	frac = (count >> (bits - 4)) & 0xf;
+    else
+	frac = (count << (4 - bits)) & 0xf;
+
+    return bits * 16 + frac + 1;
+}
+
+static int
+compare_model_pair(const void* a, const void* b)
+{
+    const HanjaModelPair* x = a;
+    const HanjaModelPair* y = b;
+
+    return x->hash < y->hash ? -1 : x->hash > y->hash;
+}
+
+static int
+compare_model_pair_bucket(const void* a, const void* b)
+{
+    const HanjaModelPair* x = a;
+    const HanjaModelPair* y = b;
+
+    if (x->bucket != y->bucket)
+	return x->bucket < y->bucket ? -1 : 1;
+    return compare_model_pair(a, b);
+}
+
+/* (bucket, 크기)의 쌍을 크기가 큰 것부터 정렬한다. */
+static int
+compare_model_bucket(const void* a, const void* b)
+{
+    const uint32_t* x = a;
+    const uint32_t* y = b;
+
+    if (x[1] != y[1])
+	return x[1] > y[1] ? -1 : 1;
+    return x[0] < y[0] ? -1 : x[0] > y[0];
+}
+
+/* 쌍들을 slot에 배치해서 @a displacements 를 채우고, @a slots 에는 각
+ * slot에 들어간 쌍의 번호를 기록한다. 큰 bucket부터 빈 slot이 많을 때
+ * 자리를 잡아야 displacement를 빨리 찾을 수 있다. */
+static bool
+hanja_model_place(HanjaModelPair* pairs, uint32_t npairs, uint32_t nbuckets,
+		  uint32_t* displacements, uint32_t* slots)
+{
+    uint32_t* buckets;
+    uint32_t* starts;
+    uint8_t* taken;
+    uint32_t tmp[64];
+    uint32_t i, j;
+    bool ret = false;
+
+    buckets = malloc(nbuckets * 2 * sizeof(buckets[0]));
+    starts = malloc((nbuckets + 1) * sizeof(starts[0]));
+    taken = calloc(npairs, 1);
+    if (buckets == NULL || starts == NULL || taken == NULL)
+	goto done;
+
+    for (i = 0; i < npairs; i++)
+	pairs[i].bucket = hanja_model_bucket(pairs[i].hash, nbuckets);
+    qsort(pairs, npairs, sizeof(pairs[0]), compare_model_pair_bucket);
+
+    j = 0;
+    for (i = 0; i < nbuckets; i++) {
+	starts[i] = j;
+	while (j < npairs && pairs[j].bucket == i)
+	    j++;
+	buckets[2 * i] = i;
+	buckets[2 * i + 1] = j - starts[i];
+	displacements[i] = 0;
+    }
+    starts[nbuckets] = npairs;
+    qsort(buckets, nbuckets, 2 * sizeof(buckets[0]), compare_model_bucket);
+
+    for (i = 0; i < nbuckets; i++) {
+	uint32_t b = buckets[2 * i];
+	uint32_t n = buckets[2 * i + 1];
+	uint32_t d;
+
+	if (n == 0)
+	    break;
+	if (n > N_ELEMENTS(tmp))
+	    goto done;
+
+	for (d = 0; d < HANJA_MODEL_MAX_DISPLACEMENT; d++) {
+	    for (j = 0; j < n; j++) {
+		uint32_t k;
+
+		tmp[j] = hanja_model_slot(pairs[starts[b] + j].hash, d, npairs);
+		if (taken[tmp[j]])
+		    break;
+		for (k = 0; k < j && tmp[k] != tmp[j]; k++)
+		    continue;
+		if (k < j)
+		    break;
+	    }
+	    if (j == n)
+		break;
+	}
+	if (d == HANJA_MODEL_MAX_DISPLACEMENT)
+	    goto done;
+
+	displacements[b] = d;
+	for (j = 0; j < n; j++) {
+	    taken[tmp[j]] = 1;
+	    slots[tmp[j]] = starts[b] + j;
+	}
+    }
+
+    ret = true;
+
+done:
+    free(buckets);
+    free(starts);
+    free(taken);
+    return ret;
+}
+
+/* 모델 파일을 쓴다. */
+static bool
+hanja_model_write(const char* filename, const HanjaModelPair* pairs,
+		  uint32_t npairs, uint32_t nbuckets,
+		  const uint32_t* displacements, const uint32_t* slots)
+{
+    HanjaModelHeader header;
+    unsigned max_log = 1;
+    uint32_t i;
+    FILE* file;
+    bool ret;
+
+    for (i = 0; i < npairs; i++) {
+	unsigned l = hanja_model_log_count(pairs[i].count);
+	if (l > max_log)
+	    max_log = l;
+    }
+
+    file = fopen(filename, "wb");
+    if (file == NULL)
+	return false;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HANJA_MODEL_MAGIC, sizeof(header.magic));
+    header.version = HANJA_MODEL_VERSION;
+    header.byte_order = HANJA_MODEL_BYTE_ORDER;
+    header.nbuckets = nbuckets;
+    header.nslots = npairs;
+
+    ret = fwrite(&header, sizeof(header), 1, file) == 1 &&
+	  fwrite(displacements, sizeof(displacements[0]), nbuckets, file) ==
+	  nbuckets;
+
+    for (i = 0; ret && i < npairs; i++) {
+	uint16_t fingerprint = hanja_model_fingerprint(pairs[slots[i]].hash);
+	ret = fwrite(&fingerprint, sizeof(fingerprint), 1, file) == 1;
+    }
+
+    /* 점수는 가장 큰 빈도를 255로 하는 log 스케일이다. */
+    for (i = 0; ret && i < npairs; i++) {
+	unsigned l = hanja_model_log_count(pairs[slots[i]].count);
+	uint8_t score = max_log > 1 ? 1 + (l - 1) * 254 / (max_log - 1) : 255;
+	ret = fputc(score, file) != EOF;
+    }
+
+    if (fclose(file) != 0)
+	ret = false;
+
+    return ret;
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief 빈도 목록으로 bigram 모델 파일을 만드는 함수
+ * @param input 빈도 목록 파일
+ * @param output 만들 모델 파일
+ * @return 성공하면 true, 실패하면 false
+ *
+ * @a input 은 한 줄에 "앞 단어:한자어:빈도" 형식으로 쓴 텍스트 파일이다.
+ * '#'으로 시작하는 줄과 빈 줄은 무시한다. 빈도는 양의 정수로, 같은 쌍이
+ * 여러번 나오면 더한다. 만든 모델은 hanja_model_load() 로 로딩한다.
+ *
+ * 모델 파일은 쌍 하나에 4바이트 정도를 쓴다. 스트링은 저장하지 않으므로
+ * 목록에 없는 쌍이 아주 드물게(1/65536) 다른 쌍의 점수를 얻을 수 있다.
+ * 파일은 만든 기계와 같은 byte order의 기계에서만 로딩할 수 있다.
+ */
+bool
+hanja_model_compile(const char* input, const char* output)
+{
+    HanjaBuffer pairs = { NULL, 0, 0 };
+    HanjaBuffer line = { NULL, 0, 0 };
+    HanjaModelPair* p;
+    uint32_t* displacements = NULL;
+    uint32_t* slots = NULL;
+    size_t npairs;
+    uint32_t nbuckets;
+    size_t i, n;
+    FILE* in;
+    bool ret = false;
+    int res;
+
+    if (input == NULL || output == NULL)
+	return false;
+
+    in = fopen(input, "r");
+    if (in == NULL)
+	return false;
+
+    while ((res = hanja_read_line(in, &line)) > 0) {
+	HanjaModelPair pair;
+	char* save_ptr = NULL;
+	char* previous;
+	char* value;
+	char* count;
+	char* end;
+
+	if (line.data[0] == '#' || line.data[0] == '\0')
+	    continue;
+
+	previous = strtok_r(line.data, ":", &save_ptr);
+	value = strtok_r(NULL, ":", &save_ptr);
+	count = strtok_r(NULL, ":", &save_ptr);
+	if (previous == NULL || value == NULL || count == NULL)
+	    continue;
+
+	pair.count = strtoull(count, &end, 10);
+	if (end == count || pair.count == 0)
+	    continue;
+
+	pair.hash = hanja_model_hash(previous, value);
+	pair.bucket = 0;
+	if (!hanja_buffer_append(&pairs, &pair, sizeof(pair))) {
+	    res = -1;
+	    break;
+	}
+    }
+    fclose(in);
+    free(line.data);
+    if (res < 0)
+	goto done;
+
+    /* 같은 쌍을 하나로 합친다. */
+    p = (HanjaModelPair*)pairs.data;
+    npairs = pairs.len / sizeof(p[0]);
+    if (npairs > 0)
+	qsort(p, npairs, sizeof(p[0]), compare_model_pair);
+    for (i = 0, n = 0; i < npairs; i++) {
+	if (n > 0 && p[n - 1].hash == p[i].hash) {
+	    if (p[n - 1].count > UINT64_MAX - p[i].count)
+		p[n - 1].count = UINT64_MAX;
+	    else
+		p[n - 1].count += p[i].count;
+	} else {
+	    p[n++] = p[i];
+	}
+    }
+    npairs = n;
+
+    if (npairs == 0 || npairs > UINT32_MAX / 2)
+	goto done;
+
+    nbuckets = (npairs + HANJA_MODEL_BUCKET_SIZE - 1) / HANJA_MODEL_BUCKET_SIZE;
+    displacements = malloc(nbuckets * sizeof(displacements[0]));
+    slots = malloc(npairs * sizeof(slots[0]));
+    if (displacements == NULL || slots == NULL)
+	goto done;
+
+    if (!hanja_model_place(p, npairs, nbuckets, displacements, slots))
+	goto done;
+
+    ret = hanja_model_write(output, p, npairs, nbuckets, displacements, slots);
+
+done:
+    free(displacements);
+    free(slots);
+    free(pairs.data);
+    return ret;
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief bigram 모델 파일을 로딩하는 함수
+ * @param filename hanja_model_compile() 로 만든 모델 파일
+ * @return 모델 object, 실패하면 NULL
+ *
+ * 모델 파일은 가능하면 메모리에 매핑하므로 로딩은 파일 크기와 상관없이
+ * 빠르다. 다 쓴 모델은 hanja_model_delete() 로 free한다.
+ */
+HanjaModel*
+hanja_model_load(const char* filename)
+{
+    HanjaModel* model;
+    const HanjaModelHeader* header;
+    size_t size;
+
+    if (filename == NULL)
+	return NULL;
+
+    model = malloc(sizeof(*model));
+    if (model == NULL)
+	return NULL;
+
+    memset(model, 0, sizeof(*model));
+
+#ifdef HAVE_MMAP
+    {
+	struct stat st;
+	int fd = open(filename, O_RDONLY);
+	if (fd >= 0) {
+	    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED,
+				 fd, 0);
+		if (map != MAP_FAILED) {
+		    model->data = map;
+		    model->size = st.st_size;
+		    model->mapped = true;
+		}
+	    }
+	    close(fd);
+	}
+    }
+#endif /* HAVE_MMAP */
+
+    if (model->data == NULL) {
+	FILE* file = fopen(filename, "rb");
+	long len = -1;
+
+	if (file != NULL && fseek(file, 0, SEEK_END) == 0)
+	    len = ftell(file);
+	if (len > 0 && fseek(file, 0, SEEK_SET) == 0) {
+	    model->data = malloc(len);
+	    if (model->data != NULL &&
+		fread(model->data, 1, len, file) != (size_t)len) {
+		free(model->data);
+		model->data = NULL;
+	    }
+	    model->size = len;
+	}
+	if (file != NULL)
+	    fclose(file);
+    }
+
+    if (model->data == NULL || model->size < sizeof(*header))
+	goto failed;
+
+    header = model->data;
+    if (memcmp(header->magic, HANJA_MODEL_MAGIC, sizeof(header->magic)) != 0 ||
+	header->version != HANJA_MODEL_VERSION ||
+	header->byte_order != HANJA_MODEL_BYTE_ORDER ||
+	header->nbuckets == 0 || header->nslots == 0)
+	goto failed;
+
+    size = sizeof(*header) + (size_t)header->nbuckets * sizeof(uint32_t) +
+	   (size_t)header->nslots * (sizeof(uint16_t) + sizeof(uint8_t));
+    if (size != model->size)
+	goto failed;
+
+    model->nbuckets = header->nbuckets;
+    model->nslots = header->nslots;
+    model->displacements = (const uint32_t*)(header + 1);
+    model->fingerprints = (const uint16_t*)(model->displacements + model->nbuckets);
+    model->scores = (const uint8_t*)(model->fingerprints + model->nslots);
+
+    return model;
+
+failed:
+    hanja_model_delete(model);
+    return NULL;
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief bigram 모델을 free하는 함수
+ * @param model free할 모델
+ */
+void
+hanja_model_delete(HanjaModel* model)
+{
+    if (model == NULL)
+	return;
+
+#ifdef HAVE_MMAP
+    if (model->mapped)
+	munmap(model->data, model->size);
+    else
+#endif /* HAVE_MMAP */
+	free(model->data);
+    free(model);
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief 앞 단어 다음에 한자어가 나올 점수를 구하는 함수
+ * @param model bigram 모델
+ * @param previous 앞에 입력한 단어, UTF-8
+ * @param value 한자어, UTF-8
+ * @return 0에서 255 사이의 점수, 모델에 없는 쌍이면 0
+ *
+ * 점수는 빈도의 log에 비례하므로 같은 @a previous 에 대한 점수끼리
+ * 비교하는데 쓴다.
+ */
+int
+hanja_model_get_score(const HanjaModel* model, const char* previous,
+		      const char* value)
+{
+    uint64_t hash;
+    uint32_t slot;
+
+    if (model == NULL || previous == NULL || value == NULL)
+	return 0;
+
+    hash = hanja_model_hash(previous, value);
+    slot = hanja_model_slot(hash,
+		model->displacements[hanja_model_bucket(hash, model->nbuckets)],
+		model->nslots);
+    if (model->fingerprints[slot] != hanja_model_fingerprint(hash))
+	return 0;
+
+    return model->scores[slot];
+}
+
+typedef struct _HanjaScored HanjaScored;
+
+struct _HanjaScored {
+    const Hanja* hanja;
+    int          score;
+    size_t       pos;
+};
+
+static int
+compare_scored(const void* a, const void* b)
+{
+    const HanjaScored* x = a;
+    const HanjaScored* y = b;
+
+    if (x->score != y->score)
+	return y->score - x->score;
+    return x->pos < y->pos ? -1 : x->pos > y->pos;
+}
+
+/**
+ * @ingroup hanjadictionary
+ * @brief 앞 단어에 따라 검색 결과의 순서를 바꾸는 함수
+ * @param list 한자 사전 검색 결과
+ * @param model bigram 모델
+ * @param previous 바로 앞에 입력한 단어, UTF-8
+ * @return 성공하면 true, 메모리가 부족하면 false
+ *
+ * @a list 의 아이템을 @a model 에서 @a previous 다음에 나올 점수가 높은
+ * 것부터 다시 정렬한다. 점수가 같은 아이템, 모델에 없는 아이템은 원래의
+ * 순서를 유지하므로 모델에 없는 문맥에서는 순서가 바뀌지 않는다.
+ * 예를 들어 "역사" 다음의 "사기"는 史記를, "보험" 다음의 "사기"는 詐欺를
+ * 앞에 둘 수 있다.
+ *
+ * 실패하면 @a list 는 바뀌지 않는다.
+ */
+bool
+hanja_list_rerank(HanjaList* list, const HanjaModel* model,
+		  const char* previous)
+{
+    HanjaScored* items;
+    size_t nruns;
+    size_t i, n;
+    bool scored = false;
+
+    if (list == NULL || model == NULL || previous == NULL || list->len < 2)
+	return true;
+
+    items = malloc(list->len * sizeof(items[0]));
+    if (items == NULL)
+	return false;
+
+    for (i = 0; i < list->len; i++) {
+	items[i].hanja = hanja_list_get_nth(list, i);
+	items[i].score = hanja_model_get_score(model, previous,
+					       hanja_get_value(items[i].hanja));
+	items[i].pos = i;
+	if (items[i].score > 0)
+	    scored = true;
+    }
+
+    if (!scored) {
+	free(items);
+	return true;
+    }
+
+    qsort(items, list->len, sizeof(items[0]), compare_scored);
+
+    /* 새 순서에서 필요한 구간의 수만큼 미리 확보한다. */
+    nruns = 1;
+    for (i = 1; i < list->len; i++) {
+	if (items[i - 1].hanja + 1 != items[i].hanja)
+	    nruns++;
+    }
+    if (nruns > list->nruns && !hanja_list_reserve(list, nruns - list->nruns)) {
+	free(items);
+	return false;
+    }
+
+    n = list->len;
+    list->nruns = 0;
+    list->len = 0;
+    for (i = 0; i < n; i++)
+	hanja_list_append_n(list, items[i].hanja, 1);
+
+    free(items);
+    return true;
+}
+
 static int
 compare_pair(const void* a, const void* b)
 {
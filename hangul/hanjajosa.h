@@ -0,0 +1,131 @@
+/* 조사와 어미를 뒤에서부터 찾기 위한 trie
+ * 이 파일은 gen_hanjajosa.py로 hanjajosa.txt에서 만든다.
+ * 각 노드의 자식 노드들은 글자 순서로 연속해서 있다.
+ * { 글자, 첫번째 자식 노드, 자식 노드 갯수, 조사나 어미의 끝인지 여부 } */
+static const HanjaJosaNode hanja_josa_trie[] = {
+    { 0x0000,   1, 41, 0 },  /* 0 */
+    { 0xAC00,   0,  0, 1 },  /* 1: 가 */
+    { 0xAC8C,  42,  2, 0 },  /* 2 */
+    { 0xACE0,  44,  3, 0 },  /* 3 */
+    { 0xACFC,   0,  0, 1 },  /* 4: 과 */
+    { 0xAED8,   0,  0, 1 },  /* 5: 께 */
+    { 0xB098,  47,  1, 1 },  /* 6: 나 */
+    { 0xB294,  48, 13, 1 },  /* 7: 는 */
+    { 0xB2E4,  61,  9, 0 },  /* 8 */
+    { 0xB3C4,  70,  3, 1 },  /* 9: 도 */
+    { 0xB41C,   0,  0, 1 },  /* 10: 된 */
+    { 0xB77C,  73,  1, 0 },  /* 11 */
+    { 0xB791,  74,  1, 1 },  /* 12: 랑 */
+    { 0xB7EC,  75,  1, 0 },  /* 13 */
+    { 0xB7FC,  76,  1, 0 },  /* 14 */
+    { 0xB85C,  77,  1, 1 },  /* 15: 로 */
+    { 0xB97C,   0,  0, 1 },  /* 16: 를 */
+    { 0xB9C8,  78,  1, 0 },  /* 17 */
+    { 0xB9CC,   0,  0, 1 },  /* 18: 만 */
+    { 0xBA70,  79,  2, 1 },  /* 19: 며 */
+    { 0xBFD0,   0,  0, 1 },  /* 20: 뿐 */
+    { 0xC11C,  81,  6, 1 },  /* 21: 서 */
+    { 0xC368,  87,  1, 0 },  /* 22 */
+    { 0xC5B4,  88,  1, 0 },  /* 23 */
+    { 0xC5D0,  89,  1, 1 },  /* 24: 에 */
+    { 0xC5EC,  90,  1, 0 },  /* 25 */
+    { 0xC640,   0,  0, 1 },  /* 26: 와 */
+    { 0xC740,  91,  1, 1 },  /* 27: 은 */
+    { 0xC744,  92,  1, 1 },  /* 28: 을 */
+    { 0xC758,   0,  0, 1 },  /* 29: 의 */
+    { 0xC774,  93,  2, 1 },  /* 30: 이 */
+    { 0xC778,  95,  1, 1 },  /* 31: 인 */
+    { 0xC77C,   0,  0, 1 },  /* 32: 일 */
+    { 0xC800,  96,  1, 0 },  /* 33 */
+    { 0xC801,   0,  0, 1 },  /* 34: 적 */
+    { 0xC9C0,  97,  3, 0 },  /* 35 */
+    { 0xCC28, 100,  1, 0 },  /* 36 */
+    { 0xD130, 101,  1, 0 },  /* 37 */
+    { 0xD14C, 102,  1, 0 },  /* 38 */
+    { 0xD55C,   0,  0, 1 },  /* 39: 한 */
+    { 0xD560,   0,  0, 1 },  /* 40: 할 */
+    { 0xD574,   0,  0, 1 },  /* 41: 해 */
+    { 0xC5D0,   0,  0, 1 },  /* 42: 에게 */
+    { 0xD558,   0,  0, 1 },  /* 43: 하게 */
+    { 0xB77C, 103,  1, 1 },  /* 44: 라고 */
+    { 0xC774,   0,  0, 1 },  /* 45: 이고 */
+    { 0xD558,   0,  0, 1 },  /* 46: 하고 */
+    { 0xC774,   0,  0, 1 },  /* 47: 이나 */
+    { 0xAC8C, 104,  1, 0 },  /* 48 */
+    { 0xACFC,   0,  0, 1 },  /* 49: 과는 */
+    { 0xB2E4, 105,  1, 0 },  /* 50 */
+    { 0xB3C4,   0,  0, 1 },  /* 51: 도는 */
+    { 0xB418,   0,  0, 1 },  /* 52: 되는 */
+    { 0xB77C, 106,  1, 0 },  /* 53 */
+    { 0xB85C, 107,  1, 1 },  /* 54: 로는 */
+    { 0xC11C, 108,  1, 0 },  /* 55 */
+    { 0xC5D0,   0,  0, 1 },  /* 56: 에는 */
+    { 0xC640,   0,  0, 1 },  /* 57: 와는 */
+    { 0xC9C0, 109,  1, 0 },  /* 58 */
+    { 0xD130, 110,  1, 0 },  /* 59 */
+    { 0xD558,   0,  0, 1 },  /* 60: 하는 */
+    { 0xB2C8, 111,  2, 0 },  /* 61 */
+    { 0xB9C8,   0,  0, 1 },  /* 62: 마다 */
+    { 0xBCF4,   0,  0, 1 },  /* 63: 보다 */
+    { 0xC5C8, 113,  1, 0 },  /* 64 */
+    { 0xC600,   0,  0, 1 },  /* 65: 였다 */
+    { 0xC774,   0,  0, 1 },  /* 66: 이다 */
+    { 0xD558,   0,  0, 1 },  /* 67: 하다 */
+    { 0xD55C,   0,  0, 1 },  /* 68: 한다 */
+    { 0xD588,   0,  0, 1 },  /* 69: 했다 */
+    { 0xB77C, 114,  1, 1 },  /* 70: 라도 */
+    { 0xC11C, 115,  1, 0 },  /* 71 */
+    { 0xC5D0,   0,  0, 1 },  /* 72: 에도 */
+    { 0xC774,   0,  0, 1 },  /* 73: 이라 */
+    { 0xC774,   0,  0, 1 },  /* 74: 이랑 */
+    { 0xB354,   0,  0, 1 },  /* 75: 더러 */
+    { 0xCC98,   0,  0, 1 },  /* 76: 처럼 */
+    { 0xC73C, 116,  1, 1 },  /* 77: 으로 */
+    { 0xB098, 117,  1, 1 },  /* 78: 나마 */
+    { 0xC774,   0,  0, 1 },  /* 79: 이며 */
+    { 0xD558,   0,  0, 1 },  /* 80: 하며 */
+    { 0xAC8C, 118,  1, 0 },  /* 81 */
+    { 0xAED8,   0,  0, 1 },  /* 82: 께서 */
+    { 0xB85C, 119,  1, 1 },  /* 83: 로서 */
+    { 0xC5D0,   0,  0, 1 },  /* 84: 에서 */
+    { 0xD14C, 120,  1, 0 },  /* 85 */
+    { 0xD574,   0,  0, 1 },  /* 86: 해서 */
+    { 0xB85C, 121,  1, 1 },  /* 87: 로써 */
+    { 0xB418,   0,  0, 1 },  /* 88: 되어 */
+    { 0xBC16,   0,  0, 1 },  /* 89: 밖에 */
+    { 0xD558,   0,  0, 1 },  /* 90: 하여 */
+    { 0xB9CC,   0,  0, 1 },  /* 91: 만은 */
+    { 0xB9CC,   0,  0, 1 },  /* 92: 만을 */
+    { 0xAC19,   0,  0, 1 },  /* 93: 같이 */
+    { 0xB9CC,   0,  0, 1 },  /* 94: 만이 */
+    { 0xC801,   0,  0, 1 },  /* 95: 적인 */
+    { 0xB9C8,   0,  0, 1 },  /* 96: 마저 */
+    { 0xAE4C,   0,  0, 1 },  /* 97: 까지 */
+    { 0xB4E0, 122,  1, 1 },  /* 98: 든지 */
+    { 0xD558,   0,  0, 1 },  /* 99: 하지 */
+    { 0xC870,   0,  0, 1 },  /* 100: 조차 */
+    { 0xBD80, 123,  1, 1 },  /* 101: 부터 */
+    { 0xD55C,   0,  0, 1 },  /* 102: 한테 */
+    { 0xC774,   0,  0, 1 },  /* 103: 이라고 */
+    { 0xC5D0,   0,  0, 1 },  /* 104: 에게는 */
+    { 0xBCF4,   0,  0, 1 },  /* 105: 보다는 */
+    { 0xC774,   0,  0, 1 },  /* 106: 이라는 */
+    { 0xC73C,   0,  0, 1 },  /* 107: 으로는 */
+    { 0xC5D0,   0,  0, 1 },  /* 108: 에서는 */
+    { 0xAE4C,   0,  0, 1 },  /* 109: 까지는 */
+    { 0xBD80,   0,  0, 1 },  /* 110: 부터는 */
+    { 0xC785,   0,  0, 1 },  /* 111: 입니다 */
+    { 0xD569,   0,  0, 1 },  /* 112: 합니다 */
+    { 0xC774,   0,  0, 1 },  /* 113: 이었다 */
+    { 0xC774,   0,  0, 1 },  /* 114: 이라도 */
+    { 0xC5D0,   0,  0, 1 },  /* 115: 에서도 */
+    { 0xC801,   0,  0, 1 },  /* 116: 적으로 */
+    { 0xC774,   0,  0, 1 },  /* 117: 이나마 */
+    { 0xC5D0,   0,  0, 1 },  /* 118: 에게서 */
+    { 0xC73C,   0,  0, 1 },  /* 119: 으로서 */
+    { 0xD55C,   0,  0, 1 },  /* 120: 한테서 */
+    { 0xC73C,   0,  0, 1 },  /* 121: 으로써 */
+    { 0xC774,   0,  0, 1 },  /* 122: 이든지 */
+    { 0xB85C, 124,  1, 1 },  /* 123: 로부터 */
+    { 0xC73C,   0,  0, 1 },  /* 124: 으로부터 */
+};
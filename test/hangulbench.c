@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../hangul/hangul.h"
+
+/* 한글 조합 벤치마크
+ *
+ * 사용법: hangulbench [자판 id]...
+ *
+ * 자판마다 임의의 키 입력을 조합 루틴과 상태 전이 테이블
+ * (HANGUL_IC_OPTION_AUTOMATON)로 처리해서 초당 처리한 키의 수를 출력한다.
+ * 두벌식은 실제 글처럼 자음, 모음 순서로 된 입력도 따로 측정한다.
+ * 이 입력은 hangul_ic_process_string()이 대부분 음절 단위로 처리한다.
+ * 끝으로 HangulInputContext 하나를 만들고 지우는 데 걸리는 시간을
+ * hangul_ic_new()와 pool에 대해 각각 출력한다.
+ * 자판을 주지 않으면 모든 자판을 측정한다. */
+
+#define N_KEYS   (1 << 20)
+#define N_ROUNDS 8
+#define N_CONTEXTS 4096
+
+static double
+now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned int seed = 1;
+
+static unsigned int
+next_random()
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static char*
+make_random_keys()
+{
+    char* keys = malloc(N_KEYS);
+    size_t i;
+
+    if (keys == NULL)
+	return NULL;
+
+    for (i = 0; i < N_KEYS; i++)
+	keys[i] = 0x20 + next_random() % 0x5f;
+
+    return keys;
+}
+
+/* 두벌식 자판에서 초성, 중성, 종성 순서로 친 것 같은 입력 */
+static char*
+make_syllable_keys()
+{
+    static const char consonants[] = "rRseEfaqQtTdwWczxvg";
+    static const char vowels[] = "koiOjpuPhynbml";
+    static const char* finals[] = {
+	"r", "s", "e", "f", "a", "q", "t", "d", "w", "c", "z", "x", "v", "g",
+	"T", "R", "rt", "sw", "sg", "fr", "fa", "fq", "ft", "fx", "fv", "fg",
+	"qt"
+    };
+    static const char* vowel_pairs[] = { "hk", "ho", "hl", "nj", "np", "nl", "ml" };
+    char* keys = malloc(N_KEYS + 8);
+    size_t n = 0;
+
+    if (keys == NULL)
+	return NULL;
+
+    while (n < N_KEYS) {
+	unsigned int r = next_random();
+	const char* s;
+
+	keys[n++] = consonants[r % (sizeof(consonants) - 1)];
+
+	r = next_random();
+	if (r % 8 == 0) {
+	    s = vowel_pairs[(r >> 3) % (sizeof(vowel_pairs) / sizeof(vowel_pairs[0]))];
+	    while (*s != '\0')
+		keys[n++] = *s++;
+	} else {
+	    keys[n++] = vowels[(r >> 3) % (sizeof(vowels) - 1)];
+	}
+
+	r = next_random();
+	if (r % 2 == 0) {
+	    s = finals[(r >> 1) % (sizeof(finals) / sizeof(finals[0]))];
+	    while (*s != '\0')
+		keys[n++] = *s++;
+	}
+
+	r = next_random();
+	if (r % 4 == 0)
+	    keys[n++] = ' ';
+	else if (r % 64 == 1)
+	    keys[n++] = '.';
+    }
+
+    return keys;
+}
+
+static double
+bench_process(const char* id, const char* keys, bool automaton)
+{
+    HangulInputContext* hic;
+    double start;
+    double elapsed;
+    size_t commits = 0;
+    int round;
+    size_t i;
+
+    hic = hangul_ic_new(id);
+    hangul_ic_set_option(hic, HANGUL_IC_OPTION_AUTOMATON, automaton);
+
+    start = now();
+    for (round = 0; round < N_ROUNDS; round++) {
+	for (i = 0; i < N_KEYS; i++) {
+	    hangul_ic_process(hic, keys[i]);
+	    commits += hangul_ic_get_commit_string(hic)[0] != 0;
+	}
+	hangul_ic_flush(hic);
+    }
+    elapsed = now() - start;
+
+    hangul_ic_delete(hic);
+
+    if (commits == 0)
+	fprintf(stderr, "hangulbench: %s: no commit\n", id);
+
+    return (double)N_KEYS * N_ROUNDS / elapsed;
+}
+
+static double
+bench_process_string(const char* id, const char* keys, bool automaton)
+{
+    HangulInputContext* hic;
+    ucschar out[4096];
+    double start;
+    double elapsed;
+    size_t consumed;
+    int round;
+    size_t i;
+
+    hic = hangul_ic_new(id);
+    hangul_ic_set_option(hic, HANGUL_IC_OPTION_AUTOMATON, automaton);
+
+    start = now();
+    for (round = 0; round < N_ROUNDS; round++) {
+	for (i = 0; i < N_KEYS; i += consumed) {
+	    hangul_ic_process_string(hic, keys + i, N_KEYS - i,
+				     out, sizeof(out) / sizeof(out[0]),
+				     &consumed);
+	}
+	hangul_ic_flush(hic);
+    }
+    elapsed = now() - start;
+
+    hangul_ic_delete(hic);
+
+    return (double)N_KEYS * N_ROUNDS / elapsed;
+}
+
+/* 세션이 많은 서버처럼 한꺼번에 많이 만들고 지우기를 되풀이한다. */
+static double
+bench_new_delete(HangulInputContextPool* pool)
+{
+    static HangulInputContext* ics[N_CONTEXTS];
+    double start;
+    int round;
+    int i;
+
+    start = now();
+    for (round = 0; round < N_ROUNDS * 8; round++) {
+	for (i = 0; i < N_CONTEXTS; i++) {
+	    if (pool != NULL)
+		ics[i] = hangul_ic_pool_new_ic(pool, i % 2 ? "2" : "3f");
+	    else
+		ics[i] = hangul_ic_new(i % 2 ? "2" : "3f");
+	    hangul_ic_process(ics[i], 'r');
+	}
+	for (i = 0; i < N_CONTEXTS; i++)
+	    hangul_ic_delete(ics[i]);
+    }
+
+    return (now() - start) * 1e9 / ((double)N_CONTEXTS * N_ROUNDS * 8);
+}
+
+static void
+bench_contexts()
+{
+    HangulInputContextPool* pool = hangul_ic_pool_new(0);
+    double malloced = bench_new_delete(NULL);
+    double pooled = bench_new_delete(pool);
+
+    printf("new/delete %6.1f ns -> pool %6.1f ns (x%.2f)\n",
+	   malloced, pooled, malloced / pooled);
+
+    hangul_ic_pool_delete(pool);
+}
+
+static void
+bench_keyboard(const char* id, const char* keys, const char* label)
+{
+    double engine = bench_process(id, keys, false);
+    double automaton = bench_process(id, keys, true);
+    double string_engine = bench_process_string(id, keys, false);
+    double string_automaton = bench_process_string(id, keys, true);
+
+    printf("%-6s %-8s process %6.1f -> %6.1f Mkeys/s (x%.2f)"
+	   "  process_string %6.1f -> %6.1f Mkeys/s (x%.2f)\n",
+	   id, label,
+	   engine / 1e6, automaton / 1e6, automaton / engine,
+	   string_engine / 1e6, string_automaton / 1e6,
+	   string_automaton / string_engine);
+}
+
+int
+main(int argc, char *argv[])
+{
+    char* random_keys;
+    char* syllable_keys;
+    unsigned int n;
+    unsigned int i;
+
+    random_keys = make_random_keys();
+    syllable_keys = make_syllable_keys();
+    if (random_keys == NULL || syllable_keys == NULL) {
+	fprintf(stderr, "hangulbench: out of memory\n");
+	return 1;
+    }
+
+    if (argc > 1) {
+	for (i = 1; i < argc; i++) {
+	    bench_keyboard(argv[i], random_keys, "random");
+	    if (strcmp(argv[i], "2") == 0)
+		bench_keyboard(argv[i], syllable_keys, "text");
+	}
+    } else {
+	bench_keyboard("2", syllable_keys, "text");
+
+	n = hangul_keyboard_list_get_count();
+	for (i = 0; i < n; i++) {
+	    bench_keyboard(hangul_keyboard_list_get_keyboard_id(i),
+			   random_keys, "random");
+	}
+
+	bench_contexts();
+    }
+
+    free(random_keys);
+    free(syllable_keys);
+
+    return 0;
+}
@@ -0,0 +1,746 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../hangul/hangul.h"
+
+/* 한자 사전 검색 벤치마크
+ *
+ * 사용법: hanjabench [사전 파일]
+ *
+ * 사전 파일을 주지 않으면 임의의 키, 값, 설명으로 된 사전을 만들어서
+ * 사용한다. */
+
+#define N_SYNTHETIC_ENTRIES 60000
+#define N_ROUNDS            20
+#define N_SENTENCES         2000
+
+static char** keys = NULL;
+static size_t nkeys = 0;
+
+static double
+now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+utf8_put(char* buf, unsigned c)
+{
+    buf[0] = 0xe0 | (c >> 12);
+    buf[1] = 0x80 | ((c >> 6) & 0x3f);
+    buf[2] = 0x80 | (c & 0x3f);
+    return 3;
+}
+
+static int
+compare_line(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static char*
+make_synthetic_dictionary()
+{
+    static char filename[] = "/tmp/hanjabench-XXXXXX";
+    char** lines;
+    FILE* file;
+    int fd;
+    int i, j;
+
+    fd = mkstemp(filename);
+    if (fd < 0)
+	return NULL;
+
+    file = fdopen(fd, "w");
+    if (file == NULL)
+	return NULL;
+
+    srand(1);
+    lines = malloc(N_SYNTHETIC_ENTRIES * sizeof(lines[0]));
+    for (i = 0; i < N_SYNTHETIC_ENTRIES; i++) {
+	char buf[256];
+	char* p = buf;
+	int len = 1 + rand() % 4;
+
+	/* 1음절 키는 흔한 음절에 몰리도록 한다 */
+	for (j = 0; j < len; j++)
+	    p += utf8_put(p, 0xac00 + rand() % (len == 1 ? 400 : 11172));
+	*p++ = ':';
+	for (j = 0; j < len; j++)
+	    p += utf8_put(p, 0x4e00 + rand() % 20000);
+	*p++ = ':';
+	for (j = 0; j < 12; j++)
+	    p += utf8_put(p, 0xac00 + rand() % 11172);
+	*p = '\0';
+	lines[i] = strdup(buf);
+    }
+
+    qsort(lines, N_SYNTHETIC_ENTRIES, sizeof(lines[0]), compare_line);
+    for (i = 0; i < N_SYNTHETIC_ENTRIES; i++) {
+	fprintf(file, "%s\n", lines[i]);
+	free(lines[i]);
+    }
+    free(lines);
+    fclose(file);
+
+    return filename;
+}
+
+static void
+load_keys(const char* filename)
+{
+    char buf[512];
+    size_t alloc = 1024;
+    FILE* file;
+
+    file = fopen(filename, "r");
+    if (file == NULL)
+	return;
+
+    keys = malloc(alloc * sizeof(keys[0]));
+    while (fgets(buf, sizeof(buf), file) != NULL) {
+	char* p;
+
+	if (buf[0] == '#' || buf[0] == '\n')
+	    continue;
+
+	p = strchr(buf, ':');
+	if (p == NULL)
+	    continue;
+	*p = '\0';
+
+	if (nkeys > 0 && strcmp(keys[nkeys - 1], buf) == 0)
+	    continue;
+
+	if (nkeys >= alloc) {
+	    alloc *= 2;
+	    keys = realloc(keys, alloc * sizeof(keys[0]));
+	}
+	keys[nkeys++] = strdup(buf);
+    }
+    fclose(file);
+}
+
+static void
+bench_exact(const HanjaTable* table, int with_comment)
+{
+    double start, elapsed;
+    size_t nlookups = 0;
+    size_t bytes = 0;
+    size_t i;
+    int round;
+
+    start = now();
+    for (round = 0; round < N_ROUNDS; round++) {
+	for (i = 0; i < nkeys; i++) {
+	    HanjaList* list = hanja_table_match_exact(table, keys[i]);
+	    int j, n = hanja_list_get_size(list);
+	    for (j = 0; j < n; j++) {
+		bytes += strlen(hanja_list_get_nth_value(list, j));
+		if (with_comment)
+		    bytes += strlen(hanja_list_get_nth_comment(list, j));
+	    }
+	    hanja_list_delete(list);
+	    nlookups++;
+	}
+    }
+    elapsed = now() - start;
+
+    printf("exact %-16s %8.1f ns/lookup (%zu bytes)\n",
+	   with_comment ? "key/value/comment" : "key/value",
+	   elapsed * 1e9 / nlookups, bytes / N_ROUNDS);
+}
+
+/* 후보 창처럼 prefix 검색 결과의 첫 페이지만 읽는다. */
+static void
+bench_page(const HanjaTable* table)
+{
+    const Hanja* page[9];
+    double start, elapsed;
+    size_t nlookups = 0;
+    size_t bytes = 0;
+    size_t i;
+    int round;
+
+    start = now();
+    for (round = 0; round < N_ROUNDS; round++) {
+	for (i = 0; i < nkeys; i++) {
+	    HanjaList* list = hanja_table_match_prefix(table, keys[i]);
+	    unsigned int j, n = hanja_list_get_page(list, 0, page, 9);
+	    for (j = 0; j < n; j++)
+		bytes += strlen(hanja_get_value(page[j]));
+	    hanja_list_delete(list);
+	    nlookups++;
+	}
+    }
+    elapsed = now() - start;
+
+    printf("prefix first page %8.1f ns/lookup (%zu bytes)\n",
+	   elapsed * 1e9 / nlookups, bytes / N_ROUNDS);
+}
+
+/* 입력기처럼 힌트를 주고 잠시 후에 검색한다. 검색하는 시간만 잰다. */
+static void
+bench_prefetch(HanjaTable* table)
+{
+    double elapsed = 0.0;
+    size_t n = 0;
+    size_t i;
+    uint64_t hits;
+
+    if (!hanja_table_start_prefetch(table)) {
+	printf("prefetch not supported\n");
+	return;
+    }
+
+    hits = hanja_table_get_stat(table, HANJA_TABLE_STAT_PREFETCH_HITS);
+    for (i = 0; i < nkeys && n < 2000; i += 17, n++) {
+	HanjaList* list;
+	double start;
+
+	hanja_table_prefetch_hint(table, keys[i], HANJA_MATCH_PREFIX);
+	usleep(200);
+
+	start = now();
+	list = hanja_table_match_prefix(table, keys[i]);
+	elapsed += now() - start;
+	hanja_list_delete(list);
+    }
+    hits = hanja_table_get_stat(table, HANJA_TABLE_STAT_PREFETCH_HITS) - hits;
+
+    printf("prefetched prefix %8.1f ns/lookup (%llu/%zu hits)\n",
+	   elapsed * 1e9 / n, (unsigned long long)hits, n);
+
+    hanja_table_stop_prefetch(table);
+}
+
+/* 모든 음절에 대해서 음절 하나로 된 키를 검색한다. */
+static void
+bench_syllable(const HanjaTable* table)
+{
+    double start, elapsed;
+    size_t nfound = 0;
+    unsigned c;
+    int round;
+
+    start = now();
+    for (round = 0; round < N_ROUNDS; round++) {
+	for (c = 0xac00; c <= 0xd7a3; c++) {
+	    HanjaList* list = hanja_table_match_syllable(table, c);
+	    nfound += hanja_list_get_size(list);
+	    hanja_list_delete(list);
+	}
+    }
+    elapsed = now() - start;
+
+    printf("syllable %8.1f ns/lookup (%zu found)\n",
+	   elapsed * 1e9 / (N_ROUNDS * 11172), nfound / N_ROUNDS);
+}
+
+/* 설명 검색. 처음 검색할 때 인덱스를 만드는 시간은 따로 잰다. */
+static void
+bench_comment(const HanjaTable* table)
+{
+    double start, elapsed;
+    size_t nfound = 0;
+    HanjaList* list;
+    int i;
+
+    start = now();
+    list = hanja_table_search_comment(table, "나라");
+    hanja_list_delete(list);
+    printf("comment index %8.1f ms\n", (now() - start) * 1e3);
+
+    srand(3);
+    start = now();
+    for (i = 0; i < 1000; i++) {
+	char buf[16];
+	char* p = buf;
+	int j, len = 1 + i % 2;
+
+	for (j = 0; j < len; j++)
+	    p += utf8_put(p, 0xac00 + rand() % 400);
+	*p = '\0';
+
+	list = hanja_table_search_comment(table, buf);
+	nfound += hanja_list_get_size(list);
+	hanja_list_delete(list);
+    }
+    elapsed = now() - start;
+
+    printf("comment %8.1f us/query (%zu found)\n", elapsed * 1e6 / 1000, nfound);
+}
+
+/* 한자 검색. 처음 검색할 때 인덱스를 만드는 시간은 따로 잰다. */
+static void
+bench_value(const HanjaTable* table)
+{
+    double start, elapsed;
+    size_t nfound = 0;
+    HanjaList* list;
+    int i;
+
+    start = now();
+    list = hanja_table_search_value(table, "國");
+    hanja_list_delete(list);
+    printf("value index %8.1f ms\n", (now() - start) * 1e3);
+
+    srand(4);
+    start = now();
+    for (i = 0; i < 1000; i++) {
+	char buf[16];
+	char* p = buf;
+	int j, len = 1 + i % 2;
+
+	/* 두 글자 검색은 결과가 있도록 흔한 한자에서 고른다 */
+	for (j = 0; j < len; j++)
+	    p += utf8_put(p, 0x4e00 + rand() % (len == 1 ? 20000 : 50));
+	*p = '\0';
+
+	list = hanja_table_search_value(table, buf);
+	nfound += hanja_list_get_size(list);
+	hanja_list_delete(list);
+    }
+    elapsed = now() - start;
+
+    printf("value %8.1f us/query (%zu found)\n", elapsed * 1e6 / 1000, nfound);
+}
+
+/* 키의 마지막 음절의 종성을 바꿔서 오타를 낸 키로 찾는다. */
+static void
+bench_fuzzy(const HanjaTable* table, int distance)
+{
+    double start, elapsed;
+    size_t nqueries = 0;
+    size_t nfound = 0;
+    size_t i, step;
+
+    if (nkeys == 0)
+	return;
+
+    step = nkeys > 1000 ? nkeys / 1000 : 1;
+    start = now();
+    for (i = 0; i < nkeys; i += step) {
+	char buf[256];
+	size_t len = strlen(keys[i]);
+	HanjaList* list;
+
+	if (len < 3 || len >= sizeof(buf))
+	    continue;
+
+	memcpy(buf, keys[i], len + 1);
+	buf[len - 1] ^= 1;
+
+	list = hanja_table_match_fuzzy(table, buf, distance);
+	nfound += hanja_list_get_size(list);
+	hanja_list_delete(list);
+	nqueries++;
+    }
+    elapsed = now() - start;
+
+    if (nqueries > 0)
+	printf("fuzzy k=%d %8.1f us/query (%zu found)\n", distance,
+	       elapsed * 1e6 / nqueries, nfound);
+}
+
+/* 사전을 거꾸로 뒤집은 파일을 로딩하고, 작은 메모리로 정렬한다. */
+static void
+bench_unsorted(const char* filename, const HanjaTable* table)
+{
+    char unsorted[] = "/tmp/hanjabench-unsorted-XXXXXX";
+    char sorted[] = "/tmp/hanjabench-sorted-XXXXXX";
+    char buf[512];
+    char** lines;
+    size_t nlines = 0;
+    size_t alloc = 1024;
+    HanjaTable* t;
+    double start;
+    FILE* file;
+    int fd;
+
+    file = fopen(filename, "r");
+    if (file == NULL)
+	return;
+
+    lines = malloc(alloc * sizeof(lines[0]));
+    while (fgets(buf, sizeof(buf), file) != NULL) {
+	if (nlines >= alloc) {
+	    alloc *= 2;
+	    lines = realloc(lines, alloc * sizeof(lines[0]));
+	}
+	lines[nlines++] = strdup(buf);
+    }
+    fclose(file);
+
+    fd = mkstemp(unsorted);
+    file = fd >= 0 ? fdopen(fd, "w") : NULL;
+    while (nlines > 0) {
+	nlines--;
+	if (file != NULL)
+	    fputs(lines[nlines], file);
+	free(lines[nlines]);
+    }
+    free(lines);
+    if (file == NULL)
+	return;
+    fclose(file);
+
+    start = now();
+    t = hanja_table_load(unsorted);
+    printf("load unsorted %8.1f ms (%s)\n", (now() - start) * 1e3,
+	   t != NULL && hanja_table_get_stat(t, HANJA_TABLE_STAT_ENTRIES) ==
+	   hanja_table_get_stat(table, HANJA_TABLE_STAT_ENTRIES) ? "ok" : "FAIL");
+    hanja_table_delete(t);
+
+    fd = mkstemp(sorted);
+    if (fd >= 0) {
+	close(fd);
+
+	start = now();
+	hanja_table_sort_file(unsorted, sorted, 128 * 1024);
+	printf("sort file 128KiB %8.1f ms", (now() - start) * 1e3);
+
+	t = hanja_table_load(sorted);
+	printf(" (%s)\n",
+	       t != NULL && hanja_table_get_stat(t, HANJA_TABLE_STAT_ENTRIES) ==
+	       hanja_table_get_stat(table, HANJA_TABLE_STAT_ENTRIES) ? "ok" : "FAIL");
+	hanja_table_delete(t);
+
+	start = now();
+	hanja_table_sort_file(unsorted, sorted, 0);
+	printf("sort file in memory %8.1f ms\n", (now() - start) * 1e3);
+	unlink(sorted);
+    }
+
+    unlink(unsorted);
+}
+
+/* 사전의 키와 값으로 임의의 bigram을 만들어서 모델을 만들고, 검색 결과의
+ * 순서를 바꾼다. */
+/* 메모리 예산에 따라 로딩하는 방식과 검색 속도가 어떻게 바뀌는지 본다.
+ * 예산은 제한 없음(0)부터 사전 전체를 막 로딩했을 때의 메모리를 나눈 값,
+ * 1바이트까지 차례로 준다.
+ * 페이지 모드는 검색마다 파일을 읽으므로 키의 일부만 검색한다. */
+static void
+bench_budget(const char* filename)
+{
+    static const unsigned divisors[] = { 0, 2, 4, 8, 16, 64, 0 };
+    uint64_t heap;
+    HanjaTable* t;
+    size_t n = sizeof(divisors) / sizeof(divisors[0]);
+    size_t i, k;
+
+    t = hanja_table_load(filename);
+    if (t == NULL)
+	return;
+    heap = hanja_table_get_stat(t, HANJA_TABLE_STAT_HEAP_BYTES);
+    hanja_table_delete(t);
+
+    for (i = 0; i < n; i++) {
+	size_t budget = divisors[i] > 0 ? heap / divisors[i] : (i == 0 ? 0 : 1);
+	size_t step = nkeys / 200 > 0 ? nkeys / 200 : 1;
+	size_t nlookups = 0;
+	size_t nfound = 0;
+	uint64_t bytes_read;
+	uint64_t size;
+	double start, load, exact, prefix;
+
+	start = now();
+	t = hanja_table_load_with_budget(filename, budget);
+	load = now() - start;
+	if (t == NULL)
+	    continue;
+
+	size = hanja_table_get_stat(t, HANJA_TABLE_STAT_HEAP_BYTES);
+	bytes_read = hanja_table_get_stat(t, HANJA_TABLE_STAT_BYTES_READ);
+	start = now();
+	for (k = 0; k < nkeys; k += step) {
+	    HanjaList* list = hanja_table_match_exact(t, keys[k]);
+	    if (list != NULL && hanja_list_get_size(list) > 0 &&
+		hanja_list_get_nth_comment(list, 0) != NULL)
+		nfound++;
+	    hanja_list_delete(list);
+	    nlookups++;
+	}
+	exact = now() - start;
+	bytes_read = hanja_table_get_stat(t, HANJA_TABLE_STAT_BYTES_READ) -
+		     bytes_read;
+
+	start = now();
+	for (k = 0; k < nkeys; k += step)
+	    hanja_list_delete(hanja_table_match_prefix(t, keys[k]));
+	prefix = now() - start;
+
+	printf("budget %10zu B %-5s page %5llu heap %8.1f KiB "
+	       "load %6.1f ms exact %9.1f ns %6.0f B/lookup prefix %9.1f ns (%s)\n",
+	       budget,
+	       hanja_table_get_stat(t, HANJA_TABLE_STAT_MODE) ==
+	       HANJA_TABLE_MODE_PAGED ? "paged" : "full",
+	       (unsigned long long)hanja_table_get_stat(t, HANJA_TABLE_STAT_PAGE_SIZE),
+	       size / 1024.0, load * 1e3, exact * 1e9 / nlookups,
+	       (double)bytes_read / nlookups, prefix * 1e9 / nlookups,
+	       nfound == nlookups ? "ok" : "FAIL");
+	hanja_table_delete(t);
+    }
+}
+
+static void
+bench_model(const HanjaTable* table)
+{
+    char input[] = "/tmp/hanjabench-bigram-XXXXXX";
+    char output[] = "/tmp/hanjabench-model-XXXXXX";
+    HanjaModel* model;
+    double start, elapsed;
+    size_t npairs = 0;
+    size_t nscored = 0;
+    FILE* file;
+    int fd;
+    int i;
+
+    if (nkeys == 0)
+	return;
+
+    fd = mkstemp(input);
+    file = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (file == NULL)
+	return;
+
+    srand(5);
+    for (i = 0; i < 200000; i++) {
+	const char* previous = keys[rand() % nkeys];
+	HanjaList* list = hanja_table_match_exact(table, keys[rand() % nkeys]);
+	int j, n = hanja_list_get_size(list);
+	for (j = 0; j < n; j++) {
+	    fprintf(file, "%s:%s:%d\n", previous,
+		    hanja_list_get_nth_value(list, j), 1 + rand() % 1000);
+	    npairs++;
+	}
+	hanja_list_delete(list);
+    }
+    fclose(file);
+
+    fd = mkstemp(output);
+    if (fd < 0) {
+	unlink(input);
+	return;
+    }
+    close(fd);
+
+    start = now();
+    hanja_model_compile(input, output);
+    printf("model compile %8.1f ms (%zu pairs)\n", (now() - start) * 1e3, npairs);
+
+    start = now();
+    model = hanja_model_load(output);
+    printf("model load %8.1f us\n", (now() - start) * 1e6);
+
+    if (model != NULL) {
+	srand(5);
+	start = now();
+	for (i = 0; i < 1000000; i++) {
+	    if (hanja_model_get_score(model, keys[rand() % nkeys],
+				      keys[rand() % nkeys]) > 0)
+		nscored++;
+	}
+	elapsed = now() - start;
+	printf("model score %8.1f ns (%zu hits)\n", elapsed * 1e9 / 1000000,
+	       nscored);
+
+	srand(6);
+	start = now();
+	for (i = 0; i < 10000; i++) {
+	    const char* previous = keys[rand() % nkeys];
+	    HanjaList* list = hanja_table_match_prefix(table, keys[rand() % nkeys]);
+	    hanja_list_rerank(list, model, previous);
+	    hanja_list_delete(list);
+	}
+	elapsed = now() - start;
+	printf("prefix+rerank %8.1f us\n", elapsed * 1e6 / 10000);
+
+	hanja_model_delete(model);
+    }
+
+    unlink(output);
+    unlink(input);
+}
+
+/* 사전의 키 몇백개에 엔트리를 추가하고 지우는 패치를 적용한 후 합친다. */
+static void
+bench_patch(HanjaTable* table)
+{
+    char filename[] = "/tmp/hanjabench-patch-XXXXXX";
+    double start;
+    FILE* file;
+    int fd;
+    int i;
+
+    if (nkeys == 0)
+	return;
+
+    fd = mkstemp(filename);
+    if (fd < 0)
+	return;
+
+    file = fdopen(fd, "w");
+    if (file == NULL)
+	return;
+
+    srand(5);
+    for (i = 0; i < 300; i++) {
+	const char* key = keys[rand() % nkeys];
+	char value[16];
+
+	value[utf8_put(value, 0x4e00 + rand() % 20000)] = '\0';
+	if (i % 3 == 0)
+	    fprintf(file, "-%s:%s\n", key, value);
+	else
+	    fprintf(file, "+%s:%s:patch\n", key, value);
+    }
+    fclose(file);
+
+    start = now();
+    hanja_table_apply_patch(table, filename);
+    printf("patch %8.1f ms (300 lines)\n", (now() - start) * 1e3);
+
+    start = now();
+    hanja_table_compact(table);
+    printf("compact %8.1f ms\n", (now() - start) * 1e3);
+
+    unlink(filename);
+}
+
+/* 사전의 키와 임의의 음절을 이어서 문장을 만들고, 문장 변환기처럼
+ * 문장의 각 위치에서 prefix 검색을, 문장 전체에 대해서 suffix 검색을
+ * 한다. 검색하는 키의 대부분은 사전에 없다. */
+static void
+bench_sentence(const HanjaTable* table)
+{
+    char** sentences;
+    double start, elapsed;
+    size_t nlookups = 0;
+    size_t nfound = 0;
+    int round;
+    int i, j;
+
+    if (nkeys == 0)
+	return;
+
+    srand(2);
+    sentences = malloc(N_SENTENCES * sizeof(sentences[0]));
+    for (i = 0; i < N_SENTENCES; i++) {
+	char buf[512];
+	char* p = buf;
+	int n = 3 + rand() % 4;
+
+	for (j = 0; j < n; j++) {
+	    const char* key = keys[rand() % nkeys];
+	    int len = strlen(key);
+	    memcpy(p, key, len);
+	    p += len;
+	    p += utf8_put(p, 0xac00 + rand() % 11172);
+	}
+	*p = '\0';
+	sentences[i] = strdup(buf);
+    }
+
+    start = now();
+    for (round = 0; round < N_ROUNDS; round++) {
+	for (i = 0; i < N_SENTENCES; i++) {
+	    const char* p = sentences[i];
+	    HanjaList* list;
+
+	    while (*p != '\0') {
+		list = hanja_table_match_prefix(table, p);
+		nfound += hanja_list_get_size(list);
+		hanja_list_delete(list);
+		nlookups++;
+		p += 3;
+	    }
+
+	    list = hanja_table_match_suffix(table, sentences[i]);
+	    nfound += hanja_list_get_size(list);
+	    hanja_list_delete(list);
+	}
+    }
+    elapsed = now() - start;
+
+    printf("sentence %8.1f us/sentence %8.1f ns/prefix (%zu found)\n",
+	   elapsed * 1e6 / (N_ROUNDS * N_SENTENCES),
+	   elapsed * 1e9 / nlookups, nfound / N_ROUNDS);
+
+    for (i = 0; i < N_SENTENCES; i++)
+	free(sentences[i]);
+    free(sentences);
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char* filename;
+    char* synthetic = NULL;
+    HanjaTable* table;
+    double start;
+    size_t i;
+
+    if (argc > 1) {
+	filename = argv[1];
+    } else {
+	synthetic = make_synthetic_dictionary();
+	filename = synthetic;
+    }
+
+    if (filename == NULL) {
+	fprintf(stderr, "hanjabench: cannot create dictionary\n");
+	return 1;
+    }
+
+    start = now();
+    table = hanja_table_load(filename);
+    if (table == NULL) {
+	fprintf(stderr, "hanjabench: cannot load %s\n", filename);
+	return 1;
+    }
+    printf("load %.1f ms\n", (now() - start) * 1e3);
+
+    load_keys(filename);
+    printf("%zu keys\n", nkeys);
+
+    bench_exact(table, 0);
+    bench_exact(table, 1);
+    bench_syllable(table);
+    bench_page(table);
+    bench_prefetch(table);
+    bench_sentence(table);
+    bench_comment(table);
+    bench_value(table);
+    bench_fuzzy(table, 1);
+    bench_fuzzy(table, 2);
+    bench_unsorted(filename, table);
+    bench_budget(filename);
+    bench_model(table);
+    bench_patch(table);
+
+    printf("memory index %.1f KiB data %.1f KiB heap %.1f KiB\n",
+	   hanja_table_get_stat(table, HANJA_TABLE_STAT_INDEX_BYTES) / 1024.0,
+	   hanja_table_get_stat(table, HANJA_TABLE_STAT_DATA_BYTES) / 1024.0,
+	   hanja_table_get_stat(table, HANJA_TABLE_STAT_HEAP_BYTES) / 1024.0);
+    printf("lookups %llu misses %llu\n",
+	   (unsigned long long)hanja_table_get_stat(table, HANJA_TABLE_STAT_LOOKUPS),
+	   (unsigned long long)hanja_table_get_stat(table, HANJA_TABLE_STAT_MISSES));
+
+    hanja_table_delete(table);
+
+    for (i = 0; i < nkeys; i++)
+	free(keys[i]);
+    free(keys);
+
+    if (synthetic != NULL)
+	unlink(synthetic);
+
+    return 0;
+}
@@ -1,7 +1,9 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <wchar.h>
+#include <unistd.h>
 #include <check.h>
 
 #include "../hangul/hangul.h"
@@ -416,6 +418,459 @@ START_TEST(test_hangul_ic_non_choseong_combi)
 END_TEST
 }
 
+START_TEST(test_hangul_ic_process_string)
+{
+    HangulInputContext* ic;
+    const char* input = "dkssud gktpdy";
+    ucschar out[64];
+    size_t consumed;
+    size_t len;
+    size_t n;
+
+    ic = get_ic("2");
+    len = hangul_ic_process_string(ic, input, strlen(input),
+				   out, sizeof(out) / sizeof(out[0]), &consumed);
+    out[len] = 0;
+    ck_assert_uint_eq(consumed, strlen(input));
+    ck_assert(wcscmp((const wchar_t*)out, L"안녕 하세") == 0);
+    ck_assert(wcscmp((const wchar_t*)hangul_ic_get_preedit_string(ic),
+		     L"요") == 0);
+
+    /* 공간이 모자라면 그 키를 처리하기 전 상태로 멈추고,
+     * 이어서 부르면 같은 결과가 나와야 한다. */
+    ic = get_ic("2");
+    len = hangul_ic_process_string(ic, input, strlen(input),
+				   out, 1, &consumed);
+    ck_assert_uint_eq(len, 1);
+    ck_assert_uint_eq(consumed, 6);
+    ck_assert(wcscmp((const wchar_t*)hangul_ic_get_preedit_string(ic),
+		     L"녕") == 0);
+
+    while (consumed < strlen(input)) {
+	len += hangul_ic_process_string(ic, input + consumed,
+					strlen(input) - consumed,
+					out + len, 2, &n);
+	ck_assert(n > 0);
+	consumed += n;
+    }
+    out[len] = 0;
+    ck_assert(wcscmp((const wchar_t*)out, L"안녕 하세") == 0);
+
+    /* 버퍼에 아무것도 넣을 수 없으면 조합만 하는 키까지 처리한다. */
+    ic = get_ic("2");
+    len = hangul_ic_process_string(ic, "rk ", 3, out, 0, &consumed);
+    ck_assert_uint_eq(len, 0);
+    ck_assert_uint_eq(consumed, 2);
+    ck_assert(wcscmp((const wchar_t*)hangul_ic_get_preedit_string(ic),
+		     L"가") == 0);
+}
+END_TEST
+
+typedef struct {
+    ucschar buf[256];
+    size_t len;
+    int ncalls;
+} CommitSink;
+
+static void
+on_commit(HangulInputContext* ic, const ucschar* str, size_t len, void* data)
+{
+    CommitSink* sink = data;
+
+    memcpy(sink->buf + sink->len, str, len * sizeof(ucschar));
+    sink->len += len;
+    sink->buf[sink->len] = 0;
+    sink->ncalls++;
+}
+
+START_TEST(test_hangul_ic_commit_callback)
+{
+    HangulInputContext* ic;
+    CommitSink sink = { { 0, }, 0, 0 };
+    const char* p;
+    ucschar out[16];
+    size_t consumed;
+    size_t len;
+    int i;
+
+    ic = hangul_ic_new("2");
+    hangul_ic_connect_callback(ic, "commit", on_commit, &sink);
+
+    for (p = "dkssudgktpdy"; *p != '\0'; p++) {
+	hangul_ic_process(ic, *p);
+	ck_assert(hangul_ic_get_commit_string(ic)[0] == 0);
+    }
+    ck_assert(wcscmp((const wchar_t*)sink.buf, L"안녕하세") == 0);
+    ck_assert_int_eq(sink.ncalls, 4);
+    ck_assert(wcscmp((const wchar_t*)hangul_ic_get_preedit_string(ic),
+		     L"요") == 0);
+
+    /* flush한 글자도 콜백으로 전달한다. */
+    ck_assert(hangul_ic_flush(ic)[0] == 0);
+    ck_assert(wcscmp((const wchar_t*)sink.buf, L"안녕하세요") == 0);
+    ck_assert_int_eq(sink.ncalls, 5);
+    ck_assert(hangul_ic_flush(ic)[0] == 0);
+    ck_assert_int_eq(sink.ncalls, 5);
+
+    /* process_string은 콜백 대신 out에 저장한다. */
+    len = hangul_ic_process_string(ic, "rkrk", 4,
+				   out, sizeof(out) / sizeof(out[0]), &consumed);
+    ck_assert_uint_eq(len, 1);
+    ck_assert_int_eq(out[0], L'가');
+    ck_assert_int_eq(sink.ncalls, 5);
+
+    /* 콜백을 끊으면 다시 commit string에 모은다. */
+    hangul_ic_connect_callback(ic, "commit", NULL, NULL);
+    hangul_ic_reset(ic);
+    hangul_ic_process(ic, 'r');
+    ck_assert(wcscmp((const wchar_t*)hangul_ic_get_commit_string(ic),
+		     L"") == 0);
+    hangul_ic_process(ic, 'k');
+    hangul_ic_process(ic, '1');
+    ck_assert(wcscmp((const wchar_t*)hangul_ic_get_commit_string(ic),
+		     L"가") == 0);
+
+    sink.len = 0;
+    sink.ncalls = 0;
+    hangul_ic_connect_callback(ic, "commit", on_commit, &sink);
+    for (i = 0; i < 100; i++) {
+	hangul_ic_process(ic, 'r');
+	hangul_ic_process(ic, 'k');
+    }
+    hangul_ic_process(ic, ' ');
+    ck_assert_uint_eq(sink.len, 100);
+
+    hangul_ic_delete(ic);
+}
+END_TEST
+
+START_TEST(test_hangul_ic_pool)
+{
+    static const char* keyboards[] = { "2", "3f", "2y", "39", NULL };
+    HangulInputContextPool* pool;
+    HangulInputContext* ics[10];
+    HangulInputContext* ic;
+    HangulInputContext* recycled;
+    CommitSink sink = { { 0, }, 0, 0 };
+    int i;
+
+    pool = hangul_ic_pool_new(3);
+    ck_assert(pool != NULL);
+
+    /* slab 크기보다 많이 만들어도 각각 따로 조합한다. */
+    for (i = 0; i < 10; i++) {
+	ics[i] = hangul_ic_pool_new_ic(pool, keyboards[i % 5]);
+	ck_assert(ics[i] != NULL);
+    }
+    for (i = 0; i < 10; i++) {
+	if (i % 5 == 1 || i % 5 == 3)
+	    ck_assert(check_preedit_with_ic(ics[i], "kf", L"가"));
+	else
+	    ck_assert(check_preedit_with_ic(ics[i], "rk", L"가"));
+    }
+
+    /* 지운 것을 다시 쓰고, 이전 설정은 남지 않는다. */
+    ic = ics[4];
+    hangul_ic_set_option(ic, HANGUL_IC_OPTION_AUTOMATON, true);
+    hangul_ic_set_option(ic, HANGUL_IC_OPTION_AUTO_REORDER, true);
+    hangul_ic_set_output_mode(ic, HANGUL_OUTPUT_JAMO);
+    hangul_ic_connect_callback(ic, "commit", on_commit, &sink);
+    for (i = 0; i < 100; i++)
+	hangul_ic_process(ic, 'r');
+    hangul_ic_delete(ic);
+    sink.len = 0;
+
+    recycled = hangul_ic_pool_new_ic(pool, "2");
+    ck_assert(recycled == ic);
+    ck_assert(!hangul_ic_get_option(ic, HANGUL_IC_OPTION_AUTOMATON));
+    ck_assert(!hangul_ic_get_option(ic, HANGUL_IC_OPTION_AUTO_REORDER));
+    ck_assert(hangul_ic_get_option(ic, HANGUL_IC_OPTION_NON_CHOSEONG_COMBI));
+    ck_assert(hangul_ic_is_empty(ic));
+    ck_assert(hangul_ic_get_preedit_string(ic)[0] == 0);
+    ck_assert(hangul_ic_get_commit_string(ic)[0] == 0);
+    ck_assert(check_preedit_with_ic(ic, "rk", L"가"));
+    ck_assert(check_commit_with_ic(ic, "rkr1", L"각"));
+    ck_assert_uint_eq(sink.len, 0);
+
+    /* 지운 것은 hangul_ic_new()로 만든 것과 같이 조합한다. */
+    for (i = 0; i < 10; i++) {
+	if (i != 4)
+	    hangul_ic_delete(ics[i]);
+    }
+    for (i = 0; i < 10; i++) {
+	ics[i] = hangul_ic_pool_new_ic(pool, "3f");
+	ck_assert(ics[i] != NULL && ics[i] != recycled);
+	ck_assert(check_preedit_with_ic(ics[i], "kf", L"가"));
+    }
+
+    /* 지우지 않은 것도 pool과 같이 해제된다. */
+    hangul_ic_pool_delete(pool);
+    hangul_ic_pool_delete(NULL);
+    ck_assert(hangul_ic_pool_new_ic(NULL, "2") == NULL);
+
+#if ENABLE_EXTERNAL_KEYBOARDS
+    /* 자판 목록이 바뀌면 기억해 둔 자판을 쓰지 않는다. */
+    HangulKeyboard* keyboard;
+    keyboard = hangul_keyboard_new_from_file(TEST_SOURCE_DIR "/recursive.xml");
+    ck_assert(keyboard != NULL);
+    ck_assert(hangul_keyboard_list_register_keyboard(keyboard) != NULL);
+
+    pool = hangul_ic_pool_new(0);
+    ic = hangul_ic_pool_new_ic(pool, "recursive");
+    hangul_ic_delete(ic);
+    ck_assert(hangul_keyboard_list_unregister_keyboard("recursive") == keyboard);
+    hangul_keyboard_delete(keyboard);
+
+    ic = hangul_ic_pool_new_ic(pool, "recursive");
+    ck_assert(!hangul_ic_process(ic, 'r'));
+    hangul_ic_pool_delete(pool);
+#endif /* ENABLE_EXTERNAL_KEYBOARDS */
+}
+END_TEST
+
+static bool
+ucschar_equal(const ucschar* a, const ucschar* b)
+{
+    while (*a != 0 && *a == *b) {
+	a++;
+	b++;
+    }
+    return *a == *b;
+}
+
+START_TEST(test_hangul_ic_automaton)
+{
+    unsigned int n;
+    unsigned int i;
+    unsigned int seed = 1;
+    int option;
+    int step;
+
+    n = hangul_keyboard_list_get_count();
+    for (i = 0; i < n; ++i) {
+	const char* id = hangul_keyboard_list_get_keyboard_id(i);
+
+	for (option = 0; option < 16; option++) {
+	    HangulInputContext* ref = hangul_ic_new(id);
+	    HangulInputContext* ic = hangul_ic_new(id);
+	    HangulInputContext* hics[] = { ref, ic };
+	    int k;
+
+	    for (k = 0; k < 2; k++) {
+		hangul_ic_set_option(hics[k], HANGUL_IC_OPTION_AUTO_REORDER,
+				     option & 1);
+		hangul_ic_set_option(hics[k],
+				     HANGUL_IC_OPTION_COMBI_ON_DOUBLE_STROKE,
+				     option & 2);
+		hangul_ic_set_option(hics[k],
+				     HANGUL_IC_OPTION_NON_CHOSEONG_COMBI,
+				     option & 4);
+		hangul_ic_set_output_mode(hics[k], (option & 8) ?
+			HANGUL_OUTPUT_JAMO : HANGUL_OUTPUT_SYLLABLE);
+	    }
+	    hangul_ic_set_option(ic, HANGUL_IC_OPTION_AUTOMATON, true);
+	    ck_assert(hangul_ic_get_option(ic, HANGUL_IC_OPTION_AUTOMATON));
+
+	    /* 임의의 키 입력에 대해 조합 루틴과 결과가 같아야 한다.
+	     * backspace, flush, reset이나 ASCII가 아닌 키가 중간에 섞여도
+	     * 같아야 한다. */
+	    for (step = 0; step < 4000; step++) {
+		unsigned int r;
+		int key;
+		bool r1, r2;
+
+		seed = seed * 1103515245 + 12345;
+		r = (seed >> 16) % 100;
+		if (r < 4) {
+		    key = '\b';
+		} else if (r == 4) {
+		    r1 = hangul_ic_backspace(ref);
+		    r2 = hangul_ic_backspace(ic);
+		    ck_assert(r1 == r2);
+		    continue;
+		} else if (r == 5) {
+		    ck_assert(ucschar_equal(hangul_ic_flush(ref),
+					    hangul_ic_flush(ic)));
+		    continue;
+		} else if (r == 6) {
+		    hangul_ic_reset(ref);
+		    hangul_ic_reset(ic);
+		    continue;
+		} else if (r == 7) {
+		    key = 0xac00;
+		} else {
+		    key = 0x20 + (seed >> 8) % 0x5f;
+		}
+
+		r1 = hangul_ic_process(ref, key);
+		r2 = hangul_ic_process(ic, key);
+		ck_assert_msg(r1 == r2, "%s option %d step %d", id, option, step);
+		ck_assert_msg(ucschar_equal(hangul_ic_get_commit_string(ref),
+					    hangul_ic_get_commit_string(ic)),
+			      "%s option %d step %d", id, option, step);
+		ck_assert_msg(ucschar_equal(hangul_ic_get_preedit_string(ref),
+					    hangul_ic_get_preedit_string(ic)),
+			      "%s option %d step %d", id, option, step);
+	    }
+
+	    ck_assert(ucschar_equal(hangul_ic_flush(ref), hangul_ic_flush(ic)));
+
+	    hangul_ic_delete(ref);
+	    hangul_ic_delete(ic);
+	}
+    }
+
+    /* 상태가 아주 많이 생기는 옛한글 자판에 긴 입력을 주어서 테이블을
+     * 비우고 다시 시작하는 경우에도 결과가 같은지 확인한다. */
+    {
+	HangulInputContext* ref = hangul_ic_new("2y");
+	HangulInputContext* ic = hangul_ic_new("2y");
+
+	hangul_ic_set_option(ref, HANGUL_IC_OPTION_AUTO_REORDER, true);
+	hangul_ic_set_option(ic, HANGUL_IC_OPTION_AUTO_REORDER, true);
+	hangul_ic_set_option(ic, HANGUL_IC_OPTION_AUTOMATON, true);
+
+	for (step = 0; step < 600000; step++) {
+	    int key;
+	    bool r1, r2;
+
+	    seed = seed * 1103515245 + 12345;
+	    key = 0x20 + (seed >> 8) % 0x5f;
+
+	    r1 = hangul_ic_process(ref, key);
+	    r2 = hangul_ic_process(ic, key);
+	    ck_assert_msg(r1 == r2, "2y step %d", step);
+	    ck_assert_msg(ucschar_equal(hangul_ic_get_commit_string(ref),
+					hangul_ic_get_commit_string(ic)),
+			  "2y step %d", step);
+	}
+	ck_assert(ucschar_equal(hangul_ic_get_preedit_string(ref),
+				hangul_ic_get_preedit_string(ic)));
+
+	hangul_ic_delete(ref);
+	hangul_ic_delete(ic);
+    }
+}
+END_TEST
+
+/* 조합 루틴으로 하나씩 처리한 결과를 out에 모은다. */
+static size_t
+process_keys_one_by_one(HangulInputContext* ic, const char* keys, size_t nkeys,
+			ucschar* out)
+{
+    size_t len = 0;
+    size_t i;
+
+    for (i = 0; i < nkeys; i++) {
+	const ucschar* commit;
+	bool res;
+
+	res = hangul_ic_process(ic, (unsigned char)keys[i]);
+	for (commit = hangul_ic_get_commit_string(ic); *commit != 0; commit++)
+	    out[len++] = *commit;
+	if (!res)
+	    out[len++] = (unsigned char)keys[i];
+    }
+
+    return len;
+}
+
+START_TEST(test_hangul_ic_process_syllables)
+{
+    static const char consonants[] = "rRseEfaqQtTdwWczxvg";
+    static const char vowels[] = "koiOjpuPhynbml";
+    static const char others[] = " .,1\b";
+    enum { NKEYS = 20000 };
+    char* keys = malloc(NKEYS + 4);
+    ucschar* expected = malloc((NKEYS * 2 + 16) * sizeof(ucschar));
+    ucschar* out = malloc((NKEYS * 2 + 16) * sizeof(ucschar));
+    unsigned int seed = 1;
+    int option;
+
+    /* 두벌식에서 음절 단위로 처리하는 부분이 있어도 키를 하나씩 처리한
+     * 것과 결과가 같아야 한다. 글처럼 자음, 모음이 번갈아 오는 입력에
+     * 겹모음, 겹받침, 자음이 여러개 이어지는 경우와 임의의 키를 섞고,
+     * 입력을 임의의 길이로 나누고 out의 크기도 바꿔 가면서 확인한다. */
+    for (option = 0; option < 16; option++) {
+	HangulInputContext* ref = hangul_ic_new("2");
+	HangulInputContext* ic = hangul_ic_new("2");
+	HangulInputContext* hics[] = { ref, ic };
+	size_t nkeys = 0;
+	size_t nexpected;
+	size_t len;
+	size_t i;
+	const ucschar* flushed;
+	int k;
+
+	for (k = 0; k < 2; k++) {
+	    hangul_ic_set_option(hics[k], HANGUL_IC_OPTION_AUTO_REORDER,
+				 option & 1);
+	    hangul_ic_set_option(hics[k],
+				 HANGUL_IC_OPTION_COMBI_ON_DOUBLE_STROKE,
+				 option & 2);
+	    hangul_ic_set_option(hics[k], HANGUL_IC_OPTION_NON_CHOSEONG_COMBI,
+				 option & 4);
+	    hangul_ic_set_output_mode(hics[k], (option & 8) ?
+		    HANGUL_OUTPUT_JAMO : HANGUL_OUTPUT_SYLLABLE);
+	}
+	hangul_ic_set_option(ic, HANGUL_IC_OPTION_AUTOMATON, true);
+
+	while (nkeys < NKEYS) {
+	    unsigned int r;
+
+	    seed = seed * 1103515245 + 12345;
+	    r = (seed >> 8) % 100;
+	    if (r < 40) {
+		keys[nkeys++] = consonants[(seed >> 16) % (sizeof(consonants) - 1)];
+	    } else if (r < 75) {
+		keys[nkeys++] = vowels[(seed >> 16) % (sizeof(vowels) - 1)];
+	    } else if (r < 95) {
+		keys[nkeys++] = others[(seed >> 16) % (sizeof(others) - 1)];
+	    } else if (r < 99) {
+		keys[nkeys++] = 0x20 + (seed >> 16) % 0x5f;
+	    } else {
+		keys[nkeys++] = (char)0xb0;
+	    }
+	}
+
+	nexpected = process_keys_one_by_one(ref, keys, nkeys, expected);
+	for (flushed = hangul_ic_flush(ref); *flushed != 0; flushed++)
+	    expected[nexpected++] = *flushed;
+
+	len = 0;
+	i = 0;
+	while (i < nkeys) {
+	    size_t chunk;
+	    size_t outcap;
+	    size_t consumed;
+
+	    seed = seed * 1103515245 + 12345;
+	    chunk = 1 + (seed >> 8) % 200;
+	    if (chunk > nkeys - i)
+		chunk = nkeys - i;
+	    outcap = (seed >> 20) % 4 == 0 ? (seed >> 16) % 4 : 1000;
+
+	    len += hangul_ic_process_string(ic, keys + i, chunk,
+					    out + len, outcap, &consumed);
+	    i += consumed;
+	}
+	for (flushed = hangul_ic_flush(ic); *flushed != 0; flushed++)
+	    out[len++] = *flushed;
+
+	ck_assert_msg(len == nexpected, "option %d", option);
+	ck_assert_msg(memcmp(out, expected, len * sizeof(ucschar)) == 0,
+		      "option %d", option);
+
+	hangul_ic_delete(ref);
+	hangul_ic_delete(ic);
+    }
+
+    free(keys);
+    free(expected);
+    free(out);
+}
+END_TEST
+
 START_TEST(test_syllable_iterator)
 {
     ucschar str[] = {
@@ -593,6 +1048,1009 @@ START_TEST(test_hangul_jamo_to_cjamo)
 }
 END_TEST
 
+START_TEST(test_hanja_table_match)
+{
+    HanjaTable* table;
+    HanjaList* list;
+
+    table = hanja_table_load(TEST_SOURCE_DIR "/hanjadic.txt");
+    ck_assert(table != NULL);
+
+    list = hanja_table_match_exact(table, "가");
+    ck_assert(hanja_list_get_size(list) == 2);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "家") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 1), "可") == 0);
+    hanja_list_delete(list);
+
+    list = hanja_table_match_exact(table, "나");
+    ck_assert(list == NULL);
+
+    /* 첫가끝 자모로 된 키: 삼국 */
+    list = hanja_table_match_exact(table,
+	    "\xe1\x84\x89\xe1\x85\xa1\xe1\x86\xb7\xe1\x84\x80\xe1\x85\xae\xe1\x86\xa8");
+    ck_assert(hanja_list_get_size(list) == 1);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "三國") == 0);
+    hanja_list_delete(list);
+
+    /* 음절 뒤에 종성이 붙은 키: 사 + ㅁ + 국 */
+    list = hanja_table_match_exact(table, "사\xe1\x86\xb7국");
+    ck_assert(hanja_list_get_size(list) == 1);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "三國") == 0);
+    hanja_list_delete(list);
+
+    /* 채움 문자가 붙은 자모는 호환 자모로 검색한다: ㄱ */
+    list = hanja_table_match_exact(table, "\xe1\x84\x80\xe1\x85\xa0");
+    ck_assert(hanja_list_get_size(list) == 1);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "丁") == 0);
+    hanja_list_delete(list);
+
+    list = hanja_table_match_exact(table, "\xe1\x86\xa8");
+    ck_assert(hanja_list_get_size(list) == 1);
+    hanja_list_delete(list);
+
+    /* 삼국사 */
+    list = hanja_table_match_prefix(table,
+	    "\xe1\x84\x89\xe1\x85\xa1\xe1\x86\xb7\xe1\x84\x80\xe1\x85\xae\xe1\x86\xa8사");
+    ck_assert(hanja_list_get_size(list) == 2);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "三國") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 1), "三") == 0);
+    hanja_list_delete(list);
+
+    /* 삼국 */
+    list = hanja_table_match_suffix(table,
+	    "\xe1\x84\x89\xe1\x85\xa1\xe1\x86\xb7\xe1\x84\x80\xe1\x85\xae\xe1\x86\xa8");
+    ck_assert(hanja_list_get_size(list) == 2);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "三國") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 1), "國") == 0);
+    hanja_list_delete(list);
+
+    hanja_table_delete(table);
+}
+END_TEST
+
+START_TEST(test_hanja_table_match_ucs4)
+{
+    HanjaTable* table;
+    HanjaList* list;
+
+    table = hanja_table_load(TEST_SOURCE_DIR "/hanjadic.txt");
+    ck_assert(table != NULL);
+
+    list = hanja_table_match_exact_ucs4(table, (const ucschar*)L"삼국");
+    ck_assert(hanja_list_get_size(list) == 1);
+    ck_assert(wcscmp((const wchar_t*)hanja_list_get_nth_value_ucs4(list, 0),
+		     L"三國") == 0);
+    ck_assert(wcscmp((const wchar_t*)hanja_list_get_nth_comment_ucs4(list, 0),
+		     L"세 나라") == 0);
+    ck_assert(strcmp(hanja_list_get_key(list), "삼국") == 0);
+    hanja_list_delete(list);
+
+    /* 첫가끝 자모로 된 키 */
+    list = hanja_table_match_exact_ucs4(table,
+	    (const ucschar*)L"\x1109\x1161\x11b7\x1100\x116e\x11a8");
+    ck_assert(hanja_list_get_size(list) == 1);
+    ck_assert(wcscmp((const wchar_t*)hanja_list_get_nth_key_ucs4(list, 0),
+		     L"삼국") == 0);
+    hanja_list_delete(list);
+
+    list = hanja_table_match_prefix_ucs4(table, (const ucschar*)L"삼국사");
+    ck_assert(hanja_list_get_size(list) == 2);
+    hanja_list_delete(list);
+
+    list = hanja_table_match_suffix_ucs4(table, (const ucschar*)L"삼국");
+    ck_assert(hanja_list_get_size(list) == 2);
+    ck_assert(wcscmp((const wchar_t*)hanja_list_get_nth_value_ucs4(list, 1),
+		     L"國") == 0);
+    hanja_list_delete(list);
+
+    hanja_table_delete(table);
+}
+END_TEST
+
+START_TEST(test_hanja_table_match_josa)
+{
+    HanjaTable* table;
+    HanjaList* list;
+
+    table = hanja_table_load(TEST_SOURCE_DIR "/hanjadic.txt");
+    ck_assert(table != NULL);
+
+    list = hanja_table_match_josa(table, "대한민국에서");
+    ck_assert(hanja_list_get_size(list) == 1);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "大韓民國") == 0);
+    ck_assert(strcmp(hanja_list_get_key(list), "대한민국") == 0);
+    ck_assert(strcmp(hanja_list_get_josa(list), "에서") == 0);
+    hanja_list_delete(list);
+
+    /* 키 전체가 사전에 있으면 조사로 보지 않는다. */
+    list = hanja_table_match_josa(table, "국가");
+    ck_assert(hanja_list_get_size(list) == 1);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "國家") == 0);
+    ck_assert(strcmp(hanja_list_get_josa(list), "") == 0);
+    hanja_list_delete(list);
+
+    list = hanja_table_match_josa(table, "사기를");
+    ck_assert(hanja_list_get_size(list) == 2);
+    ck_assert(strcmp(hanja_list_get_josa(list), "를") == 0);
+    hanja_list_delete(list);
+
+    list = hanja_table_match_josa_ucs4(table, (const ucschar*)L"삼국사기으로부터");
+    ck_assert(hanja_list_get_size(list) == 1);
+    ck_assert(strcmp(hanja_list_get_josa(list), "으로부터") == 0);
+    hanja_list_delete(list);
+
+    list = hanja_table_match_josa(table, "하늘에서");
+    ck_assert(list == NULL);
+
+    list = hanja_table_match_exact(table, "삼국");
+    ck_assert(hanja_list_get_josa(list) == NULL);
+    hanja_list_delete(list);
+
+    hanja_table_delete(table);
+}
+END_TEST
+
+START_TEST(test_hanja_table_match_syllable)
+{
+    HanjaTable* table;
+    HanjaList* list;
+
+    table = hanja_table_load(TEST_SOURCE_DIR "/hanjadic.txt");
+    ck_assert(table != NULL);
+
+    list = hanja_table_match_syllable(table, 0xac00);
+    ck_assert(hanja_list_get_size(list) == 2);
+    ck_assert(strcmp(hanja_list_get_key(list), "가") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "家") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 1), "可") == 0);
+    ck_assert(hanja_list_get_nth(list, 2) == NULL);
+    hanja_list_delete(list);
+
+    /* 나 */
+    list = hanja_table_match_syllable(table, 0xb098);
+    ck_assert(list == NULL);
+
+    /* 음절이 아닌 글자 */
+    list = hanja_table_match_syllable(table, 0x3131);
+    ck_assert(list == NULL);
+
+    /* 음절 하나로 된 키는 exact 검색도 같은 결과를 준다. */
+    list = hanja_table_match_exact(table, "가");
+    ck_assert(hanja_list_get_size(list) == 2);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 1), "可") == 0);
+    hanja_list_delete(list);
+
+    hanja_table_delete(table);
+}
+END_TEST
+
+START_TEST(test_hanja_table_match_fuzzy)
+{
+    HanjaTable* table;
+    HanjaList* list;
+
+    table = hanja_table_load(TEST_SOURCE_DIR "/hanjadic.txt");
+    ck_assert(table != NULL);
+
+    /* 모음 하나를 잘못 입력한 경우 */
+    list = hanja_table_match_fuzzy(table, "삼국사가", 1);
+    ck_assert(hanja_list_get_size(list) == 1);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "三國史記") == 0);
+    hanja_list_delete(list);
+
+    /* 거리가 같으면 키 순서, 한 키 안에서는 사전의 순서를 따른다 */
+    list = hanja_table_match_fuzzy(table, "가", 1);
+    ck_assert(hanja_list_get_size(list) == 3);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "家") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 1), "可") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 2), "丁") == 0);
+    hanja_list_delete(list);
+
+    list = hanja_table_match_fuzzy(table, "사기", 2);
+    ck_assert(hanja_list_get_size(list) == 4);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "史記") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 1), "詐欺") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 2), "詐取") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 3), "三") == 0);
+    hanja_list_delete(list);
+
+    list = hanja_table_match_fuzzy(table, "사기", 0);
+    ck_assert(hanja_list_get_size(list) == 2);
+    hanja_list_delete(list);
+
+    list = hanja_table_match_fuzzy(table, "하늘", 1);
+    ck_assert(list == NULL);
+
+    list = hanja_table_match_fuzzy(table, "사기", -1);
+    ck_assert(list == NULL);
+
+    hanja_table_delete(table);
+}
+END_TEST
+
+static void
+check_hanja_table_equal(const HanjaTable* table, const HanjaTable* expected)
+{
+    static const char* keys[] = {
+	"ㄱ", "가", "국", "국가", "대한", "대한민국", "민국",
+	"사기", "사취", "삼", "삼국", "삼국사기", "수"
+    };
+    size_t i;
+    int j;
+
+    for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+	HanjaList* list = hanja_table_match_exact(table, keys[i]);
+	HanjaList* list2 = hanja_table_match_exact(expected, keys[i]);
+	ck_assert(list != NULL);
+	ck_assert(hanja_list_get_size(list) == hanja_list_get_size(list2));
+	for (j = 0; j < hanja_list_get_size(list); j++) {
+	    ck_assert(strcmp(hanja_list_get_nth_value(list, j),
+			     hanja_list_get_nth_value(list2, j)) == 0);
+	    ck_assert(strcmp(hanja_list_get_nth_comment(list, j),
+			     hanja_list_get_nth_comment(list2, j)) == 0);
+	}
+	hanja_list_delete(list);
+	hanja_list_delete(list2);
+    }
+}
+
+START_TEST(test_hanja_table_load_unsorted)
+{
+    HanjaTable* expected;
+    HanjaTable* table;
+    HanjaList* list;
+    char filename[] = "hanjasort-XXXXXX";
+    FILE* file;
+    char buf[512];
+    int fd;
+
+    expected = hanja_table_load(TEST_SOURCE_DIR "/hanjadic.txt");
+    ck_assert(expected != NULL);
+
+    /* 정렬되지 않은 파일도 그대로 로딩할 수 있다 */
+    table = hanja_table_load(TEST_SOURCE_DIR "/hanjadic-unsorted.txt");
+    ck_assert(table != NULL);
+    check_hanja_table_equal(table, expected);
+
+    list = hanja_table_match_prefix(table, "삼국사기");
+    ck_assert(hanja_list_get_size(list) == 3);
+    hanja_list_delete(list);
+
+    list = hanja_table_search_comment(table, "속");
+    ck_assert(hanja_list_get_size(list) == 2);
+    hanja_list_delete(list);
+    hanja_table_delete(table);
+
+    /* 한 줄씩 run을 만들어서 merge하게 한다 */
+    fd = mkstemp(filename);
+    ck_assert(fd >= 0);
+    close(fd);
+
+    ck_assert(hanja_table_sort_file(TEST_SOURCE_DIR "/hanjadic-unsorted.txt",
+				    filename, 1));
+    table = hanja_table_load(filename);
+    ck_assert(table != NULL);
+    check_hanja_table_equal(table, expected);
+    hanja_table_delete(table);
+
+    file = fopen(filename, "r");
+    ck_assert(file != NULL);
+    ck_assert(fgets(buf, sizeof(buf), file) != NULL);
+    ck_assert(strcmp(buf, "ㄱ:丁:\n") == 0);
+    fclose(file);
+
+    /* 메모리에 모두 들어가는 경우 */
+    ck_assert(hanja_table_sort_file(TEST_SOURCE_DIR "/hanjadic-unsorted.txt",
+				    filename, 0));
+    table = hanja_table_load(filename);
+    ck_assert(table != NULL);
+    check_hanja_table_equal(table, expected);
+    hanja_table_delete(table);
+
+    ck_assert(hanja_table_sort_file(TEST_SOURCE_DIR "/nonexistent.txt",
+				    filename, 0) == false);
+
+    unlink(filename);
+    hanja_table_delete(expected);
+}
+END_TEST
+
+START_TEST(test_hanja_table_load_with_budget)
+{
+    static const size_t budgets[] = { 1, 256, 4096 };
+    HanjaTable* expected;
+    HanjaTable* table;
+    HanjaList* list;
+    size_t i;
+
+    expected = hanja_table_load(TEST_SOURCE_DIR "/hanjadic.txt");
+    ck_assert(expected != NULL);
+    ck_assert(hanja_table_get_stat(expected, HANJA_TABLE_STAT_MODE) ==
+	      HANJA_TABLE_MODE_FULL);
+    ck_assert(hanja_table_get_stat(expected, HANJA_TABLE_STAT_PAGE_SIZE) == 0);
+
+    /* 예산이 충분하면 모두 메모리에 올린다 */
+    table = hanja_table_load_with_budget(TEST_SOURCE_DIR "/hanjadic.txt",
+					 1024 * 1024);
+    ck_assert(table != NULL);
+    ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_MODE) ==
+	      HANJA_TABLE_MODE_FULL);
+    hanja_table_delete(table);
+
+    for (i = 0; i < sizeof(budgets) / sizeof(budgets[0]); i++) {
+	table = hanja_table_load_with_budget(TEST_SOURCE_DIR "/hanjadic.txt",
+					     budgets[i]);
+	ck_assert(table != NULL);
+	ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_MODE) ==
+		  HANJA_TABLE_MODE_PAGED);
+	ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_KEYS) == 13);
+	ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_ENTRIES) == 15);
+	ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_INDEX_BYTES) <
+		  hanja_table_get_stat(expected, HANJA_TABLE_STAT_INDEX_BYTES));
+	check_hanja_table_equal(table, expected);
+
+	list = hanja_table_match_prefix(table, "삼국사기");
+	ck_assert(hanja_list_get_size(list) == 3);
+	ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "三國史記") == 0);
+	ck_assert(strcmp(hanja_list_get_nth_comment(list, 0),
+			 "고려 인종 때 김부식이 지은 역사책") == 0);
+	hanja_list_delete(list);
+
+	list = hanja_table_match_josa(table, "대한민국에서");
+	ck_assert(hanja_list_get_size(list) == 1);
+	ck_assert(strcmp(hanja_list_get_josa(list), "에서") == 0);
+	hanja_list_delete(list);
+
+	list = hanja_table_match_syllable(table, 0xac00);
+	ck_assert(hanja_list_get_size(list) == 2);
+	hanja_list_delete(list);
+
+	ck_assert(hanja_table_match_exact(table, "하늘") == NULL);
+
+	/* 모든 엔트리를 훑어야 하는 기능은 쓸 수 없다 */
+	ck_assert(hanja_table_search_comment(table, "나라") == NULL);
+	ck_assert(hanja_table_match_fuzzy(table, "삼국사가", 1) == NULL);
+	ck_assert(!hanja_table_start_prefetch(table));
+	hanja_table_delete(table);
+    }
+
+    table = hanja_table_load_with_budget(TEST_SOURCE_DIR "/hanjadic.txt", 1);
+    ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_PAGE_SIZE) > 13);
+    hanja_table_delete(table);
+
+    table = hanja_table_load_with_budget(TEST_SOURCE_DIR "/hanjadic.txt", 4096);
+    ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_PAGE_SIZE) == 1);
+    hanja_table_delete(table);
+
+    /* 정렬되지 않은 사전은 예산과 관계 없이 메모리에 올린다 */
+    table = hanja_table_load_with_budget(TEST_SOURCE_DIR "/hanjadic-unsorted.txt",
+					 1);
+    ck_assert(table != NULL);
+    ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_MODE) ==
+	      HANJA_TABLE_MODE_FULL);
+    check_hanja_table_equal(table, expected);
+    hanja_table_delete(table);
+
+    hanja_table_delete(expected);
+}
+END_TEST
+
+START_TEST(test_hanja_table_load_long_comments)
+{
+    HanjaTable* table;
+    HanjaList* list;
+    char filename[] = "hanjalong-XXXXXX";
+    char comment[512];
+    FILE* file;
+    int i, j;
+    int fd;
+
+    /* 페이지 모드는 설명을 값과 같이 저장하므로 키 하나의 설명이 처음
+     * 할당한 버퍼보다 길어지도록 한다. */
+    fd = mkstemp(filename);
+    ck_assert(fd >= 0);
+    file = fdopen(fd, "w");
+    ck_assert(file != NULL);
+    for (i = 0; i < 32; i++) {
+	fprintf(file, "한:\xe4\xb8%c:%02d", 0x80 + i, i);
+	for (j = 0; j < 150; j++)
+	    fputs("가", file);
+	fputc('\n', file);
+    }
+    fclose(file);
+
+    table = hanja_table_load_with_budget(filename, 1);
+    ck_assert(table != NULL);
+    ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_MODE) ==
+	      HANJA_TABLE_MODE_PAGED);
+
+    list = hanja_table_match_exact(table, "한");
+    ck_assert(hanja_list_get_size(list) == 32);
+    for (i = 0; i < 32; i++) {
+	const ucschar* ucs4 = hanja_list_get_nth_comment_ucs4(list, i);
+
+	snprintf(comment, sizeof(comment), "%02d", i);
+	for (j = 0; j < 150; j++)
+	    strcat(comment, "가");
+	ck_assert(strcmp(hanja_list_get_nth_comment(list, i), comment) == 0);
+	ck_assert(ucs4[0] == '0' + i / 10 && ucs4[1] == '0' + i % 10);
+	for (j = 0; j < 150; j++)
+	    ck_assert(ucs4[2 + j] == 0xac00);
+	ck_assert(ucs4[152] == 0);
+    }
+    hanja_list_delete(list);
+    hanja_table_delete(table);
+
+    unlink(filename);
+}
+END_TEST
+
+START_TEST(test_hanja_table_value_pool)
+{
+    static const char* keys[] = { "낙", "락", "악", "요" };
+    static const char* comments[] = {
+	"즐길 낙", "즐길 락", "노래 악", "좋아할 요"
+    };
+    HanjaTable* table;
+    HanjaList* list;
+    const char* value = NULL;
+    char filename[] = "hanjapool-XXXXXX";
+    FILE* file;
+    size_t i;
+    int fd;
+
+    fd = mkstemp(filename);
+    ck_assert(fd >= 0);
+    file = fdopen(fd, "w");
+    ck_assert(file != NULL);
+    for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
+	fprintf(file, "%s:樂:%s\n", keys[i], comments[i]);
+    fclose(file);
+
+    /* 같은 값은 한번만 저장하므로 모든 엔트리가 같은 스트링을 가리킨다 */
+    table = hanja_table_load(filename);
+    ck_assert(table != NULL);
+    for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+	list = hanja_table_match_exact(table, keys[i]);
+	ck_assert(hanja_list_get_size(list) == 1);
+	ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "樂") == 0);
+	ck_assert(strcmp(hanja_list_get_nth_comment(list, 0), comments[i]) == 0);
+	if (value == NULL)
+	    value = hanja_list_get_nth_value(list, 0);
+	ck_assert(hanja_list_get_nth_value(list, 0) == value);
+	ck_assert(hanja_list_get_nth_value_ucs4(list, 0)[0] == 0x6a02);
+	hanja_list_delete(list);
+    }
+    hanja_table_delete(table);
+
+    /* 설명을 값과 같이 저장하는 페이지 모드에서는 설명이 달라야 한다 */
+    table = hanja_table_load_with_budget(filename, 1);
+    ck_assert(table != NULL);
+    for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+	list = hanja_table_match_exact(table, keys[i]);
+	ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "樂") == 0);
+	ck_assert(strcmp(hanja_list_get_nth_comment(list, 0), comments[i]) == 0);
+	hanja_list_delete(list);
+    }
+    hanja_table_delete(table);
+
+    unlink(filename);
+}
+END_TEST
+
+START_TEST(test_hanja_table_key_encoding)
+{
+    /* BMP 밖의 글자와 U+FFFF 근처의 글자가 들어간 키 */
+    static const char* keys[] = {
+	"가\xf0\xa0\x80\x80", "가\xef\xbf\xbd", "가힣", "가", "\xf0\xa0\x80\x80"
+    };
+    HanjaTable* table;
+    HanjaList* list;
+    char filename[] = "hanjakey-XXXXXX";
+    FILE* file;
+    size_t i;
+    int fd;
+
+    fd = mkstemp(filename);
+    ck_assert(fd >= 0);
+    file = fdopen(fd, "w");
+    ck_assert(file != NULL);
+    for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
+	fprintf(file, "%s:%zu:\n", keys[i], i);
+    fclose(file);
+
+    table = hanja_table_load(filename);
+    ck_assert(table != NULL);
+    ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_KEYS) == 5);
+    for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+	char value[8];
+
+	snprintf(value, sizeof(value), "%zu", i);
+	list = hanja_table_match_exact(table, keys[i]);
+	ck_assert(hanja_list_get_size(list) == 1);
+	ck_assert(strcmp(hanja_list_get_nth_key(list, 0), keys[i]) == 0);
+	ck_assert(strcmp(hanja_list_get_nth_value(list, 0), value) == 0);
+	hanja_list_delete(list);
+    }
+
+    list = hanja_table_match_prefix(table, "가\xf0\xa0\x80\x80나");
+    ck_assert(hanja_list_get_size(list) == 2);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "0") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 1), "3") == 0);
+    hanja_list_delete(list);
+
+    list = hanja_table_match_suffix(table, "나가\xf0\xa0\x80\x80");
+    ck_assert(hanja_list_get_size(list) == 2);
+    hanja_list_delete(list);
+
+    ck_assert(hanja_table_match_exact(table, "가\xf0\xa0\x80\x81") == NULL);
+    ck_assert(hanja_table_match_exact(table, "\xef\xbf\xbf") == NULL);
+
+    /* 오타 검색에서도 BMP 밖의 글자는 한 글자로 비교한다 */
+    list = hanja_table_match_fuzzy(table, "가\xf0\xa0\x80\x80", 0);
+    ck_assert(hanja_list_get_size(list) == 1);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "0") == 0);
+    hanja_list_delete(list);
+
+    list = hanja_table_match_fuzzy(table, "가\xf0\xa0\x80\x81", 1);
+    ck_assert(hanja_list_get_size(list) == 3);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "3") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 1), "1") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 2), "0") == 0);
+    hanja_list_delete(list);
+
+    list = hanja_table_match_fuzzy(table, "\xf0\xa0\x80\x81", 1);
+    ck_assert(hanja_list_get_size(list) == 1);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "4") == 0);
+    hanja_list_delete(list);
+    hanja_table_delete(table);
+
+    unlink(filename);
+}
+END_TEST
+
+START_TEST(test_hanja_model)
+{
+    HanjaTable* table;
+    HanjaModel* model;
+    HanjaList* list;
+    char filename[] = "hanjamodel-XXXXXX";
+    int fd;
+
+    fd = mkstemp(filename);
+    ck_assert(fd >= 0);
+    close(fd);
+
+    ck_assert(hanja_model_compile(TEST_SOURCE_DIR "/hanjabigram.txt", filename));
+    model = hanja_model_load(filename);
+    ck_assert(model != NULL);
+
+    ck_assert(hanja_model_get_score(model, "역사", "史記") == 255);
+    ck_assert(hanja_model_get_score(model, "역사", "詐欺") > 0);
+    ck_assert(hanja_model_get_score(model, "역사", "詐欺") <
+	      hanja_model_get_score(model, "보험", "詐欺"));
+    /* 같은 쌍은 빈도를 더한다 */
+    ck_assert(hanja_model_get_score(model, "국가", "大韓民國") >
+	      hanja_model_get_score(model, "역사", "詐欺"));
+    ck_assert(hanja_model_get_score(model, "하늘", "史記") == 0);
+    ck_assert(hanja_model_get_score(model, "史記", "역사") == 0);
+
+    table = hanja_table_load(TEST_SOURCE_DIR "/hanjadic.txt");
+    ck_assert(table != NULL);
+
+    list = hanja_table_match_exact(table, "사기");
+    ck_assert(hanja_list_rerank(list, model, "보험"));
+    ck_assert(hanja_list_get_size(list) == 2);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "詐欺") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 1), "史記") == 0);
+
+    ck_assert(hanja_list_rerank(list, model, "역사"));
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "史記") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 1), "詐欺") == 0);
+    hanja_list_delete(list);
+
+    /* 모델에 없는 아이템은 원래의 순서대로 뒤에 남는다 */
+    list = hanja_table_match_fuzzy(table, "사기", 2);
+    ck_assert(hanja_list_get_size(list) == 4);
+    ck_assert(hanja_list_rerank(list, model, "보험"));
+    ck_assert(hanja_list_get_size(list) == 4);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "詐欺") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 1), "詐取") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 2), "史記") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 3), "三") == 0);
+    hanja_list_delete(list);
+
+    /* 모르는 문맥에서는 순서가 그대로다 */
+    list = hanja_table_match_exact(table, "사기");
+    ck_assert(hanja_list_rerank(list, model, "하늘"));
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "史記") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 1), "詐欺") == 0);
+    hanja_list_delete(list);
+
+    hanja_table_delete(table);
+    hanja_model_delete(model);
+
+    ck_assert(hanja_model_load(TEST_SOURCE_DIR "/hanjadic.txt") == NULL);
+    ck_assert(hanja_model_load(TEST_SOURCE_DIR "/nonexistent.txt") == NULL);
+
+    unlink(filename);
+}
+END_TEST
+
+START_TEST(test_hanja_table_search_comment)
+{
+    HanjaTable* table;
+    HanjaList* list;
+
+    table = hanja_table_load(TEST_SOURCE_DIR "/hanjadic.txt");
+    ck_assert(table != NULL);
+
+    list = hanja_table_search_comment(table, "물");
+    ck_assert(hanja_list_get_size(list) == 1);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "水") == 0);
+    hanja_list_delete(list);
+
+    list = hanja_table_search_comment(table, "나라");
+    ck_assert(hanja_list_get_size(list) == 3);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "國") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 1), "國家") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 2), "三國") == 0);
+    hanja_list_delete(list);
+
+    list = hanja_table_search_comment(table, "역사");
+    ck_assert(hanja_list_get_size(list) == 2);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "史記") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 1), "三國史記") == 0);
+    hanja_list_delete(list);
+
+    /* bigram은 모두 있지만 연속해서 나오지 않는 경우 */
+    list = hanja_table_search_comment(table, "나라 나");
+    ck_assert(list == NULL);
+
+    list = hanja_table_search_comment(table, "세 나라");
+    ck_assert(hanja_list_get_size(list) == 1);
+    hanja_list_delete(list);
+
+    list = hanja_table_search_comment(table, "하늘");
+    ck_assert(list == NULL);
+
+    hanja_table_delete(table);
+}
+END_TEST
+
+START_TEST(test_hanja_table_search_value)
+{
+    HanjaTable* table;
+    HanjaList* list;
+
+    table = hanja_table_load(TEST_SOURCE_DIR "/hanjadic.txt");
+    ck_assert(table != NULL);
+
+    list = hanja_table_search_value(table, "國");
+    ck_assert(hanja_list_get_size(list) == 6);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "國") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 1), "國家") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 5), "三國史記") == 0);
+    hanja_list_delete(list);
+
+    list = hanja_table_search_value(table, "三國");
+    ck_assert(hanja_list_get_size(list) == 2);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "三國") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 1), "三國史記") == 0);
+    hanja_list_delete(list);
+
+    /* 순서에 상관없이 모든 글자가 들어 있으면 찾는다 */
+    list = hanja_table_search_value(table, "國民");
+    ck_assert(hanja_list_get_size(list) == 2);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "大韓民國") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 1), "民國") == 0);
+    hanja_list_delete(list);
+
+    /* 같은 키에서 뒤에 있는 詐欺는 덜 쓰는 것으로 본다 */
+    list = hanja_table_search_value(table, "詐");
+    ck_assert(hanja_list_get_size(list) == 2);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "詐取") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 1), "詐欺") == 0);
+    hanja_list_delete(list);
+
+    list = hanja_table_search_value(table, "三水");
+    ck_assert(list == NULL);
+
+    list = hanja_table_search_value(table, "學");
+    ck_assert(list == NULL);
+
+    hanja_table_delete(table);
+}
+END_TEST
+
+START_TEST(test_hanja_table_apply_patch)
+{
+    HanjaTable* table;
+    HanjaList* list;
+    int i;
+
+    table = hanja_table_load(TEST_SOURCE_DIR "/hanjadic.txt");
+    ck_assert(table != NULL);
+
+    ck_assert(hanja_table_apply_patch(table, TEST_SOURCE_DIR "/nonexistent.txt") == false);
+    ck_assert(hanja_table_apply_patch(table, TEST_SOURCE_DIR "/hanjapatch.txt"));
+
+    /* 패치를 적용한 후와 합친 후의 결과가 같아야 한다. */
+    for (i = 0; i < 2; i++) {
+	list = hanja_table_match_exact(table, "가");
+	ck_assert(hanja_list_get_size(list) == 3);
+	ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "可") == 0);
+	ck_assert(strcmp(hanja_list_get_nth_value(list, 1), "家") == 0);
+	ck_assert(strcmp(hanja_list_get_nth_value(list, 2), "佳") == 0);
+	ck_assert(strcmp(hanja_list_get_nth_comment(list, 1), "집 가") == 0);
+	ck_assert(strcmp(hanja_list_get_nth_comment(list, 2), "아름다울 가") == 0);
+	hanja_list_delete(list);
+
+	list = hanja_table_match_exact(table, "사기");
+	ck_assert(hanja_list_get_size(list) == 1);
+	ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "史記") == 0);
+	hanja_list_delete(list);
+
+	list = hanja_table_match_exact(table, "한자");
+	ck_assert(hanja_list_get_size(list) == 1);
+	ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "漢字") == 0);
+	hanja_list_delete(list);
+
+	list = hanja_table_match_syllable(table, 0xc218); /* 수 */
+	ck_assert(list == NULL);
+
+	list = hanja_table_match_prefix(table, "삼국사기");
+	ck_assert(hanja_list_get_size(list) == 3);
+	hanja_list_delete(list);
+
+	list = hanja_table_search_comment(table, "아름다울");
+	ck_assert(hanja_list_get_size(list) == 1);
+	ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "佳") == 0);
+	hanja_list_delete(list);
+
+	list = hanja_table_search_comment(table, "물");
+	ck_assert(list == NULL);
+
+	list = hanja_table_search_value(table, "詐");
+	ck_assert(hanja_list_get_size(list) == 1);
+	ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "詐取") == 0);
+	hanja_list_delete(list);
+
+	ck_assert(hanja_table_compact(table));
+    }
+
+    hanja_table_delete(table);
+}
+END_TEST
+
+START_TEST(test_hanja_list_after_table_delete)
+{
+    HanjaTable* table;
+    HanjaList* list;
+    HanjaList* patched;
+
+    /* 사전을 free한 뒤에도 검색 결과와 설명을 쓸 수 있어야 한다. */
+    table = hanja_table_load(TEST_SOURCE_DIR "/hanjadic.txt");
+    ck_assert(table != NULL);
+    list = hanja_table_match_prefix(table, "삼국사기");
+    ck_assert(hanja_table_apply_patch(table, TEST_SOURCE_DIR "/hanjapatch.txt"));
+    patched = hanja_table_match_exact(table, "가");
+    hanja_table_delete(table);
+
+    ck_assert(hanja_list_get_size(list) == 3);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "三國史記") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_comment(list, 1), "세 나라") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_comment(list, 2), "석 삼") == 0);
+    hanja_list_delete(list);
+
+    ck_assert(hanja_list_get_size(patched) == 3);
+    ck_assert(strcmp(hanja_list_get_nth_comment(patched, 1), "집 가") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_comment(patched, 2), "아름다울 가") == 0);
+    hanja_list_delete(patched);
+
+    table = hanja_table_load_with_budget(TEST_SOURCE_DIR "/hanjadic.txt", 1);
+    ck_assert(table != NULL);
+    list = hanja_table_match_prefix(table, "삼국사기");
+    hanja_table_delete(table);
+
+    ck_assert(hanja_list_get_size(list) == 3);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 1), "三國") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_comment(list, 0),
+		     "고려 인종 때 김부식이 지은 역사책") == 0);
+    hanja_list_delete(list);
+}
+END_TEST
+
+START_TEST(test_hanja_list_after_patch)
+{
+    HanjaTable* table;
+    HanjaList* base;
+    HanjaList* patched;
+    HanjaList* list;
+
+    /* 패치를 다시 적용하거나 합친 뒤에도 그 전에 검색한 결과는 원래의
+     * 엔트리를 가지고 있어야 한다. */
+    table = hanja_table_load(TEST_SOURCE_DIR "/hanjadic.txt");
+    ck_assert(table != NULL);
+    base = hanja_table_match_exact(table, "가");
+    ck_assert(hanja_table_apply_patch(table, TEST_SOURCE_DIR "/hanjapatch.txt"));
+    patched = hanja_table_match_exact(table, "가");
+    ck_assert(hanja_table_apply_patch(table, TEST_SOURCE_DIR "/hanjapatch.txt"));
+    ck_assert(hanja_table_compact(table));
+
+    list = hanja_table_match_exact(table, "가");
+    ck_assert(hanja_list_get_size(list) == 3);
+    ck_assert(strcmp(hanja_list_get_nth_comment(list, 0), "옳을 가") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_comment(list, 2), "아름다울 가") == 0);
+    hanja_list_delete(list);
+
+    ck_assert(hanja_list_get_size(patched) == 3);
+    ck_assert(strcmp(hanja_list_get_nth_value(patched, 0), "可") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_comment(patched, 1), "집 가") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_comment(patched, 2), "아름다울 가") == 0);
+    hanja_list_delete(patched);
+
+    hanja_table_delete(table);
+
+    ck_assert(hanja_list_get_size(base) == 2);
+    ck_assert(strcmp(hanja_list_get_nth_value(base, 0), "家") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_comment(base, 0), "집 가") == 0);
+    ck_assert(strcmp(hanja_list_get_nth_comment(base, 1), "옳을 가") == 0);
+    hanja_list_delete(base);
+}
+END_TEST
+
+START_TEST(test_hanja_list_get_page)
+{
+    HanjaTable* table;
+    HanjaList* list;
+    const Hanja* page[4];
+
+    table = hanja_table_load(TEST_SOURCE_DIR "/hanjadic.txt");
+    ck_assert(table != NULL);
+
+    /* 삼국사기, 삼국, 삼 세 구간으로 된 결과 */
+    list = hanja_table_match_prefix(table, "삼국사기");
+    ck_assert(hanja_list_get_size(list) == 3);
+    ck_assert(strcmp(hanja_list_get_nth_value(list, 2), "三") == 0);
+    ck_assert(hanja_list_get_nth(list, 3) == NULL);
+
+    ck_assert(hanja_list_get_page(list, 1, page, 2) == 2);
+    ck_assert(strcmp(hanja_get_value(page[0]), "三國") == 0);
+    ck_assert(strcmp(hanja_get_value(page[1]), "三") == 0);
+
+    ck_assert(hanja_list_get_page(list, 0, page, 4) == 3);
+    ck_assert(page[0] == hanja_list_get_nth(list, 0));
+    ck_assert(hanja_list_get_page(list, 3, page, 4) == 0);
+    hanja_list_delete(list);
+
+    list = hanja_table_match_exact(table, "사기");
+    ck_assert(hanja_list_get_page(list, 1, page, 4) == 1);
+    ck_assert(strcmp(hanja_get_value(page[0]), "詐欺") == 0);
+    hanja_list_delete(list);
+
+    hanja_table_delete(table);
+}
+END_TEST
+
+START_TEST(test_hanja_table_get_stat)
+{
+    HanjaTable* table;
+    HanjaList* list;
+    uint64_t bytes_read;
+
+    table = hanja_table_load(TEST_SOURCE_DIR "/hanjadic.txt");
+    ck_assert(table != NULL);
+
+    ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_KEYS) == 13);
+    ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_ENTRIES) == 15);
+    ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_INDEX_BYTES) > 0);
+    ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_DATA_BYTES) > 0);
+    ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_HEAP_BYTES) >
+	      hanja_table_get_stat(table, HANJA_TABLE_STAT_INDEX_BYTES) +
+	      hanja_table_get_stat(table, HANJA_TABLE_STAT_DATA_BYTES));
+    ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_LOOKUPS) == 0);
+
+    bytes_read = hanja_table_get_stat(table, HANJA_TABLE_STAT_BYTES_READ);
+    ck_assert(bytes_read > 0);
+
+    list = hanja_table_match_exact(table, "가");
+    ck_assert(strcmp(hanja_list_get_nth_comment(list, 0), "집 가") == 0);
+    hanja_list_delete(list);
+    ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_BYTES_READ) > bytes_read);
+
+    list = hanja_table_match_prefix(table, "하늘");
+    ck_assert(list == NULL);
+
+    ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_LOOKUPS) == 2);
+    ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_MISSES) == 1);
+    ck_assert(hanja_table_get_stat(table, -1) == 0);
+
+    /* 패치가 바꾼 키는 한번만 센다. 패치는 "한자"를 추가하고 "수"의
+     * 엔트리를 모두 지운다. */
+    ck_assert(hanja_table_apply_patch(table, TEST_SOURCE_DIR "/hanjapatch.txt"));
+    ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_KEYS) == 13);
+    ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_ENTRIES) == 15);
+    ck_assert(hanja_table_compact(table));
+    ck_assert(hanja_table_apply_patch(table, TEST_SOURCE_DIR "/hanjapatch.txt"));
+    ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_KEYS) == 13);
+    ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_ENTRIES) == 15);
+
+    hanja_table_delete(table);
+}
+END_TEST
+
+START_TEST(test_hanja_table_prefetch)
+{
+    HanjaTable* table;
+    HanjaList* list;
+    int i;
+
+    table = hanja_table_load(TEST_SOURCE_DIR "/hanjadic.txt");
+    ck_assert(table != NULL);
+
+    /* 쓰레드를 시작하지 않았으면 힌트는 무시된다. */
+    hanja_table_prefetch_hint(table, "삼국사기", HANJA_MATCH_PREFIX);
+
+    if (!hanja_table_start_prefetch(table)) {
+	hanja_table_delete(table);
+	return;
+    }
+    ck_assert(hanja_table_start_prefetch(table));
+
+    /* 쓰레드가 힌트를 처리할 때까지 기다린다. */
+    for (i = 0; i < 1000; i++) {
+	hanja_table_prefetch_hint(table, "삼국사기", HANJA_MATCH_PREFIX);
+	list = hanja_table_match_prefix(table, "삼국사기");
+	ck_assert(hanja_list_get_size(list) == 3);
+	ck_assert(strcmp(hanja_list_get_key(list), "삼국사기") == 0);
+	ck_assert(strcmp(hanja_list_get_nth_value(list, 0), "三國史記") == 0);
+	hanja_list_delete(list);
+	if (hanja_table_get_stat(table, HANJA_TABLE_STAT_PREFETCH_HITS) > 0)
+	    break;
+	usleep(1000);
+    }
+    ck_assert(hanja_table_get_stat(table, HANJA_TABLE_STAT_PREFETCH_HITS) > 0);
+
+    /* 결과가 없는 검색도 캐시한다. */
+    for (i = 0; i < 1000; i++) {
+	uint64_t hits = hanja_table_get_stat(table, HANJA_TABLE_STAT_PREFETCH_HITS);
+	hanja_table_prefetch_hint(table, "하늘", HANJA_MATCH_EXACT);
+	list = hanja_table_match_exact(table, "하늘");
+	ck_assert(list == NULL);
+	if (hanja_table_get_stat(table, HANJA_TABLE_STAT_PREFETCH_HITS) > hits)
+	    break;
+	usleep(1000);
+    }
+
+    /* 캐시에서 가져온 결과도 직접 검색한 결과와 같은 키를 가진다. */
+    list = hanja_table_match_prefix(table, "삼국사기에서");
+    ck_assert(strcmp(hanja_list_get_key(list), "삼국사기") == 0);
+    hanja_list_delete(list);
+    for (i = 0; i < 1000; i++) {
+	uint64_t hits = hanja_table_get_stat(table, HANJA_TABLE_STAT_PREFETCH_HITS);
+	hanja_table_prefetch_hint(table, "삼국사기에서", HANJA_MATCH_PREFIX);
+	list = hanja_table_match_prefix(table, "삼국사기에서");
+	ck_assert(hanja_list_get_size(list) == 3);
+	ck_assert(strcmp(hanja_list_get_key(list), "삼국사기") == 0);
+	hanja_list_delete(list);
+	if (hanja_table_get_stat(table, HANJA_TABLE_STAT_PREFETCH_HITS) > hits)
+	    break;
+	usleep(1000);
+    }
+    ck_assert(i < 1000);
+
+    /* 패치를 적용하면 캐시를 비운다. */
+    ck_assert(hanja_table_apply_patch(table, TEST_SOURCE_DIR "/hanjapatch.txt"));
+    list = hanja_table_match_prefix(table, "가");
+    ck_assert(hanja_list_get_size(list) == 3);
+    hanja_list_delete(list);
+
+    hanja_table_stop_prefetch(table);
+    hanja_table_delete(table);
+}
+END_TEST
+
 Suite* libhangul_suite()
 {
     Suite* s = suite_create("libhangul");
@@ -606,6 +2064,11 @@ Suite* libhangul_suite()
     tcase_add_test(hangul, test_hangul_ic_auto_reorder);
     tcase_add_test(hangul, test_hangul_ic_combi_on_double_stroke);
     tcase_add_test(hangul, test_hangul_ic_non_choseong_combi);
+    tcase_add_test(hangul, test_hangul_ic_process_string);
+    tcase_add_test(hangul, test_hangul_ic_commit_callback);
+    tcase_add_test(hangul, test_hangul_ic_automaton);
+    tcase_add_test(hangul, test_hangul_ic_process_syllables);
+    tcase_add_test(hangul, test_hangul_ic_pool);
     tcase_add_test(hangul, test_syllable_iterator);
 #if ENABLE_EXTERNAL_KEYBOARDS
     tcase_add_test(hangul, test_hangul_keyboard);
@@ -613,6 +2076,28 @@ Suite* libhangul_suite()
     tcase_add_test(hangul, test_hangul_jamo_to_cjamo);
     suite_add_tcase(s, hangul);
 
+    TCase* hanja = tcase_create("hanja");
+    tcase_add_test(hanja, test_hanja_table_match);
+    tcase_add_test(hanja, test_hanja_table_match_ucs4);
+    tcase_add_test(hanja, test_hanja_table_match_josa);
+    tcase_add_test(hanja, test_hanja_table_match_syllable);
+    tcase_add_test(hanja, test_hanja_table_match_fuzzy);
+    tcase_add_test(hanja, test_hanja_table_load_unsorted);
+    tcase_add_test(hanja, test_hanja_table_load_with_budget);
+    tcase_add_test(hanja, test_hanja_table_load_long_comments);
+    tcase_add_test(hanja, test_hanja_table_value_pool);
+    tcase_add_test(hanja, test_hanja_table_key_encoding);
+    tcase_add_test(hanja, test_hanja_model);
+    tcase_add_test(hanja, test_hanja_table_search_comment);
+    tcase_add_test(hanja, test_hanja_table_search_value);
+    tcase_add_test(hanja, test_hanja_table_apply_patch);
+    tcase_add_test(hanja, test_hanja_list_after_table_delete);
+    tcase_add_test(hanja, test_hanja_list_after_patch);
+    tcase_add_test(hanja, test_hanja_list_get_page);
+    tcase_add_test(hanja, test_hanja_table_get_stat);
+    tcase_add_test(hanja, test_hanja_table_prefetch);
+    suite_add_tcase(s, hanja);
+
     return s;
 }
 
@@ -33,6 +33,10 @@
 #include <langinfo.h>
 #endif
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 #include <iconv.h>
 
 #include "../hangul/hangul.h"
@@ -82,6 +86,7 @@ Mandatory arguments to long options are mandatory for short options too.\n\
   -i, --input=STRING          use STRING as input instead of standard input\n\
   -o, --output=FILE           write result to FILE instead of standard output\n\
   -s, --strict-order          do not allow wrong input sequence\n\
+  -j, --jobs=N                convert input with N threads\n\
 "), stdout);
 
 	fputs(_("\
@@ -167,62 +172,115 @@ size_t ucschar_strlen(const ucschar* str)
 }
 
 static int
-fputs_ucschar(const ucschar* str, FILE* stream)
+fwrite_ucschar(iconv_t cd, const ucschar* str, size_t len, FILE* stream)
 {
     char buf[512];
     ICONV_CONST char* inbuf;
     char* outbuf;
     size_t inbytesleft;
     size_t outbytesleft;
-    size_t len;
     size_t res;
 
-    len = ucschar_strlen(str);
-
     inbuf = (char*)str;
-    outbuf = buf;
     inbytesleft = len * 4;
-    outbytesleft = sizeof(buf) - 1;
+    while (inbytesleft > 0) {
+	outbuf = buf;
+	outbytesleft = sizeof(buf);
+
+	res = iconv(cd, &inbuf, &inbytesleft, &outbuf, &outbytesleft);
+	if (res == -1 && errno != E2BIG) {
+	    // 변환할 수 없는 글자는 건너뛴다.
+	    inbuf += 4;
+	    inbytesleft = inbytesleft >= 4 ? inbytesleft - 4 : 0;
+	}
 
-    res = iconv(cd_ucs4_to_utf8, &inbuf, &inbytesleft, &outbuf, &outbytesleft);
-    if (res == -1) {
-	if (errno == E2BIG) {
-	} else if (errno == EILSEQ) {
-	} else if (errno == EINVAL) {
+	if (outbuf > buf) {
+	    if (fwrite(buf, outbuf - buf, 1, stream) != 1)
+		return EOF;
 	}
     }
-    
-    *outbuf = '\0';
 
-    return fputs(buf, stream);
+    return 0;
 }
 
-static void
-hangul_process_with_string(HangulInputContext* ic, const char* input, FILE* output)
+static int
+fputs_ucschar(iconv_t cd, const ucschar* str, FILE* stream)
 {
-    int r;
+    return fwrite_ucschar(cd, str, ucschar_strlen(str), stream);
+}
+
+/* 이 바이트 다음에서는 항상 조합을 끝내므로 조합 상태가 비어 있다.
+ * 공백이나 문장 부호는 자판에 따라 자모로 변환되기도 하므로 여기에
+ * 넣지 않는다. */
+static inline bool
+is_boundary(char c)
+{
+    return c == '\n' || (unsigned char)c >= 0x80;
+}
+
+/* keys를 ic로 처리하여 output에 쓴다.
+ * ASCII가 아닌 바이트는 UTF-8 입력이 깨지지 않도록 조합을 끝내고
+ * 그대로 쓴다. 줄바꿈도 조합을 끝내고 그대로 써서, 입력을 줄 단위로
+ * 나누어 따로 처리해도 같은 결과가 나오게 한다. */
+static int
+hangul_process_keys(HangulInputContext* ic, iconv_t cd,
+		    const char* keys, size_t nkeys, FILE* output)
+{
+    ucschar buf[4096];
     const ucschar* str;
+    size_t consumed;
+    size_t len;
+    size_t n;
+    int r;
 
-    while (*input != '\0') {
-	bool is_processed = hangul_ic_process(ic, *input);
-	str = hangul_ic_get_commit_string(ic);
-	if (str[0] != 0) {
-	    r = fputs_ucschar(str, output);
+    while (nkeys > 0) {
+	n = 0;
+	while (n < nkeys && !is_boundary(keys[n]))
+	    n++;
+
+	if (n == 0) {
+	    str = hangul_ic_flush(ic);
+	    if (str[0] != 0) {
+		r = fputs_ucschar(cd, str, output);
+		if (r == EOF)
+		    return EOF;
+	    }
+	    r = fputc(keys[0], output);
 	    if (r == EOF)
-		goto on_error;
+		return EOF;
+	    keys++;
+	    nkeys--;
+	    continue;
 	}
-	if (!is_processed) {
-	    r = fputc(*input, output);
+
+	nkeys -= n;
+	while (n > 0) {
+	    len = hangul_ic_process_string(ic, keys, n,
+				buf, sizeof(buf) / sizeof(buf[0]), &consumed);
+	    r = fwrite_ucschar(cd, buf, len, output);
 	    if (r == EOF)
-		goto on_error;
+		return EOF;
+	    keys += consumed;
+	    n -= consumed;
 	}
-
-	input++;
     }
 
+    return 0;
+}
+
+static void
+hangul_process_with_string(HangulInputContext* ic, const char* input, FILE* output)
+{
+    int r;
+    const ucschar* str;
+
+    r = hangul_process_keys(ic, cd_ucs4_to_utf8, input, strlen(input), output);
+    if (r == EOF)
+	goto on_error;
+
     str = hangul_ic_flush(ic);
     if (str[0] != 0) {
-	r = fputs_ucschar(str, output);
+	r = fputs_ucschar(cd_ucs4_to_utf8, str, output);
 	if (r == EOF)
 	    goto on_error;
     }
@@ -242,30 +300,19 @@ static void
 hangul_process(HangulInputContext* ic, FILE* input, FILE* output)
 {
     int r;
-    int c;
+    char buf[4096];
+    size_t n;
     const ucschar* str;
 
-    c = fgetc(input);
-    while (c != EOF) {
-	bool res = hangul_ic_process(ic, c);
-	str = hangul_ic_get_commit_string(ic);
-	if (str[0] != 0) {
-	    r = fputs_ucschar(str, output);
-	    if (r == EOF)
-		goto on_error;
-	}
-	if (!res) {
-	    r = fputc(c, output);
-	    if (r == EOF)
-		goto on_error;
-	}
-
-	c = fgetc(input);
+    while ((n = fread(buf, 1, sizeof(buf), input)) > 0) {
+	r = hangul_process_keys(ic, cd_ucs4_to_utf8, buf, n, output);
+	if (r == EOF)
+	    goto on_error;
     }
 
     str = hangul_ic_flush(ic);
     if (str[0] != 0) {
-	r = fputs_ucschar(str, output);
+	r = fputs_ucschar(cd_ucs4_to_utf8, str, output);
 	if (r == EOF)
 	    goto on_error;
     }
@@ -277,6 +324,294 @@ on_error:
     exit(EXIT_FAILURE);
 }
 
+static HangulInputContext*
+create_ic(const char* keyboard, bool strict_order)
+{
+    HangulInputContext* ic;
+
+    ic = hangul_ic_new(keyboard);
+
+    if (strict_order) {
+	hangul_ic_set_option(ic, HANGUL_IC_OPTION_AUTO_REORDER, false);
+    } else {
+	hangul_ic_set_option(ic, HANGUL_IC_OPTION_AUTO_REORDER, true);
+    }
+
+    // 많은 양의 입력을 처리하므로 상태 전이 테이블을 사용한다.
+    hangul_ic_set_option(ic, HANGUL_IC_OPTION_AUTOMATON, true);
+
+    return ic;
+}
+
+#ifdef HAVE_PTHREAD
+/* -j 옵션을 주면 입력을 CHUNK_SIZE 정도의 조각으로 나누어 여러 스레드에서
+ * 변환한다. 조각은 조합 상태가 항상 비어 있는 곳(is_boundary())에서
+ * 나누므로 스레드마다 따로 HangulInputContext를 만들어 처음부터 처리해도
+ * 한 스레드에서 처리한 것과 결과가 같다. 메인 스레드는 입력을 읽어서
+ * 조각을 만들고, 변환이 끝난 조각을 순서대로 출력한다. */
+#define CHUNK_SIZE (4 << 20)
+
+typedef struct {
+    char* keys;
+    size_t nkeys;
+    char* output;
+    size_t output_len;
+    bool done;
+    bool error;
+} Chunk;
+
+typedef struct {
+    const char* keyboard;
+    bool strict_order;
+
+    /* nslots개의 자리를 돌려 쓴다. n번째 조각은 chunks[n % nslots]에
+     * 있다. */
+    Chunk* chunks;
+    size_t nslots;
+    size_t nsubmitted;
+    size_t ntaken;
+    bool finished;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} Converter;
+
+static void*
+xrealloc(void* ptr, size_t size)
+{
+    ptr = realloc(ptr, size);
+    if (ptr == NULL) {
+	print_error(0, ENOMEM, _("parallel conversion"));
+	exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+static void
+convert_chunk(HangulInputContext* ic, iconv_t cd, Chunk* chunk)
+{
+    FILE* output;
+    const ucschar* str;
+    int r;
+
+    output = open_memstream(&chunk->output, &chunk->output_len);
+    if (output == NULL) {
+	chunk->error = true;
+	return;
+    }
+
+    r = hangul_process_keys(ic, cd, chunk->keys, chunk->nkeys, output);
+    if (r != EOF) {
+	str = hangul_ic_flush(ic);
+	r = fputs_ucschar(cd, str, output);
+    }
+
+    if (fclose(output) != 0 || r == EOF)
+	chunk->error = true;
+}
+
+static void*
+convert_worker(void* data)
+{
+    Converter* converter = data;
+    HangulInputContext* ic;
+    iconv_t cd;
+
+    ic = create_ic(converter->keyboard, converter->strict_order);
+    cd = iconv_open("UTF-8", UCS4);
+
+    pthread_mutex_lock(&converter->lock);
+    while (true) {
+	Chunk* chunk;
+
+	while (converter->ntaken == converter->nsubmitted &&
+	       !converter->finished)
+	    pthread_cond_wait(&converter->cond, &converter->lock);
+
+	if (converter->ntaken == converter->nsubmitted)
+	    break;
+
+	chunk = &converter->chunks[converter->ntaken % converter->nslots];
+	converter->ntaken++;
+	pthread_mutex_unlock(&converter->lock);
+
+	if (cd == (iconv_t)-1) {
+	    chunk->error = true;
+	} else {
+	    convert_chunk(ic, cd, chunk);
+	}
+
+	pthread_mutex_lock(&converter->lock);
+	chunk->done = true;
+	pthread_cond_broadcast(&converter->cond);
+    }
+    pthread_mutex_unlock(&converter->lock);
+
+    if (cd != (iconv_t)-1)
+	iconv_close(cd);
+    hangul_ic_delete(ic);
+
+    return NULL;
+}
+
+/* input에서 CHUNK_SIZE 이상을 읽어 마지막 경계까지를 chunk에 넣는다.
+ * 경계 뒤의 나머지는 carry에 남겨 두었다가 다음 조각의 앞에 붙인다.
+ * 더 읽을 것이 없으면 false를 리턴한다. */
+static bool
+read_chunk(FILE* input, Chunk* chunk, char** carry, size_t* ncarry)
+{
+    size_t alloced = CHUNK_SIZE + *ncarry;
+    size_t n = *ncarry;
+    size_t split;
+    char* keys;
+
+    keys = xrealloc(NULL, alloced);
+    memcpy(keys, *carry, *ncarry);
+
+    while (true) {
+	n += fread(keys + n, 1, alloced - n, input);
+	if (n < alloced) {
+	    /* 입력의 끝이므로 모두 넣는다. */
+	    split = n;
+	    break;
+	}
+
+	split = n;
+	while (split > 0 && !is_boundary(keys[split - 1]))
+	    split--;
+	if (split > 0)
+	    break;
+
+	/* 경계가 없으면 나올 때까지 더 읽는다. */
+	alloced *= 2;
+	keys = xrealloc(keys, alloced);
+    }
+
+    *ncarry = n - split;
+    *carry = xrealloc(*carry, *ncarry + 1);
+    memcpy(*carry, keys + split, *ncarry);
+
+    if (split == 0) {
+	free(keys);
+	return false;
+    }
+
+    chunk->keys = keys;
+    chunk->nkeys = split;
+    chunk->output = NULL;
+    chunk->output_len = 0;
+    chunk->done = false;
+    chunk->error = false;
+
+    return true;
+}
+
+static void
+hangul_process_parallel(const char* keyboard, bool strict_order, int njobs,
+			FILE* input, FILE* output)
+{
+    Converter converter;
+    pthread_t* threads;
+    char* carry = NULL;
+    size_t ncarry = 0;
+    size_t nwritten = 0;
+    bool eof = false;
+    bool error = false;
+    int i;
+
+    converter.keyboard = keyboard;
+    converter.strict_order = strict_order;
+    converter.nslots = njobs * 2;
+    converter.chunks = xrealloc(NULL, converter.nslots * sizeof(Chunk));
+    converter.nsubmitted = 0;
+    converter.ntaken = 0;
+    converter.finished = false;
+    pthread_mutex_init(&converter.lock, NULL);
+    pthread_cond_init(&converter.cond, NULL);
+
+    threads = xrealloc(NULL, njobs * sizeof(threads[0]));
+    for (i = 0; i < njobs; i++) {
+	if (pthread_create(&threads[i], NULL, convert_worker, &converter) != 0) {
+	    print_error(0, errno, _("parallel conversion"));
+	    exit(EXIT_FAILURE);
+	}
+    }
+
+    while (!eof || nwritten < converter.nsubmitted) {
+	Chunk* chunk;
+
+	/* 빈 자리가 있으면 입력을 더 읽고, 없으면 가장 앞의 조각이 끝나기를
+	 * 기다려서 출력한다. */
+	if (!eof && converter.nsubmitted - nwritten < converter.nslots) {
+	    chunk = &converter.chunks[converter.nsubmitted % converter.nslots];
+	    if (!read_chunk(input, chunk, &carry, &ncarry)) {
+		eof = true;
+		continue;
+	    }
+
+	    pthread_mutex_lock(&converter.lock);
+	    converter.nsubmitted++;
+	    pthread_cond_broadcast(&converter.cond);
+	    pthread_mutex_unlock(&converter.lock);
+	    continue;
+	}
+
+	chunk = &converter.chunks[nwritten % converter.nslots];
+	pthread_mutex_lock(&converter.lock);
+	while (!chunk->done)
+	    pthread_cond_wait(&converter.cond, &converter.lock);
+	pthread_mutex_unlock(&converter.lock);
+
+	if (chunk->error ||
+	    fwrite(chunk->output, 1, chunk->output_len, output) !=
+		chunk->output_len) {
+	    error = true;
+	}
+
+	free(chunk->keys);
+	free(chunk->output);
+	nwritten++;
+
+	if (error)
+	    break;
+    }
+
+    pthread_mutex_lock(&converter.lock);
+    converter.finished = true;
+    pthread_cond_broadcast(&converter.cond);
+    pthread_mutex_unlock(&converter.lock);
+
+    for (i = 0; i < njobs; i++)
+	pthread_join(threads[i], NULL);
+
+    if (error) {
+	print_error(0, errno, _("standard output"));
+	exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_destroy(&converter.lock);
+    pthread_cond_destroy(&converter.cond);
+    free(converter.chunks);
+    free(threads);
+    free(carry);
+}
+#endif /* HAVE_PTHREAD */
+
+/* -j 옵션에 따라 input 전체를 변환해서 output에 쓴다. */
+static void
+process_file(HangulInputContext* ic, const char* keyboard, bool strict_order,
+	     int njobs, FILE* input, FILE* output)
+{
+#ifdef HAVE_PTHREAD
+    if (njobs > 1) {
+	hangul_process_parallel(keyboard, strict_order, njobs, input, output);
+	return;
+    }
+#endif
+
+    hangul_process(ic, input, output);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -288,6 +623,7 @@ main(int argc, char *argv[])
     FILE* output;
     HangulInputContext* ic;
     bool strict_order = false;
+    int njobs = 1;
 
 #ifdef ENABLE_NLS
     bindtextdomain(GETTEXT_PACKAGE, LOCALEDIR);
@@ -307,12 +643,13 @@ main(int argc, char *argv[])
 	    { "input",       required_argument,  NULL, 'i' },
 	    { "output",      required_argument,  NULL, 'o' },
 	    { "strict-order",no_argument,        NULL, 's' },
+	    { "jobs",        required_argument,  NULL, 'j' },
 	    { "help",        no_argument,        NULL, 'h' },
 	    { "version",     no_argument,        NULL, 'v' },
 	    { NULL,          0,                  NULL, 0   }
 	};
 
-	c = getopt_long(argc, argv, "k:li:o:s", long_options, NULL);
+	c = getopt_long(argc, argv, "k:li:o:sj:", long_options, NULL);
 	if (c == -1)
 	    break;
 
@@ -332,6 +669,11 @@ main(int argc, char *argv[])
 	case 's':
 	    strict_order = true;
 	    break;
+	case 'j':
+	    njobs = atoi(optarg);
+	    if (njobs < 1)
+		njobs = 1;
+	    break;
 	case 'h':
 	    usage(EXIT_SUCCESS);
 	    break;
@@ -359,13 +701,7 @@ main(int argc, char *argv[])
 	exit(EXIT_FAILURE);
     }
 
-    ic = hangul_ic_new(keyboard);
-
-    if (strict_order) {
-	hangul_ic_set_option(ic, HANGUL_IC_OPTION_AUTO_REORDER, false);
-    } else {
-	hangul_ic_set_option(ic, HANGUL_IC_OPTION_AUTO_REORDER, true);
-    }
+    ic = create_ic(keyboard, strict_order);
 
     if (input_string != NULL) {
 	hangul_process_with_string(ic, input_string, output);
@@ -376,19 +712,19 @@ main(int argc, char *argv[])
 	    FILE* input = NULL;
 	    if (strcmp(argv[i], "-") == 0) {
 		input = stdin;
-		hangul_process(ic, input, output);
+		process_file(ic, keyboard, strict_order, njobs, input, output);
 	    } else {
 		input = fopen(argv[i], "r");
 		if (input == NULL) {
 		    print_error(0, errno, "%s", argv[i]);
 		} else {
-		    hangul_process(ic, input, output);
+		    process_file(ic, keyboard, strict_order, njobs, input, output);
 		    fclose(input);
 		}
 	    }
 	}
     } else if (input_string == NULL) {
-	hangul_process(ic, stdin, output);
+	process_file(ic, keyboard, strict_order, njobs, stdin, output);
     }
 
     hangul_ic_delete(ic);
@@ -1,15 +1,121 @@
+/* libhangul
+ * Copyright (C) 2026 Choe Hwanjin
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * 정렬되지 않은 한자 사전 파일을 hanja_table_load()로 바로 읽을 수 있게
+ * 키 순서로 정렬하는 도구.
+ *
+ * 정렬은 hanja_table_sort_file()이 한다. 입력이 메모리보다 커도 정해진
+ * 크기만큼씩 정렬한 후 merge하므로, 사용자가 모은 큰 단어 목록도 처리할
+ * 수 있다.
+ *
+ * --bigram 옵션을 주면 "앞 단어:한자어:빈도" 목록으로 hanja_model_load()가
+ * 읽는 bigram 모델 파일을 만든다.
+ */
+
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <getopt.h>
 
 #include "../hangul/hangul.h"
 
+static const char* program_name = "hanjac";
+
+static void
+usage(int status)
+{
+    FILE* out = status == EXIT_SUCCESS ? stdout : stderr;
+
+    fprintf(out, "\
+Usage: %s [OPTION]... INPUT OUTPUT\n\
+Sort hanja dictionary INPUT by key and write it to OUTPUT.\n\
+\n\
+  -b, --bigram         compile bigram list INPUT into a model file OUTPUT\n\
+  -m, --memory=MIB     use at most MIB megabytes for sorting (default: 64)\n\
+      --help           display this help and exit\n\
+", program_name);
+
+    exit(status);
+}
+
 int
 main(int argc, char *argv[])
 {
-    if (argc != 3)
-	return 1;
+    size_t memory_limit = 0;
+    bool bigram = false;
+
+    while (1) {
+	int c;
+	static struct option const long_options[] = {
+	    { "bigram", no_argument,       NULL, 'b' },
+	    { "memory", required_argument, NULL, 'm' },
+	    { "help",   no_argument,       NULL, 'h' },
+	    { NULL,     0,                 NULL, 0   }
+	};
+
+	c = getopt_long(argc, argv, "bm:", long_options, NULL);
+	if (c == -1)
+	    break;
+
+	switch (c) {
+	case 'b':
+	    bigram = true;
+	    break;
+	case 'm':
+	    {
+		char* end;
+		unsigned long mib = strtoul(optarg, &end, 10);
+		if (*end != '\0' || mib == 0) {
+		    fprintf(stderr, "%s: invalid memory size: %s\n",
+			    program_name, optarg);
+		    usage(EXIT_FAILURE);
+		}
+		memory_limit = (size_t)mib * 1024 * 1024;
+	    }
+	    break;
+	case 'h':
+	    usage(EXIT_SUCCESS);
+	    break;
+	default:
+	    usage(EXIT_FAILURE);
+	    break;
+	}
+    }
+
+    if (argc - optind != 2)
+	usage(EXIT_FAILURE);
+
+    if (bigram) {
+	if (!hanja_model_compile(argv[optind], argv[optind + 1])) {
+	    fprintf(stderr, "%s: cannot compile %s to %s\n", program_name,
+		    argv[optind], argv[optind + 1]);
+	    return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+    }
 
-    hanja_table_txt_to_bin(argv[1], argv[2]);
+    if (!hanja_table_sort_file(argv[optind], argv[optind + 1], memory_limit)) {
+	fprintf(stderr, "%s: cannot sort %s to %s\n", program_name,
+		argv[optind], argv[optind + 1]);
+	return EXIT_FAILURE;
+    }
 
-    return 0;
+    return EXIT_SUCCESS;
 }
@@ -0,0 +1,1169 @@
+/* libhangul
+ * Copyright (C) 2026 Choe Hwanjin
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * data/hanja/merge.py 를 C로 옮긴 한자 사전 병합 도구.
+ *
+ * merge.py와 같은 일을 한다. compat-table.txt로 호환 한자를 통합 한자로
+ * 바꾸고, freq-hanja.txt, freq-hanjaeo.txt 의 빈도값을 찾아서, 같은 키와
+ * 값을 가진 항목은 하나로 합치고 설명(comment)을 병합한 후, 키 순서로
+ * 정렬하고 같은 키 안에서는 빈도의 역순으로 stable sort 하여 출력한다.
+ * 출력 결과는 merge.py 와 바이트 단위로 같다.
+ *
+ * 입력 파일은 줄 단위로 나눈 여러 조각으로 쪼개서 여러 쓰레드에서 동시에
+ * 파싱하고, 병합은 파일 순서대로 한 쓰레드에서 진행한다. 병합 순서가
+ * merge.py와 같아야 중복 처리 결과와 같은 빈도를 가진 항목의 순서가
+ * 같아진다. pthread가 없으면 모든 조각을 한 쓰레드에서 파싱한다.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+typedef uint32_t ucschar;
+
+typedef struct _Str          Str;
+typedef struct _StrMap       StrMap;
+typedef struct _StrMapItem   StrMapItem;
+typedef struct _Record       Record;
+typedef struct _Chunk        Chunk;
+typedef struct _Entry        Entry;
+typedef struct _EntryList    EntryList;
+typedef struct _CompatPair   CompatPair;
+
+struct _Str {
+    const char* str;
+    size_t      len;
+};
+
+struct _StrMapItem {
+    Str      first;
+    Str      second;
+    uint32_t hash;
+    void*    data;
+};
+
+/* open addressing hash table. 키는 (first, second) 두 스트링의 쌍이다.
+ * 한 스트링만 키로 쓸 때는 second를 빈 스트링으로 둔다. */
+struct _StrMap {
+    StrMapItem* items;
+    size_t      size;
+    size_t      len;
+};
+
+enum {
+    RECORD_HEADER,
+    RECORD_ENTRY,
+    RECORD_FREQ
+};
+
+struct _Record {
+    int    type;
+    Str    key;
+    Str    value;
+    Str    comment;
+    double freq;
+};
+
+/* 파싱 작업의 단위. 한 파일을 줄 경계에서 여러 조각으로 나눈 것이다. */
+struct _Chunk {
+    const char* filename;
+    char*       begin;
+    char*       end;
+    int         type;
+
+    Record*     records;
+    size_t      len;
+    size_t      alloc;
+    bool        error;
+};
+
+struct _Entry {
+    Str    value;
+    char*  comment;
+    size_t comment_len;
+    double freq;
+    size_t seq;
+};
+
+struct _EntryList {
+    Str     key;
+    Entry** items;
+    size_t  len;
+    size_t  alloc;
+};
+
+struct _CompatPair {
+    ucschar compat;
+    ucschar unified;
+    size_t  order;
+};
+
+static const char* program_name = "hanjamerge";
+
+static StrMap      freq_table;
+static CompatPair* compat_table;
+static size_t      compat_table_len;
+
+static Chunk*      chunks;
+static size_t      nchunks;
+static size_t      next_chunk;
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t next_chunk_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void*
+xmalloc(size_t size)
+{
+    void* p = malloc(size);
+    if (p == NULL) {
+	fprintf(stderr, "%s: out of memory\n", program_name);
+	exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static void*
+xrealloc(void* ptr, size_t size)
+{
+    void* p = realloc(ptr, size);
+    if (p == NULL) {
+	fprintf(stderr, "%s: out of memory\n", program_name);
+	exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static char*
+read_file(const char* filename, size_t* len)
+{
+    FILE* file;
+    char* buf;
+    size_t alloc;
+    size_t n;
+
+    file = fopen(filename, "rb");
+    if (file == NULL) {
+	fprintf(stderr, "%s: %s: %s\n", program_name, filename, strerror(errno));
+	exit(EXIT_FAILURE);
+    }
+
+    alloc = 64 * 1024;
+    buf = xmalloc(alloc);
+    n = 0;
+    while (true) {
+	size_t r;
+	if (n + 1 >= alloc) {
+	    alloc *= 2;
+	    buf = xrealloc(buf, alloc);
+	}
+	r = fread(buf + n, 1, alloc - n - 1, file);
+	if (r == 0)
+	    break;
+	n += r;
+    }
+
+    if (ferror(file)) {
+	fprintf(stderr, "%s: %s: %s\n", program_name, filename, strerror(errno));
+	exit(EXIT_FAILURE);
+    }
+    fclose(file);
+
+    buf[n] = '\0';
+    *len = n;
+    return buf;
+}
+
+/* utf8 */
+static size_t
+utf8_decode(const char* s, const char* end, ucschar* c)
+{
+    const unsigned char* p = (const unsigned char*)s;
+    size_t n;
+    size_t i;
+    ucschar ch;
+
+    if (p[0] < 0x80) {
+	*c = p[0];
+	return 1;
+    } else if (p[0] < 0xe0) {
+	ch = p[0] & 0x1f;
+	n = 2;
+    } else if (p[0] < 0xf0) {
+	ch = p[0] & 0x0f;
+	n = 3;
+    } else {
+	ch = p[0] & 0x07;
+	n = 4;
+    }
+
+    if ((size_t)(end - s) < n) {
+	*c = p[0];
+	return 1;
+    }
+
+    for (i = 1; i < n; i++)
+	ch = (ch << 6) | (p[i] & 0x3f);
+
+    *c = ch;
+    return n;
+}
+
+static size_t
+utf8_encode(char* buf, ucschar c)
+{
+    unsigned char* p = (unsigned char*)buf;
+
+    if (c < 0x80) {
+	p[0] = c;
+	return 1;
+    } else if (c < 0x800) {
+	p[0] = 0xc0 | (c >> 6);
+	p[1] = 0x80 | (c & 0x3f);
+	return 2;
+    } else if (c < 0x10000) {
+	p[0] = 0xe0 | (c >> 12);
+	p[1] = 0x80 | ((c >> 6) & 0x3f);
+	p[2] = 0x80 | (c & 0x3f);
+	return 3;
+    } else {
+	p[0] = 0xf0 | (c >> 18);
+	p[1] = 0x80 | ((c >> 12) & 0x3f);
+	p[2] = 0x80 | ((c >> 6) & 0x3f);
+	p[3] = 0x80 | (c & 0x3f);
+	return 4;
+    }
+}
+
+static const char*
+utf8_prev(const char* begin, const char* p)
+{
+    for (--p; p > begin; --p) {
+	if ((*(const unsigned char*)p & 0xc0) != 0x80)
+	    break;
+    }
+    return p;
+}
+
+/* python 2의 str.strip() 이 지우는 문자 */
+static bool
+is_ascii_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' ||
+	   c == '\v' || c == '\f';
+}
+
+/* python 2의 unicode.strip() 이 지우는 문자 */
+static bool
+is_unicode_space(ucschar c)
+{
+    if (c <= 0x20)
+	return (c >= 0x09 && c <= 0x0d) || (c >= 0x1c && c <= 0x20);
+
+    switch (c) {
+    case 0x0085:
+    case 0x00a0:
+    case 0x1680:
+    case 0x180e:
+    case 0x2028:
+    case 0x2029:
+    case 0x202f:
+    case 0x205f:
+    case 0x3000:
+	return true;
+    }
+
+    return c >= 0x2000 && c <= 0x200a;
+}
+
+static Str
+ascii_strip(char* begin, char* end)
+{
+    Str s;
+
+    while (begin < end && is_ascii_space(*begin))
+	begin++;
+    while (end > begin && is_ascii_space(end[-1]))
+	end--;
+
+    s.str = begin;
+    s.len = end - begin;
+    return s;
+}
+
+static Str
+unicode_strip(const char* begin, const char* end)
+{
+    Str s;
+
+    while (begin < end) {
+	ucschar c;
+	size_t n = utf8_decode(begin, end, &c);
+	if (!is_unicode_space(c))
+	    break;
+	begin += n;
+    }
+
+    while (end > begin) {
+	ucschar c;
+	const char* p = utf8_prev(begin, end);
+	utf8_decode(p, end, &c);
+	if (!is_unicode_space(c))
+	    break;
+	end = p;
+    }
+
+    s.str = begin;
+    s.len = end - begin;
+    return s;
+}
+
+static bool
+str_equal(Str a, Str b)
+{
+    return a.len == b.len && memcmp(a.str, b.str, a.len) == 0;
+}
+
+static int
+str_compare(Str a, Str b)
+{
+    size_t n = a.len < b.len ? a.len : b.len;
+    int res = memcmp(a.str, b.str, n);
+    if (res != 0)
+	return res;
+    if (a.len < b.len)
+	return -1;
+    if (a.len > b.len)
+	return 1;
+    return 0;
+}
+
+/* FNV-1a */
+static uint32_t
+str_hash(Str first, Str second)
+{
+    uint32_t h = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < first.len; i++) {
+	h ^= (unsigned char)first.str[i];
+	h *= 16777619u;
+    }
+    h ^= 0xff;
+    h *= 16777619u;
+    for (i = 0; i < second.len; i++) {
+	h ^= (unsigned char)second.str[i];
+	h *= 16777619u;
+    }
+
+    return h;
+}
+
+static void
+str_map_init(StrMap* map, size_t hint)
+{
+    size_t size = 1024;
+
+    while (size < hint * 2)
+	size *= 2;
+
+    map->items = calloc(size, sizeof(map->items[0]));
+    if (map->items == NULL) {
+	fprintf(stderr, "%s: out of memory\n", program_name);
+	exit(EXIT_FAILURE);
+    }
+    map->size = size;
+    map->len = 0;
+}
+
+static StrMapItem*
+str_map_lookup_item(StrMapItem* items, size_t size,
+		    Str first, Str second, uint32_t hash)
+{
+    size_t mask = size - 1;
+    size_t i = hash & mask;
+
+    while (items[i].first.str != NULL) {
+	if (items[i].hash == hash &&
+	    str_equal(items[i].first, first) &&
+	    str_equal(items[i].second, second))
+	    break;
+	i = (i + 1) & mask;
+    }
+
+    return &items[i];
+}
+
+static void
+str_map_grow(StrMap* map)
+{
+    StrMapItem* items;
+    size_t size = map->size * 2;
+    size_t i;
+
+    items = calloc(size, sizeof(items[0]));
+    if (items == NULL) {
+	fprintf(stderr, "%s: out of memory\n", program_name);
+	exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < map->size; i++) {
+	StrMapItem* item = &map->items[i];
+	if (item->first.str != NULL) {
+	    StrMapItem* slot = str_map_lookup_item(items, size,
+					 item->first, item->second, item->hash);
+	    *slot = *item;
+	}
+    }
+
+    free(map->items);
+    map->items = items;
+    map->size = size;
+}
+
+static void**
+str_map_lookup(StrMap* map, Str first, Str second, bool insert)
+{
+    uint32_t hash = str_hash(first, second);
+    StrMapItem* item;
+
+    item = str_map_lookup_item(map->items, map->size, first, second, hash);
+    if (item->first.str != NULL)
+	return &item->data;
+
+    if (!insert)
+	return NULL;
+
+    if ((map->len + 1) * 2 > map->size) {
+	str_map_grow(map);
+	item = str_map_lookup_item(map->items, map->size, first, second, hash);
+    }
+
+    item->first = first;
+    item->second = second;
+    item->hash = hash;
+    item->data = NULL;
+    map->len++;
+
+    return &item->data;
+}
+
+static const Str empty_str = { "", 0 };
+
+/* compat table */
+static int
+compat_pair_compare(const void* a, const void* b)
+{
+    const CompatPair* x = a;
+    const CompatPair* y = b;
+
+    if (x->compat < y->compat)
+	return -1;
+    if (x->compat > y->compat)
+	return 1;
+    return 0;
+}
+
+static int
+compat_pair_compare_order(const void* a, const void* b)
+{
+    const CompatPair* x = a;
+    const CompatPair* y = b;
+    int res = compat_pair_compare(a, b);
+
+    if (res != 0)
+	return res;
+    if (x->order < y->order)
+	return -1;
+    if (x->order > y->order)
+	return 1;
+    return 0;
+}
+
+static void
+load_compat(const char* filename)
+{
+    char* buf;
+    char* p;
+    char* end;
+    size_t len;
+    size_t alloc;
+
+    buf = read_file(filename, &len);
+
+    alloc = 1024;
+    compat_table = xmalloc(alloc * sizeof(compat_table[0]));
+    compat_table_len = 0;
+
+    p = buf;
+    end = buf + len;
+    while (p < end) {
+	char* eol = memchr(p, '\n', end - p);
+	char* tab;
+	if (eol == NULL)
+	    eol = end;
+	*eol = '\0';
+
+	tab = strchr(p, '\t');
+	if (tab != NULL) {
+	    if (compat_table_len >= alloc) {
+		alloc *= 2;
+		compat_table = xrealloc(compat_table,
+					alloc * sizeof(compat_table[0]));
+	    }
+	    compat_table[compat_table_len].compat = strtoul(p, NULL, 16);
+	    compat_table[compat_table_len].unified = strtoul(tab + 1, NULL, 16);
+	    compat_table[compat_table_len].order = compat_table_len;
+	    compat_table_len++;
+	}
+
+	p = eol + 1;
+    }
+
+    free(buf);
+
+    /* merge.py 에서는 dict를 사용하므로 같은 키가 여러번 나오면 마지막
+     * 값이 사용된다. 파일 순서로 정렬한 후 같은 키의 마지막 것만 남긴다. */
+    qsort(compat_table, compat_table_len, sizeof(compat_table[0]),
+	  compat_pair_compare_order);
+    if (compat_table_len > 0) {
+	size_t i, n;
+	n = 0;
+	for (i = 0; i < compat_table_len; i++) {
+	    if (i + 1 < compat_table_len &&
+		compat_table[i].compat == compat_table[i + 1].compat)
+		continue;
+	    compat_table[n++] = compat_table[i];
+	}
+	compat_table_len = n;
+    }
+}
+
+static ucschar
+get_unified(ucschar c)
+{
+    CompatPair key;
+    CompatPair* res;
+
+    key.compat = c;
+    res = bsearch(&key, compat_table, compat_table_len,
+		  sizeof(compat_table[0]), compat_pair_compare);
+    if (res != NULL)
+	return res->unified;
+    return c;
+}
+
+/* parsing */
+static Record*
+chunk_append(Chunk* chunk)
+{
+    if (chunk->len >= chunk->alloc) {
+	chunk->alloc = chunk->alloc == 0 ? 256 : chunk->alloc * 2;
+	chunk->records = xrealloc(chunk->records,
+				  chunk->alloc * sizeof(chunk->records[0]));
+    }
+    return &chunk->records[chunk->len++];
+}
+
+/* value에 호환 한자가 있으면 통합 한자로 바꾼다. 바꿀 글자가 없으면
+ * 원래 버퍼를 그대로 사용한다. */
+static Str
+unify(Str value)
+{
+    const char* p = value.str;
+    const char* end = value.str + value.len;
+    bool changed = false;
+    char* buf;
+    char* q;
+    Str res;
+
+    while (p < end) {
+	ucschar c;
+	p += utf8_decode(p, end, &c);
+	if (get_unified(c) != c) {
+	    changed = true;
+	    break;
+	}
+    }
+
+    if (!changed)
+	return value;
+
+    buf = xmalloc(value.len * 2 + 1);
+    q = buf;
+    p = value.str;
+    while (p < end) {
+	ucschar c;
+	size_t n = utf8_decode(p, end, &c);
+	ucschar u = get_unified(c);
+	if (u != c) {
+	    q += utf8_encode(q, u);
+	} else {
+	    memcpy(q, p, n);
+	    q += n;
+	}
+	p += n;
+    }
+    *q = '\0';
+
+    res.str = buf;
+    res.len = q - buf;
+    return res;
+}
+
+static void
+parse_freq_line(Chunk* chunk, char* line, char* eol)
+{
+    Str s = ascii_strip(line, eol);
+    const char* colon;
+    const char* field_end;
+    char num[64];
+    char* numend;
+    Record* r;
+    size_t n;
+
+    if (s.len == 0)
+	return;
+
+    colon = memchr(s.str, ':', s.len);
+    if (colon == NULL)
+	return;
+
+    field_end = memchr(colon + 1, ':', s.str + s.len - colon - 1);
+    if (field_end == NULL)
+	field_end = s.str + s.len;
+
+    n = field_end - colon - 1;
+    if (n >= sizeof(num))
+	n = sizeof(num) - 1;
+    memcpy(num, colon + 1, n);
+    num[n] = '\0';
+
+    r = chunk_append(chunk);
+    r->type = RECORD_FREQ;
+    r->key.str = s.str;
+    r->key.len = colon - s.str;
+    r->freq = strtod(num, &numend);
+    while (is_ascii_space(*numend))
+	numend++;
+    if (numend == num || *numend != '\0') {
+	fprintf(stderr, "%s: %s: invalid frequency: %s\n",
+		program_name, chunk->filename, num);
+	chunk->error = true;
+    }
+}
+
+static void
+parse_dic_line(Chunk* chunk, char* line, char* eol)
+{
+    Str s;
+    const char* c1;
+    const char* c2;
+    const char* c3;
+    const char* end;
+    Record* r;
+
+    if (line[0] == '#') {
+	r = chunk_append(chunk);
+	r->type = RECORD_HEADER;
+	r->key.str = line;
+	r->key.len = eol - line;
+	return;
+    }
+
+    s = ascii_strip(line, eol);
+    end = s.str + s.len;
+
+    c1 = memchr(s.str, ':', s.len);
+    if (c1 == NULL)
+	return;
+    c2 = memchr(c1 + 1, ':', end - c1 - 1);
+    if (c2 == NULL)
+	return;
+    c3 = memchr(c2 + 1, ':', end - c2 - 1);
+    if (c3 == NULL)
+	c3 = end;
+
+    r = chunk_append(chunk);
+    r->type = RECORD_ENTRY;
+    r->key.str = s.str;
+    r->key.len = c1 - s.str;
+    r->value.str = c1 + 1;
+    r->value.len = c2 - c1 - 1;
+    r->value = unify(r->value);
+    r->comment = unicode_strip(c2 + 1, c3);
+
+    if (freq_table.items != NULL) {
+	void** data = str_map_lookup(&freq_table, r->value, empty_str, false);
+	r->freq = data != NULL ? ((const Record*)*data)->freq : 0;
+    } else {
+	r->freq = 0;
+    }
+}
+
+static void
+parse_chunk(Chunk* chunk)
+{
+    char* p = chunk->begin;
+
+    while (p < chunk->end) {
+	/* 줄 끝의 '\n'은 헤더 라인에서는 유지해야 하므로 포함한다. */
+	char* eol = memchr(p, '\n', chunk->end - p);
+	if (eol == NULL)
+	    eol = chunk->end;
+	else
+	    eol++;
+
+	if (chunk->type == RECORD_FREQ)
+	    parse_freq_line(chunk, p, eol);
+	else
+	    parse_dic_line(chunk, p, eol);
+
+	p = eol;
+    }
+}
+
+static void*
+parse_worker(void* data)
+{
+    while (true) {
+	size_t i;
+
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&next_chunk_mutex);
+#endif
+	i = next_chunk++;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&next_chunk_mutex);
+#endif
+
+	if (i >= nchunks)
+	    break;
+
+	parse_chunk(&chunks[i]);
+    }
+
+    return NULL;
+}
+
+/* 파일을 줄 경계에서 최대 n개의 조각으로 나눈다. */
+static void
+split_file(const char* filename, int type, size_t n)
+{
+    size_t len;
+    char* buf = read_file(filename, &len);
+    char* p = buf;
+    char* end = buf + len;
+    size_t size = len / n + 1;
+
+    while (p < end) {
+	char* q = p + size;
+	Chunk* chunk;
+
+	if (q >= end) {
+	    q = end;
+	} else {
+	    q = memchr(q, '\n', end - q);
+	    q = (q == NULL) ? end : q + 1;
+	}
+
+	chunks = xrealloc(chunks, (nchunks + 1) * sizeof(chunks[0]));
+	chunk = &chunks[nchunks++];
+	memset(chunk, 0, sizeof(*chunk));
+	chunk->filename = filename;
+	chunk->begin = p;
+	chunk->end = q;
+	chunk->type = type;
+
+	p = q;
+    }
+}
+
+/* first 번째 조각부터 나머지 모든 조각을 파싱한다.
+ * 쓰레드를 쓸 수 없으면 한 쓰레드에서 차례로 파싱한다. */
+static void
+parse_all(size_t first, int nthreads)
+{
+#ifdef HAVE_PTHREAD
+    pthread_t* threads;
+    int i;
+#endif
+    size_t j;
+
+    next_chunk = first;
+#ifdef HAVE_PTHREAD
+    threads = xmalloc(nthreads * sizeof(threads[0]));
+    for (i = 0; i < nthreads; i++) {
+	if (pthread_create(&threads[i], NULL, parse_worker, NULL) != 0) {
+	    fprintf(stderr, "%s: can't create thread\n", program_name);
+	    exit(EXIT_FAILURE);
+	}
+    }
+    for (i = 0; i < nthreads; i++)
+	pthread_join(threads[i], NULL);
+    free(threads);
+#else
+    parse_worker(NULL);
+#endif
+
+    for (j = first; j < nchunks; j++) {
+	if (chunks[j].error)
+	    exit(EXIT_FAILURE);
+    }
+}
+
+static void
+load_frequency(const char* dir, int nthreads)
+{
+    static const char* const files[] = { "freq-hanja.txt", "freq-hanjaeo.txt" };
+    size_t i, j;
+
+    for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+	char* path = xmalloc(strlen(dir) + strlen(files[i]) + 2);
+	sprintf(path, "%s/%s", dir, files[i]);
+	split_file(path, RECORD_FREQ, nthreads);
+    }
+
+    parse_all(0, nthreads);
+
+    /* 빈도 테이블의 각 항목은 그 키의 가장 큰 빈도값을 가진 레코드를
+     * 가리킨다. */
+    str_map_init(&freq_table, 0);
+    for (i = 0; i < nchunks; i++) {
+	for (j = 0; j < chunks[i].len; j++) {
+	    Record* r = &chunks[i].records[j];
+	    Record** max = (Record**)str_map_lookup(&freq_table,
+					r->key, empty_str, true);
+	    if (*max == NULL || r->freq > (*max)->freq)
+		*max = r;
+	}
+    }
+}
+
+/* merging */
+static int
+entry_list_compare(const void* a, const void* b)
+{
+    const EntryList* x = *(const EntryList* const*)a;
+    const EntryList* y = *(const EntryList* const*)b;
+    return str_compare(x->key, y->key);
+}
+
+static int
+entry_compare(const void* a, const void* b)
+{
+    const Entry* x = *(const Entry* const*)a;
+    const Entry* y = *(const Entry* const*)b;
+
+    if (x->freq > y->freq)
+	return -1;
+    if (x->freq < y->freq)
+	return 1;
+    if (x->seq < y->seq)
+	return -1;
+    if (x->seq > y->seq)
+	return 1;
+    return 0;
+}
+
+static void
+print_dup(Str key, Str value, const char* msg)
+{
+    fprintf(stderr, "%.*s:%.*s is duplicate, %s",
+	    (int)key.len, key.str, (int)value.len, value.str, msg);
+}
+
+/* 공백을 무시하고 haystack에 needle이 포함되어 있는지 확인한다. */
+static bool
+contains_ignoring_space(const char* haystack, size_t hlen,
+			const char* needle, size_t nlen)
+{
+    char* h = xmalloc(hlen + 1);
+    char* n = xmalloc(nlen + 1);
+    size_t i, hl, nl;
+    bool res;
+
+    for (i = 0, hl = 0; i < hlen; i++) {
+	if (haystack[i] != ' ')
+	    h[hl++] = haystack[i];
+    }
+    h[hl] = '\0';
+
+    for (i = 0, nl = 0; i < nlen; i++) {
+	if (needle[i] != ' ')
+	    n[nl++] = needle[i];
+    }
+    n[nl] = '\0';
+
+    res = strstr(h, n) != NULL;
+
+    free(h);
+    free(n);
+    return res;
+}
+
+static void
+set_comment(Entry* entry, Str comment)
+{
+    free(entry->comment);
+    entry->comment = xmalloc(comment.len + 1);
+    memcpy(entry->comment, comment.str, comment.len);
+    entry->comment[comment.len] = '\0';
+    entry->comment_len = comment.len;
+}
+
+static void
+merge_record(StrMap* table, StrMap* pairs, Record* r, size_t seq)
+{
+    EntryList** list;
+    Entry** found;
+    Entry* entry;
+    Str comment = r->comment;
+
+    found = (Entry**)str_map_lookup(pairs, r->key, r->value, false);
+    if (found != NULL) {
+	Entry* i = *found;
+	if (comment.len == 0) {
+	    print_dup(r->key, r->value, "ignored\n");
+	} else if (i->comment_len == 0) {
+	    print_dup(r->key, r->value, "but has new comment, added: ");
+	    fprintf(stderr, "\"%.*s\"\n", (int)comment.len, comment.str);
+	    set_comment(i, comment);
+	} else if (i->comment_len == comment.len &&
+		   memcmp(i->comment, comment.str, comment.len) == 0) {
+	    print_dup(r->key, r->value, "ignored\n");
+	} else if (contains_ignoring_space(i->comment, i->comment_len,
+					   comment.str, comment.len)) {
+	    print_dup(r->key, r->value,
+		      "already includes that comments, ignored\n");
+	} else {
+	    char* merged;
+	    size_t len;
+
+	    print_dup(r->key, r->value, "but has different comments, merged: ");
+	    fprintf(stderr, "\"%s\" + \"%.*s\"\n",
+		    i->comment, (int)comment.len, comment.str);
+
+	    len = i->comment_len + 2 + comment.len;
+	    merged = xmalloc(len + 1);
+	    memcpy(merged, i->comment, i->comment_len);
+	    memcpy(merged + i->comment_len, ", ", 2);
+	    memcpy(merged + i->comment_len + 2, comment.str, comment.len);
+	    merged[len] = '\0';
+	    free(i->comment);
+	    i->comment = merged;
+	    i->comment_len = len;
+	}
+	return;
+    }
+
+    entry = xmalloc(sizeof(*entry));
+    entry->value = r->value;
+    entry->comment = NULL;
+    set_comment(entry, comment);
+    entry->freq = r->freq;
+    entry->seq = seq;
+
+    *(Entry**)str_map_lookup(pairs, r->key, r->value, true) = entry;
+
+    list = (EntryList**)str_map_lookup(table, r->key, empty_str, true);
+    if (*list == NULL) {
+	*list = xmalloc(sizeof(**list));
+	(*list)->key = r->key;
+	(*list)->items = NULL;
+	(*list)->len = 0;
+	(*list)->alloc = 0;
+    }
+
+    if ((*list)->len >= (*list)->alloc) {
+	(*list)->alloc = (*list)->alloc == 0 ? 4 : (*list)->alloc * 2;
+	(*list)->items = xrealloc((*list)->items,
+				  (*list)->alloc * sizeof((*list)->items[0]));
+    }
+    (*list)->items[(*list)->len++] = entry;
+}
+
+static void
+write_str(FILE* output, const char* str, size_t len)
+{
+    if (fwrite(str, 1, len, output) != len) {
+	fprintf(stderr, "%s: %s\n", program_name, strerror(errno));
+	exit(EXIT_FAILURE);
+    }
+}
+
+static void
+usage(int status)
+{
+    FILE* out = status == EXIT_SUCCESS ? stdout : stderr;
+
+    fprintf(out, "\
+Usage: %s [OPTION]... FILE...\n\
+Merge hanja dictionary source FILEs and print the result.\n\
+\n\
+  -d, --data-dir=DIR   read compat-table.txt and freq-*.txt from DIR\n\
+                       (default: current directory)\n\
+  -o, --output=FILE    write result to FILE instead of standard output\n\
+  -j, --jobs=N         use N threads for parsing\n\
+      --help           display this help and exit\n\
+", program_name);
+
+    exit(status);
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char* data_dir = ".";
+    const char* output_file = "-";
+    FILE* output;
+    int nthreads;
+    size_t nfreqchunks;
+    size_t i, j;
+    size_t seq;
+    StrMap table;
+    StrMap pairs;
+    EntryList** lists;
+    size_t nlists;
+    char* compat_file;
+
+    nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads < 1)
+	nthreads = 1;
+
+    while (1) {
+	int c;
+	static struct option const long_options[] = {
+	    { "data-dir", required_argument, NULL, 'd' },
+	    { "output",   required_argument, NULL, 'o' },
+	    { "jobs",     required_argument, NULL, 'j' },
+	    { "help",     no_argument,       NULL, 'h' },
+	    { NULL,       0,                 NULL, 0   }
+	};
+
+	c = getopt_long(argc, argv, "d:o:j:", long_options, NULL);
+	if (c == -1)
+	    break;
+
+	switch (c) {
+	case 'd':
+	    data_dir = optarg;
+	    break;
+	case 'o':
+	    output_file = optarg;
+	    break;
+	case 'j':
+	    nthreads = atoi(optarg);
+	    if (nthreads < 1)
+		nthreads = 1;
+	    break;
+	case 'h':
+	    usage(EXIT_SUCCESS);
+	    break;
+	default:
+	    usage(EXIT_FAILURE);
+	}
+    }
+
+    if (optind >= argc)
+	usage(EXIT_FAILURE);
+
+    load_frequency(data_dir, nthreads);
+    nfreqchunks = nchunks;
+
+    compat_file = xmalloc(strlen(data_dir) + sizeof("/compat-table.txt"));
+    sprintf(compat_file, "%s/compat-table.txt", data_dir);
+    load_compat(compat_file);
+    free(compat_file);
+
+    for (i = optind; i < (size_t)argc; i++)
+	split_file(argv[i], RECORD_ENTRY, nthreads);
+
+    parse_all(nfreqchunks, nthreads);
+
+    if (strcmp(output_file, "-") == 0) {
+	output = stdout;
+    } else {
+	output = fopen(output_file, "w");
+	if (output == NULL) {
+	    fprintf(stderr, "%s: %s: %s\n",
+		    program_name, output_file, strerror(errno));
+	    exit(EXIT_FAILURE);
+	}
+    }
+
+    str_map_init(&table, 0);
+    str_map_init(&pairs, 0);
+    seq = 0;
+    for (i = nfreqchunks; i < nchunks; i++) {
+	for (j = 0; j < chunks[i].len; j++) {
+	    Record* r = &chunks[i].records[j];
+	    if (r->type == RECORD_HEADER) {
+		write_str(output, r->key.str, r->key.len);
+	    } else {
+		merge_record(&table, &pairs, r, seq++);
+	    }
+	}
+    }
+    write_str(output, "\n", 1);
+
+    lists = xmalloc((table.len + 1) * sizeof(lists[0]));
+    nlists = 0;
+    for (i = 0; i < table.size; i++) {
+	if (table.items[i].first.str != NULL)
+	    lists[nlists++] = table.items[i].data;
+    }
+    qsort(lists, nlists, sizeof(lists[0]), entry_list_compare);
+
+    for (i = 0; i < nlists; i++) {
+	EntryList* list = lists[i];
+	qsort(list->items, list->len, sizeof(list->items[0]), entry_compare);
+	for (j = 0; j < list->len; j++) {
+	    Entry* entry = list->items[j];
+	    write_str(output, list->key.str, list->key.len);
+	    write_str(output, ":", 1);
+	    write_str(output, entry->value.str, entry->value.len);
+	    write_str(output, ":", 1);
+	    write_str(output, entry->comment, entry->comment_len);
+	    write_str(output, "\n", 1);
+	}
+    }
+
+    if (fflush(output) != 0) {
+	fprintf(stderr, "%s: %s\n", program_name, strerror(errno));
+	exit(EXIT_FAILURE);
+    }
+
+    if (output != stdout)
+	fclose(output);
+
+    return EXIT_SUCCESS;
+}